@@ -0,0 +1,408 @@
+// SPDX-License-Identifier: GPL-2.0
+
+/*
+ * Copyright (C) 2021 VMware Inc, Yordan Karadzhov <y.karadz@gmail.com>
+ */
+
+/*
+ * Performance benchmark of the library-level data paths, running on
+ * synthetic trace data. No trace file and no display are needed.
+ *
+ * The timings can be stored as a baseline (-w) and compared against a
+ * baseline (-b). In this case the program fails (returns 1), if any of the
+ * timings is slower than the baseline by more than the tolerance (-t).
+ * The "dbench" test compares a small run against databench.baseline.
+ */
+
+// C
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+
+// KernelShark
+#include "libkshark.h"
+#include "libkshark-model.h"
+
+#define N_STREAMS	2	// the number of synthetic Data streams
+#define N_CPUS		8	// the number of CPUs of each stream
+#define N_TASKS		500	// the number of tasks of each stream
+#define N_EVENTS	4	// the number of event types
+#define N_BINS		1024	// the number of bins of the model
+#define N_SEARCH	100000	// the number of searches by time
+#define N_REPEAT	3	// each benchmark is repeated, the best is taken
+
+/* The benchmarks. */
+enum {
+	BENCH_LOAD,
+	BENCH_MERGE,
+	BENCH_FILTER,
+	BENCH_COLLECTION,
+	BENCH_MODEL,
+	BENCH_GRAPH,
+	BENCH_SEARCH,
+	N_BENCH,
+};
+
+static const char *bench_names[N_BENCH] = {
+	"load",
+	"merge",
+	"filter",
+	"collection",
+	"model",
+	"graph",
+	"search",
+};
+
+static size_t n_per_stream = 1000000;
+
+/* Simple, deterministic pseudo-random number generator. */
+static unsigned int rand_next(unsigned int *seed)
+{
+	*seed = *seed * 1103515245 + 12345;
+	return (*seed >> 16) & 0x7fff;
+}
+
+/* Generate synthetic entries, imitating the loading of a trace file. */
+static ssize_t synth_load_entries(struct kshark_data_stream *stream,
+				  struct kshark_context *kshark_ctx,
+				  struct kshark_entry ***data_rows)
+{
+	unsigned int seed = stream->stream_id + 1;
+	int pid[N_CPUS] = {0};
+	struct kshark_entry **rows;
+	int64_t ts = 1000;
+	size_t i;
+
+	rows = calloc(n_per_stream, sizeof(*rows));
+	if (!rows)
+		return -ENOMEM;
+
+	for (i = 0; i < n_per_stream; ++i) {
+		rows[i] = kshark_entry_alloc(kshark_ctx);
+		if (!rows[i]) {
+			kshark_free_entries(kshark_ctx, rows, i);
+			return -ENOMEM;
+		}
+
+		ts += 1 + rand_next(&seed) % 200;
+
+		rows[i]->ts = ts + stream->stream_id;
+		rows[i]->stream_id = stream->stream_id;
+		rows[i]->cpu = rand_next(&seed) % N_CPUS;
+		rows[i]->event_id = rand_next(&seed) % N_EVENTS;
+		rows[i]->offset = i;
+
+		/* Event 0 switches the task running on the CPU. */
+		if (rows[i]->event_id == 0)
+			pid[rows[i]->cpu] = 1 + rand_next(&seed) % N_TASKS;
+
+		rows[i]->pid = pid[rows[i]->cpu];
+		rows[i]->visible = 0xff;
+
+		kshark_hash_id_add(stream->tasks, rows[i]->pid);
+		kshark_apply_filters(kshark_ctx, stream, rows[i]);
+	}
+
+	*data_rows = rows;
+
+	return n_per_stream;
+}
+
+static int synth_open(struct kshark_context *kshark_ctx)
+{
+	struct kshark_data_stream *stream;
+	int sd;
+
+	sd = kshark_add_stream(kshark_ctx);
+	if (sd < 0)
+		return sd;
+
+	stream = kshark_get_data_stream(kshark_ctx, sd);
+	stream->n_cpus = N_CPUS;
+	stream->n_events = N_EVENTS;
+	stream->format = KS_INVALIDE_DATA;
+	stream->interface.load_entries = synth_load_entries;
+
+	return sd;
+}
+
+static double now_ms(void)
+{
+	struct timespec t;
+
+	clock_gettime(CLOCK_MONOTONIC, &t);
+
+	return t.tv_sec * 1e3 + t.tv_nsec * 1e-6;
+}
+
+static void best(double *result, double t0)
+{
+	double t = now_ms() - t0;
+
+	if (*result < 0 || t < *result)
+		*result = t;
+}
+
+static int load_baseline(const char *file, double *baseline)
+{
+	char name[64];
+	double val;
+	FILE *f;
+	int i;
+
+	f = fopen(file, "r");
+	if (!f) {
+		fprintf(stderr, "Failed to open baseline file %s\n", file);
+		return -1;
+	}
+
+	while (fscanf(f, "%63s %lf", name, &val) == 2)
+		for (i = 0; i < N_BENCH; ++i)
+			if (strcmp(name, bench_names[i]) == 0)
+				baseline[i] = val;
+
+	fclose(f);
+
+	return 0;
+}
+
+static int save_baseline(const char *file, const double *result)
+{
+	FILE *f;
+	int i;
+
+	f = fopen(file, "w");
+	if (!f) {
+		fprintf(stderr, "Failed to open baseline file %s\n", file);
+		return -1;
+	}
+
+	for (i = 0; i < N_BENCH; ++i)
+		fprintf(f, "%s %.3f\n", bench_names[i], result[i]);
+
+	fclose(f);
+
+	return 0;
+}
+
+static void usage(const char *prog)
+{
+	printf("Usage: %s [-n entries] [-b baseline] [-w baseline] [-t tolerance]\n",
+	       prog);
+	printf("  -n	number of entries per Data stream, default is %zu\n",
+	       n_per_stream);
+	printf("  -b	compare against the timings in a baseline file\n");
+	printf("  -w	write the timings into a baseline file\n");
+	printf("  -t	allowed slowdown relative to the baseline in %%, default is 20\n");
+}
+
+int main(int argc, char **argv)
+{
+	struct kshark_entry_data_set buffers[N_STREAMS];
+	double result[N_BENCH], baseline[N_BENCH];
+	struct kshark_entry_collection *col;
+	const char *in_file = NULL, *out_file = NULL;
+	struct kshark_context *kshark_ctx;
+	struct kshark_entry **data = NULL;
+	struct kshark_trace_histo histo;
+	double t0, tolerance = 20;
+	unsigned int seed = 1;
+	size_t n_rows = 0;
+	int i, r, c, b, sd;
+	char *end;
+	long n;
+	int ret = 0;
+
+	while ((c = getopt(argc, argv, "hn:b:w:t:")) != -1) {
+		switch (c) {
+		case 'n':
+			n = strtol(optarg, &end, 10);
+			if (end == optarg || *end != '\0' || n <= 0) {
+				fprintf(stderr,
+					"Invalid number of entries \"%s\"\n",
+					optarg);
+				usage(argv[0]);
+				return 1;
+			}
+
+			n_per_stream = n;
+			break;
+		case 'b':
+			in_file = optarg;
+			break;
+		case 'w':
+			out_file = optarg;
+			break;
+		case 't':
+			tolerance = atof(optarg);
+			break;
+		default:
+			usage(argv[0]);
+			return 1;
+		}
+	}
+
+	for (i = 0; i < N_BENCH; ++i)
+		result[i] = baseline[i] = -1;
+
+	if (in_file && load_baseline(in_file, baseline) < 0)
+		return 1;
+
+	/* Create a new kshark session. */
+	kshark_ctx = NULL;
+	if (!kshark_instance(&kshark_ctx))
+		return 1;
+
+	for (i = 0; i < N_STREAMS; ++i)
+		if (synth_open(kshark_ctx) < 0)
+			goto fail;
+
+	for (r = 0; r < N_REPEAT; ++r) {
+		if (data)
+			kshark_free_entries(kshark_ctx, data, n_rows);
+
+		/* Load each Data stream. */
+		t0 = now_ms();
+		for (i = 0; i < N_STREAMS; ++i) {
+			buffers[i].n_rows = kshark_load_entries(kshark_ctx, i,
+								&buffers[i].data);
+			if (buffers[i].n_rows < 0)
+				goto fail;
+		}
+
+		best(&result[BENCH_LOAD], t0);
+
+		/* Merge the Data streams. */
+		t0 = now_ms();
+		data = kshark_merge_data_entries(buffers, N_STREAMS);
+		best(&result[BENCH_MERGE], t0);
+
+		for (i = 0; i < N_STREAMS; ++i)
+			free(buffers[i].data);
+
+		if (!data)
+			goto fail;
+
+		n_rows = n_per_stream * N_STREAMS;
+	}
+
+	/* Show only every second task. */
+	for (i = 0; i < N_TASKS; i += 2)
+		kshark_filter_add_id(kshark_ctx, 0, KS_SHOW_TASK_FILTER, i);
+
+	for (r = 0; r < N_REPEAT; ++r) {
+		t0 = now_ms();
+		kshark_filter_all_entries(kshark_ctx, data, n_rows);
+		best(&result[BENCH_FILTER], t0);
+	}
+
+	/* Build the per-CPU collections of all Data streams. */
+	for (r = 0; r < N_REPEAT; ++r) {
+		kshark_free_collection_list(kshark_ctx->collections);
+		kshark_ctx->collections = NULL;
+
+		t0 = now_ms();
+		for (sd = 0; sd < N_STREAMS; ++sd)
+			for (c = 0; c < N_CPUS; ++c)
+				kshark_register_data_collection(kshark_ctx,
+								data, n_rows,
+								kshark_match_cpu,
+								sd, &c, 1, 0);
+
+		best(&result[BENCH_COLLECTION], t0);
+	}
+
+	/* Fill the model and navigate (zoom and shift). */
+	ksmodel_init(&histo);
+	for (r = 0; r < N_REPEAT; ++r) {
+		t0 = now_ms();
+		ksmodel_set_bining(&histo, N_BINS, data[0]->ts,
+				   data[n_rows - 1]->ts);
+		ksmodel_fill(&histo, data, n_rows);
+
+		for (i = 0; i < 10; ++i)
+			ksmodel_zoom_in(&histo, .2, N_BINS / 3);
+
+		for (i = 0; i < 10; ++i)
+			ksmodel_shift_forward(&histo, N_BINS / 10);
+
+		for (i = 0; i < 10; ++i)
+			ksmodel_shift_backward(&histo, N_BINS / 10);
+
+		for (i = 0; i < 10; ++i)
+			ksmodel_zoom_out(&histo, .2, N_BINS / 3);
+
+		best(&result[BENCH_MODEL], t0);
+	}
+
+	/* Resolve the content of all CPU graphs, as it is done when plotting. */
+	ksmodel_set_bining(&histo, N_BINS, data[0]->ts, data[n_rows - 1]->ts);
+	ksmodel_fill(&histo, data, n_rows);
+	for (r = 0; r < N_REPEAT; ++r) {
+		t0 = now_ms();
+		for (sd = 0; sd < N_STREAMS; ++sd) {
+			for (c = 0; c < N_CPUS; ++c) {
+				col = kshark_find_data_collection(kshark_ctx->collections,
+								  kshark_match_cpu,
+								  sd, &c, 1);
+
+				for (b = 0; b < N_BINS; ++b)
+					ksmodel_get_pid_back(&histo, b, sd, c,
+							     false, col, NULL);
+			}
+		}
+
+		best(&result[BENCH_GRAPH], t0);
+	}
+
+	/* Search by time. */
+	for (r = 0; r < N_REPEAT; ++r) {
+		t0 = now_ms();
+		for (i = 0; i < N_SEARCH; ++i) {
+			int64_t ts = data[0]->ts +
+				     (int64_t) rand_next(&seed) *
+				     (data[n_rows - 1]->ts - data[0]->ts) / 0x7fff;
+
+			kshark_find_entry_by_time(ts, data, 0, n_rows - 1);
+		}
+
+		best(&result[BENCH_SEARCH], t0);
+	}
+
+	ksmodel_clear(&histo);
+
+	printf("%-12s %12s %12s\n", "benchmark", "time [ms]", "baseline");
+	for (i = 0; i < N_BENCH; ++i) {
+		printf("%-12s %12.3f", bench_names[i], result[i]);
+		if (baseline[i] < 0) {
+			puts("");
+			continue;
+		}
+
+		printf(" %12.3f", baseline[i]);
+		if (result[i] > baseline[i] * (1. + tolerance / 100.)) {
+			printf("  REGRESSION");
+			ret = 1;
+		}
+
+		puts("");
+	}
+
+	if (out_file && save_baseline(out_file, result) < 0)
+		ret = 1;
+
+	/* Free the memory. */
+	kshark_free_entries(kshark_ctx, data, n_rows);
+
+	/* Close the session. */
+	kshark_free(kshark_ctx);
+
+	return ret;
+
+ fail:
+	fprintf(stderr, "Failed to load the synthetic data.\n");
+	kshark_free(kshark_ctx);
+	return 1;
+}
@@ -0,0 +1,136 @@
+// SPDX-License-Identifier: GPL-2.0
+
+/*
+ * Copyright (C) 2021 VMware Inc, Yordan Karadzhov <y.karadz@gmail.com>
+ */
+
+// C
+#include <stdio.h>
+#include <stdlib.h>
+
+// KernelShark
+#include "libkshark.h"
+#include "libkshark-diff.h"
+
+static void print_top(const struct kshark_trace_diff *diff,
+		      const struct kshark_diff_item *items, size_t n_items,
+		      enum kshark_diff_metric metric, double scale,
+		      size_t n_top, const char *title)
+{
+	const struct kshark_diff_item **top;
+	size_t i, n;
+
+	top = malloc(n_top * sizeof(*top));
+	if (!top)
+		return;
+
+	printf("%s\n", title);
+	n = kshark_diff_top(diff, items, n_items, metric, n_top, top);
+	for (i = 0; i < n; ++i) {
+		printf("  %-32s %14.3f -> %14.3f  (+%.3f)\n",
+		       top[i]->name,
+		       kshark_diff_normalized(diff, top[i], KS_DIFF_BASE,
+					      metric) * scale,
+		       kshark_diff_normalized(diff, top[i], KS_DIFF_TEST,
+					      metric) * scale,
+		       kshark_diff_delta(diff, top[i], metric) * scale);
+	}
+
+	if (!n)
+		puts("  none");
+
+	puts("");
+	free(top);
+}
+
+static int load(struct kshark_context *kshark_ctx, const char *file,
+		struct kshark_matrix_data_set *matrix)
+{
+	int sd;
+
+	/* Open a trace data file produced by trace-cmd. */
+	sd = kshark_open(kshark_ctx, file);
+	if (sd < 0)
+		return sd;
+
+	/* Load the content of the file into a data matrix. */
+	matrix->n_rows = kshark_load_matrix(kshark_ctx, sd,
+					    &matrix->cpu_array,
+					    &matrix->pid_array,
+					    &matrix->event_array,
+					    &matrix->offset_array,
+					    &matrix->ts_array);
+
+	return (matrix->n_rows < 0) ? matrix->n_rows : sd;
+}
+
+int main(int argc, char **argv)
+{
+	struct kshark_matrix_data_set base = {0}, test = {0};
+	struct kshark_context *kshark_ctx;
+	struct kshark_trace_diff *diff;
+	int sd_base, sd_test;
+	size_t n_top = 10;
+
+	if (argc < 3) {
+		fprintf(stderr, "Usage: %s <baseline file> <file> [n top]\n",
+			argv[0]);
+		return 1;
+	}
+
+	if (argc > 3)
+		n_top = (atoi(argv[3]) > 0) ? atoi(argv[3]) : 0;
+
+	/* Create a new kshark session. */
+	kshark_ctx = NULL;
+	if (!kshark_instance(&kshark_ctx))
+		return 1;
+
+	sd_base = load(kshark_ctx, argv[1], &base);
+	sd_test = load(kshark_ctx, argv[2], &test);
+	if (sd_base < 0 || sd_test < 0 || n_top < 1) {
+		kshark_diff_free_matrix(&base);
+		kshark_diff_free_matrix(&test);
+		kshark_free(kshark_ctx);
+		return 1;
+	}
+
+	/* Compare the two Data streams. */
+	diff = kshark_trace_diff(kshark_ctx, sd_base, &base, sd_test, &test);
+	kshark_diff_free_matrix(&base);
+	kshark_diff_free_matrix(&test);
+	if (!diff) {
+		kshark_free(kshark_ctx);
+		return 1;
+	}
+
+	printf("Duration: %.3f ms -> %.3f ms\n\n",
+	       diff->duration[KS_DIFF_BASE] * 1e-6,
+	       diff->duration[KS_DIFF_TEST] * 1e-6);
+
+	print_top(diff, diff->tasks, diff->n_tasks, KS_DIFF_RUN_TIME, 1e-6,
+		  n_top, "Run time [ms / s]");
+
+	print_top(diff, diff->tasks, diff->n_tasks, KS_DIFF_LATENCY_P99, 1e-3,
+		  n_top, "Wakeup latency, 99th percentile [us]");
+
+	print_top(diff, diff->tasks, diff->n_tasks, KS_DIFF_LATENCY_P90, 1e-3,
+		  n_top, "Wakeup latency, 90th percentile [us]");
+
+	print_top(diff, diff->tasks, diff->n_tasks, KS_DIFF_LATENCY_P50, 1e-3,
+		  n_top, "Wakeup latency, median [us]");
+
+	print_top(diff, diff->tasks, diff->n_tasks, KS_DIFF_COUNT, 1.,
+		  n_top, "Task entries [1 / s]");
+
+	print_top(diff, diff->events, diff->n_events, KS_DIFF_COUNT, 1.,
+		  n_top, "Events [1 / s]");
+
+	/* Free the memory. */
+	kshark_free_trace_diff(diff);
+
+	/* Close the session. */
+	kshark_free(kshark_ctx);
+
+	return 0;
+}
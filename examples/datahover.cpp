@@ -0,0 +1,173 @@
+// SPDX-License-Identifier: GPL-2.0
+
+/*
+ * Copyright (C) 2021 VMware Inc, Yordan Karadzhov <y.karadz@gmail.com>
+ */
+
+// C++
+#include <iostream>
+#include <chrono>
+
+// KernelShark
+#include "libkshark.h"
+#include "KsPlotTools.hpp"
+
+using namespace std;
+
+#define N_BINS		1024 // the number of bins of the model
+#define VARIANCE	5    // the search range used by the GUI on mouse move
+
+struct kshark_trace_histo	histo;
+
+/* Resolve the mouse position by searching inside the Vis. model. */
+static ssize_t hoverModel(int sd, int cpu, int bin)
+{
+	auto lamGetEntry = [&] (int b) {
+		if (b < 0 || b >= histo.n_bins)
+			return (ssize_t) KS_EMPTY_BIN;
+
+		return ksmodel_first_index_at_cpu(&histo, b, sd, cpu);
+	};
+
+	ssize_t row = lamGetEntry(bin);
+
+	for (int i = 1; row < 0 && i < VARIANCE; ++i) {
+		row = lamGetEntry(bin + i);
+		if (row < 0)
+			row = lamGetEntry(bin - i);
+	}
+
+	if (row >= 0)
+		return row;
+
+	/* Nothing found. Get the last task running on this CPU. */
+	for (int b = bin; b >= 0; --b) {
+		row = ksmodel_get_pid_back(&histo, b, sd, cpu, false,
+					   nullptr, nullptr);
+		if (row >= 0)
+			return row;
+	}
+
+	return ksmodel_get_pid_back(&histo, LOWER_OVERFLOW_BIN, sd, cpu, false,
+				    nullptr, nullptr);
+}
+
+/* Resolve the mouse position by using the picking index of the Graph. */
+static ssize_t hoverPick(const KsPlot::Graph *graph, int bin)
+{
+	auto lamGetEntry = [&] (int b) {
+		const KsPlot::BinPick *pick = graph->getPick(b);
+
+		return pick ? pick->_first : KS_EMPTY_BIN;
+	};
+
+	ssize_t row = lamGetEntry(bin);
+
+	for (int i = 1; row < 0 && i < VARIANCE; ++i) {
+		row = lamGetEntry(bin + i);
+		if (row < 0)
+			row = lamGetEntry(bin - i);
+	}
+
+	if (row >= 0)
+		return row;
+
+	/* Nothing found. Get the last task running on this CPU. */
+	return graph->getPick(bin)->_lastId;
+}
+
+int main(int argc, char **argv)
+{
+	struct kshark_context *kshark_ctx(nullptr);
+	struct kshark_entry **data(nullptr);
+	struct kshark_data_stream *stream;
+	KsPlot::ColorTable colors;
+	size_t nRows;
+	int sd, nEvents;
+
+	if (argc < 2) {
+		cerr << "Usage: " << argv[0] << " <file>\n";
+		return 1;
+	}
+
+	/* Create a new kshark session. */
+	if (!kshark_instance(&kshark_ctx))
+		return 1;
+
+	/* Open a trace data file produced by trace-cmd. */
+	sd = kshark_open(kshark_ctx, argv[1]);
+	if (sd < 0) {
+		kshark_free(kshark_ctx);
+		cerr << "Failed to open file " << argv[1] << endl;
+
+		return 1;
+	}
+
+	/* Load the content of the file into an array of entries. */
+	nRows = kshark_load_entries(kshark_ctx, sd, &data);
+	if (!nRows) {
+		kshark_free(kshark_ctx);
+		return 1;
+	}
+
+	/* Initialize the Visualization Model. */
+	ksmodel_init(&histo);
+	ksmodel_set_bining(&histo, N_BINS, data[0]->ts, data[nRows - 1]->ts);
+	ksmodel_fill(&histo, data, nRows);
+
+	auto lamTime = [] (auto func) {
+		auto t0 = chrono::steady_clock::now();
+
+		func();
+
+		auto t1 = chrono::steady_clock::now();
+
+		return chrono::duration<double, std::nano>(t1 - t0).count();
+	};
+
+	/*
+	 * Move the mouse over all bins of all CPU graphs, as it is done when
+	 * the user is exploring the trace.
+	 */
+	stream = kshark_get_data_stream(kshark_ctx, sd);
+	nEvents = stream->n_cpus * histo.n_bins;
+
+	double tFill(0), tModel(0), tPick(0);
+	ssize_t checkModel(0), checkPick(0);
+	for (int cpu = 0; cpu < stream->n_cpus; ++cpu) {
+		KsPlot::Graph graph(&histo, &colors, &colors);
+
+		tFill += lamTime([&] () {graph.fillCPUGraph(sd, cpu);});
+
+		tModel += lamTime([&] () {
+			for (int bin = 0; bin < histo.n_bins; ++bin)
+				checkModel += hoverModel(sd, cpu, bin);
+		});
+
+		tPick += lamTime([&] () {
+			for (int bin = 0; bin < histo.n_bins; ++bin)
+				checkPick += hoverPick(&graph, bin);
+		});
+	}
+
+	cout << "Graphs filled in:      " << tFill * 1e-6 << " ms\n";
+	cout << "Hover (model search):  " << tModel / nEvents << " ns / event\n";
+	cout << "Hover (picking index): " << tPick / nEvents << " ns / event\n";
+
+	if (checkModel != checkPick)
+		cerr << "Warning: the two methods disagree.\n";
+
+	/* Free the memory. */
+	kshark_free_entries(kshark_ctx, data, nRows);
+
+	/* Reset (clear) the model. */
+	ksmodel_clear(&histo);
+
+	/* Close the file. */
+	kshark_close(kshark_ctx, sd);
+
+	/* Close the session. */
+	kshark_free(kshark_ctx);
+
+	return 0;
+}
@@ -0,0 +1,92 @@
+// SPDX-License-Identifier: GPL-2.0
+
+/*
+ * Copyright (C) 2021 VMware Inc, Yordan Karadzhov <y.karadz@gmail.com>
+ */
+
+// C
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// KernelShark
+#include "libkshark.h"
+#include "libkshark-intervals.h"
+
+int main(int argc, char **argv)
+{
+	enum kshark_interval_key_type key_type = KS_INTERVAL_KEY_CPU;
+	struct kshark_interval_set *intervals;
+	struct kshark_context *kshark_ctx;
+	struct kshark_entry **data = NULL;
+	struct kshark_data_stream *stream;
+	const char *key_field = NULL;
+	int sd, start_id, stop_id, ret = 1;
+	ssize_t n_rows;
+
+	if (argc < 4) {
+		fprintf(stderr,
+			"Usage: %s <file> <start event> <stop event> [cpu|pid|<field>]\n",
+			argv[0]);
+		return 1;
+	}
+
+	if (argc > 4) {
+		if (strcmp(argv[4], "pid") == 0) {
+			key_type = KS_INTERVAL_KEY_PID;
+		} else if (strcmp(argv[4], "cpu") != 0) {
+			key_type = KS_INTERVAL_KEY_FIELD;
+			key_field = argv[4];
+		}
+	}
+
+	/* Create a new kshark session. */
+	kshark_ctx = NULL;
+	if (!kshark_instance(&kshark_ctx))
+		return 1;
+
+	/* Open a trace data file produced by trace-cmd. */
+	sd = kshark_open(kshark_ctx, argv[1]);
+	if (sd < 0) {
+		kshark_free(kshark_ctx);
+		return 1;
+	}
+
+	/* The names of the events must be given as "system/name". */
+	stream = kshark_get_data_stream(kshark_ctx, sd);
+	start_id = stream->interface.find_event_id(stream, argv[2]);
+	stop_id = stream->interface.find_event_id(stream, argv[3]);
+	if (start_id < 0 || stop_id < 0) {
+		fprintf(stderr, "Unknown event %s\n",
+			(start_id < 0) ? argv[2] : argv[3]);
+		kshark_free(kshark_ctx);
+		return 1;
+	}
+
+	/* Load the content of the file into an array of entries. */
+	n_rows = kshark_load_entries(kshark_ctx, sd, &data);
+	if (n_rows < 1) {
+		kshark_free(kshark_ctx);
+		return 1;
+	}
+
+	/* Pair the start and stop events and print the intervals as CSV. */
+	intervals = kshark_join_intervals(kshark_ctx, sd, start_id, stop_id,
+					  key_type, key_field, data, n_rows);
+	if (intervals) {
+		kshark_export_intervals_csv(intervals, stdout);
+		kshark_free_interval_set(intervals);
+		ret = 0;
+	}
+
+	/* Free the memory. */
+	kshark_free_entries(kshark_ctx, data, n_rows);
+
+	/* Close the file. */
+	kshark_close(kshark_ctx, sd);
+
+	/* Close the session. */
+	kshark_free(kshark_ctx);
+
+	return ret;
+}
@@ -0,0 +1,80 @@
+// SPDX-License-Identifier: GPL-2.0
+
+/*
+ * Copyright (C) 2021 VMware Inc, Yordan Karadzhov <y.karadz@gmail.com>
+ */
+
+// C
+#include <stdio.h>
+#include <stdlib.h>
+
+// KernelShark
+#include "libkshark.h"
+#include "libkshark-memory.h"
+
+int main(int argc, char **argv)
+{
+	struct kshark_memory_report *report;
+	struct kshark_context *kshark_ctx;
+	struct kshark_entry **data = NULL;
+	long long budget = 0;
+	ssize_t n_rows;
+	char *end;
+	int sd;
+
+	if (argc < 2) {
+		fprintf(stderr, "Usage: %s <file> [memory budget (MB)]\n",
+			argv[0]);
+		return 1;
+	}
+
+	if (argc > 2) {
+		budget = strtoll(argv[2], &end, 10);
+		if (end == argv[2] || *end != '\0' || budget <= 0) {
+			fprintf(stderr, "Invalid memory budget \"%s\"\n",
+				argv[2]);
+			return 1;
+		}
+	}
+
+	/* Create a new kshark session. */
+	kshark_ctx = NULL;
+	if (!kshark_instance(&kshark_ctx))
+		return 1;
+
+	/* The entries above the budget are kept in a temporary file. */
+	if (budget)
+		kshark_set_memory_budget(kshark_ctx, (size_t) budget << 20);
+
+	/* Open a trace data file produced by trace-cmd. */
+	sd = kshark_open(kshark_ctx, argv[1]);
+	if (sd < 0) {
+		kshark_free(kshark_ctx);
+		return 1;
+	}
+
+	/* Load the content of the file into an array of entries. */
+	n_rows = kshark_load_entries(kshark_ctx, sd, &data);
+	if (n_rows < 1) {
+		kshark_free(kshark_ctx);
+		return 1;
+	}
+
+	/* Print the memory used by the session. */
+	report = kshark_memory_report(kshark_ctx, data, n_rows);
+	if (report) {
+		kshark_print_memory_report(kshark_ctx, report, stdout);
+		kshark_free_memory_report(report);
+	}
+
+	/* Free the memory. */
+	kshark_free_entries(kshark_ctx, data, n_rows);
+
+	/* Close the file. */
+	kshark_close(kshark_ctx, sd);
+
+	/* Close the session. */
+	kshark_free(kshark_ctx);
+
+	return 0;
+}
@@ -0,0 +1,94 @@
+// SPDX-License-Identifier: GPL-2.0
+
+/*
+ * Copyright (C) 2021 VMware Inc, Yordan Karadzhov <y.karadz@gmail.com>
+ */
+
+// C
+#include <stdio.h>
+#include <stdlib.h>
+
+// KernelShark
+#include "libkshark.h"
+#include "libkshark-query.h"
+
+const char *default_file = "trace.dat";
+
+int main(int argc, char **argv)
+{
+	struct kshark_context *kshark_ctx;
+	struct kshark_entry **data = NULL;
+	struct kshark_query *query;
+	ssize_t r, n_rows, count;
+	const char *file, *expr;
+	uint64_t *bitset;
+	char *entry_str, *error;
+	int sd;
+
+	if (argc < 2) {
+		fprintf(stderr, "Usage: %s [file] <query>\n", argv[0]);
+		return 1;
+	}
+
+	file = (argc > 2) ? argv[1] : default_file;
+	expr = argv[argc - 1];
+
+	/* Create a new kshark session. */
+	kshark_ctx = NULL;
+	if (!kshark_instance(&kshark_ctx))
+		return 1;
+
+	/* Open a trace data file produced by trace-cmd. */
+	sd = kshark_open(kshark_ctx, file);
+	if (sd < 0) {
+		kshark_free(kshark_ctx);
+		return 1;
+	}
+
+	/* Compile the query expression. */
+	query = kshark_query_compile(kshark_ctx, sd, expr, &error);
+	if (!query) {
+		fprintf(stderr, "%s\n", error ? error : "Invalid query.");
+		free(error);
+		kshark_free(kshark_ctx);
+		return 1;
+	}
+
+	/* Load the content of the file into an array of entries. */
+	n_rows = kshark_load_entries(kshark_ctx, sd, &data);
+	if (n_rows < 1) {
+		kshark_query_free(query);
+		kshark_free(kshark_ctx);
+		return 1;
+	}
+
+	/* Evaluate the query, using all available CPUs. */
+	count = kshark_query_bitset(query, data, n_rows, 0, &bitset);
+	printf("%zi of %zi entries match \"%s\"\n\n",
+	       count, n_rows, kshark_query_string(query));
+
+	/* Print to the screen the first 10 matching entries. */
+	for (r = 0, count = 0; r < n_rows && count < 10; ++r) {
+		if (!kshark_query_bit(bitset, r))
+			continue;
+
+		entry_str = kshark_dump_entry(data[r]);
+		puts(entry_str);
+		free(entry_str);
+		++count;
+	}
+
+	/* Free the memory. */
+	free(bitset);
+	kshark_query_free(query);
+
+	kshark_free_entries(kshark_ctx, data, n_rows);
+
+	/* Close the file. */
+	kshark_close(kshark_ctx, sd);
+
+	/* Close the session. */
+	kshark_free(kshark_ctx);
+
+	return 0;
+}
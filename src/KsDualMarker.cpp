@@ -138,6 +138,7 @@ KsDualMarkerSM::KsDualMarkerSM(QWidget *parent)
   _buttonA("Marker A", this),
   _buttonB("Marker B", this),
   _labelDeltaDescr("    A,B Delta: ", this),
+  _labelCountDescr("    Events: ", this),
   _markA(DualMarkerState::A, Qt::darkGreen),
   _markB(DualMarkerState::B, Qt::darkCyan),
   _scCtrlA(this),
@@ -148,7 +149,7 @@ KsDualMarkerSM::KsDualMarkerSM(QWidget *parent)
 	_buttonA.setFixedWidth(STRING_WIDTH(" Marker A ") + FONT_WIDTH);
 	_buttonB.setFixedWidth(STRING_WIDTH(" Marker B ") + FONT_WIDTH);
 
-	for (auto const &l: {&_labelMA, &_labelMB, &_labelDelta}) {
+	for (auto const &l: {&_labelMA, &_labelMB, &_labelDelta, &_labelCount}) {
 		l->setFrameStyle(QFrame::Panel | QFrame::Sunken);
 		l->setStyleSheet("QLabel {background-color : white; color : black}");
 		l->setTextInteractionFlags(Qt::TextSelectableByMouse);
@@ -228,6 +229,8 @@ void KsDualMarkerSM::reset()
 	_labelMA.setText("");
 	_labelMB.setText("");
 	_labelDelta.setText("");
+	_labelCount.setText("");
+	_labelCount.setToolTip("");
 }
 
 /** Restart the Dual Marker State Machine. */
@@ -283,6 +286,8 @@ void KsDualMarkerSM::placeInToolBar(QToolBar *tb)
 	tb->addSeparator();
 	tb->addWidget(&_labelDeltaDescr);
 	tb->addWidget(&_labelDelta);
+	tb->addWidget(&_labelCountDescr);
+	tb->addWidget(&_labelCount);
 }
 
 /** Set the state of the Dual Marker State Machine. */
@@ -317,9 +322,52 @@ void KsDualMarkerSM::updateMarkers(const KsDataStore &data,
 	if(_markB.update(data, glw->model()->histo()))
 		glw->setMarkPoints(data, &_markB);
 
+	_updateCountLabel(data);
 	updateLabels();
 }
 
+/*
+ * Show the number of events between the two markers. The first number is the
+ * count of the events having the same type and CPU as the entry selected by
+ * Marker A, while the second number is the count of all events. Both numbers
+ * are retrieved from the prefix-count index of the data, hence no scanning of
+ * the data is performed.
+ */
+void KsDualMarkerSM::_updateCountLabel(const KsDataStore &data)
+{
+	const kshark_event_count_index *index = data.countIndex();
+	size_t nAll, nEvent;
+	int64_t min, max;
+	kshark_entry *e;
+	QString event;
+	char *buffer;
+
+	if (!_markA._isSet || !_markB._isSet || !index) {
+		_labelCount.clear();
+		_labelCount.setToolTip("");
+		return;
+	}
+
+	min = std::min(_markA._ts, _markB._ts);
+	max = std::max(_markA._ts, _markB._ts);
+
+	e = data.rows()[_markA._pos];
+	nEvent = kshark_event_count(index, e->stream_id, e->cpu, e->event_id,
+				    min, max);
+
+	nAll = kshark_event_count(index, KS_COUNT_ANY, KS_COUNT_ANY,
+				  KS_COUNT_ANY, min, max);
+
+	buffer = kshark_get_event_name(e);
+	event = buffer;
+	free(buffer);
+
+	_labelCount.setText(QString("%1 / %2").arg(nEvent).arg(nAll));
+	_labelCount.setToolTip(QString("%1 on CPU %2: %3\nAll events: %4")
+			       .arg(event).arg(e->cpu)
+			       .arg(nEvent).arg(nAll));
+}
+
 /**
  * @brief Use this function to update the labels when the state of the model
  *	  has changed.
@@ -360,5 +408,7 @@ void KsDualMarkerSM::updateLabels()
 		lamSetTimeLabel(_labelDelta, _markB._ts - _markA._ts);
 	} else {
 		_labelDelta.clear();
+		_labelCount.clear();
+		_labelCount.setToolTip("");
 	}
 }
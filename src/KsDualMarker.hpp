@@ -207,6 +207,8 @@ private:
 
 	QLabel		 _labelDeltaDescr;
 
+	QLabel		 _labelCount, _labelCountDescr;
+
 	QState		*_stateA;
 
 	QState		*_stateB;
@@ -222,6 +224,8 @@ private:
 	void _doStateA();
 
 	void _doStateB();
+
+	void _updateCountLabel(const KsDataStore &data);
 };
 
 #endif
@@ -46,6 +46,7 @@ KsGLWidget::KsGLWidget(QWidget *parent)
   _data(nullptr),
   _rubberBand(QRubberBand::Rectangle, this),
   _rubberBandOrigin(0, 0),
+  _preview(false),
   _dpr(1)
 {
 	setMouseTracking(true);
@@ -64,6 +65,77 @@ void KsGLWidget::_freeGraphs()
 			delete g;
 		stream.resize(0);
 	}
+
+	_frame._graphs.clear();
+}
+
+void KsGLWidget::_cacheGraphs()
+{
+	auto lamFreeFrame = [] (KsGraphCacheFrame &frame) {
+		for (auto const &g: frame._graphs)
+			delete g;
+	};
+
+	/*
+	 * Keep the graphs only if the corresponding state of the model is
+	 * kept in cache as well. Otherwise simply free the graphs.
+	 */
+	if (_frame._graphs.isEmpty() ||
+	    _frame._generation != _model.generation() ||
+	    !_model.isCached(_frame._min, _frame._max, _frame._nBins)) {
+		_freeGraphs();
+	} else {
+		_graphCache.prepend(_frame);
+		_frame._graphs.clear();
+		for (auto &stream: _graphs)
+			stream.resize(0);
+	}
+
+	/* Drop the graphs of all states, which are no longer in cache. */
+	for (int i = _graphCache.count() - 1; i >= 0; --i) {
+		const KsGraphCacheFrame &f = _graphCache[i];
+
+		if (i < KS_MODEL_CACHE_SIZE &&
+		    f._generation == _model.generation() &&
+		    _model.isCached(f._min, f._max, f._nBins))
+			continue;
+
+		lamFreeFrame(_graphCache[i]);
+		_graphCache.removeAt(i);
+	}
+}
+
+void KsGLWidget::_clearGraphCache()
+{
+	for (auto &frame: _graphCache)
+		for (auto const &g: frame._graphs)
+			delete g;
+
+	_graphCache.clear();
+}
+
+/*
+ * Get a graph, filled for the current state of the model, from the cache.
+ * Returns nullptr if such graph has not been cached. The caller takes the
+ * ownership of the graph.
+ */
+KsPlot::Graph *KsGLWidget::_takeCachedGraph(int sd, int type, int id)
+{
+	KsGraphCacheId key(sd, type, id);
+	KsPlot::Graph *graph;
+
+	/* The frame of the current state (if any) is always in front. */
+	if (_graphCache.isEmpty() ||
+	    _graphCache.front()._min != _frame._min ||
+	    _graphCache.front()._max != _frame._max ||
+	    _graphCache.front()._nBins != _frame._nBins ||
+	    !_graphCache.front()._graphs.contains(key))
+		return nullptr;
+
+	graph = _graphCache.front()._graphs.take(key);
+	_frame._graphs.insert(key, graph);
+
+	return graph;
 }
 
 void KsGLWidget::_freePluginShapes()
@@ -78,6 +150,7 @@ void KsGLWidget::_freePluginShapes()
 KsGLWidget::~KsGLWidget()
 {
 	_freeGraphs();
+	_clearGraphCache();
 	_freePluginShapes();
 }
 
@@ -119,12 +192,7 @@ void KsGLWidget::resizeGL(int w, int h)
 	 * Reload the data. The range of the histogram is the same
 	 * but the number of bins changes.
 	 */
-	ksmodel_set_bining(_model.histo(),
-			   nBins,
-			   _model.histo()->min,
-			   _model.histo()->max);
-
-	_model.fill(_data->rows(), _data->size());
+	_model.setBining(nBins, _model.histo()->min, _model.histo()->max);
 }
 
 /** Reimplemented function used to plot trace graphs. */
@@ -137,6 +205,8 @@ void KsGLWidget::paintGL()
 	if (isEmpty())
 		return;
 
+	kshark_self_trace_begin("kshark: paint");
+
 	render();
 
 	/* Draw the time axis. */
@@ -160,15 +230,21 @@ void KsGLWidget::paintGL()
 	_mState->updateMarkers(*_data, this);
 	_mState->passiveMarker().draw();
 	_mState->activeMarker().draw();
+
+	kshark_self_trace_end();
 }
 
 void KsGLWidget::render()
 {
 	/* Process and draw all graphs by using the built-in logic. */
+	kshark_self_trace_begin("kshark: make graphs");
 	_makeGraphs();
+	kshark_self_trace_end();
 
 	/* Process and draw all plugin-specific shapes. */
+	kshark_self_trace_begin("kshark: plugin shapes");
 	_makePluginShapes();
+	kshark_self_trace_end();
 };
 
 /** Reset (empty) the widget. */
@@ -190,12 +266,19 @@ void KsGLWidget::mousePressEvent(QMouseEvent *event)
 }
 
 int KsGLWidget::_getLastTask(struct kshark_trace_histo *histo,
+			     const KsPlot::Graph *graph,
 			     int bin, int sd, int cpu)
 {
 	kshark_context *kshark_ctx(nullptr);
+	const KsPlot::BinPick *pick;
 	kshark_entry_collection *col;
 	int pid;
 
+	/* Use the picking information of the CPU graph (if available). */
+	pick = graph ? graph->getPick(bin) : nullptr;
+	if (pick)
+		return pick->_lastId;
+
 	if (!kshark_instance(&kshark_ctx))
 		return KS_EMPTY_BIN;
 
@@ -219,12 +302,19 @@ int KsGLWidget::_getLastTask(struct kshark_trace_histo *histo,
 }
 
 int KsGLWidget::_getLastCPU(struct kshark_trace_histo *histo,
+			    const KsPlot::Graph *graph,
 			    int bin, int sd, int pid)
 {
 	kshark_context *kshark_ctx(nullptr);
+	const KsPlot::BinPick *pick;
 	kshark_entry_collection *col;
 	int cpu;
 
+	/* Use the picking information of the Task graph (if available). */
+	pick = graph ? graph->getPick(bin) : nullptr;
+	if (pick)
+		return pick->_lastId;
+
 	if (!kshark_instance(&kshark_ctx))
 		return KS_EMPTY_BIN;
 
@@ -251,6 +341,7 @@ int KsGLWidget::_getLastCPU(struct kshark_trace_histo *histo,
 /** Reimplemented event handler used to receive mouse move events. */
 void KsGLWidget::mouseMoveEvent(QMouseEvent *event)
 {
+	KsPlot::Graph *graph;
 	int bin, sd, cpu, pid;
 	size_t row;
 	bool ret;
@@ -261,19 +352,29 @@ void KsGLWidget::mouseMoveEvent(QMouseEvent *event)
 	if (_rubberBand.isVisible())
 		_rangeBoundStretched(_posInRange(event->pos().x()));
 
+	/* The preview data cannot be used to look up individual entries. */
+	if (_preview)
+		return;
+
 	bin = event->pos().x() - _bin0Offset();
-	getPlotInfo(event->pos(), &sd, &cpu, &pid);
+	getPlotInfo(event->pos(), &sd, &cpu, &pid, &graph);
 
-	ret = _find(bin, sd, cpu, pid, 5, false, &row);
+	ret = _find(graph, bin, sd, cpu, pid, 5, false, &row);
 	if (ret) {
 		emit found(row);
 	} else {
 		if (cpu >= 0) {
-			pid = _getLastTask(_model.histo(), bin, sd, cpu);
+			pid = _getLastTask(_model.histo(), graph, bin, sd, cpu);
+
+			/*
+			 * The last CPU of the task can be retrieved quickly
+			 * only if the task is plotted as well.
+			 */
+			graph = _getGraph(sd, -1, pid);
 		}
 
 		if (pid > 0) {
-			cpu = _getLastCPU(_model.histo(), bin, sd, pid);
+			cpu = _getLastCPU(_model.histo(), graph, bin, sd, pid);
 		}
 
 		emit notFound(ksmodel_bin_ts(_model.histo(), bin), sd, cpu, pid);
@@ -307,6 +408,9 @@ void KsGLWidget::mouseDoubleClickEvent(QMouseEvent *event)
 	KsPlot::PlotObject *pluginClicked(nullptr);
 	double distance, distanceMin = FONT_HEIGHT;
 
+	if (_preview)
+		return;
+
 	for (auto const &s: _shapes) {
 		distance = s->distance(event->pos().x(), event->pos().y());
 		if (distance < distanceMin) {
@@ -370,11 +474,17 @@ void KsGLWidget::keyPressEvent(QKeyEvent *event)
 		return;
 
 	case Qt::Key_Left:
-		emit scrollLeft();
+		if (event->modifiers() & Qt::AltModifier)
+			emit historyBack();
+		else
+			emit scrollLeft();
 		return;
 
 	case Qt::Key_Right:
-		emit scrollRight();
+		if (event->modifiers() & Qt::AltModifier)
+			emit historyForward();
+		else
+			emit scrollRight();
 		return;
 
 	default:
@@ -474,6 +584,14 @@ void KsGLWidget::loadColors()
 	_cpuColors = KsPlot::getCPUColorTable();
 	_streamColors.clear();
 	_streamColors = KsPlot::getStreamColorTable();
+
+	/*
+	 * The colors of the cached graphs are no longer valid. Note that the
+	 * graphs currently plotted will be freed by the next call of
+	 * _makeGraphs().
+	 */
+	_frame._graphs.clear();
+	_clearGraphCache();
 }
 
 /**
@@ -615,12 +733,29 @@ void KsGLWidget::_makeGraphs()
 	int base(_vMargin * 2 + KS_GRAPH_HEIGHT), sd;
 	KsPlot::Graph *g;
 
-	/* The very first thing to do is to clean up. */
-	_freeGraphs();
+	/*
+	 * The very first thing to do is to clean up. The graphs of recently
+	 * visited states of the model are kept in cache.
+	 */
+	_cacheGraphs();
 
 	if (!_data || !_data->size())
 		return;
 
+	_frame._min = _model.histo()->min;
+	_frame._max = _model.histo()->max;
+	_frame._nBins = _model.histo()->n_bins;
+	_frame._generation = _model.generation();
+
+	/* Move the cached graphs for this state (if any) in front. */
+	for (int i = 0; i < _graphCache.count(); ++i)
+		if (_graphCache[i]._min == _frame._min &&
+		    _graphCache[i]._max == _frame._max &&
+		    _graphCache[i]._nBins == _frame._nBins) {
+			_graphCache.move(i, 0);
+			break;
+		}
+
 	_labelSize = _getMaxLabelSize() + FONT_WIDTH * 2;
 
 	auto lamAddGraph = [&](int sd, KsPlot::Graph *graph, int vSpace=0) {
@@ -634,6 +769,7 @@ void KsGLWidget::_makeGraphs()
 		 */
 
 		graph->setBase(base);
+		graph->setDrawBase(true);
 
 		/*
 		 * If we have multiple Data streams use the color of the stream
@@ -688,6 +824,20 @@ void KsGLWidget::_makeGraphs()
 
 		base += _vSpacing;
 	}
+
+	/*
+	 * The cached graphs for this state, which have not been reused, are
+	 * no longer plotted.
+	 */
+	if (!_graphCache.isEmpty() &&
+	    _graphCache.front()._min == _frame._min &&
+	    _graphCache.front()._max == _frame._max &&
+	    _graphCache.front()._nBins == _frame._nBins) {
+		for (auto const &g: _graphCache.front()._graphs)
+			delete g;
+
+		_graphCache.removeFirst();
+	}
 }
 
 void KsGLWidget::_makePluginShapes()
@@ -704,6 +854,13 @@ void KsGLWidget::_makePluginShapes()
 	/* The very first thing to do is to clean up. */
 	_freePluginShapes();
 
+	/*
+	 * The data of the plugins is being processed while the preview is
+	 * shown.
+	 */
+	if (_preview)
+		return;
+
 	cppArgv._histo = _model.histo();
 	cppArgv._shapes = &_shapes;
 
@@ -759,11 +916,15 @@ void KsGLWidget::_makePluginShapes()
 
 KsPlot::Graph *KsGLWidget::_newCPUGraph(int sd, int cpu)
 {
+	KsPlot::Graph *graph;
 	QString name;
+
+	graph = _takeCachedGraph(sd, KsPlot::KSHARK_CPU_DRAW, cpu);
+	if (graph)
+		return graph;
+
 	/* The CPU graph needs to know only the colors of the tasks. */
-	KsPlot::Graph *graph = new KsPlot::Graph(_model.histo(),
-						 &_pidColors,
-						 &_pidColors);
+	graph = new KsPlot::Graph(_model.histo(), &_pidColors, &_pidColors);
 
 	kshark_context *kshark_ctx(nullptr);
 	kshark_data_stream *stream;
@@ -780,26 +941,38 @@ KsPlot::Graph *KsGLWidget::_newCPUGraph(int sd, int cpu)
 	graph->setHeight(KS_GRAPH_HEIGHT);
 	graph->setLabelText(KsUtils::cpuPlotName(cpu).toStdString());
 
-	col = kshark_find_data_collection(kshark_ctx->collections,
+	/*
+	 * The Data collections are registered for the exact data, hence they
+	 * cannot be used with the preview.
+	 */
+	col = _preview ? nullptr :
+	      kshark_find_data_collection(kshark_ctx->collections,
 					  KsUtils::matchCPUVisible,
 					  sd, &cpu, 1);
 
 	graph->setDataCollectionPtr(col);
 	graph->fillCPUGraph(sd, cpu);
 
+	_frame._graphs.insert(KsGraphCacheId(sd, KsPlot::KSHARK_CPU_DRAW, cpu),
+			      graph);
+
 	return graph;
 }
 
 KsPlot::Graph *KsGLWidget::_newTaskGraph(int sd, int pid)
 {
+	KsPlot::Graph *graph;
 	QString name;
+
+	graph = _takeCachedGraph(sd, KsPlot::KSHARK_TASK_DRAW, pid);
+	if (graph)
+		return graph;
+
 	/*
 	 * The Task graph needs to know the colors of the tasks and the colors
 	 * of the CPUs.
 	 */
-	KsPlot::Graph *graph = new KsPlot::Graph(_model.histo(),
-						 &_pidColors,
-						 &_cpuColors);
+	graph = new KsPlot::Graph(_model.histo(), &_pidColors, &_cpuColors);
 	kshark_context *kshark_ctx(nullptr);
 	kshark_entry_collection *col;
 	kshark_data_stream *stream;
@@ -851,6 +1024,9 @@ KsPlot::Graph *KsGLWidget::_newTaskGraph(int sd, int pid)
 	graph->setDataCollectionPtr(col);
 	graph->fillTaskGraph(sd, pid);
 
+	_frame._graphs.insert(KsGraphCacheId(sd, KsPlot::KSHARK_TASK_DRAW, pid),
+			      graph);
+
 	return graph;
 }
 
@@ -870,23 +1046,52 @@ bool KsGLWidget::find(const QPoint &point, int variance, bool joined,
 		      size_t *index)
 {
 	int bin, sd, cpu, pid;
+	KsPlot::Graph *graph;
 
 	/*
 	 * Get the bin, pid and cpu numbers.
 	 * Remember that one bin corresponds to one pixel.
 	 */
 	bin = point.x() - _bin0Offset();
-	getPlotInfo(point, &sd, &cpu, &pid);
+	getPlotInfo(point, &sd, &cpu, &pid, &graph);
+
+	return _find(graph, bin, sd, cpu, pid, variance, joined, index);
+}
+
+KsPlot::Graph *KsGLWidget::_getGraph(int sd, int cpu, int pid)
+{
+	int i;
 
-	return _find(bin, sd, cpu, pid, variance, joined, index);
+	if (!_streamPlots.contains(sd))
+		return nullptr;
+
+	const KsPerStreamPlots &plots = _streamPlots[sd];
+	if (cpu >= 0) {
+		i = plots._cpuList.indexOf(cpu);
+		if (i >= 0 && i < plots._cpuGraphs.count())
+			return plots._cpuGraphs[i];
+	} else if (pid >= 0) {
+		i = plots._taskList.indexOf(pid);
+		if (i >= 0 && i < plots._taskGraphs.count())
+			return plots._taskGraphs[i];
+	}
+
+	return nullptr;
 }
 
-int KsGLWidget::_getNextCPU(int sd, int pid, int bin)
+int KsGLWidget::_getNextCPU(const KsPlot::Graph *graph,
+			    int sd, int pid, int bin)
 {
 	kshark_context *kshark_ctx(nullptr);
+	const KsPlot::BinPick *pick;
 	kshark_entry_collection *col;
 	int cpu;
 
+	/* Use the picking information of the Task graph (if available). */
+	pick = graph ? graph->getPick(bin) : nullptr;
+	if (pick)
+		return pick->_nextCpu;
+
 	if (!kshark_instance(&kshark_ctx))
 		return KS_EMPTY_BIN;
 
@@ -906,10 +1111,12 @@ int KsGLWidget::_getNextCPU(int sd, int pid, int bin)
 	return KS_EMPTY_BIN;
 }
 
-bool KsGLWidget::_find(int bin, int sd, int cpu, int pid,
+bool KsGLWidget::_find(const KsPlot::Graph *graph,
+		       int bin, int sd, int cpu, int pid,
 		       int variance, bool joined, size_t *row)
 {
 	int hSize = _model.histo()->n_bins;
+	const KsPlot::BinPick *pick;
 	ssize_t found;
 
 	if (bin < 0 || bin > hSize || (cpu < 0 && pid < 0)) {
@@ -922,9 +1129,16 @@ bool KsGLWidget::_find(int bin, int sd, int cpu, int pid,
 	}
 
 	auto lamGetEntryByCPU = [&](int b) {
-		/* Get the first data entry in this bin. */
-		found = ksmodel_first_index_at_cpu(_model.histo(),
-						   b, sd, cpu);
+		/*
+		 * Get the first data entry in this bin. Use the picking
+		 * information of the graph if available.
+		 */
+		pick = graph ? graph->getPick(b) : nullptr;
+		if (pick)
+			found = pick->_first;
+		else
+			found = ksmodel_first_index_at_cpu(_model.histo(),
+							   b, sd, cpu);
 		if (found < 0) {
 			/*
 			 * The bin is empty or the entire connect of the bin
@@ -938,9 +1152,16 @@ bool KsGLWidget::_find(int bin, int sd, int cpu, int pid,
 	};
 
 	auto lamGetEntryByPid = [&](int b) {
-		/* Get the first data entry in this bin. */
-		found = ksmodel_first_index_at_pid(_model.histo(),
-						   b, sd, pid);
+		/*
+		 * Get the first data entry in this bin. Use the picking
+		 * information of the graph if available.
+		 */
+		pick = graph ? graph->getPick(b) : nullptr;
+		if (pick)
+			found = pick->_first;
+		else
+			found = ksmodel_first_index_at_pid(_model.histo(),
+							   b, sd, pid);
 		if (found < 0) {
 			/*
 			 * The bin is empty or the entire connect of the bin
@@ -1006,7 +1227,8 @@ bool KsGLWidget::_find(int bin, int sd, int cpu, int pid,
 		 * for an entry on the next CPU used by this task.
 		 */
 		if (!ret && joined) {
-			cpu = _getNextCPU(sd, pid, bin);
+			cpu = _getNextCPU(graph, sd, pid, bin);
+			graph = _getGraph(sd, cpu, -1);
 			ret = lamFindEntryByCPU(bin);
 		}
 
@@ -1102,9 +1324,9 @@ void KsGLWidget::_rangeChanged(int binMin, int binMax)
 	}
 
 	/* Recalculate the model and update the markers. */
-	ksmodel_set_bining(_model.histo(), nBins, min, max);
-	_model.fill(_data->rows(), _data->size());
+	_model.setBining(nBins, min, max);
 	_mState->updateMarkers(*_data, this);
+	emit rangeSelected();
 
 	/*
 	 * If the Marker is inside the new range, make sure that it will
@@ -1153,12 +1375,16 @@ int KsGLWidget::_posInRange(int x)
  *	       a Task graph.
  * @param pid: Output location for the Process Id of the graph, or -1 if this is
  *	       a CPU graph.
+ * @param graph: Optional output location for the graph.
  */
-bool KsGLWidget::getPlotInfo(const QPoint &point, int *sd, int *cpu, int *pid)
+bool KsGLWidget::getPlotInfo(const QPoint &point, int *sd, int *cpu, int *pid,
+			     KsPlot::Graph **graph)
 {
 	int base, n;
 
 	*sd = *cpu = *pid = -1;
+	if (graph)
+		*graph = nullptr;
 
 	for (auto it = _streamPlots.constBegin(); it != _streamPlots.constEnd(); ++it) {
 		n = it.value()._cpuList.count();
@@ -1168,6 +1394,8 @@ bool KsGLWidget::getPlotInfo(const QPoint &point, int *sd, int *cpu, int *pid)
 			    point.y() < base) {
 				*sd = it.key();
 				*cpu = it.value()._cpuList[i];
+				if (graph)
+					*graph = it.value()._cpuGraphs[i];
 
 				return true;
 			}
@@ -1180,6 +1408,8 @@ bool KsGLWidget::getPlotInfo(const QPoint &point, int *sd, int *cpu, int *pid)
 			    point.y() < base) {
 				*sd = it.key();
 				*pid = it.value()._taskList[i];
+				if (graph)
+					*graph = it.value()._taskGraphs[i];
 
 				return true;
 			}
@@ -1196,6 +1426,9 @@ bool KsGLWidget::getPlotInfo(const QPoint &point, int *sd, int *cpu, int *pid)
 				else if (p._type & KsPlot::KSHARK_TASK_DRAW)
 					*pid = p._id;
 
+				if (graph)
+					*graph = p._graph;
+
 				return true;
 			}
 		}
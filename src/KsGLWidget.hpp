@@ -12,6 +12,9 @@
 #ifndef _KS_GLWIDGET_H
 #define _KS_GLWIDGET_H
 
+// C++
+#include <tuple>
+
 // Qt
 #include <QRubberBand>
 
@@ -59,6 +62,31 @@ void operator >>(const KsPlotEntry &plot, QVector<int> &v);
 
 typedef QVector<KsPlotEntry>	KsComboPlot;
 
+/**
+ * Identifier of a graph inside the cache of graphs. Contains the Id of the
+ * Data stream, the type of the plot (Task or CPU plot) and the PID or the CPU
+ * number.
+ */
+typedef std::tuple<int, int, int>	KsGraphCacheId;
+
+/** Graphs, filled for a given state of the Visualization model. */
+struct KsGraphCacheFrame {
+	/** Lower edge of the time-window of the model. */
+	int64_t		_min;
+
+	/** Upper edge of the time-window of the model. */
+	int64_t		_max;
+
+	/** Number of bins of the model. */
+	int		_nBins;
+
+	/** The generation of the data of the model. */
+	unsigned int	_generation;
+
+	/** The filled graphs. */
+	QMultiMap<KsGraphCacheId, KsPlot::Graph *>	_graphs;
+};
+
 /**
  * The KsGLWidget class provides a widget for rendering OpenGL graphics used
  * to plot trace graphs.
@@ -193,7 +221,8 @@ public:
 	bool find(const QPoint &point, int variance, bool joined,
 		  size_t *index);
 
-	bool getPlotInfo(const QPoint &point, int *sd, int *cpu, int *pid);
+	bool getPlotInfo(const QPoint &point, int *sd, int *cpu, int *pid,
+			 KsPlot::Graph **graph = nullptr);
 
 	/** CPUs and Tasks graphs (per data stream) to be plotted. */
 	QMap<int, KsPerStreamPlots>	_streamPlots;
@@ -206,6 +235,16 @@ public:
 		_workInProgress = wip;
 	}
 
+	/**
+	 * Set the preview mode. In this mode the widget shows approximate
+	 * (sampled) data, while the exact data is being loaded. The plugins
+	 * are not drawn and the individual entries cannot be selected.
+	 */
+	void setPreview(bool p) {_preview = p;}
+
+	/** Check if the widget shows approximate (preview) data. */
+	bool isPreview() const {return _preview;}
+
 signals:
 	/**
 	 * This signal is emitted when the mouse moves over a visible
@@ -252,6 +291,12 @@ signals:
 private:
 	QMap<int, QVector<KsPlot::Graph *>>	_graphs;
 
+	/** The graphs currently plotted, together with the state of the model. */
+	KsGraphCacheFrame		_frame;
+
+	/** Graphs of recently visited states. The most recent comes first. */
+	QList<KsGraphCacheFrame>	_graphCache;
+
 	KsPlot::PlotObjList	_shapes;
 
 	KsPlot::ColorTable	_pidColors;
@@ -276,6 +321,8 @@ private:
 
 	QPoint		_rubberBandOrigin;
 
+	bool		_preview;
+
 	size_t		_posMousePress;
 
 	bool		_keyPressed;
@@ -286,6 +333,12 @@ private:
 
 	void _freeGraphs();
 
+	void _cacheGraphs();
+
+	void _clearGraphCache();
+
+	KsPlot::Graph *_takeCachedGraph(int sd, int type, int id);
+
 	void _freePluginShapes();
 
 	void _drawAxisX(float size);
@@ -310,16 +363,21 @@ private:
 
 	bool _findAndSelect(QMouseEvent *event);
 
-	bool _find(int bin, int sd, int cpu, int pid,
+	bool _find(const KsPlot::Graph *graph,
+		   int bin, int sd, int cpu, int pid,
 		   int variance, bool joined, size_t *row);
 
-	int _getNextCPU(int sd, int pid, int bin);
+	KsPlot::Graph *_getGraph(int sd, int cpu, int pid);
+
+	int _getNextCPU(const KsPlot::Graph *graph, int sd, int pid, int bin);
 
 	int _getLastTask(struct kshark_trace_histo *histo,
+			 const KsPlot::Graph *graph,
 			 int bin, int sd, int cpu);
 
 	int _getLastCPU(struct kshark_trace_histo *histo,
-			int sd, int bin, int pid);
+			const KsPlot::Graph *graph,
+			int bin, int sd, int pid);
 
 	void _deselect();
 
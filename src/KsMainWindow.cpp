@@ -16,6 +16,8 @@
 
 // C++11
 #include <thread>
+#include <mutex>
+#include <condition_variable>
 
 // Qt
 #include <QMenu>
@@ -23,9 +25,12 @@
 #include <QMenuBar>
 #include <QLabel>
 #include <QLocalSocket>
+#include <QInputDialog>
 
 // KernelShark
 #include "libkshark.h"
+#include "libkshark-diff.h"
+#include "libkshark-memory.h"
 #include "KsCmakeDef.hpp"
 #include "KsMainWindow.hpp"
 #include "KsAdvFilteringDialog.hpp"
@@ -64,6 +69,8 @@ KsMainWindow::KsMainWindow(QWidget *parent)
   _addPluginsAction("Add plugins", this),
   _captureAction("Record", this),
   _addOffcetAction("Add Time Offset", this),
+  _compareStreamsAction("Compare Data streams", this),
+  _memoryReportAction("Memory usage", this),
   _colorAction(this),
   _colSlider(this),
   _colorPhaseSlider(Qt::Horizontal, this),
@@ -316,6 +323,16 @@ void KsMainWindow::_createActions()
 	connect(&_addOffcetAction,	&QAction::triggered,
 		this,			&KsMainWindow::_offset);
 
+	_compareStreamsAction.setStatusTip("Compare the statistics of two Data streams");
+
+	connect(&_compareStreamsAction,	&QAction::triggered,
+		this,			&KsMainWindow::_compareStreams);
+
+	_memoryReportAction.setStatusTip("Show the memory used by the session");
+
+	connect(&_memoryReportAction,	&QAction::triggered,
+		this,			&KsMainWindow::_memoryReport);
+
 	_colorPhaseSlider.setMinimum(20);
 	_colorPhaseSlider.setMaximum(180);
 	_colorPhaseSlider.setValue(KsPlot::Color::getRainbowFrequency() * 100);
@@ -471,10 +488,12 @@ void KsMainWindow::_createMenus()
 	tools->addAction(&_managePluginsAction);
 	tools->addAction(&_addPluginsAction);
 	tools->addAction(&_addOffcetAction);
+	tools->addAction(&_compareStreamsAction);
+	tools->addAction(&_memoryReportAction);
 
 	/*
-	 * Enable the "Add Time Offset" menu only in the case of multiple
-	 * data streams.
+	 * Enable the "Add Time Offset" and the "Compare Data streams" menus
+	 * only in the case of multiple data streams.
 	 */
 	auto lamEnableOffcetAction = [this] () {
 		kshark_context *kshark_ctx(nullptr);
@@ -482,10 +501,13 @@ void KsMainWindow::_createMenus()
 		if (!kshark_instance(&kshark_ctx))
 			return;
 
-		if (kshark_ctx->n_streams > 1)
+		if (kshark_ctx->n_streams > 1) {
 			_addOffcetAction.setEnabled(true);
-		else
+			_compareStreamsAction.setEnabled(true);
+		} else {
 			_addOffcetAction.setEnabled(false);
+			_compareStreamsAction.setEnabled(false);
+		}
 	};
 
 	connect(tools,	&QMenu::aboutToShow, lamEnableOffcetAction);
@@ -534,7 +556,7 @@ void KsMainWindow::_open()
 	QString fileName;
 
 	fileName = KsUtils::getFile(this, "Open File",
-				    "trace-cmd files (*.dat);;All files (*)",
+				    "trace-cmd files (*.dat *.dat.zst);;All files (*)",
 				    _lastDataFilePath);
 
 	if (!fileName.isEmpty())
@@ -598,7 +620,7 @@ void KsMainWindow::_append()
 {
 	QString fileName = KsUtils::getFile(this,
 					    "Append File",
-					    "trace-cmd files (*.dat);;Text files (*.txt);;All files (*)",
+					    "trace-cmd files (*.dat *.dat.zst);;Text files (*.txt);;All files (*)",
 					    _lastDataFilePath);
 
 	if (!fileName.isEmpty())
@@ -1188,6 +1210,163 @@ void KsMainWindow::_offset()
 	connect(dialog, &KsTimeOffsetDialog::apply, lamApplyOffset);
 }
 
+static QString diffReport(const kshark_trace_diff *diff,
+			  const kshark_diff_item *items, size_t nItems,
+			  kshark_diff_metric metric, double scale,
+			  QString title)
+{
+	const size_t nTop = 10;
+	const kshark_diff_item *top[nTop];
+	QString text(title + "\n");
+	size_t n;
+
+	n = kshark_diff_top(diff, items, nItems, metric, nTop, top);
+	for (size_t i = 0; i < n; ++i) {
+		text += QString("   %1\t%2 -> %3\t(+%4)\n")
+			.arg(top[i]->name)
+			.arg(kshark_diff_normalized(diff, top[i], KS_DIFF_BASE,
+						    metric) * scale, 0, 'f', 3)
+			.arg(kshark_diff_normalized(diff, top[i], KS_DIFF_TEST,
+						    metric) * scale, 0, 'f', 3)
+			.arg(kshark_diff_delta(diff, top[i], metric) * scale,
+			     0, 'f', 3);
+	}
+
+	if (!n)
+		text += "   none\n";
+
+	return text + "\n";
+}
+
+void KsMainWindow::_compareStreams()
+{
+	kshark_matrix_data_set base, test;
+	kshark_context *kshark_ctx(nullptr);
+	QVector<int> streamIds;
+	KsMessageDialog *message;
+	kshark_trace_diff *diff;
+	QStringList streams;
+	int sdBase, sdTest;
+	QString text;
+
+	if (!kshark_instance(&kshark_ctx))
+		return;
+
+	streamIds = KsUtils::getStreamIdList();
+	for (auto const &sd: streamIds)
+		streams << QString("%1: ").arg(sd) +
+			   KsUtils::streamDescription(kshark_ctx->stream[sd]);
+
+	auto lamGetStream = [&] (QString label, int current) {
+		QString item;
+		bool ok;
+
+		item = QInputDialog::getItem(this, "Compare Data streams",
+					     label, streams, current, false,
+					     &ok);
+
+		return ok ? streamIds[streams.indexOf(item)] : -1;
+	};
+
+	sdBase = lamGetStream("Baseline:", 0);
+	if (sdBase < 0)
+		return;
+
+	sdTest = lamGetStream("Compare with:", 1);
+	if (sdTest < 0 || sdTest == sdBase)
+		return;
+
+	diff = nullptr;
+	if (kshark_diff_matrix_from_entries(sdBase, _data.rows(), _data.size(),
+					    &base)) {
+		if (kshark_diff_matrix_from_entries(sdTest, _data.rows(),
+						    _data.size(), &test)) {
+			diff = kshark_trace_diff(kshark_ctx, sdBase, &base,
+						 sdTest, &test);
+			kshark_diff_free_matrix(&test);
+		}
+
+		kshark_diff_free_matrix(&base);
+	}
+
+	if (!diff)
+		return;
+
+	text = "Top regressions (normalized to the duration of the traces)\n\n";
+	text += diffReport(diff, diff->tasks, diff->n_tasks,
+			   KS_DIFF_RUN_TIME, 1e-6, "Run time [ms / s]");
+	text += diffReport(diff, diff->tasks, diff->n_tasks,
+			   KS_DIFF_LATENCY_P99, 1e-3,
+			   "Wakeup latency, 99th percentile [us]");
+	text += diffReport(diff, diff->tasks, diff->n_tasks,
+			   KS_DIFF_LATENCY_P50, 1e-3,
+			   "Wakeup latency, median [us]");
+	text += diffReport(diff, diff->tasks, diff->n_tasks,
+			   KS_DIFF_COUNT, 1., "Task entries [1 / s]");
+	text += diffReport(diff, diff->events, diff->n_events,
+			   KS_DIFF_COUNT, 1., "Events [1 / s]");
+
+	kshark_free_trace_diff(diff);
+
+	message = new KsMessageDialog(text);
+	message->setWindowTitle("Compare Data streams");
+	message->show();
+}
+
+void KsMainWindow::_memoryReport()
+{
+	kshark_context *kshark_ctx(nullptr);
+	kshark_memory_report *report;
+	KsMessageDialog *message;
+	QString text;
+
+	if (!kshark_instance(&kshark_ctx))
+		return;
+
+	report = kshark_memory_report(kshark_ctx, _data.rows(), _data.size());
+	if (!report)
+		return;
+
+	auto lamLine = [] (QString name, size_t size) {
+		return QString("   %1 %2 MB\n")
+		       .arg(name, -24)
+		       .arg(size / (double) (1 << 20), 12, 'f', 3);
+	};
+
+	for (int i = 0; i < KS_MEM_N_SUBSYSTEMS; ++i) {
+		auto sub = static_cast<kshark_memory_subsystem>(i);
+
+		text += lamLine(kshark_memory_subsystem_name(sub),
+				report->subsystem[i]);
+	}
+
+	if (report->spilled)
+		text += lamLine("(spilled entries)", report->spilled);
+
+	text += lamLine("Total", report->total);
+
+	text += "\nData streams\n";
+	for (auto const &sd: KsUtils::getStreamIdList())
+		text += lamLine(QString("%1: ").arg(sd) +
+				KsUtils::streamDescription(kshark_ctx->stream[sd]),
+				report->stream[sd]);
+
+	if (report->n_plugins)
+		text += "\nPlugins\n";
+
+	for (int i = 0; i < report->n_plugins; ++i)
+		text += lamLine(QString("%1: %2")
+				.arg(report->plugins[i].stream_id)
+				.arg(report->plugins[i].name),
+				report->plugins[i].size);
+
+	kshark_free_memory_report(report);
+
+	message = new KsMessageDialog(text);
+	message->setWindowTitle("Memory usage");
+	message->show();
+}
+
 void KsMainWindow::_setGraphColorPhase(int f)
 {
 	KsPlot::Color::setRainbowFrequency(f / 100.);
@@ -1239,7 +1418,11 @@ void KsMainWindow::_bugReport()
 void KsMainWindow::_load(const QString& fileName, bool append)
 {
 	QString pbLabel("Loading    ");
+	bool previewReady(false), previewShown(false);
+	std::condition_variable previewCond;
 	bool loadDone = false;
+	std::mutex previewMutex;
+	KsDataStore preview;
 	struct stat st;
 	double shift;
 	int ret, sd;
@@ -1280,6 +1463,22 @@ void KsMainWindow::_load(const QString& fileName, bool append)
 	_view.reset();
 	_graph.reset();
 
+	/*
+	 * Called by the loading thread, once the file is open. The sampled
+	 * (preview) data is handed to the GUI thread and the full load waits
+	 * until the preview is shown. From this point on, the GUI thread only
+	 * plots the preview data. The only data of the streams it reads are
+	 * the names of the tasks, which are protected by a lock.
+	 */
+	auto lamPreview = [&] () {
+		if (preview.loadPreview(KS_PREVIEW_MAX_PAGES) <= 0)
+			return;
+
+		std::unique_lock<std::mutex> lk(previewMutex);
+		previewReady = true;
+		previewCond.wait(lk, [&] {return previewShown;});
+	};
+
 	auto lamLoadJob = [&, this] () {
 		QVector<kshark_dpi *> v;
 		for (auto const p: _plugins.getUserDataPlugins()) {
@@ -1287,10 +1486,27 @@ void KsMainWindow::_load(const QString& fileName, bool append)
 				v.append(p->process_interface);
 		}
 
-		sd = _data.loadDataFile(fileName, v);
+		/* Preview only the big files. */
+		if (st.st_size > KS_PREVIEW_MIN_FILE_SIZE)
+			sd = _data.loadDataFile(fileName, v, lamPreview);
+		else
+			sd = _data.loadDataFile(fileName, v);
+
 		loadDone = true;
 	};
 
+	auto lamShowPreview = [&, this] () {
+		std::lock_guard<std::mutex> lk(previewMutex);
+
+		if (!previewReady || previewShown)
+			return;
+
+		_graph.glPtr()->setPreview(true);
+		_graph.loadData(&preview);
+		previewShown = true;
+		previewCond.notify_one();
+	};
+
 	auto lamAppendJob = [&, this] () {
 		sd = _data.appendDataFile(fileName, shift);
 		loadDone = true;
@@ -1303,20 +1519,28 @@ void KsMainWindow::_load(const QString& fileName, bool append)
 		job = std::thread(lamLoadJob);
 	}
 
-	for (int i = 0; i < 160; ++i) {
+	for (int i = 0; !loadDone; ++i) {
+		lamShowPreview();
+
 		/*
 		 * TODO: The way this progress bar gets updated here is a pure
 		 * cheat. See if this can be implemented better.
+		 * The events are processed often, so that the preview can be
+		 * navigated while the data is loading.
 		*/
-		if (loadDone)
-			break;
-
-		pb.setValue(i);
-		usleep(150000);
+		pb.setValue(std::min(i / 10, 160));
+		usleep(15000);
 	}
 
 	job.join();
 
+	if (previewShown) {
+		/* Swap in the exact data. */
+		_graph.reset();
+		_graph.glPtr()->setPreview(false);
+		preview.clear();
+	}
+
 	if (sd < 0 || !_data.size()) {
 		QString text("File ");
 
@@ -89,6 +89,10 @@ public:
 
 	KsTraceViewer *viewPtr() {return &_view;}
 
+	KsDualMarkerSM *markersPtr() {return &_mState;}
+
+	KsDataStore *dataPtr() {return &_data;}
+
 	KsWidgetsLib::KsWorkInProgress *getWipPtr() {return &_workInProgress;}
 
 	void markEntry(const kshark_entry *e, DualMarkerState st);
@@ -166,6 +170,10 @@ private:
 
 	QAction		_addOffcetAction;
 
+	QAction		_compareStreamsAction;
+
+	QAction		_memoryReportAction;
+
 	QWidgetAction	_colorAction;
 
 	QWidget		_colSlider;
@@ -248,6 +256,10 @@ private:
 
 	void _offset();
 
+	void _compareStreams();
+
+	void _memoryReport();
+
 	void _setGraphColorPhase(int);
 
 	void _changeScreenMode();
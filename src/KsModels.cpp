@@ -482,7 +482,8 @@ size_t KsViewModel::search(int column,
 
 /** Create a default (empty) KsFilterProxyModel object. */
 KsGraphModel::KsGraphModel(QObject *parent)
-: QAbstractTableModel(parent)
+: QAbstractTableModel(parent),
+  _generation(0)
 {
 	ksmodel_init(&_histo);
 }
@@ -507,6 +508,9 @@ void KsGraphModel::fill(kshark_entry **entries, size_t n)
 
 	beginResetModel();
 
+	/* The data may have changed. The cached states are no longer valid. */
+	_clearCache();
+
 	if (_histo.n_bins == 0)
 		ksmodel_set_bining(&_histo,
 				   KS_DEFAULT_NBUNS,
@@ -588,16 +592,9 @@ void KsGraphModel::zoomIn(double r, int mark)
 /** Quick zoom out. The entire data-set will be visualized. */
 void KsGraphModel::quickZoomOut()
 {
-	beginResetModel();
-
-	ksmodel_set_bining(&_histo,
-			   _histo.n_bins,
-			   _histo.data[0]->ts,
-			   _histo.data[_histo.data_size - 1]->ts);
-
-	ksmodel_fill(&_histo, _histo.data, _histo.data_size);
-
-	endResetModel();
+	setBining(_histo.n_bins,
+		  _histo.data[0]->ts,
+		  _histo.data[_histo.data_size - 1]->ts);
 }
 
 /**
@@ -620,6 +617,7 @@ void KsGraphModel::quickZoomIn(uint64_t binSize)
 void KsGraphModel::reset()
 {
 	beginResetModel();
+	_clearCache();
 	ksmodel_clear(&_histo);
 	endResetModel();
 }
@@ -628,7 +626,114 @@ void KsGraphModel::reset()
 void KsGraphModel::update(KsDataStore *data)
 {
 	beginResetModel();
+	_clearCache();
 	if (data)
 		ksmodel_fill(&_histo, data->rows(), data->size());
 	endResetModel();
 }
+
+/**
+ * @brief Change the time-window (and the number of bins) of the model. If
+ *	  the requested state of the model has been visited recently, it is
+ *	  restored from the cache, otherwise the model gets recalculated.
+ *
+ * @param n: Number of bins.
+ * @param min: Lower edge of the time-window to be visualized.
+ * @param max: Upper edge of the time-window to be visualized.
+ */
+void KsGraphModel::setBining(size_t n, uint64_t min, uint64_t max)
+{
+	beginResetModel();
+
+	/*
+	 * Setting the bining is cheap. It gives us the actual (adjusted)
+	 * time-window, which is needed in order to search in the cache.
+	 */
+	ksmodel_set_bining(&_histo, n, min, max);
+	if (!_restoreState() && _histo.data_size) {
+		ksmodel_fill(&_histo, _histo.data, _histo.data_size);
+		cacheState();
+	}
+
+	endResetModel();
+}
+
+/**
+ * Add the current state of the model to the cache. If the cache is full, the
+ * least recently used state gets dropped.
+ */
+void KsGraphModel::cacheState()
+{
+	KsGraphModelState state;
+	int nBins = _histo.n_bins + 2;
+
+	if (!_histo.n_bins || !_histo.data_size)
+		return;
+
+	for (int i = 0; i < _cache.count(); ++i)
+		if (_cache[i]._min == _histo.min &&
+		    _cache[i]._max == _histo.max &&
+		    _cache[i]._nBins == _histo.n_bins) {
+			_cache.move(i, 0);
+			return;
+		}
+
+	state._min = _histo.min;
+	state._max = _histo.max;
+	state._binSize = _histo.bin_size;
+	state._nBins = _histo.n_bins;
+	state._totCount = _histo.tot_count;
+	state._map = QVector<ssize_t>(_histo.map, _histo.map + nBins);
+	state._binCount = QVector<size_t>(_histo.bin_count,
+					  _histo.bin_count + nBins);
+
+	_cache.prepend(state);
+	while (_cache.count() > KS_MODEL_CACHE_SIZE)
+		_cache.removeLast();
+}
+
+/**
+ * @brief Check if a given state of the model is available in the cache.
+ *
+ * @param min: Lower edge of the time-window.
+ * @param max: Upper edge of the time-window.
+ * @param nBins: Number of bins.
+ */
+bool KsGraphModel::isCached(int64_t min, int64_t max, int nBins) const
+{
+	for (auto const &s: _cache)
+		if (s._min == min && s._max == max && s._nBins == nBins)
+			return true;
+
+	return false;
+}
+
+bool KsGraphModel::_restoreState()
+{
+	for (int i = 0; i < _cache.count(); ++i) {
+		const KsGraphModelState &s = _cache[i];
+
+		if (s._min != _histo.min ||
+		    s._max != _histo.max ||
+		    s._nBins != _histo.n_bins)
+			continue;
+
+		std::copy(s._map.begin(), s._map.end(), _histo.map);
+		std::copy(s._binCount.begin(), s._binCount.end(),
+			  _histo.bin_count);
+
+		_histo.bin_size = s._binSize;
+		_histo.tot_count = s._totCount;
+
+		_cache.move(i, 0);
+		return true;
+	}
+
+	return false;
+}
+
+void KsGraphModel::_clearCache()
+{
+	_cache.clear();
+	++_generation;
+}
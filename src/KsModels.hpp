@@ -243,6 +243,36 @@ private:
 		       bool notify);
 };
 
+/** A state of the Visualization model, kept in the cache of the model. */
+struct KsGraphModelState {
+	/** Lower edge of the time-window. */
+	int64_t			_min;
+
+	/** Upper edge of the time-window. */
+	int64_t			_max;
+
+	/** The size in time for each bin. */
+	uint64_t		_binSize;
+
+	/** Number of bins. */
+	int			_nBins;
+
+	/** Total number of entries in all bin except the overflow bins. */
+	int			_totCount;
+
+	/** The first entry in each bin (including the overflow bins). */
+	QVector<ssize_t>	_map;
+
+	/** Number of entries in each bin (including the overflow bins). */
+	QVector<size_t>		_binCount;
+};
+
+/**
+ * The maximum number of states of the Visualization model (and the graphs
+ * filled for these states) kept in cache.
+ */
+#define KS_MODEL_CACHE_SIZE	16
+
 /**
  * Class KsGraphModel provides a model for visualization of trace data. This
  * class is a wrapper of kshark_trace_histo and is needed only because we want
@@ -302,8 +332,30 @@ public:
 
 	void update(KsDataStore *data = nullptr);
 
+	void setBining(size_t n, uint64_t min, uint64_t max);
+
+	void cacheState();
+
+	bool isCached(int64_t min, int64_t max, int nBins) const;
+
+	/**
+	 * Get the generation of the data of the model. The generation changes
+	 * every time when the data (or its visibility) changes and all cached
+	 * states of the model become invalid.
+	 */
+	unsigned int generation() const {return _generation;}
+
 private:
 	kshark_trace_histo	_histo;
+
+	/** Recently used states of the model. The most recent comes first. */
+	QList<KsGraphModelState>	_cache;
+
+	unsigned int		_generation;
+
+	bool _restoreState();
+
+	void _clearCache();
 };
 
 /** Defines a default number of bins to be used by the visualization model. */
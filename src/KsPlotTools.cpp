@@ -760,6 +760,7 @@ void Bin::drawVal(float size)
 Graph::Graph()
 : _histoPtr(nullptr),
   _bins(nullptr),
+  _pick(nullptr),
   _size(0),
   _labelSize(30),
   _collectionPtr(nullptr),
@@ -781,6 +782,7 @@ Graph::Graph()
 Graph::Graph(kshark_trace_histo *histo, KsPlot::ColorTable *bct, KsPlot::ColorTable *ect)
 : _histoPtr(histo),
   _bins(new(std::nothrow) Bin[histo->n_bins]),
+  _pick(new(std::nothrow) BinPick[histo->n_bins]),
   _size(histo->n_bins),
   _hMargin(30),
   _labelSize(0),
@@ -793,7 +795,7 @@ Graph::Graph(kshark_trace_histo *histo, KsPlot::ColorTable *bct, KsPlot::ColorTa
   _idlePid(-1),
   _drawBase(true)
 {
-	if (!_bins) {
+	if (!_bins || !_pick) {
 		_size = 0;
 		fprintf(stderr, "Failed to allocate memory graph's bins.\n");
 	}
@@ -807,6 +809,7 @@ Graph::Graph(kshark_trace_histo *histo, KsPlot::ColorTable *bct, KsPlot::ColorTa
 Graph::~Graph()
 {
 	delete[] _bins;
+	delete[] _pick;
 }
 
 int Graph::_bin0Offset()
@@ -821,6 +824,9 @@ void Graph::_initBins()
 		_bins[i]._base.setY(0);
 		_bins[i]._val.setX(_bins[i]._base.x());
 		_bins[i]._val.setY(_bins[i]._base.y());
+
+		_pick[i]._first = _pick[i]._last = KS_EMPTY_BIN;
+		_pick[i]._lastId = _pick[i]._nextCpu = KS_EMPTY_BIN;
 	}
 }
 
@@ -833,9 +839,11 @@ void Graph::setModelPtr(kshark_trace_histo *histo)
 {
 	if (_size != histo->n_bins) {
 		delete[] _bins;
+		delete[] _pick;
 		_size = histo->n_bins;
 		_bins = new(std::nothrow) Bin[_size];
-		if (!_bins) {
+		_pick = new(std::nothrow) BinPick[_size];
+		if (!_bins || !_pick) {
 			_size = 0;
 			fprintf(stderr,
 				"Failed to allocate memory graph's bins.\n");
@@ -985,12 +993,29 @@ void Graph::setBin(int bin, int pidF, int pidB, const Color &col, uint8_t m)
 void Graph::fillCPUGraph(int sd, int cpu)
 {
 	struct kshark_entry *eFront;
-	int pidFront(0), pidBack(0);
+	int pidFront(0), pidBack(0), lastPid(KS_EMPTY_BIN);
 	int pidBackNoFilter;
+	ssize_t index, first, last;
 	uint8_t visMask;
-	ssize_t index;
 	int bin;
 
+	auto lamSetPick = [&] (int bin)
+	{
+		if (first >= 0 &&
+		    !(_histoPtr->data[first]->visible & KS_GRAPH_VIEW_FILTER_MASK)) {
+			/*
+			 * The first visible event is not visible in the graph.
+			 * Search the bin the slow way.
+			 */
+			first = ksmodel_first_index_at_cpu(_histoPtr, bin,
+							   sd, cpu);
+		}
+
+		_pick[bin]._first = first;
+		_pick[bin]._last = last;
+		_pick[bin]._lastId = lastPid;
+	};
+
 	auto lamGetPid = [&] (int bin)
 	{
 		eFront = nullptr;
@@ -1010,7 +1035,7 @@ void Graph::fillCPUGraph(int sd, int cpu)
 							  cpu,
 							  true,
 							  _collectionPtr,
-							  nullptr);
+							  &last);
 
 		pidBackNoFilter =
 			ksmodel_get_pid_back(_histoPtr, bin,
@@ -1023,16 +1048,55 @@ void Graph::fillCPUGraph(int sd, int cpu)
 		if (pidBack != pidBackNoFilter)
 			pidBack = KS_FILTERED_BIN;
 
+		first = (pidBackNoFilter == KS_EMPTY_BIN) ?
+			KS_EMPTY_BIN : KS_FILTERED_BIN;
+
 		visMask = 0x0;
 		if (ksmodel_cpu_visible_event_exist(_histoPtr, bin,
 							       sd,
 							       cpu,
 							       _collectionPtr,
-							       &index))
-
+							       &index)) {
 			visMask = _histoPtr->data[index]->visible;
-		else if (eFront)
+			first = index;
+		} else if (eFront) {
 			visMask = eFront->visible;
+		}
+
+		if (pidBackNoFilter >= 0)
+			lastPid = pidBackNoFilter;
+
+		lamSetPick(bin);
+	};
+
+	auto lamGetPidLOB = [&] (bool visOnly)
+	{
+		const struct kshark_entry *e;
+
+		if (!_collectionPtr)
+			return ksmodel_get_pid_back(_histoPtr,
+						    LOWER_OVERFLOW_BIN,
+						    sd,
+						    cpu,
+						    visOnly,
+						    nullptr,
+						    nullptr);
+
+		/*
+		 * Search for the entries of the collection. This way the
+		 * search uses the states of the collection and its cost does
+		 * not depend on how far back in time the last entry is.
+		 */
+		e = ksmodel_get_entry_back(_histoPtr,
+					   LOWER_OVERFLOW_BIN,
+					   visOnly,
+					   _collectionPtr->cond,
+					   sd,
+					   _collectionPtr->values,
+					   _collectionPtr,
+					   nullptr);
+
+		return e ? e->pid : KS_EMPTY_BIN;
 	};
 
 	auto lamSetBin = [&] (int bin)
@@ -1065,22 +1129,10 @@ void Graph::fillCPUGraph(int sd, int cpu)
 		 * Overflow Bin to retrieve the Process Id (if any). First
 		 * get the Pid back, ignoring the filters.
 		 */
-		pidBackNoFilter = ksmodel_get_pid_back(_histoPtr,
-						       LOWER_OVERFLOW_BIN,
-						       sd,
-						       cpu,
-						       false,
-						       _collectionPtr,
-						       nullptr);
+		pidBackNoFilter = lamGetPidLOB(false);
 
 		/* Now get the Pid back, applying filters. */
-		pidBack = ksmodel_get_pid_back(_histoPtr,
-					       LOWER_OVERFLOW_BIN,
-					       sd,
-					       cpu,
-					       true,
-					       _collectionPtr,
-					       nullptr);
+		pidBack = lamGetPidLOB(true);
 
 		if (pidBack != pidBackNoFilter) {
 			/* The Lower Overflow Bin ends with filtered data. */
@@ -1092,6 +1144,10 @@ void Graph::fillCPUGraph(int sd, int cpu)
 			 */
 			setBinPid(bin, pidBack, pidBack);
 		}
+
+		/* Retrieve the last known task from the Lower Overflow Bin. */
+		if (lastPid < 0)
+			_pick[bin]._lastId = lastPid = pidBackNoFilter;
 	}
 
 	/*
@@ -1117,8 +1173,46 @@ void Graph::fillCPUGraph(int sd, int cpu)
 void Graph::fillTaskGraph(int sd, int pid)
 {
 	int cpuFront, cpuBack(0), pidFront(0), pidBack(0), lastCpu(-1), bin(0);
+	int pickCpu(KS_EMPTY_BIN);
+	ssize_t index, first, last;
 	uint8_t visMask;
-	ssize_t index;
+
+	auto lamSetPick = [&] (int bin)
+	{
+		if (cpuFront < 0) {
+			first = last = KS_EMPTY_BIN;
+		} else {
+			if (first >= 0 &&
+			    !(_histoPtr->data[first]->visible &
+			      KS_GRAPH_VIEW_FILTER_MASK)) {
+				/*
+				 * The first visible event is not visible in
+				 * the graph. Search the bin the slow way.
+				 */
+				first = ksmodel_first_index_at_pid(_histoPtr,
+								   bin,
+								   sd,
+								   pid);
+			}
+
+			ksmodel_get_cpu_back(_histoPtr, bin, sd, pid,
+					     true, _collectionPtr, &last);
+
+			pickCpu = cpuBack;
+		}
+
+		_pick[bin]._first = first;
+		_pick[bin]._last = last;
+		_pick[bin]._lastId = pickCpu;
+
+		/*
+		 * For the moment store the CPU at the front edge of the bin.
+		 * The next CPU used by the task gets propagated backwards,
+		 * once all bins are processed.
+		 */
+		_pick[bin]._nextCpu = cpuFront;
+	};
+
 	auto lamSetBin = [&] (int bin)
 	{
 		if (cpuFront >= 0) {
@@ -1229,6 +1323,7 @@ void Graph::fillTaskGraph(int sd, int pid)
 						       nullptr);
 
 			visMask = 0x0;
+			first = KS_FILTERED_BIN;
 			if (ksmodel_task_visible_event_exist(_histoPtr,
 							     bin,
 							     sd,
@@ -1236,8 +1331,11 @@ void Graph::fillTaskGraph(int sd, int pid)
 							     _collectionPtr,
 							     &index)) {
 				visMask = _histoPtr->data[index]->visible;
+				first = index;
 			}
 		}
+
+		lamSetPick(bin);
 	};
 
 	/*
@@ -1294,6 +1392,10 @@ void Graph::fillTaskGraph(int sd, int pid)
 				setBinPid(bin, KS_EMPTY_BIN, KS_EMPTY_BIN);
 			}
 		}
+
+		/* Retrieve the last known CPU from the Lower Overflow Bin. */
+		if (pickCpu < 0)
+			_pick[bin]._lastId = pickCpu = cpuFront;
 	}
 
 	/*
@@ -1306,6 +1408,11 @@ void Graph::fillTaskGraph(int sd, int pid)
 		/* Set the bin accordingly. */
 		lamSetBin(bin);
 	}
+
+	/* Propagate the next CPU used by the task backwards. */
+	for (bin = _histoPtr->n_bins - 2; bin >= 0; --bin)
+		if (_pick[bin]._nextCpu < 0)
+			_pick[bin]._nextCpu = _pick[bin + 1]._nextCpu;
 }
 
 /**
@@ -536,6 +536,39 @@ private:
 	void _draw(const Color &col, float size = 1.) const override;
 };
 
+/**
+ * The picking information of a Graph's bin. It is collected while the Graph
+ * is being filled and allows the entry under the mouse to be resolved without
+ * searching inside the Vis. model.
+ */
+struct BinPick {
+	/**
+	 * The index of the first visible entry from the CPU (or Task) of the
+	 * Graph in this bin. KS_EMPTY_BIN or KS_FILTERED_BIN if such entry
+	 * does not exist.
+	 */
+	ssize_t	_first;
+
+	/**
+	 * The index of the last entry from the CPU (or Task) of the Graph in
+	 * this bin, which is visible in the graph. KS_EMPTY_BIN or
+	 * KS_FILTERED_BIN if such entry does not exist.
+	 */
+	ssize_t	_last;
+
+	/**
+	 * The last known Id value (pid for CPU graphs and cpu for Task graphs)
+	 * at the back edge of this bin. The filters are ignored.
+	 */
+	int	_lastId;
+
+	/**
+	 * The next CPU used by the Task, found in this bin or in any of the
+	 * following bins (Task graphs only). The filters are ignored.
+	 */
+	int	_nextCpu;
+};
+
 /** This class represents a KernelShark graph. */
 class Graph {
 public:
@@ -605,6 +638,15 @@ public:
 	/** @brief Get a particular bin. */
 	const Bin &getBin(int bin) const {return _bins[bin];}
 
+	/**
+	 * @brief Get the picking information of a particular bin. Returns
+	 *	  nullptr if the bin is outside of the Graph.
+	 */
+	const BinPick *getPick(int bin) const
+	{
+		return (_pick && bin >= 0 && bin < _size) ? &_pick[bin] : nullptr;
+	}
+
 	/** Set the text of the graph's label. */
 	void setLabelText(std::string text) {_label.setText(text);}
 
@@ -631,6 +673,9 @@ protected:
 	/** An array of Bins. */
 	Bin			*_bins;
 
+	/** An array of picking information records (one per Bin). */
+	BinPick			*_pick;
+
 	/** The number of Bins. */
 	int			_size;
 
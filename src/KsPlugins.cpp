@@ -337,3 +337,68 @@ void eventFieldIntervalPlot(KsCppArgV *argvCpp,
 			  << exc.what() << std::endl;
 	}
 }
+
+static int intervalBin(kshark_trace_histo *histo, int64_t ts)
+{
+	if (ts <= histo->min)
+		return 0;
+
+	if (ts >= histo->max)
+		return histo->n_bins - 1;
+
+	return (ts - histo->min) / histo->bin_size;
+}
+
+static void intervalSetPlotRange(KsCppArgV *argvCpp,
+				 const kshark_interval_set *set,
+				 IsIntervalApplicableFunc isApplicable,
+				 pluginShapeFunc makeShape,
+				 Color col,
+				 float size)
+{
+	kshark_trace_histo *histo = argvCpp->_histo;
+	int binStart, binEnd;
+	ssize_t first;
+
+	/*
+	 * The intervals are sorted by their start. An interval, which is
+	 * visible, can not start earlier than the longest interval.
+	 */
+	first = kshark_find_interval_by_time(set,
+					     histo->min - set->max_duration);
+
+	for (size_t i = first; i < set->n_intervals; ++i) {
+		if (set->start[i] > histo->max)
+			break;
+
+		if (set->end[i] < histo->min || !isApplicable(set, i))
+			continue;
+
+		binStart = intervalBin(histo, set->start[i]);
+		binEnd = intervalBin(histo, set->end[i]);
+		if (binEnd - binStart >= PLUGIN_MIN_BOX_SIZE)
+			argvCpp->_shapes->push_front(makeShape({argvCpp->_graph},
+							       {binStart, binEnd},
+							       {set->duration[i]},
+							       col, size));
+	}
+}
+
+void intervalSetPlot(KsCppArgV *argvCpp,
+		     const kshark_interval_set *set,
+		     IsIntervalApplicableFunc isApplicable,
+		     pluginShapeFunc makeShape,
+		     Color col,
+		     float size)
+{
+	if (!set || set->n_intervals == 0)
+		return;
+
+	try {
+		intervalSetPlotRange(argvCpp, set, isApplicable,
+				     makeShape, col, size);
+	} catch (const std::exception &exc) {
+		std::cerr << "Exception in intervalSetPlot\n"
+			  << exc.what() << std::endl;
+	}
+}
@@ -20,6 +20,7 @@
 // KernelShark
 #include "libkshark-plugin.h"
 #include "libkshark-model.h"
+#include "libkshark-intervals.h"
 #include "KsPlotTools.hpp"
 
 class KsMainWindow;
@@ -64,6 +65,9 @@ typedef std::function<KsPlot::PlotObject *(std::vector<const KsPlot::Graph *> gr
 
 typedef std::function<bool(kshark_data_container *, ssize_t)> IsApplicableFunc;
 
+typedef std::function<bool(const kshark_interval_set *, size_t)>
+IsIntervalApplicableFunc;
+
 void eventPlot(KsCppArgV *argvCpp, IsApplicableFunc isApplicable,
 	       pluginShapeFunc makeShape, KsPlot::Color col, float size);
 
@@ -90,4 +94,11 @@ void eventFieldIntervalPlot(KsCppArgV *argvCpp,
 			    KsPlot::Color col,
 			    float size);
 
+void intervalSetPlot(KsCppArgV *argvCpp,
+		     const kshark_interval_set *set,
+		     IsIntervalApplicableFunc isApplicable,
+		     pluginShapeFunc makeShape,
+		     KsPlot::Color col,
+		     float size);
+
 #endif
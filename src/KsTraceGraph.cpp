@@ -17,6 +17,189 @@
 
 using namespace KsWidgetsLib;
 
+/** Create a default (empty) Overview widget. */
+KsGraphOverview::KsGraphOverview(QWidget *parent)
+: QWidget(parent),
+  _summary(nullptr),
+  _histo(nullptr)
+{
+	setFixedHeight(FONT_HEIGHT * 4);
+	setToolTip("Overview of the entire trace. Click to jump.");
+}
+
+/** Destroy the Overview widget. */
+KsGraphOverview::~KsGraphOverview()
+{
+	ksmodel_summary_free(_summary);
+}
+
+/**
+ * @brief Compute the summary of the entire trace. This is done only once,
+ *	  after loading the data.
+ *
+ * @param data: Input location for the KsDataStore object.
+ * @param histo: Input location for the model descriptor. Used to show the
+ *		 currently visualized time-window.
+ */
+void KsGraphOverview::loadData(KsDataStore *data, kshark_trace_histo *histo)
+{
+	kshark_context *kshark_ctx(nullptr);
+
+	reset();
+	if (!kshark_instance(&kshark_ctx) || !data || !data->size())
+		return;
+
+	_summary = ksmodel_summary_alloc(kshark_ctx, data->rows(),
+					 data->size());
+	_histo = histo;
+	_makeImage();
+	update();
+}
+
+/** Reset (empty) the widget. */
+void KsGraphOverview::reset()
+{
+	ksmodel_summary_free(_summary);
+	_summary = nullptr;
+	_histo = nullptr;
+	_image = QImage();
+	update();
+}
+
+void KsGraphOverview::_makeImage()
+{
+	kshark_context *kshark_ctx(nullptr);
+	kshark_data_stream *stream;
+	int w(width()), h(height());
+	int hDensity, row, *streamIds;
+	QVector<int> first(w), last(w);
+	size_t count, maxCount(0);
+	double util;
+
+	if (!_summary || w <= 0 || h <= 0 || !kshark_instance(&kshark_ctx))
+		return;
+
+	_image = QImage(w, h, QImage::Format_RGB32);
+	_image.fill(Qt::white);
+
+	/* One pixel may contain multiple buckets of the summary. */
+	for (int x = 0; x < w; ++x) {
+		first[x] = x * KS_SUMMARY_N_BUCKETS / w;
+		last[x] = (x + 1) * KS_SUMMARY_N_BUCKETS / w - 1;
+		if (last[x] < first[x])
+			last[x] = first[x];
+
+		count = ksmodel_summary_count(_summary, first[x], last[x]);
+		if (count > maxCount)
+			maxCount = count;
+	}
+
+	/* The upper part shows the density of the events. */
+	hDensity = h / 3;
+	for (int x = 0; maxCount && x < w; ++x) {
+		count = ksmodel_summary_count(_summary, first[x], last[x]);
+		for (int y = hDensity * (1. - (double) count / maxCount);
+		     y < hDensity; ++y)
+			_image.setPixel(x, y, qRgb(80, 80, 80));
+	}
+
+	if (!_summary->n_cpus)
+		return;
+
+	/*
+	 * The lower part shows the utilization of the CPUs. One row per CPU,
+	 * the darker the color, the busier the CPU.
+	 */
+	row = 0;
+	streamIds = kshark_all_streams(kshark_ctx);
+	for (int i = 0; i < kshark_ctx->n_streams; ++i) {
+		stream = kshark_get_data_stream(kshark_ctx, streamIds[i]);
+		if (!stream)
+			continue;
+
+		for (int cpu = 0; cpu < stream->n_cpus; ++cpu, ++row) {
+			int yMin = hDensity + 1 +
+				   row * (h - hDensity - 1) / _summary->n_cpus;
+			int yMax = hDensity + 1 +
+				   (row + 1) * (h - hDensity - 1) / _summary->n_cpus;
+
+			for (int x = 0; x < w; ++x) {
+				util = ksmodel_summary_cpu_util(_summary,
+								streamIds[i],
+								cpu,
+								first[x],
+								last[x]);
+				if (util > 1.)
+					util = 1.;
+
+				for (int y = yMin; y < yMax; ++y)
+					_image.setPixel(x, y,
+							qRgb(255,
+							     255 * (1. - util),
+							     255 * (1. - util)));
+			}
+		}
+	}
+
+	free(streamIds);
+}
+
+/**
+ * Reimplemented event handler used to draw the overview and the currently
+ * visualized time-window.
+ */
+void KsGraphOverview::paintEvent(QPaintEvent *event)
+{
+	QPainter painter(this);
+	int64_t range;
+	int x0, x1;
+
+	if (!_summary || _image.isNull())
+		return;
+
+	painter.drawImage(0, 0, _image);
+
+	range = _summary->max - _summary->min;
+	if (!_histo || !_histo->n_bins || range <= 0)
+		return;
+
+	x0 = (double) (_histo->min - _summary->min) * width() / range;
+	x1 = (double) (_histo->max - _summary->min) * width() / range;
+	if (x1 - x0 < 2)
+		x1 = x0 + 2;
+
+	painter.setPen(Qt::blue);
+	painter.fillRect(x0, 0, x1 - x0, height(), QColor(0, 0, 255, 40));
+	painter.drawRect(x0, 0, x1 - x0 - 1, height() - 1);
+}
+
+/**
+ * Reimplemented event handler used to redraw the overview when the widget
+ * has been resized.
+ */
+void KsGraphOverview::resizeEvent(QResizeEvent *event)
+{
+	_makeImage();
+}
+
+/**
+ * Reimplemented event handler used to jump to the position of the mouse
+ * click.
+ */
+void KsGraphOverview::mousePressEvent(QMouseEvent *event)
+{
+	uint64_t ts;
+
+	if (!_summary || event->button() != Qt::LeftButton || width() <= 0)
+		return;
+
+	ts = _summary->min +
+	     (double) event->pos().x() * (_summary->max - _summary->min) /
+	     width();
+
+	emit jumpTo(ts);
+}
+
 /** Create a default (empty) Trace graph widget. */
 KsTraceGraph::KsTraceGraph(QWidget *parent)
 : KsWidgetsLib::KsDataWidget(parent),
@@ -35,11 +218,13 @@ KsTraceGraph::KsTraceGraph(QWidget *parent)
   _labelI3("", this),
   _labelI4("", this),
   _labelI5("", this),
+  _overview(this),
   _scrollArea(this),
   _glWindow(&_scrollArea),
   _mState(nullptr),
   _data(nullptr),
-  _keyPressed(false)
+  _keyPressed(false),
+  _historyPos(-1)
 {
 	auto lamMakeNavButton = [&](QPushButton *b) {
 		b->setMaximumWidth(FONT_WIDTH * 5);
@@ -106,6 +291,25 @@ KsTraceGraph::KsTraceGraph(QWidget *parent)
 	connect(&_glWindow,	&KsGLWidget::stopUpdating,
 		this,		&KsTraceGraph::_stopUpdating);
 
+	connect(&_glWindow,	&KsGLWidget::rangeSelected,
+		this,		&KsTraceGraph::_historyAppend);
+
+	connect(&_glWindow,	&KsGLWidget::historyBack,
+		this,		&KsTraceGraph::historyBack);
+
+	connect(&_glWindow,	&KsGLWidget::historyForward,
+		this,		&KsTraceGraph::historyForward);
+
+	connect(&_overview,	&KsGraphOverview::jumpTo,
+		this,		&KsTraceGraph::_jumpTo);
+
+	/*
+	 * Using the old Signal-Slot syntax because QWidget::update has
+	 * overloads.
+	 */
+	connect(_glWindow.model(), SIGNAL(modelReset()),
+		&_overview, SLOT(update()));
+
 	_glWindow.setContextMenuPolicy(Qt::CustomContextMenu);
 	connect(&_glWindow,	&QWidget::customContextMenuRequested,
 		this,		&KsTraceGraph::_onCustomContextMenu);
@@ -141,6 +345,7 @@ KsTraceGraph::KsTraceGraph(QWidget *parent)
 
 	_layout.addWidget(&_pointerBar);
 	_layout.addWidget(&_navigationBar);
+	_layout.addWidget(&_overview);
 	_layout.addWidget(&_scrollArea);
 	this->setLayout(&_layout);
 	updateGeom();
@@ -156,7 +361,11 @@ void KsTraceGraph::loadData(KsDataStore *data)
 {
 	_data = data;
 	_glWindow.loadData(data);
+	_overview.loadData(data, _glWindow.model()->histo());
 	updateGeom();
+
+	_historyClear();
+	_historyAppend();
 }
 
 /** Connect the KsGLWidget widget and the State machine of the Dual marker. */
@@ -173,6 +382,8 @@ void KsTraceGraph::reset()
 {
 	/* Reset (empty) the OpenGL widget. */
 	_glWindow.reset();
+	_overview.reset();
+	_historyClear();
 
 	_labelP2.setText("");
 	for (auto l1: {&_labelI1, &_labelI2, &_labelI3, &_labelI4, &_labelI5})
@@ -194,6 +405,7 @@ void KsTraceGraph::_zoomIn()
 
 	startOfWork(action);
 	_updateGraphs(action);
+	_historyAppend();
 	endOfWork(action);
 }
 
@@ -203,6 +415,7 @@ void KsTraceGraph::_zoomOut()
 
 	startOfWork(action);
 	_updateGraphs(action);
+	_historyAppend();
 	endOfWork(action);
 }
 
@@ -226,6 +439,7 @@ void KsTraceGraph::_quickZoomIn()
 		_glWindow.render();
 	}
 
+	_historyAppend();
 	endOfWork(KsDataWork::QuickZoomIn);
 }
 
@@ -237,15 +451,103 @@ void KsTraceGraph::_quickZoomOut()
 	startOfWork(KsDataWork::QuickZoomOut);
 	_glWindow.model()->quickZoomOut();
 	_glWindow.render();
+	_historyAppend();
 	endOfWork(KsDataWork::QuickZoomOut);
 }
 
+/**
+ * @brief Go back to the previous time-window in the navigation history. The
+ *	  states of the model and the graphs of the recently visited
+ *	  time-windows are cached, hence the navigation is instant.
+ */
+void KsTraceGraph::historyBack()
+{
+	/*
+	 * The current time-window may not be in the history yet (for example
+	 * if it was reached by using the mouse wheel). Add it, so that we can
+	 * come back to it by going forward.
+	 */
+	_historyAppend();
+	if (canGoBack())
+		_historyGoTo(_historyPos - 1);
+}
+
+/** Go forward to the next time-window in the navigation history. */
+void KsTraceGraph::historyForward()
+{
+	if (canGoForward())
+		_historyGoTo(_historyPos + 1);
+}
+
+void KsTraceGraph::_historyAppend()
+{
+	kshark_trace_histo *histo = _glWindow.model()->histo();
+	QPair<int64_t, int64_t> range(histo->min, histo->max);
+
+	if (_glWindow.isEmpty() || !histo->n_bins)
+		return;
+
+	if (_historyPos >= 0 && _history[_historyPos] == range)
+		return;
+
+	/* The "forward" part of the history is no longer reachable. */
+	_history.resize(_historyPos + 1);
+	_history.append(range);
+	if (_history.count() > KS_NAV_HISTORY_SIZE)
+		_history.removeFirst();
+
+	_historyPos = _history.count() - 1;
+
+	/* Keep the state of the model (and the graphs) in cache. */
+	_glWindow.model()->cacheState();
+}
+
+void KsTraceGraph::_historyGoTo(int pos)
+{
+	KsGraphModel *model = _glWindow.model();
+
+	if (_glWindow.isEmpty())
+		return;
+
+	startOfWork(KsDataWork::JumpTo);
+
+	_historyPos = pos;
+	model->setBining(model->histo()->n_bins,
+			 _history[pos].first,
+			 _history[pos].second);
+
+	_mState->updateMarkers(*_data, &_glWindow);
+
+	endOfWork(KsDataWork::JumpTo);
+}
+
+void KsTraceGraph::_historyClear()
+{
+	_history.clear();
+	_historyPos = -1;
+}
+
+void KsTraceGraph::_jumpTo(uint64_t ts)
+{
+	if (_glWindow.isEmpty())
+		return;
+
+	startOfWork(KsDataWork::JumpTo);
+
+	_glWindow.model()->jumpTo(ts);
+	_mState->updateMarkers(*_data, &_glWindow);
+	_historyAppend();
+
+	endOfWork(KsDataWork::JumpTo);
+}
+
 void KsTraceGraph::_scrollLeft()
 {
 	KsDataWork action = KsDataWork::ScrollLeft;
 
 	startOfWork(action);
 	_updateGraphs(action);
+	_historyAppend();
 	endOfWork(action);
 }
 
@@ -255,6 +557,7 @@ void KsTraceGraph::_scrollRight()
 
 	startOfWork(action);
 	_updateGraphs(action);
+	_historyAppend();
 	endOfWork(action);
 }
 
@@ -366,6 +669,7 @@ void KsTraceGraph::markEntry(size_t row)
 				    row, _data->rows()[row]->stream_id);
 
 	_mState->updateMarkers(*_data, &_glWindow);
+	_historyAppend();
 
 	/*
 	 * If a Combo graph has been found, this Combo graph will be visible.
@@ -559,7 +863,8 @@ void KsTraceGraph::updateGeom()
 
 	saHeight = height() - _pointerBar.height() -
 			      _navigationBar.height() -
-			      _layout.spacing() * 2 -
+			      _overview.height() -
+			      _layout.spacing() * 3 -
 			      _layout.contentsMargins().top() -
 			      _layout.contentsMargins().bottom();
 
@@ -580,6 +885,7 @@ void KsTraceGraph::updateGeom()
 	hMin = _glWindow.height() +
 	       _pointerBar.height() +
 	       _navigationBar.height() +
+	       _overview.height() +
 	       _layout.contentsMargins().top() +
 	       _layout.contentsMargins().bottom();
 
@@ -595,7 +901,8 @@ void KsTraceGraph::updateGeom()
 	setMaximumHeight(_glWindow.height() +
 			 _pointerBar.height() +
 			 _navigationBar.height() +
-			 _layout.spacing() * 2 +
+			 _overview.height() +
+			 _layout.spacing() * 3 +
 			 _layout.contentsMargins().top() +
 			 _layout.contentsMargins().bottom() +
 			 2);  /* Just a little bit of extra space. This will
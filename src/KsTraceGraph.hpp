@@ -32,6 +32,50 @@ public:
 	void wheelEvent(QWheelEvent *evt) {evt->ignore();}
 };
 
+/**
+ * The KsGraphOverview class provides a strip, showing the density of the
+ * events and the utilization of the CPUs over the entire trace. The strip is
+ * drawn by using a precomputed summary of the trace, hence it never touches
+ * the array of entries.
+ */
+class KsGraphOverview : public QWidget
+{
+	Q_OBJECT
+public:
+	explicit KsGraphOverview(QWidget *parent = nullptr);
+
+	~KsGraphOverview();
+
+	void loadData(KsDataStore *data, kshark_trace_histo *histo);
+
+	void reset();
+
+	void paintEvent(QPaintEvent *event) override;
+
+	void resizeEvent(QResizeEvent *event) override;
+
+	void mousePressEvent(QMouseEvent *event) override;
+
+signals:
+	/**
+	 * This signal is emitted when the user clicks on the overview. The
+	 * timestamp corresponds to the position of the click.
+	 */
+	void jumpTo(uint64_t ts);
+
+private:
+	kshark_trace_summary	*_summary;
+
+	kshark_trace_histo	*_histo;
+
+	QImage			_image;
+
+	void _makeImage();
+};
+
+/** The maximum number of time-windows kept in the navigation history. */
+#define KS_NAV_HISTORY_SIZE	64
+
 /**
  * The KsTraceViewer class provides a widget for interactive visualization of
  * trace data shown as time-series.
@@ -71,6 +115,19 @@ public:
 
 	void updateGeom();
 
+	void historyBack();
+
+	void historyForward();
+
+	/** Check if there is a previous time-window in the navigation history. */
+	bool canGoBack() const {return _historyPos > 0;}
+
+	/** Check if there is a next time-window in the navigation history. */
+	bool canGoForward() const
+	{
+		return _historyPos < _history.count() - 1;
+	}
+
 	void resizeEvent(QResizeEvent* event) override;
 
 	bool eventFilter(QObject* obj, QEvent* evt) override;
@@ -110,6 +167,14 @@ private:
 
 	void _onCustomContextMenu(const QPoint &point);
 
+	void _historyAppend();
+
+	void _historyGoTo(int pos);
+
+	void _historyClear();
+
+	void _jumpTo(uint64_t ts);
+
 	QToolBar	_pointerBar, _navigationBar;
 
 	QPushButton	_zoomInButton, _quickZoomInButton;
@@ -121,6 +186,8 @@ private:
 	QLabel	_labelP1, _labelP2,				  // Pointer
 		_labelI1, _labelI2, _labelI3, _labelI4, _labelI5; // Proc. info
 
+	KsGraphOverview	_overview;
+
 	KsGraphScrollArea	_scrollArea;
 
 	KsGLWidget	_glWindow;
@@ -132,6 +199,12 @@ private:
 	KsDataStore 	*_data;
 
 	bool		 _keyPressed;
+
+	/** Time-windows (min, max) of the model, visited by the user. */
+	QVector<QPair<int64_t, int64_t>>	_history;
+
+	/** The position of the current time-window in the history. */
+	int		 _historyPos;
 };
 
 #endif // _KS_TRACEGRAPH_H
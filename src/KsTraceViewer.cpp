@@ -10,7 +10,8 @@
  */
 
 // C++
-#include <thread>
+#include <algorithm>
+#include <functional>
 #include <future>
 #include <queue>
 
@@ -61,7 +62,8 @@ KsTraceViewer::KsTraceViewer(QWidget *parent)
   _graphFollowsCheckBox(this),
   _graphFollows(true),
   _mState(nullptr),
-  _data(nullptr)
+  _data(nullptr),
+  _searchCancel(kshark_cancel_token_alloc())
 {
 	this->setSizePolicy(QSizePolicy::Preferred, QSizePolicy::Maximum);
 
@@ -148,6 +150,12 @@ KsTraceViewer::KsTraceViewer(QWidget *parent)
 	this->setLayout(&_layout);
 }
 
+/** Destroy KsTraceViewer object. */
+KsTraceViewer::~KsTraceViewer()
+{
+	kshark_cancel_token_free(_searchCancel);
+}
+
 /**
  * @brief Load and show trace data.
  *
@@ -402,6 +410,7 @@ void KsTraceViewer::_updateSearchCount()
 void KsTraceViewer::_searchStop()
 {
 	_proxyModel._searchStop = true;
+	kshark_cancel(_searchCancel);
 	_searchFSM.handleInput(sm_input_t::Stop);
 }
 
@@ -690,12 +699,34 @@ void KsTraceViewer::_setSearchIterator(int row)
 	}
 }
 
+//! @cond Doxygen_Suppress
+
+using searchFunc_t = std::function<QList<int>(int, bool)>;
+
+struct searchTask {
+	const searchFunc_t	*func;
+	int			first;
+	bool			notify;
+	bool			done;
+	QList<int>		matches;
+};
+
+//! @endcond
+
+static void searchTaskRun(void *arg)
+{
+	searchTask *task = static_cast<searchTask *>(arg);
+
+	task->matches = (*task->func)(task->first, task->notify);
+	task->done = true;
+}
+
 void KsTraceViewer::_searchItemsMT()
 {
-	int nThreads = std::thread::hardware_concurrency();
+	int nThreads = std::max(kshark_pool_size(), 1);
 	int startFrom, nRows(_proxyModel.rowCount({}));
-	std::vector<QPair<int, int>> ranges(nThreads);
-	std::vector<std::future<QList<int>>> maps;
+	std::vector<searchTask> tasks(nThreads);
+	std::future<void> job;
 	std::mutex lrs_mtx;
 
 	auto lamLRSUpdate = [&] (int lastRowSearched) {
@@ -712,7 +743,7 @@ void KsTraceViewer::_searchItemsMT()
 		}
 	};
 
-	auto lamSearchMap = [&] (const int first, bool notify) {
+	searchFunc_t lamSearchMap = [&] (const int first, bool notify) {
 		int lastRowSearched;
 		QList<int> list;
 
@@ -792,16 +823,28 @@ void KsTraceViewer::_searchItemsMT()
 	startFrom = _searchFSM._lastRowSearched + 1;
 	_searchFSM._lastRowSearched = -1;
 
-	/* Start the thread that will update the progress bar. */
-	maps.push_back(std::async(lamSearchMap,
-				  startFrom,
-				  true)); // notify = true
+	/* Only the first task will update the progress bar. */
+	for (int r = 0; r < nThreads; ++r) {
+		tasks[r].func = &lamSearchMap;
+		tasks[r].first = startFrom + r;
+		tasks[r].notify = (r == 0);
+		tasks[r].done = false;
+	}
+
+	/* The tasks, which are not started yet, will be skipped on stop. */
+	if (_proxyModel._searchStop)
+		kshark_cancel(_searchCancel);
+	else
+		kshark_cancel_reset(_searchCancel);
 
-	/* Start all other threads. */
-	for (int r = 1; r < nThreads; ++r)
-		maps.push_back(std::async(lamSearchMap,
-					  startFrom + r,
-					  false)); // notify = false
+	/*
+	 * Run the search tasks in the thread pool. The tasks are submitted
+	 * from a separate thread, because this one has to update the GUI.
+	 */
+	job = std::async(std::launch::async, [&] () {
+		kshark_pool_run(searchTaskRun, tasks.data(), sizeof(tasks[0]),
+				nThreads, KS_TASK_INTERACTIVE, _searchCancel);
+	});
 
 	while (_searchFSM.getState() == search_state_t::InProgress_s &&
 	       _proxyModel.searchProgress() < KS_PROGRESS_BAR_MAX - nThreads) {
@@ -811,9 +854,22 @@ void KsTraceViewer::_searchItemsMT()
 		QApplication::processEvents();
 	}
 
+	job.wait();
+
+	for (auto &t: tasks)
+		if (!t.done) {
+			/*
+			 * The search has been stopped before this task was
+			 * started. None of its rows has been searched, hence
+			 * the next search has to start from its first row.
+			 */
+			lamLRSUpdate(t.first - 1);
+			break;
+		}
+
 	QVector<QList<int>> res;
-	for (auto &m: maps)
-		res.append(std::move(m.get()));
+	for (auto &t: tasks)
+		res.append(std::move(t.matches));
 
 	lamSearchMerge(_matchList, res);
 }
@@ -16,6 +16,7 @@
 #include <QTableView>
 
 // KernelShark
+#include "libkshark-pool.h"
 #include "KsUtils.hpp"
 #include "KsModels.hpp"
 #include "KsSearchFSM.hpp"
@@ -49,6 +50,8 @@ class KsTraceViewer : public KsWidgetsLib::KsDataWidget
 public:
 	explicit KsTraceViewer(QWidget *parent = nullptr);
 
+	~KsTraceViewer();
+
 	void loadData(KsDataStore *data);
 
 	void setMarkerSM(KsDualMarkerSM *m);
@@ -123,6 +126,9 @@ private:
 
 	KsDataStore		*_data;
 
+	/** Cancels the search tasks, running in the thread pool. */
+	kshark_cancel_token	*_searchCancel;
+
 	enum Condition
 	{
 		Containes = 0,
@@ -466,12 +466,17 @@ QColor& operator <<(QColor &thisColor, const KsPlot::Color &c)
 KsDataStore::KsDataStore(QWidget *parent)
 : QObject(parent),
   _rows(nullptr),
-  _dataSize(0)
+  _dataSize(0),
+  _countIndex(nullptr),
+  _preview(false)
 {}
 
 /** Destroy the KsDataStore object. */
 KsDataStore::~KsDataStore()
-{}
+{
+	_waitCountIndex();
+	kshark_event_count_index_free(_countIndex);
+}
 
 int KsDataStore::_openDataFile(kshark_context *kshark_ctx,
 				const QString &file)
@@ -508,9 +513,19 @@ void KsDataStore::_addPluginsToStream(kshark_context *kshark_ctx, int sd,
 	}
 }
 
-/** Load trace data for file. */
+/**
+ * @brief Load trace data for file.
+ *
+ * @param file: Trace data file.
+ * @param plugins: User plugins to be registered to the new Data streams.
+ * @param preview: Optional callback function. It is called after the file
+ *		   is opened and before the trace data is loaded. This gives
+ *		   the caller the chance to show a preview of the data, while
+ *		   the full load proceeds.
+ */
 int  KsDataStore::loadDataFile(const QString &file,
-			       QVector<kshark_dpi *> plugins)
+			       QVector<kshark_dpi *> plugins,
+			       std::function<void()> preview)
 {
 	kshark_context *kshark_ctx(nullptr);
 	int sd, n_streams;
@@ -534,6 +549,9 @@ int  KsDataStore::loadDataFile(const QString &file,
 	for (sd = 0; sd < n_streams; ++sd)
 		_addPluginsToStream(kshark_ctx, sd, plugins);
 
+	if (preview)
+		preview();
+
 	_dataSize = kshark_load_all_entries(kshark_ctx, &_rows);
 	if (_dataSize <= 0) {
 		kshark_close(kshark_ctx, sd);
@@ -541,6 +559,7 @@ int  KsDataStore::loadDataFile(const QString &file,
 	}
 
 	registerCPUCollections();
+	_buildCountIndex();
 
 	return sd;
 }
@@ -563,6 +582,8 @@ int KsDataStore::appendDataFile(const QString &file, int64_t offset)
 	if (!kshark_instance(&kshark_ctx))
 		return -EFAULT;
 
+	/* The merge below frees the array of the loaded entries. */
+	_waitCountIndex();
 	unregisterCPUCollections();
 
 	sd = _openDataFile(kshark_ctx, file);
@@ -592,21 +613,142 @@ int KsDataStore::appendDataFile(const QString &file, int64_t offset)
 	_rows = mergedRows;
 
 	registerCPUCollections();
+	_buildCountIndex();
 
 	return sd;
 }
 
+/**
+ * @brief Load approximate (preview) trace data for all Data streams that are
+ *	  currently open. Only one record per page (or per every N pages) is
+ *	  loaded. The preview data cannot be used for anything else but
+ *	  plotting.
+ *
+ * @param maxPages: The maximum number of pages to be sampled, per Data stream.
+ *
+ * @returns The number of loaded entries.
+ */
+ssize_t KsDataStore::loadPreview(size_t maxPages)
+{
+	kshark_context *kshark_ctx(nullptr);
+	QVector<kshark_entry_data_set> buffers;
+	kshark_entry_data_set set;
+	int *streamIds;
+
+	if (!kshark_instance(&kshark_ctx))
+		return -EFAULT;
+
+	_freeData();
+	_preview = true;
+
+	streamIds = kshark_all_streams(kshark_ctx);
+	for (int i = 0; i < kshark_ctx->n_streams; ++i) {
+		if (kshark_ctx->stream[streamIds[i]]->format != KS_TEP_DATA)
+			continue;
+
+		set.data = nullptr;
+		set.n_rows = kshark_tep_load_preview(kshark_ctx, streamIds[i],
+						     maxPages, &set.data);
+		if (set.n_rows > 0) {
+			buffers.append(set);
+			_dataSize += set.n_rows;
+		} else if (set.n_rows == 0) {
+			free(set.data);
+		}
+	}
+
+	free(streamIds);
+
+	if (buffers.count() == 1) {
+		_rows = buffers[0].data;
+	} else if (buffers.count() > 1) {
+		_rows = kshark_merge_data_entries(buffers.data(),
+						  buffers.count());
+		for (auto const &b: buffers) {
+			if (!_rows)
+				kshark_free_preview(b.data, b.n_rows);
+			else
+				free(b.data);
+		}
+
+		if (!_rows)
+			_dataSize = 0;
+	}
+
+	return _dataSize;
+}
+
 void KsDataStore::_freeData()
 {
-	if (_dataSize > 0) {
-		for (ssize_t r = 0; r < _dataSize; ++r)
-			free(_rows[r]);
+	kshark_context *kshark_ctx(nullptr);
 
-		free(_rows);
+	_waitCountIndex();
+
+	if (_dataSize > 0 && _preview) {
+		kshark_free_preview(_rows, _dataSize);
+		_rows = nullptr;
+	} else if (_dataSize > 0 && kshark_instance(&kshark_ctx)) {
+		kshark_free_entries(kshark_ctx, _rows, _dataSize);
 		_rows = nullptr;
 	}
 
 	_dataSize = 0;
+
+	kshark_event_count_index_free(_countIndex);
+	_countIndex = nullptr;
+}
+
+/*
+ * Build the prefix-count index of the loaded data. The index allows the
+ * number of events in an arbitrary time range to be retrieved without
+ * scanning the data. The index is built in the background. Until it is
+ * ready, countIndex() returns nullptr.
+ */
+void KsDataStore::_buildCountIndex()
+{
+	kshark_entry **rows = _rows;
+	ssize_t size = _dataSize;
+
+	_waitCountIndex();
+	kshark_event_count_index_free(_countIndex);
+	_countIndex = nullptr;
+
+	if (size <= 0)
+		return;
+
+	_countFuture = std::async(std::launch::async, [rows, size] {
+		return kshark_event_count_index_alloc(rows, size);
+	});
+}
+
+/*
+ * Wait for the background build of the prefix-count index to finish. This
+ * must be done before the trace data is modified or freed.
+ */
+void KsDataStore::_waitCountIndex()
+{
+	if (!_countFuture.valid())
+		return;
+
+	kshark_event_count_index_free(_countIndex);
+	_countIndex = _countFuture.get();
+}
+
+/**
+ * @brief Get the prefix-count index of the trace data.
+ *
+ * @returns The index, or nullptr if the index is still being built in the
+ *	    background.
+ */
+const kshark_event_count_index *KsDataStore::countIndex() const
+{
+	using namespace std::chrono;
+
+	if (_countFuture.valid() &&
+	    _countFuture.wait_for(seconds(0)) == std::future_status::ready)
+		_countIndex = _countFuture.get();
+
+	return _countIndex;
 }
 
 /** Reload the trace data. */
@@ -627,6 +769,7 @@ void KsDataStore::reload()
 	_dataSize = kshark_load_all_entries(kshark_ctx, &_rows);
 
 	registerCPUCollections();
+	_buildCountIndex();
 
 	emit updateWidgets(this);
 }
@@ -639,6 +782,13 @@ void KsDataStore::clear()
 	if (!kshark_instance(&kshark_ctx))
 		return;
 
+	if (_preview) {
+		/* The preview data has no Data collections. */
+		_freeData();
+		_preview = false;
+		return;
+	}
+
 	_freeData();
 	unregisterCPUCollections();
 }
@@ -883,9 +1033,11 @@ void KsDataStore::setClockOffset(int sd, int64_t offset)
 	if (!kshark_get_data_stream(kshark_ctx, sd))
 		return;
 
+	_waitCountIndex();
 	unregisterCPUCollections();
 	kshark_set_clock_offset(kshark_ctx, _rows, _dataSize, sd, offset);
 	registerCPUCollections();
+	_buildCountIndex();
 }
 
 /**
@@ -17,6 +17,8 @@
 
 // C++ 11
 #include <chrono>
+#include <functional>
+#include <future>
 
 // Qt
 #include <QtWidgets>
@@ -25,6 +27,7 @@
 #include "libkshark.h"
 #include "libkshark-model.h"
 #include "libkshark-plugin.h"
+#include "libkshark-stats.h"
 #include "KsCmakeDef.hpp"
 #include "KsPlotTools.hpp"
 
@@ -66,6 +69,15 @@ inline auto stringWidth = [](QString s)
 /** Macro providing the height of the KernelShark graphs in pixels. */
 #define KS_GRAPH_HEIGHT		(FONT_HEIGHT * 2)
 
+/**
+ * A preview of the data is shown while loading, only for files bigger than
+ * this size (in bytes).
+ */
+#define KS_PREVIEW_MIN_FILE_SIZE	(256L << 20)
+
+/** The maximum number of pages sampled per Data stream, by the preview. */
+#define KS_PREVIEW_MAX_PAGES		(1 << 16)
+
 //! @cond Doxygen_Suppress
 
 #define KS_JSON_CAST(doc) \
@@ -185,7 +197,13 @@ public:
 	~KsDataStore();
 
 	int loadDataFile(const QString &file,
-			 QVector<kshark_dpi *> plugins);
+			 QVector<kshark_dpi *> plugins,
+			 std::function<void()> preview = nullptr);
+
+	ssize_t loadPreview(size_t maxPages);
+
+	/** Check if the data store holds approximate (preview) data. */
+	bool isPreview() const {return _preview;}
 
 	int appendDataFile(const QString &file, int64_t shift);
 
@@ -202,6 +220,8 @@ public:
 	/** Set the size of the data (number of entries). */
 	void setSize(ssize_t s) {_dataSize = s;}
 
+	const kshark_event_count_index *countIndex() const;
+
 	void reload();
 
 	void update();
@@ -239,10 +259,23 @@ private:
 	/** The size of the data array. */
 	ssize_t			_dataSize;
 
+	/** Prefix-count index of the trace data. */
+	mutable kshark_event_count_index	*_countIndex;
+
+	/** Prefix-count index, being built in the background. */
+	mutable std::future<kshark_event_count_index *>	_countFuture;
+
+	/** The data array holds approximate (sampled) data. */
+	bool			_preview;
+
 	int _openDataFile(kshark_context *kshark_ctx, const QString &file);
 
 	void _freeData();
 
+	void _buildCountIndex();
+
+	void _waitCountIndex();
+
 	void _applyIdFilter(int filterId, QVector<int> vec, int sd);
 
 	void _addPluginsToStream(kshark_context *kshark_ctx, int sd,
@@ -7,6 +7,8 @@
 // C
 #include <sys/stat.h>
 #include <getopt.h>
+#include <errno.h>
+#include <stdint.h>
 
 // Qt
 #include <QApplication>
@@ -31,6 +33,10 @@ void usage(const char *prog)
 	printf("  -u	unregister plugin, use plugin name or absolute path\n");
 	printf("  -s	import a session\n");
 	printf("  -l	import the last session\n");
+	printf("  -m	memory budget for the trace data (in MB), the data above\n");
+	printf("	the budget is kept in a temporary file\n");
+	printf("  -f	data fields to extract during loading, use\n");
+	printf("	\"system/event:field,field;system/event:field\"\n");
 }
 
 int main(int argc, char **argv)
@@ -44,7 +50,7 @@ int main(int argc, char **argv)
 	KsMainWindow ks;
 	ks.show();
 
-	while ((c = getopt(argc, argv, "hvi:a:p:u:s:l")) != -1) {
+	while ((c = getopt(argc, argv, "hvi:a:p:u:s:lm:f:")) != -1) {
 		switch(c) {
 		case 'h':
 			usage(argv[0]);
@@ -80,6 +86,35 @@ int main(int argc, char **argv)
 			fromSession = true;
 			break;
 
+		case 'm': {
+			kshark_context *kshark_ctx(nullptr);
+			long long budget;
+			char *end;
+
+			errno = 0;
+			budget = strtoll(optarg, &end, 10);
+			if (errno || end == optarg || *end != '\0' ||
+			    budget <= 0 || budget > (long long) (SIZE_MAX >> 20)) {
+				fprintf(stderr, "Invalid memory budget \"%s\"\n",
+					optarg);
+				usage(argv[0]);
+				return 1;
+			}
+
+			if (kshark_instance(&kshark_ctx))
+				kshark_set_memory_budget(kshark_ctx,
+							 (size_t) budget << 20);
+			break;
+		}
+
+		case 'f': {
+			kshark_context *kshark_ctx(nullptr);
+
+			if (kshark_instance(&kshark_ctx))
+				kshark_declare_field_columns(kshark_ctx, optarg);
+			break;
+		}
+
 		default:
 			break;
 		}
@@ -70,6 +70,83 @@ static bool collection_add_entry(struct entry_list **list,
 	return true;
 }
 
+/*
+ * Loop over the intervals of the collection and record the positions, at
+ * which the Process Id or the CPU Id of the matching entries changes.
+ */
+static bool collection_set_states(struct kshark_context *kshark_ctx,
+				  struct kshark_entry_collection *col,
+				  struct kshark_entry **data)
+{
+	size_t i, j, first = 0, n_states = 0, size = 0;
+	size_t *points = NULL, *ends = NULL, *tmp;
+	struct kshark_entry *last = NULL;
+
+	for (i = 0; i < col->size; ++i) {
+		/* Make sure that no entry is processed twice. */
+		if (first < col->resume_points[i])
+			first = col->resume_points[i];
+
+		for (j = first; j <= col->break_points[i]; ++j) {
+			if (!col->cond(kshark_ctx, data[j],
+				       col->stream_id, col->values))
+				continue;
+
+			if (!last ||
+			    last->pid != data[j]->pid ||
+			    last->cpu != data[j]->cpu) {
+				if (n_states == size) {
+					size = size ? size * 2 : 64;
+					tmp = realloc(points,
+						      size * sizeof(*points));
+					if (!tmp)
+						goto fail;
+
+					points = tmp;
+
+					tmp = realloc(ends,
+						      size * sizeof(*ends));
+					if (!tmp)
+						goto fail;
+
+					ends = tmp;
+				}
+
+				points[n_states++] = j;
+			}
+
+			ends[n_states - 1] = j;
+			last = data[j];
+		}
+
+		first = j;
+	}
+
+	col->state_points = points;
+	col->state_ends = ends;
+	col->n_states = n_states;
+
+	return true;
+
+ fail:
+	free(points);
+	free(ends);
+
+	return false;
+}
+
+/*
+ * Find the next (in time) entry, recorded on the same CPU as the entry at
+ * row "i". Returns "end" if no such entry is found before "end".
+ */
+static ssize_t next_on_cpu(const struct kshark_cpu_index *index,
+			   size_t i, ssize_t end)
+{
+	ssize_t j = kshark_next_on_cpu(index, i);
+
+	return (j < 0 || j >= end) ? end : j;
+}
+
 static struct kshark_entry_collection *
 kshark_data_collection_alloc(struct kshark_context *kshark_ctx,
 			     struct kshark_entry **data,
@@ -82,11 +159,12 @@ kshark_data_collection_alloc(struct kshark_context *kshark_ctx,
 			     size_t margin)
 {
 	struct kshark_entry_collection *col_ptr = NULL;
-	struct kshark_entry *last_vis_entry = NULL;
+	struct kshark_cpu_index *local_index = NULL;
+	const struct kshark_cpu_index *index;
 	struct entry_list *col_list, *temp;
 	size_t resume_count = 0, break_count = 0;
 	size_t i, j, last_added = 0;
-	ssize_t end;
+	ssize_t end, next;
 	bool good_data = false;
 
 	/* Create the collection. */
@@ -98,6 +176,18 @@ kshark_data_collection_alloc(struct kshark_context *kshark_ctx,
 	if (first >= end)
 		return col_ptr;
 
+	/*
+	 * Use the per-CPU index of the session, if the data has one.
+	 * Otherwise build a temporary index, used only by this collection.
+	 */
+	index = kshark_get_cpu_index(kshark_ctx, data, first + n_rows);
+	if (!index) {
+		index = local_index = kshark_cpu_index_alloc(kshark_ctx, data,
+							     first + n_rows);
+		if (!index)
+			goto fail;
+	}
+
 	col_list = malloc(sizeof(*col_list));
 	if (!col_list)
 		goto fail;
@@ -150,20 +240,15 @@ kshark_data_collection_alloc(struct kshark_context *kshark_ctx,
 				--break_count;
 			}
 		} else if (good_data &&
-			   data[i]->next &&
-			   !cond(kshark_ctx, data[i]->next, sd, values)) {
+			   (next = next_on_cpu(index, i, end)) != end &&
+			   !cond(kshark_ctx, data[next], sd, values)) {
 			/*
 			 * Break the collection here. Add some margin data
-			 * after the data of interest.
+			 * after the data of interest. Keep adding entries
+			 * until the "next" record.
 			 */
 			good_data = false;
-			last_vis_entry = data[i];
-
-			/* Keep adding entries until the "next" record. */
-			for (j = i + 1;
-			     j != end && last_vis_entry->next != data[j];
-			     j++)
-				;
+			j = next;
 
 			/*
 			 * If the number of added entries is smaller than the
@@ -192,6 +277,9 @@ kshark_data_collection_alloc(struct kshark_context *kshark_ctx,
 		}
 	}
 
+	kshark_cpu_index_free(local_index);
+	local_index = NULL;
+
 	if (good_data) {
 		collection_add_entry(&temp, end - 1, COLLECTION_BREAK);
 		++break_count;
@@ -255,11 +343,23 @@ kshark_data_collection_alloc(struct kshark_context *kshark_ctx,
 		free(temp);
 	}
 
+	if (!collection_set_states(kshark_ctx, col_ptr, data)) {
+		free(col_ptr->resume_points);
+		free(col_ptr->break_points);
+		free(col_ptr->values);
+		free(col_ptr);
+		fprintf(stderr,
+			"Failed to allocate memory for Data collection.\n");
+
+		return NULL;
+	}
+
 	return col_ptr;
 
 fail:
 	fprintf(stderr, "Failed to allocate memory for Data collection.\n");
 
+	kshark_cpu_index_free(local_index);
 	free(col_ptr);
 	for (i = 0; i < resume_count + break_count; ++i) {
 		temp = col_list;
@@ -306,7 +406,7 @@ map_collection_index_from_source(const struct kshark_entry_collection *col,
 		return h;
 	}
 
-	BSEARCH(h, l, source_index > col->resume_points[mid]);
+	BSEARCH(h, l, source_index >= col->resume_points[mid]);
 
 	if (source_index <= col->break_points[l])
 		*flag = COLLECTION_INSIDE;
@@ -476,7 +576,7 @@ map_collection_back_request(const struct kshark_entry_collection *col,
 
 		--col_index;
 
-		if (req_end > col->break_points[col_index]) {
+		if (col_index < 0 || req_end > col->break_points[col_index]) {
 			/*
 			 * The last entry of the original request comes before
 			 * the end of the next collection interval. Stop here.
@@ -716,6 +816,36 @@ kshark_get_collection_entry_back(struct kshark_entry_request **req,
 	return entry;
 }
 
+/**
+ * @brief Get the state (the Process Id and the CPU Id of the matching
+ *	  entries) of the collection at a given position inside the data.
+ *
+ * @param col: Input location for the Data collection.
+ * @param row: The index of the position inside the data.
+ *
+ * @returns The index of the state (inside the arrays "state_points" and
+ *	    "state_ends"), to which belongs the last matching entry located
+ *	    at or before the given position. KS_EMPTY_BIN if no matching
+ *	    entry exists before this position.
+ */
+ssize_t kshark_get_collection_state(const struct kshark_entry_collection *col,
+				    size_t row)
+{
+	size_t l, h, mid;
+
+	if (!col->n_states || row < col->state_points[0])
+		return KS_EMPTY_BIN;
+
+	l = 0;
+	h = col->n_states - 1;
+	if (row >= col->state_points[h])
+		return h;
+
+	BSEARCH(h, l, row >= col->state_points[mid]);
+
+	return l;
+}
+
 static bool val_compare(int *val_a, int *val_b, size_t n_val)
 {
 	size_t i;
@@ -772,12 +902,22 @@ void kshark_reset_data_collection(struct kshark_entry_collection *col)
 	col->break_points = NULL;
 
 	col->size = 0;
+
+	free(col->state_points);
+	col->state_points = NULL;
+
+	free(col->state_ends);
+	col->state_ends = NULL;
+
+	col->n_states = 0;
 }
 
 static void kshark_free_data_collection(struct kshark_entry_collection *col)
 {
 	free(col->resume_points);
 	free(col->break_points);
+	free(col->state_points);
+	free(col->state_ends);
 	free(col->values);
 	free(col);
 }
@@ -0,0 +1,450 @@
+// SPDX-License-Identifier: LGPL-2.1
+
+/*
+ * Copyright (C) 2021 VMware Inc, Yordan Karadzhov (VMware) <y.karadz@gmail.com>
+ */
+
+/**
+ *  @file    libkshark-decompress.c
+ *  @brief   Opening of compressed trace data files.
+ */
+
+#ifndef _GNU_SOURCE
+/** Use GNU C Library. */
+#define _GNU_SOURCE
+#endif // _GNU_SOURCE
+
+// C
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/statvfs.h>
+
+#ifdef KS_HAVE_ZSTD
+#include <zstd.h>
+#endif // KS_HAVE_ZSTD
+
+// KernelShark
+#include "libkshark-decompress.h"
+#include "libkshark-pool.h"
+
+/**
+ * @brief Check if a trace data file is compressed, using the extension of
+ *	  the file.
+ */
+bool kshark_is_compressed(const char *file)
+{
+	size_t len = strlen(file), ext_len = strlen(KS_ZSTD_EXT);
+
+	return len > ext_len &&
+	       strcmp(file + len - ext_len, KS_ZSTD_EXT) == 0;
+}
+
+#ifdef KS_HAVE_ZSTD
+
+/**
+ * The temporary copy of the decompressed data must leave at least this part
+ * (1/16) of the file system free.
+ */
+#define KS_DECOMPRESS_RESERVE_SHIFT	4
+
+/**
+ * When the size of the decompressed data is unknown, the free space is
+ * checked every time this much data (64 MB) gets written.
+ */
+#define KS_DECOMPRESS_CHECK_STEP	(1UL << 26)
+
+/* Quiet warnings over documenting simple structures */
+//! @cond Doxygen_Suppress
+
+struct zstd_frame {
+	const char	*src;
+	size_t		src_size;
+	size_t		offset;
+	size_t		size;
+};
+
+struct zstd_task {
+	struct zstd_frame	*frames;
+	size_t			n_frames;
+	size_t			first;
+	size_t			step;
+	char			*dst;
+	int			status;
+};
+
+//! @endcond
+
+static int temp_file(void)
+{
+	const char *dir = getenv("TMPDIR");
+	char *file;
+	int fd;
+
+	if (asprintf(&file, "%s/kshark-trace-XXXXXX", dir ? dir : "/tmp") <= 0)
+		return -ENOMEM;
+
+	fd = mkstemp(file);
+	if (fd >= 0) {
+		/* The file will be deleted as soon as it gets closed. */
+		unlink(file);
+	}
+
+	free(file);
+
+	return fd >= 0 ? fd : -errno;
+}
+
+/*
+ * Check if "size" more bytes of decompressed data can be stored, without
+ * taking the reserved part of the file system.
+ */
+static int check_space(int fd, size_t size)
+{
+	unsigned long long avail, reserve;
+	struct statvfs st;
+
+	if (fstatvfs(fd, &st) < 0)
+		return 0;
+
+	avail = (unsigned long long) st.f_bavail * st.f_frsize;
+	reserve = ((unsigned long long) st.f_blocks * st.f_frsize) >>
+		  KS_DECOMPRESS_RESERVE_SHIFT;
+
+	return (avail < reserve || avail - reserve < size) ? -ENOSPC : 0;
+}
+
+/*
+ * Make sure that the file system can store "size" bytes of decompressed data
+ * and allocate all blocks of the file. Writing through a shared mapping into
+ * a hole of the file, when the file system is full, ends with SIGBUS.
+ */
+static int reserve_space(int fd, size_t size)
+{
+	int ret;
+
+	ret = check_space(fd, size);
+	if (ret < 0)
+		return ret;
+
+	ret = posix_fallocate(fd, 0, size);
+
+	return ret ? -ret : 0;
+}
+
+static int write_all(int fd, const char *buffer, size_t size)
+{
+	ssize_t n;
+
+	while (size) {
+		n = write(fd, buffer, size);
+		if (n < 0) {
+			if (errno == EINTR)
+				continue;
+
+			return -errno;
+		}
+
+		buffer += n;
+		size -= n;
+	}
+
+	return 0;
+}
+
+/*
+ * Split the compressed data into frames. Returns the number of frames, or
+ * zero if the decompressed size of some of the frames is unknown.
+ */
+static ssize_t zstd_frames(const char *src, size_t src_size,
+			   struct zstd_frame **frames_ptr)
+{
+	struct zstd_frame *frames = NULL, *tmp;
+	size_t pos = 0, offset = 0, size;
+	unsigned long long dsize;
+	ssize_t n = 0;
+
+	while (pos < src_size) {
+		size = ZSTD_findFrameCompressedSize(src + pos, src_size - pos);
+		if (ZSTD_isError(size)) {
+			free(frames);
+			return -EINVAL;
+		}
+
+		dsize = ZSTD_getFrameContentSize(src + pos, size);
+		if (dsize == ZSTD_CONTENTSIZE_UNKNOWN ||
+		    dsize == ZSTD_CONTENTSIZE_ERROR) {
+			free(frames);
+			return 0;
+		}
+
+		if ((n & (n - 1)) == 0) {
+			tmp = realloc(frames, (n ? 2 * n : 1) * sizeof(*frames));
+			if (!tmp) {
+				free(frames);
+				return -ENOMEM;
+			}
+
+			frames = tmp;
+		}
+
+		frames[n].src = src + pos;
+		frames[n].src_size = size;
+		frames[n].offset = offset;
+		frames[n].size = dsize;
+
+		offset += dsize;
+		pos += size;
+		++n;
+	}
+
+	*frames_ptr = frames;
+
+	return n;
+}
+
+static void zstd_worker(void *arg)
+{
+	struct zstd_task *task = arg;
+	struct zstd_frame *frame;
+	ZSTD_DCtx *dctx;
+	size_t i, ret;
+
+	dctx = ZSTD_createDCtx();
+	if (!dctx) {
+		task->status = -ENOMEM;
+		return;
+	}
+
+	for (i = task->first; i < task->n_frames; i += task->step) {
+		frame = &task->frames[i];
+		ret = ZSTD_decompressDCtx(dctx, task->dst + frame->offset,
+					  frame->size,
+					  frame->src, frame->src_size);
+
+		if (ZSTD_isError(ret) || ret != frame->size) {
+			task->status = -EINVAL;
+			break;
+		}
+	}
+
+	ZSTD_freeDCtx(dctx);
+}
+
+/*
+ * Decompress frames of known size directly into a shared mapping of the
+ * output file. The frames are independent, hence if the file consists of
+ * multiple frames (as produced by "pzstd"), they are decompressed in
+ * parallel. A single frame is decompressed by a single thread.
+ */
+static int zstd_decompress_frames(struct zstd_frame *frames, size_t n_frames,
+				  int fd)
+{
+	struct zstd_frame *last = &frames[n_frames - 1];
+	size_t size = last->offset + last->size;
+	struct zstd_task *tasks;
+	int i, n_threads, ret;
+	char *dst;
+
+	if (!size)
+		return 0;
+
+	ret = reserve_space(fd, size);
+	if (ret < 0)
+		return ret;
+
+	dst = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	if (dst == MAP_FAILED)
+		return -errno;
+
+	n_threads = kshark_pool_size();
+	if (n_threads > n_frames)
+		n_threads = n_frames;
+
+	if (n_threads < 1)
+		n_threads = 1;
+
+	tasks = calloc(n_threads, sizeof(*tasks));
+	if (!tasks) {
+		munmap(dst, size);
+		return -ENOMEM;
+	}
+
+	/*
+	 * The frames are distributed in a round-robin fashion, because the
+	 * sizes of the consecutive frames are usually similar.
+	 */
+	for (i = 0; i < n_threads; ++i) {
+		tasks[i].frames = frames;
+		tasks[i].n_frames = n_frames;
+		tasks[i].first = i;
+		tasks[i].step = n_threads;
+		tasks[i].dst = dst;
+	}
+
+	kshark_pool_run(zstd_worker, tasks, sizeof(*tasks), n_threads,
+			KS_TASK_INTERACTIVE, NULL);
+
+	for (i = 0; i < n_threads; ++i)
+		if (tasks[i].status < 0)
+			ret = tasks[i].status;
+
+	free(tasks);
+	munmap(dst, size);
+
+	return ret;
+}
+
+/*
+ * Decompress a stream of frames of unknown size, using a single thread. The
+ * size of the output is not known in advance, hence the free space is
+ * checked step by step, while writing.
+ */
+static int zstd_sequential(const char *src, size_t src_size, int fd)
+{
+	ZSTD_inBuffer in = {src, src_size, 0};
+	size_t out_size = ZSTD_DStreamOutSize();
+	size_t written = 0, checked = 0;
+	ZSTD_DStream *dstream;
+	ZSTD_outBuffer out;
+	size_t ret = 0;
+	int status = 0;
+	char *buffer;
+
+	dstream = ZSTD_createDStream();
+	buffer = malloc(out_size);
+	if (!dstream || !buffer) {
+		status = -ENOMEM;
+		goto end;
+	}
+
+	ZSTD_initDStream(dstream);
+	while (in.pos < in.size) {
+		out.dst = buffer;
+		out.size = out_size;
+		out.pos = 0;
+
+		ret = ZSTD_decompressStream(dstream, &out, &in);
+		if (ZSTD_isError(ret)) {
+			status = -EINVAL;
+			goto end;
+		}
+
+		if (written + out.pos > checked) {
+			status = check_space(fd, KS_DECOMPRESS_CHECK_STEP);
+			if (status < 0)
+				goto end;
+
+			checked += KS_DECOMPRESS_CHECK_STEP;
+		}
+
+		status = write_all(fd, buffer, out.pos);
+		if (status < 0)
+			goto end;
+
+		written += out.pos;
+	}
+
+	/* The last frame is truncated. */
+	if (ret != 0)
+		status = -EINVAL;
+
+ end:
+	ZSTD_freeDStream(dstream);
+	free(buffer);
+
+	return status;
+}
+
+/**
+ * @brief Decompress a (zstd) compressed trace data file. The whole content
+ *	  of the file is decompressed into an unlinked temporary copy, which
+ *	  gets deleted when closed. The data can be read only after the
+ *	  decompression is complete. The copy must leave 1/16 of the file
+ *	  system free. The pages of the temporary file stay in the page
+ *	  cache, hence reading it back is as fast as reading an uncompressed
+ *	  file, while the memory is managed by the kernel.
+ *	  Only if the compressed file consists of multiple independent
+ *	  frames (as produced by "pzstd"), the frames are decompressed in
+ *	  parallel. Files, compressed by "zstd", have a single frame and are
+ *	  decompressed by a single thread.
+ *
+ * @param file: The compressed file.
+ *
+ * @returns File descriptor of the decompressed data on success, or a
+ *	    negative error code on failure.
+ */
+int kshark_decompress_file(const char *file)
+{
+	struct zstd_frame *frames = NULL;
+	int in_fd, out_fd, ret = 0;
+	ssize_t n_frames;
+	struct stat st;
+	char *src;
+
+	in_fd = open(file, O_RDONLY | O_CLOEXEC);
+	if (in_fd < 0)
+		return -errno;
+
+	if (fstat(in_fd, &st) < 0 || st.st_size == 0) {
+		close(in_fd);
+		return -EINVAL;
+	}
+
+	src = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, in_fd, 0);
+	close(in_fd);
+	if (src == MAP_FAILED)
+		return -errno;
+
+	out_fd = temp_file();
+	if (out_fd < 0) {
+		munmap(src, st.st_size);
+		return out_fd;
+	}
+
+	n_frames = zstd_frames(src, st.st_size, &frames);
+	if (n_frames < 0)
+		ret = n_frames;
+	else if (n_frames > 0)
+		ret = zstd_decompress_frames(frames, n_frames, out_fd);
+	else
+		ret = zstd_sequential(src, st.st_size, out_fd);
+
+	free(frames);
+	munmap(src, st.st_size);
+
+	if (ret < 0) {
+		fprintf(stderr, "Failed to decompress file %s (%s)\n",
+			file, strerror(-ret));
+		close(out_fd);
+		return ret;
+	}
+
+	return out_fd;
+}
+
+#else // KS_HAVE_ZSTD
+
+/**
+ * @brief Decompress a (zstd) compressed trace data file. KernelShark is built
+ *	  without zstd support, hence this always fails.
+ *
+ * @param file: The compressed file.
+ *
+ * @returns -ENOTSUP.
+ */
+int kshark_decompress_file(const char *file)
+{
+	fprintf(stderr,
+		"Unable to open %s. KernelShark is built without zstd support.\n",
+		file);
+
+	return -ENOTSUP;
+}
+
+#endif // KS_HAVE_ZSTD
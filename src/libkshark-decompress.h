@@ -0,0 +1,33 @@
+/* SPDX-License-Identifier: LGPL-2.1 */
+
+/*
+ * Copyright (C) 2021 VMware Inc, Yordan Karadzhov (VMware) <y.karadz@gmail.com>
+ */
+
+/**
+ *  @file    libkshark-decompress.h
+ *  @brief   Opening of compressed trace data files.
+ */
+
+#ifndef _LIB_KSHARK_DECOMPRESS_H
+#define _LIB_KSHARK_DECOMPRESS_H
+
+// C
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif // __cplusplus
+
+/** File extension of the zstd compressed files. */
+#define KS_ZSTD_EXT	".zst"
+
+bool kshark_is_compressed(const char *file);
+
+int kshark_decompress_file(const char *file);
+
+#ifdef __cplusplus
+}
+#endif // __cplusplus
+
+#endif // _LIB_KSHARK_DECOMPRESS_H
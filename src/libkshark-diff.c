@@ -0,0 +1,723 @@
+// SPDX-License-Identifier: LGPL-2.1
+
+/*
+ * Copyright (C) 2021 VMware Inc, Yordan Karadzhov (VMware) <y.karadz@gmail.com>
+ */
+
+ /**
+  *  @file    libkshark-diff.c
+  *  @brief   Differential comparison of two Data streams.
+  */
+
+// C
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+// KernelShark
+#include "libkshark-diff.h"
+#include "libkshark-pool.h"
+
+/* Quiet warnings over documenting simple structures */
+//! @cond Doxygen_Suppress
+
+struct diff_name {
+	char	*name;
+	size_t	idx;
+};
+
+struct diff_latency {
+	ssize_t	task;
+	int64_t	latency;
+};
+
+struct diff_names {
+	char		**names;
+	size_t		n_names;
+};
+
+struct diff_side {
+	struct kshark_context			*kshark_ctx;
+	int					sd;
+	const struct kshark_matrix_data_set	*matrix;
+
+	int		*pids;
+	size_t		n_pids;
+	ssize_t		*pid_task;
+
+	int		*event_ids;
+	size_t		n_event_ids;
+	ssize_t		*event_idx;
+
+	struct diff_names	tasks;
+	int64_t			(*task_values)[KS_DIFF_N_METRICS];
+
+	struct diff_names	events;
+	int64_t			*event_count;
+
+	int64_t		duration;
+
+	bool		failed;
+};
+
+//! @endcond
+
+/**
+ * @brief Get the trace data of one Data stream in columns, from an array of
+ *	  entries.
+ *
+ * @param sd: Data stream identifier.
+ * @param data: Input location for the trace data.
+ * @param n_entries: The size of the inputted data.
+ * @param matrix: Output location for the columns. The user is responsible
+ *		  for freeing the columns, using kshark_diff_free_matrix().
+ *
+ * @returns True on success, or false on failure.
+ */
+bool kshark_diff_matrix_from_entries(int sd, struct kshark_entry **data,
+				     size_t n_entries,
+				     struct kshark_matrix_data_set *matrix)
+{
+	size_t i, n = 0;
+
+	memset(matrix, 0, sizeof(*matrix));
+	for (i = 0; i < n_entries; ++i)
+		if (data[i]->stream_id == sd)
+			++n;
+
+	if (!kshark_data_matrix_alloc(n ? n : 1,
+				      &matrix->cpu_array,
+				      &matrix->pid_array,
+				      &matrix->event_array,
+				      &matrix->offset_array,
+				      &matrix->ts_array)) {
+		fprintf(stderr, "Failed to allocate memory for data matrix.\n");
+		return false;
+	}
+
+	for (i = 0; i < n_entries; ++i) {
+		if (data[i]->stream_id != sd)
+			continue;
+
+		matrix->cpu_array[matrix->n_rows] = data[i]->cpu;
+		matrix->pid_array[matrix->n_rows] = data[i]->pid;
+		matrix->event_array[matrix->n_rows] = data[i]->event_id;
+		matrix->offset_array[matrix->n_rows] = data[i]->offset;
+		matrix->ts_array[matrix->n_rows] = data[i]->ts;
+		++matrix->n_rows;
+	}
+
+	return true;
+}
+
+/**
+ * @brief Free the columns of a data matrix.
+ *
+ * @param matrix: Input location for the data matrix.
+ */
+void kshark_diff_free_matrix(struct kshark_matrix_data_set *matrix)
+{
+	free(matrix->cpu_array);
+	free(matrix->pid_array);
+	free(matrix->event_array);
+	free(matrix->offset_array);
+	free(matrix->ts_array);
+	memset(matrix, 0, sizeof(*matrix));
+}
+
+static int compare_ids(const void *a, const void *b)
+{
+	int ia = *(const int *) a, ib = *(const int *) b;
+
+	return (ia > ib) - (ia < ib);
+}
+
+static ssize_t find_id(const int *ids, size_t n, int id)
+{
+	ssize_t l = -1, h = n, mid;
+
+	BSEARCH(h, l, ids[mid] < id);
+
+	return (h < (ssize_t) n && ids[h] == id) ? h : -1;
+}
+
+static int compare_names(const void *a, const void *b)
+{
+	const struct diff_name *na = a, *nb = b;
+
+	return strcmp(na->name, nb->name);
+}
+
+/*
+ * Make a list of unique names, sorted alphabetically. The names are taken
+ * from the array "names". "map" gets the index of each name inside the
+ * list of unique names, or -1 if the name is NULL.
+ */
+static bool unique_names(char **names, size_t n, ssize_t *map,
+			 struct diff_names *unique)
+{
+	struct diff_name *sorted;
+	size_t i, n_sorted = 0;
+
+	unique->n_names = 0;
+	unique->names = malloc((n ? n : 1) * sizeof(*unique->names));
+	sorted = malloc((n ? n : 1) * sizeof(*sorted));
+	if (!unique->names || !sorted) {
+		free(sorted);
+		return false;
+	}
+
+	for (i = 0; i < n; ++i) {
+		map[i] = -1;
+		if (!names[i])
+			continue;
+
+		sorted[n_sorted].name = names[i];
+		sorted[n_sorted++].idx = i;
+	}
+
+	qsort(sorted, n_sorted, sizeof(*sorted), compare_names);
+
+	for (i = 0; i < n_sorted; ++i) {
+		if (unique->n_names &&
+		    strcmp(unique->names[unique->n_names - 1],
+			   sorted[i].name) == 0) {
+			free(sorted[i].name);
+		} else {
+			unique->names[unique->n_names++] = sorted[i].name;
+		}
+
+		map[sorted[i].idx] = unique->n_names - 1;
+	}
+
+	free(sorted);
+
+	return true;
+}
+
+static void free_names(struct diff_names *names)
+{
+	size_t i;
+
+	if (!names->names)
+		return;
+
+	for (i = 0; i < names->n_names; ++i)
+		free(names->names[i]);
+
+	free(names->names);
+	names->names = NULL;
+	names->n_names = 0;
+}
+
+static bool side_init_names(struct diff_side *side)
+{
+	struct kshark_data_stream *stream;
+	ssize_t n_pids;
+	char **names;
+	size_t i;
+	bool ret;
+
+	stream = kshark_get_data_stream(side->kshark_ctx, side->sd);
+	if (!stream)
+		return false;
+
+	/* Tasks */
+	n_pids = kshark_get_task_pids(side->kshark_ctx, side->sd, &side->pids);
+	if (n_pids < 0 || (n_pids && !side->pids))
+		return false;
+
+	side->n_pids = n_pids;
+	qsort(side->pids, side->n_pids, sizeof(*side->pids), compare_ids);
+
+	names = calloc(side->n_pids + 1, sizeof(*names));
+	side->pid_task = malloc((side->n_pids + 1) * sizeof(*side->pid_task));
+	if (!names || !side->pid_task) {
+		free(names);
+		return false;
+	}
+
+	for (i = 0; i < side->n_pids; ++i)
+		names[i] = kshark_comm_from_pid(side->sd, side->pids[i]);
+
+	ret = unique_names(names, side->n_pids, side->pid_task, &side->tasks);
+	free(names);
+	if (!ret)
+		return false;
+
+	/* Events */
+	side->event_ids = stream->interface.get_all_event_ids(stream);
+	if (!side->event_ids)
+		return false;
+
+	side->n_event_ids = stream->n_events;
+	qsort(side->event_ids, side->n_event_ids, sizeof(*side->event_ids),
+	      compare_ids);
+
+	names = calloc(side->n_event_ids + 1, sizeof(*names));
+	side->event_idx = malloc((side->n_event_ids + 1) *
+				 sizeof(*side->event_idx));
+	if (!names || !side->event_idx) {
+		free(names);
+		return false;
+	}
+
+	for (i = 0; i < side->n_event_ids; ++i)
+		names[i] = kshark_event_from_id(side->sd, side->event_ids[i]);
+
+	ret = unique_names(names, side->n_event_ids, side->event_idx,
+			   &side->events);
+	free(names);
+
+	return ret;
+}
+
+static int compare_latencies(const void *a, const void *b)
+{
+	const struct diff_latency *la = a, *lb = b;
+
+	if (la->task != lb->task)
+		return (la->task > lb->task) ? 1 : -1;
+
+	return (la->latency > lb->latency) - (la->latency < lb->latency);
+}
+
+/* Nearest-rank percentile of a sorted array of latencies. */
+static int64_t percentile(const struct diff_latency *lat, size_t n, int p)
+{
+	size_t rank = (p * n + 99) / 100;
+
+	return lat[rank ? rank - 1 : 0].latency;
+}
+
+static void side_set_latencies(struct diff_side *side,
+			       struct diff_latency *lat, size_t n_lat)
+{
+	size_t i, first;
+
+	qsort(lat, n_lat, sizeof(*lat), compare_latencies);
+
+	for (first = 0; first < n_lat; first = i) {
+		for (i = first; i < n_lat && lat[i].task == lat[first].task; ++i)
+			;
+
+		side->task_values[lat[first].task][KS_DIFF_LATENCY_P50] =
+			percentile(&lat[first], i - first, 50);
+
+		side->task_values[lat[first].task][KS_DIFF_LATENCY_P90] =
+			percentile(&lat[first], i - first, 90);
+
+		side->task_values[lat[first].task][KS_DIFF_LATENCY_P99] =
+			percentile(&lat[first], i - first, 99);
+	}
+}
+
+static int read_field(struct kshark_data_stream *stream,
+		      const struct kshark_matrix_data_set *matrix, size_t row,
+		      const char *field, int64_t *val)
+{
+	struct kshark_entry e;
+	int ret;
+
+	memset(&e, 0, sizeof(e));
+	e.stream_id = stream->stream_id;
+	e.cpu = matrix->cpu_array[row];
+	e.pid = matrix->pid_array[row];
+	e.event_id = matrix->event_array[row];
+	e.offset = matrix->offset_array[row];
+	e.ts = matrix->ts_array[row];
+
+	/*
+	 * Currently the data reading operations are not thread-safe.
+	 * Use a mutex to protect the access.
+	 */
+	pthread_mutex_lock(&stream->input_mutex);
+	ret = stream->interface.read_event_field_int64(stream, &e, field, val);
+	pthread_mutex_unlock(&stream->input_mutex);
+
+	return ret;
+}
+
+static bool side_process(struct diff_side *side)
+{
+	const struct kshark_matrix_data_set *m = side->matrix;
+	struct diff_latency *lat = NULL, *lat_tmp;
+	size_t n_lat = 0, lat_size = 0;
+	struct kshark_data_stream *stream;
+	int wake_id, switch_id, cpu;
+	ssize_t i, p, t, e, *last;
+	int64_t *waking, val;
+	bool ret = false;
+
+	stream = kshark_get_data_stream(side->kshark_ctx, side->sd);
+
+	side->task_values = calloc(side->tasks.n_names + 1,
+				   sizeof(*side->task_values));
+	side->event_count = calloc(side->events.n_names + 1,
+				   sizeof(*side->event_count));
+	waking = malloc((side->n_pids + 1) * sizeof(*waking));
+	last = malloc((stream->n_cpus + 1) * sizeof(*last));
+	if (!side->task_values || !side->event_count || !waking || !last)
+		goto out;
+
+	for (i = 0; i < (ssize_t) side->n_pids; ++i)
+		waking[i] = -1;
+
+	for (i = 0; i < stream->n_cpus; ++i)
+		last[i] = -1;
+
+	wake_id = stream->interface.find_event_id(stream, "sched/sched_waking");
+	if (wake_id < 0)
+		wake_id = stream->interface.find_event_id(stream,
+							  "sched/sched_wakeup");
+
+	switch_id = stream->interface.find_event_id(stream,
+						    "sched/sched_switch");
+
+	for (i = 0; i < m->n_rows; ++i) {
+		p = find_id(side->pids, side->n_pids, m->pid_array[i]);
+		t = (p >= 0) ? side->pid_task[p] : -1;
+		if (t >= 0)
+			side->task_values[t][KS_DIFF_COUNT]++;
+
+		e = find_id(side->event_ids, side->n_event_ids,
+			    m->event_array[i]);
+		if (e >= 0 && side->event_idx[e] >= 0)
+			side->event_count[side->event_idx[e]]++;
+
+		/*
+		 * The time between two consecutive entries on the same CPU
+		 * is attributed to the task of the first entry.
+		 */
+		cpu = m->cpu_array[i];
+		if (cpu >= 0 && cpu < stream->n_cpus) {
+			if (last[cpu] >= 0) {
+				p = find_id(side->pids, side->n_pids,
+					    m->pid_array[last[cpu]]);
+				t = (p >= 0) ? side->pid_task[p] : -1;
+				if (t >= 0)
+					side->task_values[t][KS_DIFF_RUN_TIME] +=
+						m->ts_array[i] -
+						m->ts_array[last[cpu]];
+			}
+
+			last[cpu] = i;
+		}
+
+		/* Wakeup latency. */
+		if (wake_id >= 0 && m->event_array[i] == wake_id) {
+			if (read_field(stream, m, i, "pid", &val) < 0)
+				continue;
+
+			p = find_id(side->pids, side->n_pids, val);
+			if (p >= 0)
+				waking[p] = m->ts_array[i];
+		} else if (switch_id >= 0 && m->event_array[i] == switch_id) {
+			if (read_field(stream, m, i, "next_pid", &val) < 0)
+				continue;
+
+			p = find_id(side->pids, side->n_pids, val);
+			if (p < 0 || waking[p] < 0 || side->pid_task[p] < 0)
+				continue;
+
+			if (n_lat == lat_size) {
+				lat_size = lat_size ? lat_size * 2 : 1024;
+				lat_tmp = realloc(lat, lat_size * sizeof(*lat));
+				if (!lat_tmp)
+					goto out;
+
+				lat = lat_tmp;
+			}
+
+			lat[n_lat].task = side->pid_task[p];
+			lat[n_lat++].latency = m->ts_array[i] - waking[p];
+			waking[p] = -1;
+		}
+	}
+
+	side_set_latencies(side, lat, n_lat);
+
+	if (m->n_rows)
+		side->duration = m->ts_array[m->n_rows - 1] - m->ts_array[0];
+
+	ret = true;
+
+ out:
+	free(lat);
+	free(waking);
+	free(last);
+
+	return ret;
+}
+
+static void diff_worker(void *arg)
+{
+	struct diff_side *side = arg;
+
+	side->failed = !side_init_names(side) || !side_process(side);
+}
+
+static void free_side(struct diff_side *side)
+{
+	free(side->pids);
+	free(side->pid_task);
+	free(side->event_ids);
+	free(side->event_idx);
+	free(side->task_values);
+	free(side->event_count);
+	free_names(&side->tasks);
+	free_names(&side->events);
+}
+
+/*
+ * Merge the two alphabetically sorted lists of names. The names are moved
+ * into the items.
+ */
+static struct kshark_diff_item *merge_items(struct diff_side *side,
+					    bool tasks, size_t *n_items)
+{
+	struct kshark_diff_item *items;
+	struct diff_names *names[2];
+	size_t i[2] = {0, 0}, n = 0;
+	int s, cmp;
+
+	for (s = 0; s < 2; ++s)
+		names[s] = tasks ? &side[s].tasks : &side[s].events;
+
+	items = calloc(names[0]->n_names + names[1]->n_names + 1,
+		       sizeof(*items));
+	if (!items)
+		return NULL;
+
+	while (i[0] < names[0]->n_names || i[1] < names[1]->n_names) {
+		if (i[0] == names[0]->n_names)
+			cmp = 1;
+		else if (i[1] == names[1]->n_names)
+			cmp = -1;
+		else
+			cmp = strcmp(names[0]->names[i[0]],
+				     names[1]->names[i[1]]);
+
+		for (s = 0; s < 2; ++s) {
+			if ((s == 0 && cmp > 0) || (s == 1 && cmp < 0))
+				continue;
+
+			if (tasks)
+				memcpy(items[n].value[s],
+				       side[s].task_values[i[s]],
+				       sizeof(items[n].value[s]));
+			else
+				items[n].value[s][KS_DIFF_COUNT] =
+					side[s].event_count[i[s]];
+
+			if (items[n].name)
+				free(names[s]->names[i[s]]);
+			else
+				items[n].name = names[s]->names[i[s]];
+
+			names[s]->names[i[s]++] = NULL;
+		}
+
+		++n;
+	}
+
+	*n_items = n;
+
+	return items;
+}
+
+static void free_items(struct kshark_diff_item *items, size_t n)
+{
+	size_t i;
+
+	if (!items)
+		return;
+
+	for (i = 0; i < n; ++i)
+		free(items[i].name);
+
+	free(items);
+}
+
+/**
+ * @brief Compare the statistics of the tasks and the events of two Data
+ *	  streams. The tasks and the events are matched by name. The two
+ *	  Data streams are processed in parallel.
+ *
+ * @param kshark_ctx: Input location for the session context pointer.
+ * @param sd_base: Identifier of the baseline Data stream.
+ * @param base: The trace data of the baseline Data stream, in columns.
+ * @param sd_test: Identifier of the Data stream compared to the baseline.
+ * @param test: The trace data of the compared Data stream, in columns.
+ *
+ * @returns The result of the comparison on success, or NULL on failure. The
+ *	    user is responsible for freeing the result, using
+ *	    kshark_free_trace_diff().
+ */
+struct kshark_trace_diff *
+kshark_trace_diff(struct kshark_context *kshark_ctx,
+		  int sd_base, const struct kshark_matrix_data_set *base,
+		  int sd_test, const struct kshark_matrix_data_set *test)
+{
+	struct kshark_trace_diff *diff = NULL;
+	struct diff_side side[2];
+	int s;
+
+	memset(side, 0, sizeof(side));
+	side[KS_DIFF_BASE].sd = sd_base;
+	side[KS_DIFF_BASE].matrix = base;
+	side[KS_DIFF_TEST].sd = sd_test;
+	side[KS_DIFF_TEST].matrix = test;
+
+	for (s = 0; s < 2; ++s)
+		side[s].kshark_ctx = kshark_ctx;
+
+	/* The two sides are processed in parallel. */
+	kshark_pool_run(diff_worker, side, sizeof(*side), 2,
+			KS_TASK_INTERACTIVE, NULL);
+
+	if (side[KS_DIFF_BASE].failed || side[KS_DIFF_TEST].failed)
+		goto fail;
+
+	diff = calloc(1, sizeof(*diff));
+	if (!diff)
+		goto fail;
+
+	diff->tasks = merge_items(side, true, &diff->n_tasks);
+	diff->events = merge_items(side, false, &diff->n_events);
+	if (!diff->tasks || !diff->events)
+		goto fail;
+
+	for (s = 0; s < 2; ++s) {
+		diff->duration[s] = side[s].duration;
+		free_side(&side[s]);
+	}
+
+	return diff;
+
+ fail:
+	fprintf(stderr, "Failed to compare Data streams %i and %i.\n",
+		sd_base, sd_test);
+
+	for (s = 0; s < 2; ++s)
+		free_side(&side[s]);
+
+	kshark_free_trace_diff(diff);
+
+	return NULL;
+}
+
+/**
+ * @brief Free all memory used by the result of a comparison.
+ *
+ * @param diff: Input location for the result of the comparison.
+ */
+void kshark_free_trace_diff(struct kshark_trace_diff *diff)
+{
+	if (!diff)
+		return;
+
+	free_items(diff->tasks, diff->n_tasks);
+	free_items(diff->events, diff->n_events);
+	free(diff);
+}
+
+/**
+ * @brief Get the time-normalized value of a metric. The counts and the run
+ *	  times are divided by the time span of the Data stream (the values
+ *	  are given per second). The latencies are not normalized.
+ *
+ * @param diff: Input location for the result of the comparison.
+ * @param item: Input location for the task or the event.
+ * @param side: KS_DIFF_BASE or KS_DIFF_TEST.
+ * @param metric: The metric.
+ *
+ * @returns The normalized value.
+ */
+double kshark_diff_normalized(const struct kshark_trace_diff *diff,
+			      const struct kshark_diff_item *item,
+			      int side, enum kshark_diff_metric metric)
+{
+	double val = item->value[side][metric];
+
+	if ((metric == KS_DIFF_COUNT || metric == KS_DIFF_RUN_TIME) &&
+	    diff->duration[side] > 0)
+		val *= 1e9 / diff->duration[side];
+
+	return val;
+}
+
+/**
+ * @brief Get the difference of the time-normalized values of a metric.
+ *
+ * @param diff: Input location for the result of the comparison.
+ * @param item: Input location for the task or the event.
+ * @param metric: The metric.
+ *
+ * @returns The normalized value in the compared Data stream minus the
+ *	    normalized value in the baseline. Positive values are regressions.
+ */
+double kshark_diff_delta(const struct kshark_trace_diff *diff,
+			 const struct kshark_diff_item *item,
+			 enum kshark_diff_metric metric)
+{
+	return kshark_diff_normalized(diff, item, KS_DIFF_TEST, metric) -
+	       kshark_diff_normalized(diff, item, KS_DIFF_BASE, metric);
+}
+
+/* Quiet warnings over documenting simple structures */
+//! @cond Doxygen_Suppress
+
+struct diff_rank {
+	double	delta;
+	size_t	idx;
+};
+
+//! @endcond
+
+static int compare_ranks(const void *a, const void *b)
+{
+	const struct diff_rank *ra = a, *rb = b;
+
+	return (ra->delta < rb->delta) - (ra->delta > rb->delta);
+}
+
+/**
+ * @brief Get the top regressions of a given metric.
+ *
+ * @param diff: Input location for the result of the comparison.
+ * @param items: The tasks (or the events) of the comparison.
+ * @param n_items: The number of tasks (or events).
+ * @param metric: The metric.
+ * @param n_top: The maximum number of regressions to be returned.
+ * @param top: Output location for the regressions, sorted by the size of
+ *	       the regression. The array must have space for "n_top" elements.
+ *
+ * @returns The number of regressions found.
+ */
+size_t kshark_diff_top(const struct kshark_trace_diff *diff,
+		       const struct kshark_diff_item *items, size_t n_items,
+		       enum kshark_diff_metric metric, size_t n_top,
+		       const struct kshark_diff_item **top)
+{
+	struct diff_rank *ranks;
+	size_t i, n = 0;
+
+	ranks = malloc((n_items ? n_items : 1) * sizeof(*ranks));
+	if (!ranks)
+		return 0;
+
+	for (i = 0; i < n_items; ++i) {
+		ranks[i].delta = kshark_diff_delta(diff, &items[i], metric);
+		ranks[i].idx = i;
+	}
+
+	qsort(ranks, n_items, sizeof(*ranks), compare_ranks);
+
+	for (i = 0; i < n_items && n < n_top && ranks[i].delta > 0; ++i)
+		top[n++] = &items[ranks[i].idx];
+
+	free(ranks);
+
+	return n;
+}
@@ -0,0 +1,109 @@
+/* SPDX-License-Identifier: LGPL-2.1 */
+
+/*
+ * Copyright (C) 2021 VMware Inc, Yordan Karadzhov (VMware) <y.karadz@gmail.com>
+ */
+
+/**
+ *  @file    libkshark-diff.h
+ *  @brief   Differential comparison of two Data streams.
+ */
+
+#ifndef _LIB_KSHARK_DIFF_H
+#define _LIB_KSHARK_DIFF_H
+
+// KernelShark
+#include "libkshark.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif // __cplusplus
+
+bool kshark_diff_matrix_from_entries(int sd, struct kshark_entry **data,
+				     size_t n_entries,
+				     struct kshark_matrix_data_set *matrix);
+
+void kshark_diff_free_matrix(struct kshark_matrix_data_set *matrix);
+
+/** Statistics metrics compared between the two Data streams. */
+enum kshark_diff_metric {
+	/** The number of entries. */
+	KS_DIFF_COUNT,
+
+	/** The time the task was running (tasks only). */
+	KS_DIFF_RUN_TIME,
+
+	/** The median wakeup latency (tasks only). */
+	KS_DIFF_LATENCY_P50,
+
+	/** The 90th percentile of the wakeup latency (tasks only). */
+	KS_DIFF_LATENCY_P90,
+
+	/** The 99th percentile of the wakeup latency (tasks only). */
+	KS_DIFF_LATENCY_P99,
+
+	/** The number of metrics. */
+	KS_DIFF_N_METRICS,
+};
+
+/** Index of the baseline Data stream. */
+#define KS_DIFF_BASE	0
+
+/** Index of the Data stream compared to the baseline. */
+#define KS_DIFF_TEST	1
+
+/**
+ * The statistics of a task (or an event) in the two Data streams. The tasks
+ * and the events are matched by name.
+ */
+struct kshark_diff_item {
+	/** The name of the task or the event. */
+	char		*name;
+
+	/** The values of the metrics in the two Data streams. */
+	int64_t		value[2][KS_DIFF_N_METRICS];
+};
+
+/** The result of the comparison of two Data streams. */
+struct kshark_trace_diff {
+	/** Array of per-task statistics, sorted by name. */
+	struct kshark_diff_item	*tasks;
+
+	/** The number of tasks. */
+	size_t			n_tasks;
+
+	/** Array of per-event statistics, sorted by name. */
+	struct kshark_diff_item	*events;
+
+	/** The number of events. */
+	size_t			n_events;
+
+	/** The time span of the two Data streams. */
+	int64_t			duration[2];
+};
+
+struct kshark_trace_diff *
+kshark_trace_diff(struct kshark_context *kshark_ctx,
+		  int sd_base, const struct kshark_matrix_data_set *base,
+		  int sd_test, const struct kshark_matrix_data_set *test);
+
+void kshark_free_trace_diff(struct kshark_trace_diff *diff);
+
+double kshark_diff_normalized(const struct kshark_trace_diff *diff,
+			      const struct kshark_diff_item *item,
+			      int side, enum kshark_diff_metric metric);
+
+double kshark_diff_delta(const struct kshark_trace_diff *diff,
+			 const struct kshark_diff_item *item,
+			 enum kshark_diff_metric metric);
+
+size_t kshark_diff_top(const struct kshark_trace_diff *diff,
+		       const struct kshark_diff_item *items, size_t n_items,
+		       enum kshark_diff_metric metric, size_t n_top,
+		       const struct kshark_diff_item **top);
+
+#ifdef __cplusplus
+}
+#endif // __cplusplus
+
+#endif // _LIB_KSHARK_DIFF_H
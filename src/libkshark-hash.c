@@ -81,6 +81,17 @@ void kshark_hash_id_free(struct kshark_hash_id *hash)
 	free(hash);
 }
 
+/** Get the size (in bytes) of the memory used by a hash table of Ids. */
+size_t kshark_hash_id_memory(const struct kshark_hash_id *hash)
+{
+	if (!hash)
+		return 0;
+
+	return sizeof(*hash) +
+	       (1UL << hash->n_bits) * sizeof(*hash->hash) +
+	       hash->count * sizeof(struct kshark_hash_id_item);
+}
+
 /**
  * @brief Check if an Id with a given value exists in this hash table.
  */
@@ -0,0 +1,609 @@
+// SPDX-License-Identifier: LGPL-2.1
+
+/*
+ * Copyright (C) 2021 VMware Inc, Yordan Karadzhov (VMware) <y.karadz@gmail.com>
+ */
+
+ /**
+  *  @file    libkshark-intervals.c
+  *  @brief   Joining of paired start/stop events into time intervals.
+  */
+
+// C
+#include <stdlib.h>
+#include <string.h>
+
+// KernelShark
+#include "libkshark-intervals.h"
+#include "libkshark-pool.h"
+
+/* Quiet warnings over documenting simple structures */
+//! @cond Doxygen_Suppress
+
+enum interval_edge_type {
+	EDGE_START,
+	EDGE_STOP,
+	EDGE_MISSED,
+};
+
+struct interval_edge {
+	size_t		row;
+	int64_t		key;
+	int16_t		cpu;
+	uint8_t		type;
+};
+
+struct interval_rec {
+	int64_t		start;
+	int64_t		end;
+	int64_t		key;
+	ssize_t		start_row;
+	ssize_t		end_row;
+	ssize_t		prev_open;
+	int16_t		cpu;
+	int16_t		depth;
+	uint8_t		flags;
+};
+
+/* Unused slot of the key map. */
+#define KEY_MAP_EMPTY		(-2)
+
+/* The key is known, but it has no open interval. */
+#define KEY_MAP_NO_OPEN		(-1)
+
+#define KEY_MAP_INIT_SIZE	256
+
+struct key_map {
+	int64_t		*keys;
+	ssize_t		*values;
+	size_t		size;
+	size_t		count;
+};
+
+struct join_task {
+	int				id;
+	int				n_tasks;
+	const struct interval_edge	*edges;
+	size_t				n_edges;
+	struct kshark_entry		**data;
+	size_t				n_entries;
+	struct interval_rec		*recs;
+	size_t				n_recs;
+	size_t				capacity;
+	bool				failed;
+};
+
+//! @endcond
+
+static inline size_t key_hash(int64_t key)
+{
+	return ((uint64_t) key * 11400714819323198485llu) >> 32;
+}
+
+static bool key_map_init(struct key_map *map, size_t size)
+{
+	size_t i;
+
+	map->keys = malloc(size * sizeof(*map->keys));
+	map->values = malloc(size * sizeof(*map->values));
+	if (!map->keys || !map->values) {
+		free(map->keys);
+		free(map->values);
+		return false;
+	}
+
+	for (i = 0; i < size; ++i)
+		map->values[i] = KEY_MAP_EMPTY;
+
+	map->size = size;
+	map->count = 0;
+
+	return true;
+}
+
+static void key_map_free(struct key_map *map)
+{
+	free(map->keys);
+	free(map->values);
+}
+
+static ssize_t *key_map_slot(struct key_map *map, int64_t key)
+{
+	size_t i = key_hash(key) & (map->size - 1);
+
+	while (map->values[i] != KEY_MAP_EMPTY && map->keys[i] != key)
+		i = (i + 1) & (map->size - 1);
+
+	map->keys[i] = key;
+
+	return &map->values[i];
+}
+
+static ssize_t *key_map_add(struct key_map *map, int64_t key)
+{
+	struct key_map new_map;
+	ssize_t *slot;
+	size_t i;
+
+	slot = key_map_slot(map, key);
+	if (*slot != KEY_MAP_EMPTY)
+		return slot;
+
+	*slot = KEY_MAP_NO_OPEN;
+	if (2 * (++map->count) <= map->size)
+		return slot;
+
+	if (!key_map_init(&new_map, map->size * 2))
+		return NULL;
+
+	for (i = 0; i < map->size; ++i)
+		if (map->values[i] != KEY_MAP_EMPTY)
+			*key_map_slot(&new_map, map->keys[i]) = map->values[i];
+
+	new_map.count = map->count;
+	key_map_free(map);
+	*map = new_map;
+
+	return key_map_slot(map, key);
+}
+
+static struct interval_rec *new_rec(struct join_task *task)
+{
+	struct interval_rec *recs;
+	size_t capacity;
+
+	if (task->n_recs == task->capacity) {
+		capacity = task->capacity ? task->capacity * 2 : 1024;
+		recs = realloc(task->recs, capacity * sizeof(*recs));
+		if (!recs)
+			return NULL;
+
+		task->recs = recs;
+		task->capacity = capacity;
+	}
+
+	return &task->recs[task->n_recs++];
+}
+
+/* Mark all intervals, which are open on a given CPU. */
+static void mark_missed(struct join_task *task, struct key_map *map, int cpu)
+{
+	ssize_t i, r;
+
+	for (i = 0; i < map->size; ++i) {
+		for (r = map->values[i]; r >= 0; r = task->recs[r].prev_open)
+			if (task->recs[r].cpu == cpu)
+				task->recs[r].flags |= KS_INTERVAL_MISSED_EVENTS;
+	}
+}
+
+static void join_worker(void *arg)
+{
+	struct join_task *task = arg;
+	const struct interval_edge *edge;
+	struct interval_rec *rec;
+	struct key_map map;
+	ssize_t *slot, r;
+	size_t i;
+
+	if (!key_map_init(&map, KEY_MAP_INIT_SIZE)) {
+		task->failed = true;
+		return;
+	}
+
+	for (i = 0; i < task->n_edges; ++i) {
+		edge = &task->edges[i];
+		if (edge->type == EDGE_MISSED) {
+			mark_missed(task, &map, edge->cpu);
+			continue;
+		}
+
+		/* Each task processes only the keys from its own partition. */
+		if (key_hash(edge->key) % task->n_tasks != task->id)
+			continue;
+
+		slot = key_map_add(&map, edge->key);
+		rec = slot ? new_rec(task) : NULL;
+		if (!rec) {
+			task->failed = true;
+			break;
+		}
+
+		if (edge->type == EDGE_START) {
+			/* Open a new interval and push it on the key's stack. */
+			rec->start = task->data[edge->row]->ts;
+			rec->start_row = edge->row;
+			rec->end = -1;
+			rec->end_row = -1;
+			rec->key = edge->key;
+			rec->cpu = edge->cpu;
+			rec->flags = 0;
+			rec->prev_open = *slot;
+			rec->depth = (*slot >= 0) ?
+				     task->recs[*slot].depth + 1 : 0;
+
+			*slot = task->n_recs - 1;
+		} else if (*slot >= 0) {
+			/* Close the innermost open interval of the key. */
+			--task->n_recs;
+			rec = &task->recs[*slot];
+			rec->end = task->data[edge->row]->ts;
+			rec->end_row = edge->row;
+
+			*slot = rec->prev_open;
+		} else {
+			/* Stop event without a start. */
+			rec->start = task->data[0]->ts;
+			rec->start_row = -1;
+			rec->end = task->data[edge->row]->ts;
+			rec->end_row = edge->row;
+			rec->key = edge->key;
+			rec->cpu = edge->cpu;
+			rec->flags = KS_INTERVAL_NO_START;
+			rec->prev_open = KEY_MAP_NO_OPEN;
+			rec->depth = 0;
+		}
+	}
+
+	/* All intervals, which are still open, end with the data. */
+	for (i = 0; i < map.size; ++i) {
+		for (r = map.values[i]; r >= 0; r = task->recs[r].prev_open) {
+			task->recs[r].end = task->data[task->n_entries - 1]->ts;
+			task->recs[r].flags |= KS_INTERVAL_NO_END;
+		}
+	}
+
+	key_map_free(&map);
+}
+
+static int compare_intervals(const void *a, const void *b)
+{
+	const struct interval_rec *ia = a, *ib = b;
+
+	if (ia->start != ib->start)
+		return (ia->start > ib->start) ? 1 : -1;
+
+	if (ia->key != ib->key)
+		return (ia->key > ib->key) ? 1 : -1;
+
+	return ia->depth - ib->depth;
+}
+
+/*
+ * Read the value of the key field of an entry. Use the value extracted during
+ * the loading, if available, followed by the field handle (if any) and
+ * finally by the name of the field.
+ */
+static bool read_key(struct kshark_data_stream *stream,
+		     const struct kshark_entry *e, const char *field,
+		     const struct kshark_field_handle *handle, int64_t *key)
+{
+	if (stream->columns &&
+	    kshark_read_field_column(stream, e, field, key))
+		return true;
+
+	if (handle)
+		return stream->interface.read_event_field_handle_int64(stream,
+								       e,
+								       handle,
+								       key) >= 0;
+
+	return stream->interface.read_event_field_int64(stream, e,
+							field, key) >= 0;
+}
+
+static struct interval_edge *
+collect_edges(struct kshark_data_stream *stream,
+	      int start_event_id, int stop_event_id,
+	      enum kshark_interval_key_type key_type,
+	      const char *key_field,
+	      struct kshark_entry **data, size_t n_entries,
+	      size_t *n_edges)
+{
+	struct kshark_field_handle *handles[2] = {NULL, NULL};
+	struct interval_edge *edges = NULL, *new_edges;
+	size_t i, count = 0, capacity = 0;
+	struct kshark_entry *e;
+	uint8_t type;
+	int64_t key;
+
+	/*
+	 * Currently the data reading operations are not thread-safe. The
+	 * keys are read in this single sequential pass, holding the mutex,
+	 * hence the parallel join does not read any data.
+	 */
+	if (key_type == KS_INTERVAL_KEY_FIELD) {
+		pthread_mutex_lock(&stream->input_mutex);
+
+		if (stream->interface.get_field_handle &&
+		    stream->interface.read_event_field_handle_int64) {
+			handles[EDGE_START] =
+				stream->interface.get_field_handle(stream,
+								   start_event_id,
+								   key_field);
+			handles[EDGE_STOP] =
+				stream->interface.get_field_handle(stream,
+								   stop_event_id,
+								   key_field);
+		}
+	}
+
+	for (i = 0; i < n_entries; ++i) {
+		e = data[i];
+		if (e->stream_id != stream->stream_id)
+			continue;
+
+		if (e->event_id == start_event_id)
+			type = EDGE_START;
+		else if (e->event_id == stop_event_id)
+			type = EDGE_STOP;
+		else if (e->event_id == KS_EVENT_OVERFLOW)
+			type = EDGE_MISSED;
+		else
+			continue;
+
+		key = e->cpu;
+		if (type != EDGE_MISSED && key_type == KS_INTERVAL_KEY_PID) {
+			key = e->pid;
+		} else if (type != EDGE_MISSED &&
+			   key_type == KS_INTERVAL_KEY_FIELD) {
+			if (!read_key(stream, e, key_field, handles[type],
+				      &key))
+				continue;
+		}
+
+		if (count == capacity) {
+			capacity = capacity ? capacity * 2 : 1024;
+			new_edges = realloc(edges, capacity * sizeof(*edges));
+			if (!new_edges) {
+				free(edges);
+				edges = NULL;
+				goto out;
+			}
+
+			edges = new_edges;
+		}
+
+		edges[count].row = i;
+		edges[count].key = key;
+		edges[count].cpu = e->cpu;
+		edges[count].type = type;
+		++count;
+	}
+
+	*n_edges = count;
+
+	/* Make sure that an empty result is not mistaken for a failure. */
+	if (!edges)
+		edges = malloc(1);
+
+ out:
+	if (key_type == KS_INTERVAL_KEY_FIELD)
+		pthread_mutex_unlock(&stream->input_mutex);
+
+	return edges;
+}
+
+static bool interval_set_alloc(struct kshark_interval_set *set, size_t n)
+{
+	set->n_intervals = n;
+	if (!n)
+		n = 1;
+
+	set->start = malloc(n * sizeof(*set->start));
+	set->end = malloc(n * sizeof(*set->end));
+	set->duration = malloc(n * sizeof(*set->duration));
+	set->key = malloc(n * sizeof(*set->key));
+	set->start_row = malloc(n * sizeof(*set->start_row));
+	set->end_row = malloc(n * sizeof(*set->end_row));
+	set->depth = malloc(n * sizeof(*set->depth));
+	set->flags = malloc(n * sizeof(*set->flags));
+
+	return set->start && set->end && set->duration && set->key &&
+	       set->start_row && set->end_row && set->depth && set->flags;
+}
+
+/**
+ * @brief Join pairs of start and stop events into time intervals. Each
+ *	  start event opens an interval for its key and each stop event
+ *	  closes the innermost open interval having the same key. Nested
+ *	  intervals are supported. Stop events without a start and start
+ *	  events without a stop produce intervals, which start (end) with the
+ *	  data and have the corresponding flag set. The intervals that are
+ *	  open on a CPU when events are lost are marked as well.
+ *	  The edges (and their keys) are collected in a single sequential
+ *	  pass over the data, after which the keys are joined in parallel.
+ *
+ * @param kshark_ctx: Input location for the session context pointer.
+ * @param sd: Data stream identifier.
+ * @param start_event_id: The Id of the event starting the intervals.
+ * @param stop_event_id: The Id of the event ending the intervals.
+ * @param key_type: The type of the key used to pair the events.
+ * @param key_field: The name of the data field used as a key. Used only if
+ *		     the key type is KS_INTERVAL_KEY_FIELD.
+ * @param data: Input location for the trace data.
+ * @param n_entries: The size of the inputted data.
+ *
+ * @returns The set of intervals on success, or NULL on failure. The user is
+ *	    responsible for freeing the set, using kshark_free_interval_set().
+ */
+struct kshark_interval_set *
+kshark_join_intervals(struct kshark_context *kshark_ctx, int sd,
+		      int start_event_id, int stop_event_id,
+		      enum kshark_interval_key_type key_type,
+		      const char *key_field,
+		      struct kshark_entry **data, size_t n_entries)
+{
+	struct kshark_interval_set *set = NULL;
+	struct kshark_data_stream *stream;
+	struct join_task *tasks = NULL;
+	struct interval_edge *edges;
+	struct interval_rec *recs;
+	size_t i, j, n_edges, total = 0;
+	int n_tasks, t;
+
+	stream = kshark_get_data_stream(kshark_ctx, sd);
+	if (!stream || !n_entries || start_event_id == stop_event_id ||
+	    (key_type == KS_INTERVAL_KEY_FIELD && !key_field))
+		return NULL;
+
+	edges = collect_edges(stream, start_event_id, stop_event_id,
+			      key_type, key_field, data, n_entries, &n_edges);
+	if (!edges)
+		goto fail;
+
+	n_tasks = kshark_pool_size();
+	if (n_tasks < 1 || n_edges < 1024)
+		n_tasks = 1;
+
+	tasks = calloc(n_tasks, sizeof(*tasks));
+	if (!tasks)
+		goto fail;
+
+	for (t = 0; t < n_tasks; ++t) {
+		tasks[t].id = t;
+		tasks[t].n_tasks = n_tasks;
+		tasks[t].edges = edges;
+		tasks[t].n_edges = n_edges;
+		tasks[t].data = data;
+		tasks[t].n_entries = n_entries;
+	}
+
+	kshark_pool_run(join_worker, tasks, sizeof(*tasks), n_tasks,
+			KS_TASK_INTERACTIVE, NULL);
+
+	for (t = 0; t < n_tasks; ++t) {
+		if (tasks[t].failed)
+			goto fail;
+
+		total += tasks[t].n_recs;
+	}
+
+	/* Gather the intervals found by all tasks and sort them in time. */
+	recs = tasks[0].recs;
+	if (n_tasks > 1) {
+		recs = malloc((total ? total : 1) * sizeof(*recs));
+		if (!recs)
+			goto fail;
+
+		for (t = 0, j = 0; t < n_tasks; ++t) {
+			memcpy(&recs[j], tasks[t].recs,
+			       tasks[t].n_recs * sizeof(*recs));
+			j += tasks[t].n_recs;
+			free(tasks[t].recs);
+			tasks[t].recs = NULL;
+		}
+	} else {
+		tasks[0].recs = NULL;
+	}
+
+	if (recs)
+		qsort(recs, total, sizeof(*recs), compare_intervals);
+
+	set = calloc(1, sizeof(*set));
+	if (!set || !interval_set_alloc(set, total)) {
+		free(recs);
+		goto fail;
+	}
+
+	for (i = 0; i < total; ++i) {
+		set->start[i] = recs[i].start;
+		set->end[i] = recs[i].end;
+		set->duration[i] = recs[i].end - recs[i].start;
+		set->key[i] = recs[i].key;
+		set->start_row[i] = recs[i].start_row;
+		set->end_row[i] = recs[i].end_row;
+		set->depth[i] = recs[i].depth;
+		set->flags[i] = recs[i].flags;
+
+		if (set->max_duration < set->duration[i])
+			set->max_duration = set->duration[i];
+	}
+
+	free(recs);
+	free(tasks);
+	free(edges);
+
+	return set;
+
+ fail:
+	fprintf(stderr, "Failed to join intervals.\n");
+	if (tasks)
+		for (t = 0; t < n_tasks; ++t)
+			free(tasks[t].recs);
+
+	free(tasks);
+	free(edges);
+	kshark_free_interval_set(set);
+
+	return NULL;
+}
+
+/**
+ * @brief Free all memory used by a set of intervals.
+ *
+ * @param set: Input location for the set of intervals.
+ */
+void kshark_free_interval_set(struct kshark_interval_set *set)
+{
+	if (!set)
+		return;
+
+	free(set->start);
+	free(set->end);
+	free(set->duration);
+	free(set->key);
+	free(set->start_row);
+	free(set->end_row);
+	free(set->depth);
+	free(set->flags);
+	free(set);
+}
+
+/**
+ * @brief Binary search inside a set of intervals.
+ *
+ * @param set: Input location for the set of intervals.
+ * @param time: The value of time to search for.
+ *
+ * @returns The index of the first interval, starting at "time" or later.
+ *	    If all intervals start earlier, the number of intervals is
+ *	    returned.
+ */
+ssize_t kshark_find_interval_by_time(const struct kshark_interval_set *set,
+				     int64_t time)
+{
+	ssize_t l = -1, h = set->n_intervals, mid;
+
+	BSEARCH(h, l, set->start[mid] < time);
+
+	return h;
+}
+
+/**
+ * @brief Export a set of intervals in CSV format.
+ *
+ * @param set: Input location for the set of intervals.
+ * @param file: Output file.
+ *
+ * @returns Zero on success, or a negative error code on failure.
+ */
+int kshark_export_intervals_csv(const struct kshark_interval_set *set,
+				FILE *file)
+{
+	size_t i;
+
+	if (!set || !file)
+		return -EFAULT;
+
+	fprintf(file, "start,end,duration,key,depth,flags,start_row,end_row\n");
+	for (i = 0; i < set->n_intervals; ++i) {
+		if (fprintf(file, "%li,%li,%li,%li,%i,%i,%zi,%zi\n",
+			    set->start[i], set->end[i], set->duration[i],
+			    set->key[i], set->depth[i], set->flags[i],
+			    set->start_row[i], set->end_row[i]) < 0)
+			return -EIO;
+	}
+
+	return 0;
+}
@@ -0,0 +1,107 @@
+/* SPDX-License-Identifier: LGPL-2.1 */
+
+/*
+ * Copyright (C) 2021 VMware Inc, Yordan Karadzhov (VMware) <y.karadz@gmail.com>
+ */
+
+/**
+ *  @file    libkshark-intervals.h
+ *  @brief   Joining of paired start/stop events into time intervals.
+ */
+
+#ifndef _LIB_KSHARK_INTERVALS_H
+#define _LIB_KSHARK_INTERVALS_H
+
+// C
+#include <stdio.h>
+
+// KernelShark
+#include "libkshark.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif // __cplusplus
+
+/** The key used to pair the start and the stop events. */
+enum kshark_interval_key_type {
+	/** Pair the events recorded on the same CPU. */
+	KS_INTERVAL_KEY_CPU,
+
+	/** Pair the events having the same Process Id. */
+	KS_INTERVAL_KEY_PID,
+
+	/** Pair the events having the same value of a data field. */
+	KS_INTERVAL_KEY_FIELD,
+};
+
+/** The start event of the interval has not been found. */
+#define KS_INTERVAL_NO_START		(1 << 0)
+
+/** The stop event of the interval has not been found. */
+#define KS_INTERVAL_NO_END		(1 << 1)
+
+/** Events have been lost while the interval was open. */
+#define KS_INTERVAL_MISSED_EVENTS	(1 << 2)
+
+/**
+ * Time intervals, defined by pairs of start and stop events, stored in
+ * columns. The intervals are sorted in time by their start.
+ */
+struct kshark_interval_set {
+	/** Array of start timestamps. */
+	int64_t		*start;
+
+	/** Array of end timestamps. */
+	int64_t		*end;
+
+	/** Array of durations (end - start). */
+	int64_t		*duration;
+
+	/** Array of the values of the key. */
+	int64_t		*key;
+
+	/**
+	 * Array of the indexes (inside the data array) of the start entries.
+	 * The value is -1 if the start event has not been found.
+	 */
+	ssize_t		*start_row;
+
+	/**
+	 * Array of the indexes (inside the data array) of the stop entries.
+	 * The value is -1 if the stop event has not been found.
+	 */
+	ssize_t		*end_row;
+
+	/** Array of nesting depths. Zero for not nested intervals. */
+	int16_t		*depth;
+
+	/** Array of flags (KS_INTERVAL_NO_START ...). */
+	uint8_t		*flags;
+
+	/** The number of intervals. */
+	size_t		n_intervals;
+
+	/** The duration of the longest interval. */
+	int64_t		max_duration;
+};
+
+struct kshark_interval_set *
+kshark_join_intervals(struct kshark_context *kshark_ctx, int sd,
+		      int start_event_id, int stop_event_id,
+		      enum kshark_interval_key_type key_type,
+		      const char *key_field,
+		      struct kshark_entry **data, size_t n_entries);
+
+void kshark_free_interval_set(struct kshark_interval_set *set);
+
+ssize_t kshark_find_interval_by_time(const struct kshark_interval_set *set,
+				     int64_t time);
+
+int kshark_export_intervals_csv(const struct kshark_interval_set *set,
+				FILE *file);
+
+#ifdef __cplusplus
+}
+#endif // __cplusplus
+
+#endif // _LIB_KSHARK_INTERVALS_H
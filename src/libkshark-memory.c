@@ -0,0 +1,309 @@
+// SPDX-License-Identifier: LGPL-2.1
+
+/*
+ * Copyright (C) 2021 VMware Inc, Yordan Karadzhov (VMware) <y.karadz@gmail.com>
+ */
+
+/**
+ *  @file    libkshark-memory.c
+ *  @brief   Accounting of the memory used by a KernelShark session.
+ */
+
+// C
+#include <stdlib.h>
+#include <string.h>
+
+// KernelShark
+#include "libkshark-memory.h"
+#include "libkshark-plugin.h"
+#include "libkshark-tepdata.h"
+
+/**
+ * @brief Get the name of a subsystem of the session.
+ *
+ * @param sub: The subsystem.
+ */
+const char *kshark_memory_subsystem_name(enum kshark_memory_subsystem sub)
+{
+	switch (sub) {
+	case KS_MEM_ENTRIES:
+		return "Entries";
+	case KS_MEM_ROWS:
+		return "Rows";
+	case KS_MEM_COLLECTIONS:
+		return "Collections";
+	case KS_MEM_HASH_TABLES:
+		return "Hash tables";
+	case KS_MEM_PLUGINS:
+		return "Plugins";
+	case KS_MEM_STREAMS:
+		return "Data streams";
+	default:
+		return "Unknown";
+	}
+}
+
+static void account(struct kshark_memory_report *report,
+		    enum kshark_memory_subsystem sub, int sd, size_t size)
+{
+	report->subsystem[sub] += size;
+	report->total += size;
+
+	if (sd >= 0 && sd < KS_MAX_NUM_STREAMS)
+		report->stream[sd] += size;
+}
+
+static size_t string_memory(const char *str)
+{
+	return str ? strlen(str) + 1 : 0;
+}
+
+static void account_entries(struct kshark_context *kshark_ctx,
+			    struct kshark_memory_report *report,
+			    struct kshark_entry **data, size_t n_entries)
+{
+	size_t i;
+
+	report->spilled = kshark_ctx->spill_used;
+
+	if (!data) {
+		/* The entries cannot be attributed to the Data streams. */
+		account(report, KS_MEM_ENTRIES, -1,
+			kshark_ctx->mem_used + kshark_ctx->spill_used);
+
+		return;
+	}
+
+	for (i = 0; i < n_entries; ++i)
+		account(report, KS_MEM_ENTRIES, data[i]->stream_id,
+			sizeof(*data[i]));
+
+	account(report, KS_MEM_ROWS, -1, n_entries * sizeof(*data));
+}
+
+static void account_collections(struct kshark_context *kshark_ctx,
+				struct kshark_memory_report *report)
+{
+	struct kshark_entry_collection *col;
+	size_t size;
+
+	for (col = kshark_ctx->collections; col; col = col->next) {
+		size = sizeof(*col) +
+		       col->n_val * sizeof(*col->values) +
+		       col->size * sizeof(*col->resume_points) +
+		       col->size * sizeof(*col->break_points) +
+		       col->n_states * sizeof(*col->state_points) +
+		       col->n_states * sizeof(*col->state_ends);
+
+		account(report, KS_MEM_COLLECTIONS, col->stream_id, size);
+	}
+}
+
+static void account_hash_tables(struct kshark_data_stream *stream,
+				struct kshark_memory_report *report)
+{
+	struct kshark_hash_id *tables[] = {
+		stream->tasks,
+		stream->show_task_filter,
+		stream->hide_task_filter,
+		stream->show_event_filter,
+		stream->hide_event_filter,
+		stream->show_cpu_filter,
+		stream->hide_cpu_filter,
+	};
+	size_t i, size = 0;
+
+	for (i = 0; i < sizeof(tables) / sizeof(tables[0]); ++i)
+		size += kshark_hash_id_memory(tables[i]);
+
+	account(report, KS_MEM_HASH_TABLES, stream->stream_id, size);
+}
+
+static bool account_plugins(struct kshark_data_stream *stream,
+			    struct kshark_memory_report *report)
+{
+	struct kshark_event_proc_handler *evt_handler;
+	struct kshark_batch_proc_handler *batch_handler;
+	struct kshark_memory_plugin *plugins;
+	struct kshark_draw_handler *draw_handler;
+	struct kshark_dpi_list *plugin;
+	int sd = stream->stream_id;
+	size_t size = 0;
+
+	for (evt_handler = stream->event_handlers; evt_handler;
+	     evt_handler = evt_handler->next)
+		size += sizeof(*evt_handler);
+
+	for (batch_handler = stream->batch_handlers; batch_handler;
+	     batch_handler = batch_handler->next)
+		size += sizeof(*batch_handler);
+
+	for (draw_handler = stream->draw_handlers; draw_handler;
+	     draw_handler = draw_handler->next)
+		size += sizeof(*draw_handler);
+
+	for (plugin = stream->plugins; plugin; plugin = plugin->next) {
+		size += sizeof(*plugin);
+		if (!(plugin->status & KSHARK_PLUGIN_LOADED) ||
+		    !plugin->interface->memory)
+			continue;
+
+		plugins = realloc(report->plugins,
+				  (report->n_plugins + 1) * sizeof(*plugins));
+		if (!plugins)
+			return false;
+
+		report->plugins = plugins;
+		plugins += report->n_plugins++;
+
+		plugins->name = plugin->interface->name;
+		plugins->stream_id = sd;
+		plugins->size = plugin->interface->memory(stream);
+
+		account(report, KS_MEM_PLUGINS, sd, plugins->size);
+	}
+
+	account(report, KS_MEM_PLUGINS, sd, size);
+
+	return true;
+}
+
+static void account_stream(struct kshark_data_stream *stream,
+			   struct kshark_memory_report *report)
+{
+	size_t size;
+
+	size = sizeof(*stream) +
+	       string_memory(stream->file) +
+	       string_memory(stream->name) +
+	       stream->calib_array_size * sizeof(*stream->calib_array);
+
+	if (stream->format == KS_TEP_DATA)
+		size += kshark_tep_memory(stream);
+
+	size += kshark_field_columns_memory(stream);
+
+	account(report, KS_MEM_STREAMS, stream->stream_id, size);
+}
+
+/**
+ * @brief Walk all data structures of the session and account the memory
+ *	  used by them. The memory used internally by the external libraries
+ *	  (like libtraceevent) is not included.
+ *
+ * @param kshark_ctx: Input location for the session context pointer.
+ * @param data: Input location for the trace data, loaded by using
+ *		kshark_load_entries() or kshark_load_all_entries(). Can be
+ *		NULL, in which case the memory used by the entries is not
+ *		attributed to the individual Data streams.
+ * @param n_entries: The size of the inputted data.
+ *
+ * @returns Report of the memory used by the session on success, or NULL on
+ *	    failure. The user is responsible for freeing the report by using
+ *	    kshark_free_memory_report().
+ */
+struct kshark_memory_report *
+kshark_memory_report(struct kshark_context *kshark_ctx,
+		     struct kshark_entry **data, size_t n_entries)
+{
+	struct kshark_memory_report *report;
+	struct kshark_data_stream *stream;
+	int i, *stream_ids;
+
+	report = calloc(1, sizeof(*report));
+	if (!report)
+		goto fail;
+
+	account_entries(kshark_ctx, report, data, n_entries);
+	account_collections(kshark_ctx, report);
+
+	stream_ids = kshark_all_streams(kshark_ctx);
+	if (!stream_ids && kshark_ctx->n_streams)
+		goto fail;
+
+	for (i = 0; i < kshark_ctx->n_streams; ++i) {
+		stream = kshark_get_data_stream(kshark_ctx, stream_ids[i]);
+		if (!stream)
+			continue;
+
+		account_stream(stream, report);
+		account_hash_tables(stream, report);
+		if (!account_plugins(stream, report)) {
+			free(stream_ids);
+			goto fail;
+		}
+	}
+
+	free(stream_ids);
+
+	return report;
+
+ fail:
+	fprintf(stderr, "Failed to allocate memory for memory report.\n");
+	kshark_free_memory_report(report);
+	return NULL;
+}
+
+/** Free a report of the memory used by a session. */
+void kshark_free_memory_report(struct kshark_memory_report *report)
+{
+	if (!report)
+		return;
+
+	free(report->plugins);
+	free(report);
+}
+
+static double to_mb(size_t size)
+{
+	return size / (double) (1 << 20);
+}
+
+/**
+ * @brief Print a report of the memory used by a session in a human readable
+ *	  format.
+ *
+ * @param kshark_ctx: Input location for the session context pointer.
+ * @param report: Input location for the report.
+ * @param out: The output stream.
+ */
+void kshark_print_memory_report(struct kshark_context *kshark_ctx,
+				const struct kshark_memory_report *report,
+				FILE *out)
+{
+	struct kshark_data_stream *stream;
+	int i;
+
+	fprintf(out, "Memory usage [MB]\n");
+	for (i = 0; i < KS_MEM_N_SUBSYSTEMS; ++i)
+		fprintf(out, "  %-24s %12.3f\n",
+			kshark_memory_subsystem_name(i),
+			to_mb(report->subsystem[i]));
+
+	if (report->spilled)
+		fprintf(out, "  %-24s %12.3f\n", "(spilled entries)",
+			to_mb(report->spilled));
+
+	fprintf(out, "  %-24s %12.3f\n\n", "Total", to_mb(report->total));
+
+	fprintf(out, "Data streams [MB]\n");
+	for (i = 0; i < KS_MAX_NUM_STREAMS; ++i) {
+		stream = kshark_get_data_stream(kshark_ctx, i);
+		if (!stream)
+			continue;
+
+		fprintf(out, "  %3i %-20s %12.3f\n",
+			i, stream->file ? stream->file : "-",
+			to_mb(report->stream[i]));
+	}
+
+	if (!report->n_plugins)
+		return;
+
+	fprintf(out, "\nPlugins [MB]\n");
+	for (i = 0; i < report->n_plugins; ++i)
+		fprintf(out, "  %3i %-20s %12.3f\n",
+			report->plugins[i].stream_id,
+			report->plugins[i].name,
+			to_mb(report->plugins[i].size));
+}
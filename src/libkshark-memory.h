@@ -0,0 +1,101 @@
+/* SPDX-License-Identifier: LGPL-2.1 */
+
+/*
+ * Copyright (C) 2021 VMware Inc, Yordan Karadzhov (VMware) <y.karadz@gmail.com>
+ */
+
+/**
+ *  @file    libkshark-memory.h
+ *  @brief   Accounting of the memory used by a KernelShark session.
+ */
+
+#ifndef _LIB_KSHARK_MEMORY_H
+#define _LIB_KSHARK_MEMORY_H
+
+// C
+#include <stdio.h>
+
+// KernelShark
+#include "libkshark.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif // __cplusplus
+
+/** Subsystems of the session, used by the memory accounting. */
+enum kshark_memory_subsystem {
+	/** The trace entries. */
+	KS_MEM_ENTRIES,
+
+	/** The array of pointers to the trace entries. */
+	KS_MEM_ROWS,
+
+	/** The Data collections. */
+	KS_MEM_COLLECTIONS,
+
+	/** The hash tables of Ids (tasks and filters). */
+	KS_MEM_HASH_TABLES,
+
+	/** The plugins (data containers and handlers). */
+	KS_MEM_PLUGINS,
+
+	/** The Data streams and their readout interfaces. */
+	KS_MEM_STREAMS,
+
+	/** The number of subsystems. */
+	KS_MEM_N_SUBSYSTEMS,
+};
+
+/** The memory used by a plugin, for a given Data stream. */
+struct kshark_memory_plugin {
+	/** The name of the plugin. */
+	const char	*name;
+
+	/** Data stream identifier. */
+	int		stream_id;
+
+	/** The size of the memory (in bytes). */
+	size_t		size;
+};
+
+/** Report of the memory used by a session. All sizes are in bytes. */
+struct kshark_memory_report {
+	/** The memory used by each subsystem. */
+	size_t				subsystem[KS_MEM_N_SUBSYSTEMS];
+
+	/** The memory used by each Data stream. */
+	size_t				stream[KS_MAX_NUM_STREAMS];
+
+	/**
+	 * The part of the memory of the entries, which is kept in the
+	 * temporary (spill) file.
+	 */
+	size_t				spilled;
+
+	/** The total memory used by the session. */
+	size_t				total;
+
+	/** Array of the memory used by each plugin for each Data stream. */
+	struct kshark_memory_plugin	*plugins;
+
+	/** The number of elements of the array of plugins. */
+	int				n_plugins;
+};
+
+const char *kshark_memory_subsystem_name(enum kshark_memory_subsystem sub);
+
+struct kshark_memory_report *
+kshark_memory_report(struct kshark_context *kshark_ctx,
+		     struct kshark_entry **data, size_t n_entries);
+
+void kshark_free_memory_report(struct kshark_memory_report *report);
+
+void kshark_print_memory_report(struct kshark_context *kshark_ctx,
+				const struct kshark_memory_report *report,
+				FILE *out);
+
+#ifdef __cplusplus
+}
+#endif // __cplusplus
+
+#endif // _LIB_KSHARK_MEMORY_H
@@ -424,6 +424,8 @@ void ksmodel_fill(struct kshark_trace_histo *histo,
 		return;
 	}
 
+	kshark_self_trace_begin("kshark: model fill %i bins", histo->n_bins);
+
 	/* Set the Lower Overflow bin */
 	ksmodel_set_lower_edge(histo);
 
@@ -441,6 +443,8 @@ void ksmodel_fill(struct kshark_trace_histo *histo,
 
 	/* Calculate the number of entries in each bin. */
 	ksmodel_set_bin_counts(histo);
+
+	kshark_self_trace_end();
 }
 
 /**
@@ -957,6 +961,49 @@ ksmodel_get_entry_front(struct kshark_trace_histo *histo,
 	return entry;
 }
 
+/*
+ * Search backwards for an entry of the collection, starting from the back end
+ * of the bin. The search is limited to the collection state (interval)
+ * containing the last entry of the bin.
+ */
+static const struct kshark_entry *
+ksmodel_get_state_entry_back(struct kshark_trace_histo *histo,
+			     int bin, bool vis_only,
+			     matching_condition_func func,
+			     int sd, int *values,
+			     struct kshark_entry_collection *col,
+			     ssize_t *index)
+{
+	struct kshark_entry_request *req;
+	const struct kshark_entry *entry;
+	ssize_t first, last, state;
+
+	last = ksmodel_last_index_at_bin(histo, bin);
+	if (last < 0)
+		return NULL;
+
+	state = kshark_get_collection_state(col, last);
+	if (state < 0)
+		return NULL;
+
+	/* Search only inside the last state of the collection. */
+	first = col->state_points[state];
+	if (last > col->state_ends[state])
+		last = col->state_ends[state];
+
+	req = kshark_entry_request_alloc(last, last - first + 1,
+					 func, sd, values,
+					 vis_only, KS_GRAPH_VIEW_FILTER_MASK);
+	if (!req)
+		return NULL;
+
+	entry = kshark_get_collection_entry_back(&req, histo->data, col,
+						 index);
+	kshark_free_entry_request(req);
+
+	return entry;
+}
+
 /**
  * @brief In a given bin, start from the back end of the bin and go towards
  *	  the front end, searching for an entry satisfying the Matching
@@ -988,6 +1035,32 @@ ksmodel_get_entry_back(struct kshark_trace_histo *histo,
 	if (index)
 		*index = KS_EMPTY_BIN;
 
+	if (bin == LOWER_OVERFLOW_BIN &&
+	    col && col->size && col->n_states &&
+	    col->cond == func && col->stream_id == sd &&
+	    col->n_val == 1 && col->values[0] == *values) {
+		/*
+		 * The Lower Overflow Bin can be huge and the entry we are
+		 * looking for can be located far away from its back end.
+		 * The requested entries are exactly the entries of the
+		 * collection, hence the entry is inside the last state (the
+		 * same Process Id and CPU Id) of the collection. The state
+		 * is found with a binary search, so the cost no longer
+		 * depends on how far back the entry is.
+		 */
+		ssize_t i;
+
+		entry = ksmodel_get_state_entry_back(histo, bin, vis_only,
+						     func, sd, values,
+						     col, &i);
+		if (entry && i >= 0) {
+			if (index)
+				*index = i;
+
+			return entry;
+		}
+	}
+
 	/* Set the position at the end of the bin and go backwards. */
 	req = ksmodel_entry_back_request_alloc(histo, bin, vis_only,
 					       func, sd, values);
@@ -1390,3 +1463,202 @@ int ksmodel_get_bin(struct kshark_trace_histo *histo,
 
 	return  (entry->ts - histo->min) / histo->bin_size;
 }
+
+/**
+ * @brief Compute a coarse summary of the entire trace. The entries are
+ *	  distributed into KS_SUMMARY_N_BUCKETS buckets of equal size in time.
+ *	  For each bucket the total number of entries and the utilization of
+ *	  each CPU are calculated.
+ *
+ * @param kshark_ctx: Input location for the session context pointer.
+ * @param data: Input location for the trace data (sorted in time).
+ * @param n: The size of the trace data array.
+ *
+ * @returns The summary of the trace on success, or NULL on failure. The user
+ *	    is responsible for freeing the summary by using
+ *	    ksmodel_summary_free().
+ */
+struct kshark_trace_summary *
+ksmodel_summary_alloc(struct kshark_context *kshark_ctx,
+		      struct kshark_entry **data, size_t n)
+{
+	struct kshark_trace_summary *summary;
+	struct kshark_data_stream *stream;
+	int64_t *last_ts = NULL, t, t_end;
+	int *last_pid = NULL;
+	int i, cpu, b, k;
+	size_t r;
+
+	if (!n)
+		return NULL;
+
+	summary = calloc(1, sizeof(*summary));
+	if (!summary)
+		goto fail;
+
+	summary->min = data[0]->ts;
+	summary->max = data[n - 1]->ts;
+	summary->n_entries = n;
+
+	/* The last entry must fall inside the last bucket. */
+	summary->bucket_size =
+		(summary->max - summary->min) / KS_SUMMARY_N_BUCKETS + 1;
+
+	for (i = 0; i < KS_MAX_NUM_STREAMS; ++i) {
+		stream = kshark_get_data_stream(kshark_ctx, i);
+		if (!stream) {
+			summary->cpu_offset[i] = -1;
+			continue;
+		}
+
+		summary->cpu_offset[i] = summary->n_cpus;
+		summary->n_cpus += stream->n_cpus;
+	}
+
+	if (summary->n_cpus) {
+		summary->busy = calloc(summary->n_cpus * KS_SUMMARY_N_BUCKETS,
+				       sizeof(*summary->busy));
+		last_ts = malloc(summary->n_cpus * sizeof(*last_ts));
+		last_pid = malloc(summary->n_cpus * sizeof(*last_pid));
+		if (!summary->busy || !last_ts || !last_pid)
+			goto fail;
+
+		for (i = 0; i < summary->n_cpus; ++i)
+			last_ts[i] = -1;
+	}
+
+	for (r = 0; r < n; ++r) {
+		b = (data[r]->ts - summary->min) / summary->bucket_size;
+		summary->count[b]++;
+
+		stream = kshark_get_data_stream(kshark_ctx,
+						data[r]->stream_id);
+		if (!stream || data[r]->cpu < 0 ||
+		    data[r]->cpu >= stream->n_cpus)
+			continue;
+
+		cpu = summary->cpu_offset[data[r]->stream_id] + data[r]->cpu;
+
+		/*
+		 * The CPU was running the task of its previous entry until
+		 * the time of this entry. Same as in the CPU graphs.
+		 */
+		if (last_ts[cpu] >= 0 && last_pid[cpu] != stream->idle_pid) {
+			t = last_ts[cpu];
+			for (k = (t - summary->min) / summary->bucket_size;
+			     k <= b; ++k) {
+				t_end = summary->min +
+					(k + 1) * summary->bucket_size;
+				if (t_end > data[r]->ts)
+					t_end = data[r]->ts;
+
+				summary->busy[cpu * KS_SUMMARY_N_BUCKETS + k] +=
+					t_end - t;
+
+				t = t_end;
+			}
+		}
+
+		last_ts[cpu] = data[r]->ts;
+		last_pid[cpu] = data[r]->pid;
+	}
+
+	free(last_ts);
+	free(last_pid);
+
+	return summary;
+
+ fail:
+	fprintf(stderr, "Failed to allocate memory for trace summary.\n");
+	ksmodel_summary_free(summary);
+	free(last_ts);
+	free(last_pid);
+
+	return NULL;
+}
+
+/**
+ * @brief Free the memory used by a summary of the trace.
+ *
+ * @param summary: Input location for the summary.
+ */
+void ksmodel_summary_free(struct kshark_trace_summary *summary)
+{
+	if (!summary)
+		return;
+
+	free(summary->busy);
+	free(summary);
+}
+
+/**
+ * @brief Get the bucket of the summary containing a given time.
+ *
+ * @param summary: Input location for the summary.
+ * @param ts: Timestamp.
+ *
+ * @returns The index of the bucket. Timestamps outside of the time span of
+ *	    the trace are mapped to the first or the last bucket.
+ */
+int ksmodel_summary_bucket(const struct kshark_trace_summary *summary,
+			   int64_t ts)
+{
+	if (ts <= summary->min)
+		return 0;
+
+	if (ts >= summary->max)
+		return (summary->max - summary->min) / summary->bucket_size;
+
+	return (ts - summary->min) / summary->bucket_size;
+}
+
+/**
+ * @brief Get the number of entries in a range of buckets of the summary.
+ *
+ * @param summary: Input location for the summary.
+ * @param first: The first bucket of the range.
+ * @param last: The last bucket of the range (inclusive).
+ */
+size_t ksmodel_summary_count(const struct kshark_trace_summary *summary,
+			     int first, int last)
+{
+	size_t count = 0;
+	int b;
+
+	for (b = first; b <= last; ++b)
+		count += summary->count[b];
+
+	return count;
+}
+
+/**
+ * @brief Get the utilization of a CPU in a range of buckets of the summary.
+ *
+ * @param summary: Input location for the summary.
+ * @param sd: Data stream identifier.
+ * @param cpu: CPU Id.
+ * @param first: The first bucket of the range.
+ * @param last: The last bucket of the range (inclusive).
+ *
+ * @returns The fraction of the time (between 0 and 1), during which the CPU
+ *	    was running a non-idle task.
+ */
+double ksmodel_summary_cpu_util(const struct kshark_trace_summary *summary,
+				int sd, int cpu, int first, int last)
+{
+	const uint64_t *busy;
+	uint64_t time = 0;
+	int b;
+
+	if (sd < 0 || sd >= KS_MAX_NUM_STREAMS ||
+	    summary->cpu_offset[sd] < 0 || !summary->busy)
+		return 0.;
+
+	busy = &summary->busy[(summary->cpu_offset[sd] + cpu) *
+			      KS_SUMMARY_N_BUCKETS];
+
+	for (b = first; b <= last; ++b)
+		time += busy[b];
+
+	return (double) time / ((last - first + 1) * summary->bucket_size);
+}
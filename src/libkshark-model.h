@@ -184,6 +184,61 @@ static inline double ksmodel_bin_time(struct kshark_trace_histo *histo,
 int ksmodel_get_bin(struct kshark_trace_histo *histo,
 		    const struct kshark_entry *entry);
 
+/** The number of buckets of the summary of the entire trace. */
+#define KS_SUMMARY_N_BUCKETS	4096
+
+/**
+ * A coarse summary of the entire trace. It is computed only once (after
+ * loading the data) and can be used to visualize the whole trace without
+ * touching the array of entries.
+ */
+struct kshark_trace_summary {
+	/** Timestamp of the first entry. */
+	int64_t		min;
+
+	/** Timestamp of the last entry. */
+	int64_t		max;
+
+	/** The size in time of each bucket. */
+	uint64_t	bucket_size;
+
+	/** The total number of summarized entries. */
+	size_t		n_entries;
+
+	/** Number of entries in each bucket. */
+	size_t		count[KS_SUMMARY_N_BUCKETS];
+
+	/** The number of CPUs (all CPUs of all Data streams). */
+	int		n_cpus;
+
+	/**
+	 * The first CPU of each Data stream inside the array of CPUs of the
+	 * summary. Negative, if the Data stream does not exist.
+	 */
+	int		cpu_offset[KS_MAX_NUM_STREAMS];
+
+	/**
+	 * The time (in nanoseconds) each CPU was running a non-idle task in
+	 * each bucket. The array has size n_cpus * KS_SUMMARY_N_BUCKETS.
+	 */
+	uint64_t	*busy;
+};
+
+struct kshark_trace_summary *
+ksmodel_summary_alloc(struct kshark_context *kshark_ctx,
+		      struct kshark_entry **data, size_t n);
+
+void ksmodel_summary_free(struct kshark_trace_summary *summary);
+
+int ksmodel_summary_bucket(const struct kshark_trace_summary *summary,
+			   int64_t ts);
+
+size_t ksmodel_summary_count(const struct kshark_trace_summary *summary,
+			     int first, int last);
+
+double ksmodel_summary_cpu_util(const struct kshark_trace_summary *summary,
+				int sd, int cpu, int first, int last);
+
 #ifdef __cplusplus
 }
 #endif // __cplusplus
@@ -146,6 +146,205 @@ void kshark_free_event_handler_list(struct kshark_event_proc_handler *handlers)
 	}
 }
 
+/**
+ * @brief Search the list of batch handlers for a handle associated with a
+ *	  given event type.
+ *
+ * @param handlers: Input location for the batch handler list.
+ * @param event_id: Event Id to search for.
+ */
+struct kshark_batch_proc_handler *
+kshark_find_batch_handler(struct kshark_batch_proc_handler *handlers,
+			  int event_id)
+{
+	for (; handlers; handlers = handlers->next)
+		if (handlers->id == event_id)
+			return handlers;
+
+	return NULL;
+}
+
+/**
+ * @brief Add new batch handler to an existing list of handlers. The batch
+ *	  handlers are an alternative to the event handlers, for plugins
+ *	  which only collect data. The records are processed in spans of
+ *	  records of the same CPU, hence the plugin can process the spans in
+ *	  parallel, or use per-CPU containers to be merged at the end.
+ *
+ * @param stream: Input location for a Trace data stream pointer.
+ * @param event_id: Event Id.
+ * @param batch_func: Input location for a batch action provided by the
+ *		      plugin.
+ *
+ * @returns Zero on success, or a negative error code on failure.
+ */
+int kshark_register_batch_handler(struct kshark_data_stream *stream,
+				  int event_id,
+				  kshark_plugin_batch_handler_func batch_func)
+{
+	struct kshark_batch_proc_handler *handler = malloc(sizeof(*handler));
+
+	if (!handler) {
+		fputs("failed to allocate memory for batch handler\n", stderr);
+		return -ENOMEM;
+	}
+
+	handler->id = event_id;
+	handler->batch_func = batch_func;
+	handler->next = stream->batch_handlers;
+	stream->batch_handlers = handler;
+
+	return 0;
+}
+
+/**
+ * @brief Search the list for a specific plugin handle. If such a plugin handle
+ *	  exists, unregister (remove and free) this handle from the list.
+ *
+ * @param stream: Input location for a Trace data stream pointer.
+ * @param event_id: Event Id of the plugin handler to be unregistered.
+ * @param batch_func: Batch action function to be unregistered.
+ */
+void kshark_unregister_batch_handler(struct kshark_data_stream *stream,
+				     int event_id,
+				     kshark_plugin_batch_handler_func batch_func)
+{
+	struct kshark_batch_proc_handler **last;
+
+	for (last = &stream->batch_handlers; *last; last = &(*last)->next) {
+		if ((*last)->id == event_id &&
+		    (*last)->batch_func == batch_func) {
+			struct kshark_batch_proc_handler *this_handler;
+			this_handler = *last;
+			*last = this_handler->next;
+			free(this_handler);
+
+			return;
+		}
+	}
+}
+
+/**
+ * @brief Free all batch handlers in a given list.
+ *
+ * @param handlers: Input location for the batch handler list.
+ */
+void kshark_free_batch_handler_list(struct kshark_batch_proc_handler *handlers)
+{
+	struct kshark_batch_proc_handler *last;
+
+	while (handlers) {
+		last = handlers;
+		handlers = handlers->next;
+		free(last);
+	}
+}
+
+/**
+ * @brief Allocate a batch of records, to be used during the loading of the
+ *	  data. Use free() to free the batch.
+ *
+ * @param stream: Input location for a Trace data stream pointer.
+ * @param free_rec: Callback function used to free the records, once they are
+ *		    processed.
+ *
+ * @returns The batch on success, or NULL on failure.
+ */
+struct kshark_plugin_batch *
+kshark_plugin_batch_alloc(struct kshark_data_stream *stream,
+			  void (*free_rec)(void *rec))
+{
+	struct kshark_plugin_batch *batch = malloc(sizeof(*batch));
+
+	if (!batch) {
+		fputs("failed to allocate memory for batch\n", stderr);
+		return NULL;
+	}
+
+	batch->stream = stream;
+	batch->cpu = -1;
+	batch->n = 0;
+	batch->free_rec = free_rec;
+
+	return batch;
+}
+
+/**
+ * @brief Add a record to the batch, if there is a batch handler for the event
+ *	  of the record. A full batch, or a batch of records of another CPU
+ *	  gets processed first.
+ *
+ * @param batch: Input location for the batch.
+ * @param cpu: The CPU of the record.
+ * @param rec: Input location for the trace record.
+ * @param entry: Input location for the entry made from the record.
+ *
+ * @returns True if the record has been added to the batch. In this case the
+ *	    record is owned by the batch and gets freed once processed.
+ */
+bool kshark_plugin_batch_add(struct kshark_plugin_batch *batch, int cpu,
+			     void *rec, struct kshark_entry *entry)
+{
+	if (!kshark_find_batch_handler(batch->stream->batch_handlers,
+				       entry->event_id))
+		return false;
+
+	if (batch->n == KS_PLUGIN_BATCH_SIZE || cpu != batch->cpu)
+		kshark_plugin_batch_flush(batch);
+
+	batch->cpu = cpu;
+	batch->items[batch->n].rec = rec;
+	batch->items[batch->n].entry = entry;
+	++batch->n;
+
+	return true;
+}
+
+/**
+ * @brief Process all records of the batch and free them.
+ *
+ * @param batch: Input location for the batch.
+ */
+void kshark_plugin_batch_flush(struct kshark_plugin_batch *batch)
+{
+	struct kshark_batch_proc_handler *handler;
+	size_t i, n_sel;
+
+	for (handler = batch->stream->batch_handlers; handler;
+	     handler = handler->next) {
+		n_sel = 0;
+		for (i = 0; i < batch->n; ++i)
+			if (batch->items[i].entry->event_id == handler->id)
+				batch->selected[n_sel++] = batch->items[i];
+
+		if (n_sel)
+			handler->batch_func(batch->stream, batch->cpu,
+					    batch->selected, n_sel);
+	}
+
+	for (i = 0; i < batch->n; ++i)
+		batch->free_rec(batch->items[i].rec);
+
+	batch->n = 0;
+}
+
+/**
+ * @brief Process the remaining records of the batch and notify all batch
+ *	  handlers that the loading of the data is done.
+ *
+ * @param batch: Input location for the batch.
+ */
+void kshark_plugin_batch_end(struct kshark_plugin_batch *batch)
+{
+	struct kshark_batch_proc_handler *handler;
+
+	kshark_plugin_batch_flush(batch);
+
+	for (handler = batch->stream->batch_handlers; handler;
+	     handler = handler->next)
+		handler->batch_func(batch->stream, -1, NULL, 0);
+}
+
 /**
  * @brief Add new event handler to an existing list of handlers.
  *
@@ -281,6 +480,10 @@ kshark_register_plugin(struct kshark_context *kshark_ctx,
 		plugin->process_interface->name = strdup(plugin->name);
 		plugin->process_interface->init = init_func;
 		plugin->process_interface->close = close_func;
+
+		/* Optional. */
+		plugin->process_interface->memory =
+			dlsym(plugin->handle, KSHARK_PLOT_PLUGIN_MEMORY_NAME);
 	} else if (!!(long)init_func || !!(long)close_func) {
 		fprintf(stderr,
 			"incomplete draw interface found (will be ignored).\n%s\n",
@@ -616,6 +819,10 @@ int kshark_handle_dpi(struct kshark_data_stream *stream,
 {
 	int handler_count = 0;
 
+	kshark_self_trace_begin("kshark: plugin %s action %i stream %i",
+				plugin->interface->name, task_id,
+				stream->stream_id);
+
 	switch (task_id) {
 	case KSHARK_PLUGIN_INIT:
 		if (plugin->status & KSHARK_PLUGIN_ENABLED)
@@ -642,9 +849,11 @@ int kshark_handle_dpi(struct kshark_data_stream *stream,
 		break;
 
 	default:
-		return -EINVAL;
+		handler_count = -EINVAL;
 	}
 
+	kshark_self_trace_end();
+
 	return handler_count;
 }
 
@@ -19,6 +19,7 @@ extern "C" {
 // C
 #include <stdint.h>
 #include <stdbool.h>
+#include <stddef.h>
 
 /* Quiet warnings over documenting simple structures */
 //! @cond Doxygen_Suppress
@@ -35,6 +36,10 @@ extern "C" {
 
 #define KSHARK_PLOT_PLUGIN_DEINITIALIZER_NAME MAKE_STR(KSHARK_PLOT_PLUGIN_DEINITIALIZER)
 
+#define KSHARK_PLOT_PLUGIN_MEMORY kshark_data_plugin_memory
+
+#define KSHARK_PLOT_PLUGIN_MEMORY_NAME MAKE_STR(KSHARK_PLOT_PLUGIN_MEMORY)
+
 #define KSHARK_MENU_PLUGIN_INITIALIZER kshark_plugin_menu_initializer
 
 #define KSHARK_MENU_PLUGIN_INITIALIZER_NAME MAKE_STR(KSHARK_MENU_PLUGIN_INITIALIZER)
@@ -133,6 +138,96 @@ void kshark_unregister_event_handler(struct kshark_data_stream *stream,
 
 void kshark_free_event_handler_list(struct kshark_event_proc_handler *handlers);
 
+/** A trace record and the entry made from this record. */
+struct kshark_plugin_batch_item {
+	/** The trace record. */
+	void			*rec;
+
+	/** The entry. */
+	struct kshark_entry	*entry;
+};
+
+/**
+ * A function type to be used when defining plugin functions for batched data
+ * processing. The function receives a span of records (and entries) of a
+ * given CPU. After the last span of the Data stream, the function is called
+ * once more (for each Event Id it is registered for) with "cpu" equal to -1
+ * and no items.
+ */
+typedef void
+(*kshark_plugin_batch_handler_func)(struct kshark_data_stream *stream, int cpu,
+				    struct kshark_plugin_batch_item *items,
+				    size_t n);
+
+/*** Plugin's batched Trace Event processing handler structure. */
+struct kshark_batch_proc_handler {
+	/** Pointer to the next Plugin batch handler. */
+	struct kshark_batch_proc_handler	*next;
+
+	/**
+	 * Batch action function. This action receives spans of all records
+	 * having Event Ids equal to "id". The entries are already fully
+	 * processed (including the filtering), hence the action is meant for
+	 * collecting data and must not modify the entries.
+	 */
+	kshark_plugin_batch_handler_func	batch_func;
+
+	/** Unique Id ot the trace event type. */
+	int id;
+};
+
+struct kshark_batch_proc_handler *
+kshark_find_batch_handler(struct kshark_batch_proc_handler *handlers,
+			  int event_id);
+
+int kshark_register_batch_handler(struct kshark_data_stream *stream,
+				  int event_id,
+				  kshark_plugin_batch_handler_func batch_func);
+
+void kshark_unregister_batch_handler(struct kshark_data_stream *stream,
+				     int event_id,
+				     kshark_plugin_batch_handler_func batch_func);
+
+void kshark_free_batch_handler_list(struct kshark_batch_proc_handler *handlers);
+
+/** The maximum number of records in a batch. */
+#define KS_PLUGIN_BATCH_SIZE	1024
+
+/**
+ * A batch of records (and entries) of a given CPU, waiting to be processed
+ * by the batch handlers.
+ */
+struct kshark_plugin_batch {
+	/** Input location for the Data stream. */
+	struct kshark_data_stream	*stream;
+
+	/** The CPU of the records. */
+	int				cpu;
+
+	/** The number of records in the batch. */
+	size_t				n;
+
+	/** Callback function used to free the records of the batch. */
+	void				(*free_rec)(void *rec);
+
+	/** The records (and entries). */
+	struct kshark_plugin_batch_item	items[KS_PLUGIN_BATCH_SIZE];
+
+	/** Work space, used to select the records of a given handler. */
+	struct kshark_plugin_batch_item	selected[KS_PLUGIN_BATCH_SIZE];
+};
+
+struct kshark_plugin_batch *
+kshark_plugin_batch_alloc(struct kshark_data_stream *stream,
+			  void (*free_rec)(void *rec));
+
+bool kshark_plugin_batch_add(struct kshark_plugin_batch *batch, int cpu,
+			     void *rec, struct kshark_entry *entry);
+
+void kshark_plugin_batch_flush(struct kshark_plugin_batch *batch);
+
+void kshark_plugin_batch_end(struct kshark_plugin_batch *batch);
+
 /*** Plugin's drawing handler structure. */
 struct kshark_draw_handler {
 	/** Pointer to the next Plugin Event handler. */
@@ -160,6 +255,12 @@ void kshark_free_draw_handler_list(struct kshark_draw_handler *handlers);
  */
 typedef int (*kshark_plugin_load_func)(struct kshark_data_stream *);
 
+/**
+ * A function type to be used when defining plugin functions, reporting the
+ * size (in bytes) of the memory used by the plugin for a given stream.
+ */
+typedef size_t (*kshark_plugin_memory_func)(struct kshark_data_stream *);
+
 typedef int (*kshark_check_data_func)(const char *filename);
 
 typedef void *(*kshark_plugin_ctrl_func)(void *);
@@ -205,6 +306,12 @@ struct kshark_dpi {
 
 	/** Callback function for deinitialization of the plugin. */
 	kshark_plugin_load_func		close;
+
+	/**
+	 * Optional callback function, reporting the memory used by the
+	 * plugin.
+	 */
+	kshark_plugin_memory_func	memory;
 };
 
 /** Linked list of data processing interfaces (dpi). */
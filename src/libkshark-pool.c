@@ -0,0 +1,594 @@
+// SPDX-License-Identifier: LGPL-2.1
+
+/*
+ * Copyright (C) 2021 VMware Inc, Yordan Karadzhov (VMware) <y.karadz@gmail.com>
+ */
+
+/**
+ *  @file    libkshark-pool.c
+ *  @brief   Thread pool, shared by all parallel data processing paths.
+ *
+ *  Each worker thread owns a queue of ranges of tasks. A worker splits the
+ *  range it takes in halves, keeps the first half and pushes the second one
+ *  back to its queue, where the idle workers can steal it from. The thread,
+ *  submitting the tasks, helps executing them while it waits.
+ */
+
+// C
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <pthread.h>
+
+// KernelShark
+#include "libkshark-pool.h"
+
+/* Quiet warnings over documenting simple structures */
+//! @cond Doxygen_Suppress
+
+struct kshark_cancel_token {
+	int	cancelled;
+};
+
+struct pool_job {
+	kshark_task_func		func;
+	char				*args;
+	size_t				arg_size;
+	enum kshark_task_priority	priority;
+	struct kshark_cancel_token	*token;
+	/* The number of tasks not done yet. Protected by the pool lock. */
+	size_t				remaining;
+	bool				skipped;
+};
+
+struct pool_range {
+	struct pool_job		*job;
+	size_t			first;
+	size_t			last;
+};
+
+/* The owner works at the tail, the thieves steal from the head. */
+struct pool_queue {
+	struct pool_range	*ranges;
+	size_t			head;
+	size_t			tail;
+	size_t			capacity;
+};
+
+struct pool_worker {
+	pthread_t		thread;
+	bool			running;
+	int			id;
+	struct kshark_pool	*pool;
+	pthread_mutex_t		lock;
+	struct pool_queue	queue[KS_TASK_N_PRIORITIES];
+};
+
+struct kshark_pool {
+	/* Protects everything below, but the queues of the workers. */
+	pthread_mutex_t		lock;
+	pthread_cond_t		cond;
+	/* Ranges, submitted by threads which are not workers. */
+	struct pool_queue	inject[KS_TASK_N_PRIORITIES];
+	/* Incremented each time new work becomes available. */
+	unsigned long		epoch;
+	bool			stop;
+	struct pool_worker	*workers;
+	int			n_workers;
+};
+
+//! @endcond
+
+/* The size of the pool, including the thread submitting the tasks. */
+static int pool_size;
+
+static struct kshark_pool *pool;
+
+static pthread_mutex_t pool_init_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* The worker, running in the current thread (if any). */
+static __thread struct pool_worker *self_worker;
+
+/**
+ * @brief Create a cancellation token. Cancelling the token skips all tasks,
+ *	  submitted with this token, which are not started yet. The running
+ *	  tasks can check the token by using kshark_is_cancelled().
+ *
+ * @returns The token on success, or NULL on failure. Use
+ *	    kshark_cancel_token_free() to free the token.
+ */
+struct kshark_cancel_token *kshark_cancel_token_alloc(void)
+{
+	return calloc(1, sizeof(struct kshark_cancel_token));
+}
+
+/** Free a cancellation token. */
+void kshark_cancel_token_free(struct kshark_cancel_token *token)
+{
+	free(token);
+}
+
+/** Request the cancellation of all tasks, using a given token. */
+void kshark_cancel(struct kshark_cancel_token *token)
+{
+	if (token)
+		__atomic_store_n(&token->cancelled, 1, __ATOMIC_RELEASE);
+}
+
+/** Make a cancelled token usable again. */
+void kshark_cancel_reset(struct kshark_cancel_token *token)
+{
+	if (token)
+		__atomic_store_n(&token->cancelled, 0, __ATOMIC_RELEASE);
+}
+
+/** Check if the cancellation of a token has been requested. */
+bool kshark_is_cancelled(const struct kshark_cancel_token *token)
+{
+	return token && __atomic_load_n(&token->cancelled, __ATOMIC_ACQUIRE);
+}
+
+static bool queue_push(struct pool_queue *queue, struct pool_range *range)
+{
+	struct pool_range *ranges_tmp;
+	size_t capacity;
+
+	if (queue->tail == queue->capacity) {
+		if (queue->head) {
+			/* Reuse the space, freed by the stolen ranges. */
+			memmove(queue->ranges, queue->ranges + queue->head,
+				(queue->tail - queue->head) *
+				sizeof(*queue->ranges));
+
+			queue->tail -= queue->head;
+			queue->head = 0;
+		} else {
+			capacity = queue->capacity ? 2 * queue->capacity : 16;
+			ranges_tmp = realloc(queue->ranges,
+					     capacity * sizeof(*ranges_tmp));
+			if (!ranges_tmp)
+				return false;
+
+			queue->ranges = ranges_tmp;
+			queue->capacity = capacity;
+		}
+	}
+
+	queue->ranges[queue->tail++] = *range;
+
+	return true;
+}
+
+/*
+ * Take a range from the tail (the owner) or from the head (the thieves) of
+ * the queue. If "job" is not NULL, only the ranges of this job are taken.
+ */
+static bool queue_take(struct pool_queue *queue, struct pool_job *job,
+		       bool tail, struct pool_range *range)
+{
+	size_t i, n = queue->tail - queue->head;
+
+	for (i = 0; i < n; ++i) {
+		size_t pos = tail ? queue->tail - 1 - i : queue->head + i;
+
+		if (job && queue->ranges[pos].job != job)
+			continue;
+
+		*range = queue->ranges[pos];
+		if (pos == queue->head) {
+			++queue->head;
+		} else {
+			memmove(queue->ranges + pos, queue->ranges + pos + 1,
+				(queue->tail - pos - 1) *
+				sizeof(*queue->ranges));
+			--queue->tail;
+		}
+
+		if (queue->head == queue->tail)
+			queue->head = queue->tail = 0;
+
+		return true;
+	}
+
+	return false;
+}
+
+static void queue_free(struct pool_queue *queue)
+{
+	free(queue->ranges);
+	memset(queue, 0, sizeof(*queue));
+}
+
+/* Wake up the idle threads. Must be called with the pool lock held. */
+static void pool_notify(struct kshark_pool *p)
+{
+	++p->epoch;
+	pthread_cond_broadcast(&p->cond);
+}
+
+/*
+ * Find a range to be executed. The ranges of higher priority go first. For
+ * a given priority, try the own queue first, then the submitted ranges and
+ * finally steal from the other workers.
+ */
+static bool pool_take(struct kshark_pool *p, struct pool_worker *self,
+		      struct pool_job *job, struct pool_range *range)
+{
+	struct pool_worker *victim;
+	int prio, i, first;
+	bool found;
+
+	for (prio = 0; prio < KS_TASK_N_PRIORITIES; ++prio) {
+		if (job && (int) job->priority != prio)
+			continue;
+
+		if (self) {
+			pthread_mutex_lock(&self->lock);
+			found = queue_take(&self->queue[prio], job, true, range);
+			pthread_mutex_unlock(&self->lock);
+			if (found)
+				return true;
+		}
+
+		pthread_mutex_lock(&p->lock);
+		found = queue_take(&p->inject[prio], job, false, range);
+		pthread_mutex_unlock(&p->lock);
+		if (found)
+			return true;
+
+		first = self ? self->id + 1 : 0;
+		for (i = 0; i < p->n_workers; ++i) {
+			victim = &p->workers[(first + i) % p->n_workers];
+			if (victim == self)
+				continue;
+
+			pthread_mutex_lock(&victim->lock);
+			found = queue_take(&victim->queue[prio], job, false,
+					   range);
+			pthread_mutex_unlock(&victim->lock);
+			if (found)
+				return true;
+		}
+	}
+
+	return false;
+}
+
+/* Make the second half of a range available for stealing. */
+static bool pool_share(struct kshark_pool *p, struct pool_worker *self,
+		       struct pool_range *range)
+{
+	int prio = range->job->priority;
+	bool ok;
+
+	if (self) {
+		pthread_mutex_lock(&self->lock);
+		ok = queue_push(&self->queue[prio], range);
+		pthread_mutex_unlock(&self->lock);
+
+		if (ok) {
+			pthread_mutex_lock(&p->lock);
+			pool_notify(p);
+			pthread_mutex_unlock(&p->lock);
+		}
+	} else {
+		pthread_mutex_lock(&p->lock);
+		ok = queue_push(&p->inject[prio], range);
+		if (ok)
+			pool_notify(p);
+
+		pthread_mutex_unlock(&p->lock);
+	}
+
+	return ok;
+}
+
+static void pool_execute(struct kshark_pool *p, struct pool_worker *self,
+			 struct pool_range *range)
+{
+	struct pool_job *job = range->job;
+	struct pool_range half;
+	size_t i, done = 0;
+	bool skipped = false;
+
+	/*
+	 * Split the range in halves, until a single task is left. If the
+	 * second half cannot be shared, it is executed by this thread.
+	 */
+	while (range->last - range->first > 1) {
+		half.job = job;
+		half.first = range->first + (range->last - range->first) / 2;
+		half.last = range->last;
+		if (!pool_share(p, self, &half))
+			break;
+
+		range->last = half.first;
+	}
+
+	for (i = range->first; i < range->last; ++i, ++done) {
+		if (kshark_is_cancelled(job->token)) {
+			skipped = true;
+			continue;
+		}
+
+		job->func(job->args + i * job->arg_size);
+	}
+
+	pthread_mutex_lock(&p->lock);
+	if (skipped)
+		job->skipped = true;
+
+	job->remaining -= done;
+	if (!job->remaining)
+		pthread_cond_broadcast(&p->cond);
+
+	pthread_mutex_unlock(&p->lock);
+}
+
+static void *pool_worker_main(void *arg)
+{
+	struct pool_worker *self = arg;
+	struct kshark_pool *p = self->pool;
+	struct pool_range range;
+	unsigned long epoch;
+
+	self_worker = self;
+	for (;;) {
+		pthread_mutex_lock(&p->lock);
+		if (p->stop) {
+			pthread_mutex_unlock(&p->lock);
+			break;
+		}
+
+		epoch = p->epoch;
+		pthread_mutex_unlock(&p->lock);
+
+		if (pool_take(p, self, NULL, &range)) {
+			pool_execute(p, self, &range);
+			continue;
+		}
+
+		/* Nothing to do. Sleep until new work becomes available. */
+		pthread_mutex_lock(&p->lock);
+		while (!p->stop && p->epoch == epoch)
+			pthread_cond_wait(&p->cond, &p->lock);
+
+		pthread_mutex_unlock(&p->lock);
+	}
+
+	return NULL;
+}
+
+static void pool_free(struct kshark_pool *p)
+{
+	int i, prio;
+
+	for (i = 0; i < p->n_workers; ++i) {
+		for (prio = 0; prio < KS_TASK_N_PRIORITIES; ++prio)
+			queue_free(&p->workers[i].queue[prio]);
+
+		pthread_mutex_destroy(&p->workers[i].lock);
+	}
+
+	for (prio = 0; prio < KS_TASK_N_PRIORITIES; ++prio)
+		queue_free(&p->inject[prio]);
+
+	pthread_cond_destroy(&p->cond);
+	pthread_mutex_destroy(&p->lock);
+	free(p->workers);
+	free(p);
+}
+
+static void pool_stop(struct kshark_pool *p)
+{
+	int i;
+
+	pthread_mutex_lock(&p->lock);
+	p->stop = true;
+	pthread_cond_broadcast(&p->cond);
+	pthread_mutex_unlock(&p->lock);
+
+	for (i = 0; i < p->n_workers; ++i)
+		if (p->workers[i].running)
+			pthread_join(p->workers[i].thread, NULL);
+}
+
+/* Must be called with "pool_init_lock" held. */
+static struct kshark_pool *pool_create(void)
+{
+	struct kshark_pool *p;
+	int i, n_threads;
+
+	n_threads = pool_size;
+	if (n_threads <= 0)
+		n_threads = sysconf(_SC_NPROCESSORS_ONLN);
+
+	p = calloc(1, sizeof(*p));
+	if (!p)
+		goto fail;
+
+	/* The thread submitting the tasks is part of the pool as well. */
+	p->n_workers = n_threads > 1 ? n_threads - 1 : 0;
+	p->workers = calloc(p->n_workers ? p->n_workers : 1,
+			    sizeof(*p->workers));
+	if (!p->workers) {
+		free(p);
+		goto fail;
+	}
+
+	pthread_mutex_init(&p->lock, NULL);
+	pthread_cond_init(&p->cond, NULL);
+	for (i = 0; i < p->n_workers; ++i) {
+		p->workers[i].id = i;
+		p->workers[i].pool = p;
+		pthread_mutex_init(&p->workers[i].lock, NULL);
+	}
+
+	for (i = 0; i < p->n_workers; ++i)
+		p->workers[i].running =
+			pthread_create(&p->workers[i].thread, NULL,
+				       pool_worker_main, &p->workers[i]) == 0;
+
+	return pool = p;
+
+ fail:
+	fprintf(stderr, "Failed to allocate memory for thread pool.\n");
+	return NULL;
+}
+
+static struct kshark_pool *pool_get(void)
+{
+	struct kshark_pool *p;
+
+	pthread_mutex_lock(&pool_init_lock);
+	p = pool ? pool : pool_create();
+	pthread_mutex_unlock(&pool_init_lock);
+
+	return p;
+}
+
+/**
+ * @brief Set the number of threads of the thread pool. The thread pool is
+ *	  created when it is used for the first time. Must not be called
+ *	  while there are tasks running in the pool.
+ *
+ * @param n_threads: The number of threads executing tasks in parallel,
+ *		     including the thread which submits the tasks. If zero
+ *		     or negative, the number of online CPUs is used.
+ */
+void kshark_pool_set_size(int n_threads)
+{
+	pthread_mutex_lock(&pool_init_lock);
+
+	pool_size = n_threads;
+	if (pool) {
+		/* The pool will be recreated with the new size. */
+		pool_stop(pool);
+		pool_free(pool);
+		pool = NULL;
+	}
+
+	pthread_mutex_unlock(&pool_init_lock);
+}
+
+/**
+ * @brief Get the number of threads of the thread pool. Use this number to
+ *	  decide how many tasks to split the work into.
+ *
+ * @returns The number of threads executing tasks in parallel, including the
+ *	    thread which submits the tasks, or a negative error code on
+ *	    failure.
+ */
+int kshark_pool_size(void)
+{
+	struct kshark_pool *p = pool_get();
+
+	return p ? p->n_workers + 1 : -ENOMEM;
+}
+
+/**
+ * @brief Execute tasks in the thread pool and wait for all of them to be
+ *	  done. The calling thread helps executing the tasks. The function
+ *	  can be called from inside a task, and from multiple threads at the
+ *	  same time. The tasks of higher priority are executed first.
+ *
+ * @param func: The task function.
+ * @param args: Array of arguments. The task function is called once for
+ *		each element of the array.
+ * @param arg_size: The size of one element of the array of arguments.
+ * @param n_tasks: The number of elements of the array of arguments.
+ * @param priority: The priority of the tasks.
+ * @param token: Cancellation token. Can be NULL.
+ *
+ * @returns Zero if all tasks have been executed, -ECANCELED if some of the
+ *	    tasks have been skipped because of cancellation, or a negative
+ *	    error code on failure.
+ */
+int kshark_pool_run(kshark_task_func func, void *args, size_t arg_size,
+		    size_t n_tasks, enum kshark_task_priority priority,
+		    struct kshark_cancel_token *token)
+{
+	struct pool_worker *self = self_worker;
+	struct pool_range range;
+	struct kshark_pool *p;
+	struct pool_job job;
+	unsigned long epoch;
+	size_t i;
+
+	if (!func || (unsigned int) priority >= KS_TASK_N_PRIORITIES)
+		return -EINVAL;
+
+	if (!n_tasks)
+		return 0;
+
+	p = pool_get();
+	if (!p || !p->n_workers || n_tasks == 1) {
+		/* Execute all tasks in the calling thread. */
+		for (i = 0; i < n_tasks; ++i) {
+			if (kshark_is_cancelled(token))
+				return -ECANCELED;
+
+			func((char *) args + i * arg_size);
+		}
+
+		return 0;
+	}
+
+	job.func = func;
+	job.args = args;
+	job.arg_size = arg_size;
+	job.priority = priority;
+	job.token = token;
+	job.remaining = n_tasks;
+	job.skipped = false;
+
+	range.job = &job;
+	range.first = 0;
+	range.last = n_tasks;
+	pool_execute(p, self, &range);
+
+	/* Help executing the tasks of this job, until all of them are done. */
+	for (;;) {
+		pthread_mutex_lock(&p->lock);
+		if (!job.remaining) {
+			pthread_mutex_unlock(&p->lock);
+			break;
+		}
+
+		epoch = p->epoch;
+		pthread_mutex_unlock(&p->lock);
+
+		if (pool_take(p, self, &job, &range)) {
+			pool_execute(p, self, &range);
+			continue;
+		}
+
+		pthread_mutex_lock(&p->lock);
+		while (job.remaining && p->epoch == epoch)
+			pthread_cond_wait(&p->cond, &p->lock);
+
+		pthread_mutex_unlock(&p->lock);
+	}
+
+	return job.skipped ? -ECANCELED : 0;
+}
+
+/**
+ * @brief Stop all threads of the thread pool and free the pool. Must not be
+ *	  called while there are tasks running in the pool. The pool is
+ *	  created again if it is used after this.
+ */
+void kshark_pool_destroy(void)
+{
+	pthread_mutex_lock(&pool_init_lock);
+
+	if (pool) {
+		pool_stop(pool);
+		pool_free(pool);
+		pool = NULL;
+	}
+
+	pthread_mutex_unlock(&pool_init_lock);
+}
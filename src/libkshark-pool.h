@@ -0,0 +1,71 @@
+/* SPDX-License-Identifier: LGPL-2.1 */
+
+/*
+ * Copyright (C) 2021 VMware Inc, Yordan Karadzhov (VMware) <y.karadz@gmail.com>
+ */
+
+/**
+ *  @file    libkshark-pool.h
+ *  @brief   Thread pool, shared by all parallel data processing paths.
+ */
+
+#ifndef _LIB_KSHARK_POOL_H
+#define _LIB_KSHARK_POOL_H
+
+// C
+#include <stdbool.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif // __cplusplus
+
+/** Priorities of the tasks executed by the thread pool. */
+enum kshark_task_priority {
+	/**
+	 * Work, the user is waiting for (loading, filtering, model
+	 * operations, searching).
+	 */
+	KS_TASK_INTERACTIVE,
+
+	/** Work, which can wait (indexing, precomputing). */
+	KS_TASK_BACKGROUND,
+
+	/** The number of priorities. */
+	KS_TASK_N_PRIORITIES,
+};
+
+/**
+ * Task function type. The function is called once for each element of the
+ * array of arguments, given to kshark_pool_run().
+ */
+typedef void (*kshark_task_func) (void *arg);
+
+/** Cancellation token, shared between a task and its submitter. */
+struct kshark_cancel_token;
+
+struct kshark_cancel_token *kshark_cancel_token_alloc(void);
+
+void kshark_cancel_token_free(struct kshark_cancel_token *token);
+
+void kshark_cancel(struct kshark_cancel_token *token);
+
+void kshark_cancel_reset(struct kshark_cancel_token *token);
+
+bool kshark_is_cancelled(const struct kshark_cancel_token *token);
+
+void kshark_pool_set_size(int n_threads);
+
+int kshark_pool_size(void);
+
+int kshark_pool_run(kshark_task_func func, void *args, size_t arg_size,
+		    size_t n_tasks, enum kshark_task_priority priority,
+		    struct kshark_cancel_token *token);
+
+void kshark_pool_destroy(void);
+
+#ifdef __cplusplus
+}
+#endif // __cplusplus
+
+#endif // _LIB_KSHARK_POOL_H
@@ -0,0 +1,1185 @@
+// SPDX-License-Identifier: LGPL-2.1
+
+/*
+ * Copyright (C) 2021 VMware Inc, Yordan Karadzhov (VMware) <y.karadz@gmail.com>
+ */
+
+ /**
+  *  @file    libkshark-query.c
+  *  @brief   Compiled query expressions over the entries of a Data stream.
+  */
+
+#ifndef _GNU_SOURCE
+/** Use GNU C Library. */
+#define _GNU_SOURCE
+#endif // _GNU_SOURCE
+
+// C
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <ctype.h>
+
+// KernelShark
+#include "libkshark-query.h"
+#include "libkshark-pool.h"
+
+/* Quiet warnings over documenting simple structures */
+//! @cond Doxygen_Suppress
+
+enum query_column {
+	QCOL_STREAM,
+	QCOL_CPU,
+	QCOL_PID,
+	QCOL_EVENT,
+	QCOL_TS,
+	QCOL_FIELD,
+};
+
+enum query_cmp {
+	QCMP_EQ,
+	QCMP_NE,
+	QCMP_LT,
+	QCMP_LE,
+	QCMP_GT,
+	QCMP_GE,
+	QCMP_IN,
+};
+
+enum query_op {
+	/* Compare a column with constant(s) and store the result. */
+	QOP_TEST,
+
+	/* Invert the result. */
+	QOP_NOT,
+
+	/* Jump to "arg" if the result is false. */
+	QOP_JUMP_FALSE,
+
+	/* Jump to "arg" if the result is true. */
+	QOP_JUMP_TRUE,
+
+	/* Return the result. */
+	QOP_RET,
+};
+
+struct query_insn {
+	uint8_t		op;
+	uint8_t		column;
+	uint8_t		cmp;
+	int		arg;
+	int64_t		a;
+	int64_t		b;
+};
+
+enum query_node_type {
+	QNODE_TEST,
+	QNODE_NOT,
+	QNODE_AND,
+	QNODE_OR,
+};
+
+struct query_node {
+	enum query_node_type	type;
+	struct query_node	*left;
+	struct query_node	*right;
+	struct query_insn	test;
+	int			cost;
+};
+
+enum query_token_type {
+	QTOK_END,
+	QTOK_IDENT,
+	QTOK_NUMBER,
+	QTOK_AND,
+	QTOK_OR,
+	QTOK_NOT,
+	QTOK_LPAREN,
+	QTOK_RPAREN,
+	QTOK_CMP,
+	QTOK_IN,
+	QTOK_RANGE,
+	QTOK_MINUS,
+	QTOK_INVALID,
+};
+
+struct query_token {
+	enum query_token_type	type;
+	const char		*start;
+	int			len;
+	int64_t			value;
+	bool			has_unit;
+	bool			is_integer;
+	uint8_t			cmp;
+};
+
+struct query_parser {
+	struct kshark_data_stream	*stream;
+	struct kshark_query		*query;
+	const char			*expr;
+	const char			*pos;
+	struct query_token		tok;
+	char				*error;
+};
+
+/* Reading of a data field costs much more than reading a column. */
+#define QUERY_FIELD_COST	100
+
+//! @endcond
+
+struct kshark_query {
+	struct kshark_data_stream	*stream;
+
+	char				*expr;
+
+	struct query_insn		*code;
+
+	int				n_insn;
+
+	char				**fields;
+
+	int				n_fields;
+};
+
+static const struct {
+	char	letter;
+	int64_t	value;
+} task_states[] = {
+	{'R', 0x00}, {'S', 0x01}, {'D', 0x02}, {'T', 0x04}, {'t', 0x08},
+	{'X', 0x10}, {'Z', 0x20}, {'P', 0x40}, {'I', 0x80},
+};
+
+static void parser_error(struct query_parser *p, const char *msg)
+{
+	if (p->error)
+		return;
+
+	if (asprintf(&p->error, "%s (position %li in \"%s\")",
+		     msg, (long) (p->tok.start - p->expr), p->expr) <= 0)
+		p->error = NULL;
+}
+
+static bool is_ident_char(char c)
+{
+	return isalnum(c) || c == '_' || c == '/' || c == ':';
+}
+
+static void read_number(struct query_parser *p, struct query_token *tok)
+{
+	double frac = 0., digit = 0.1;
+	int64_t val = 0, scale = 1;
+	const char *c = p->pos;
+	char *end;
+
+	tok->is_integer = true;
+	tok->has_unit = false;
+
+	if (c[0] == '0' && (c[1] == 'x' || c[1] == 'X')) {
+		tok->value = strtoll(c, &end, 16);
+		p->pos = end;
+		return;
+	}
+
+	for (; isdigit(*c); ++c)
+		val = val * 10 + (*c - '0');
+
+	/* Make sure that this is not the ".." range operator. */
+	if (c[0] == '.' && isdigit(c[1])) {
+		tok->is_integer = false;
+		for (++c; isdigit(*c); ++c) {
+			frac += (*c - '0') * digit;
+			digit /= 10;
+		}
+	}
+
+	tok->has_unit = true;
+	if (strncmp(c, "ns", 2) == 0) {
+		c += 2;
+	} else if (strncmp(c, "us", 2) == 0) {
+		scale = 1000;
+		c += 2;
+	} else if (strncmp(c, "ms", 2) == 0) {
+		scale = 1000000;
+		c += 2;
+	} else if (c[0] == 's' && !is_ident_char(c[1])) {
+		scale = 1000000000;
+		c += 1;
+	} else {
+		tok->has_unit = false;
+	}
+
+	/* With a unit, the value is converted into integer nanoseconds. */
+	if (tok->has_unit)
+		tok->is_integer = true;
+
+	tok->value = val * scale + (int64_t) (frac * scale);
+	p->pos = c;
+}
+
+static void next_token(struct query_parser *p)
+{
+	struct query_token *tok = &p->tok;
+	const char *c;
+
+	while (isspace(*p->pos))
+		++p->pos;
+
+	c = p->pos;
+	tok->start = c;
+
+	if (*c == '\0') {
+		tok->type = QTOK_END;
+	} else if (isdigit(*c)) {
+		tok->type = QTOK_NUMBER;
+		read_number(p, tok);
+	} else if (isalpha(*c) || *c == '_') {
+		while (is_ident_char(*p->pos))
+			++p->pos;
+
+		tok->type = QTOK_IDENT;
+		if (p->pos - c == 2 && strncmp(c, "in", 2) == 0)
+			tok->type = QTOK_IN;
+	} else if (strncmp(c, "&&", 2) == 0) {
+		tok->type = QTOK_AND;
+		p->pos += 2;
+	} else if (strncmp(c, "||", 2) == 0) {
+		tok->type = QTOK_OR;
+		p->pos += 2;
+	} else if (strncmp(c, "..", 2) == 0) {
+		tok->type = QTOK_RANGE;
+		p->pos += 2;
+	} else if (strncmp(c, "==", 2) == 0) {
+		tok->type = QTOK_CMP;
+		tok->cmp = QCMP_EQ;
+		p->pos += 2;
+	} else if (strncmp(c, "!=", 2) == 0) {
+		tok->type = QTOK_CMP;
+		tok->cmp = QCMP_NE;
+		p->pos += 2;
+	} else if (strncmp(c, "<=", 2) == 0) {
+		tok->type = QTOK_CMP;
+		tok->cmp = QCMP_LE;
+		p->pos += 2;
+	} else if (strncmp(c, ">=", 2) == 0) {
+		tok->type = QTOK_CMP;
+		tok->cmp = QCMP_GE;
+		p->pos += 2;
+	} else {
+		p->pos += 1;
+		switch (*c) {
+		case '<':
+			tok->type = QTOK_CMP;
+			tok->cmp = QCMP_LT;
+			break;
+		case '>':
+			tok->type = QTOK_CMP;
+			tok->cmp = QCMP_GT;
+			break;
+		case '!':
+			tok->type = QTOK_NOT;
+			break;
+		case '(':
+			tok->type = QTOK_LPAREN;
+			break;
+		case ')':
+			tok->type = QTOK_RPAREN;
+			break;
+		case '-':
+			tok->type = QTOK_MINUS;
+			break;
+		default:
+			tok->type = QTOK_INVALID;
+		}
+	}
+
+	tok->len = p->pos - c;
+}
+
+static bool token_is(const struct query_token *tok, const char *str)
+{
+	return tok->type == QTOK_IDENT &&
+	       tok->len == strlen(str) &&
+	       strncmp(tok->start, str, tok->len) == 0;
+}
+
+static void free_node(struct query_node *node)
+{
+	if (!node)
+		return;
+
+	free_node(node->left);
+	free_node(node->right);
+	free(node);
+}
+
+static struct query_node *new_node(struct query_parser *p,
+				   enum query_node_type type,
+				   struct query_node *left,
+				   struct query_node *right)
+{
+	struct query_node *node = calloc(1, sizeof(*node));
+
+	if (!node) {
+		parser_error(p, "Failed to allocate memory");
+		free_node(left);
+		free_node(right);
+		return NULL;
+	}
+
+	node->type = type;
+	node->left = left;
+	node->right = right;
+
+	if (left)
+		node->cost = left->cost;
+
+	if (right)
+		node->cost += right->cost;
+
+	return node;
+}
+
+static int find_event_id(struct kshark_data_stream *stream, const char *name)
+{
+	int *ids, i, id = -1;
+	char *evt, *evt_name;
+
+	if (strchr(name, '/'))
+		return stream->interface.find_event_id(stream, name);
+
+	ids = kshark_get_all_event_ids(stream);
+	if (!ids)
+		return -1;
+
+	for (i = 0; i < stream->n_events && id < 0; ++i) {
+		evt = kshark_event_from_id(stream->stream_id, ids[i]);
+		if (!evt)
+			continue;
+
+		evt_name = strchr(evt, '/');
+		evt_name = evt_name ? evt_name + 1 : evt;
+		if (strcmp(evt_name, name) == 0)
+			id = ids[i];
+
+		free(evt);
+	}
+
+	free(ids);
+
+	return id;
+}
+
+static int find_field(struct query_parser *p, const char *name)
+{
+	struct kshark_query *query = p->query;
+	char **fields, *field;
+	int i;
+
+	for (i = 0; i < query->n_fields; ++i)
+		if (strcmp(query->fields[i], name) == 0)
+			return i;
+
+	field = strdup(name);
+	fields = field ? realloc(query->fields,
+				 (query->n_fields + 1) * sizeof(*fields)) :
+			 NULL;
+	if (!fields) {
+		free(field);
+		parser_error(p, "Failed to allocate memory");
+		return -1;
+	}
+
+	query->fields = fields;
+	query->fields[query->n_fields] = field;
+
+	return query->n_fields++;
+}
+
+/* Parse a constant value, to be compared with a given column. */
+static bool parse_value(struct query_parser *p,
+			const struct query_insn *test,
+			int64_t *val)
+{
+	bool negative = false;
+	char name[p->tok.len + 1];
+	int i;
+
+	if (p->tok.type == QTOK_MINUS) {
+		negative = true;
+		next_token(p);
+	}
+
+	if (p->tok.type == QTOK_NUMBER) {
+		if (!p->tok.is_integer ||
+		    (p->tok.has_unit && test->column != QCOL_TS &&
+		     test->column != QCOL_FIELD)) {
+			parser_error(p, "Integer value expected");
+			return false;
+		}
+
+		*val = negative ? -p->tok.value : p->tok.value;
+		next_token(p);
+		return true;
+	}
+
+	if (p->tok.type != QTOK_IDENT || negative) {
+		parser_error(p, "Value expected");
+		return false;
+	}
+
+	memcpy(name, p->tok.start, p->tok.len);
+	name[p->tok.len] = '\0';
+
+	if (test->column == QCOL_EVENT) {
+		*val = find_event_id(p->stream, name);
+		if (*val < 0) {
+			parser_error(p, "Unknown event");
+			return false;
+		}
+
+		next_token(p);
+		return true;
+	}
+
+	if (test->column == QCOL_FIELD && p->tok.len == 1) {
+		for (i = 0; i < sizeof(task_states) / sizeof(*task_states); ++i)
+			if (task_states[i].letter == name[0]) {
+				*val = task_states[i].value;
+				next_token(p);
+				return true;
+			}
+	}
+
+	parser_error(p, "Unknown value");
+	return false;
+}
+
+static struct query_node *parse_test(struct query_parser *p)
+{
+	struct query_node *node;
+	char name[p->tok.len + 1];
+	struct query_insn *test;
+
+	if (p->tok.type != QTOK_IDENT) {
+		parser_error(p, "Column or field name expected");
+		return NULL;
+	}
+
+	node = new_node(p, QNODE_TEST, NULL, NULL);
+	if (!node)
+		return NULL;
+
+	test = &node->test;
+	test->op = QOP_TEST;
+	node->cost = 1;
+
+	if (token_is(&p->tok, "stream")) {
+		test->column = QCOL_STREAM;
+	} else if (token_is(&p->tok, "cpu")) {
+		test->column = QCOL_CPU;
+	} else if (token_is(&p->tok, "pid")) {
+		test->column = QCOL_PID;
+	} else if (token_is(&p->tok, "event")) {
+		test->column = QCOL_EVENT;
+	} else if (token_is(&p->tok, "ts")) {
+		test->column = QCOL_TS;
+	} else {
+		memcpy(name, p->tok.start, p->tok.len);
+		name[p->tok.len] = '\0';
+
+		test->column = QCOL_FIELD;
+		test->arg = find_field(p, name);
+		if (test->arg < 0)
+			goto fail;
+
+		node->cost = QUERY_FIELD_COST;
+	}
+
+	next_token(p);
+	if (p->tok.type == QTOK_IN) {
+		test->cmp = QCMP_IN;
+		next_token(p);
+		if (!parse_value(p, test, &test->a))
+			goto fail;
+
+		if (p->tok.type != QTOK_RANGE) {
+			parser_error(p, "Range operator \"..\" expected");
+			goto fail;
+		}
+
+		next_token(p);
+		if (!parse_value(p, test, &test->b))
+			goto fail;
+	} else if (p->tok.type == QTOK_CMP) {
+		test->cmp = p->tok.cmp;
+		next_token(p);
+		if (!parse_value(p, test, &test->a))
+			goto fail;
+	} else {
+		parser_error(p, "Comparison operator expected");
+		goto fail;
+	}
+
+	return node;
+
+ fail:
+	free_node(node);
+	return NULL;
+}
+
+static struct query_node *parse_or(struct query_parser *p);
+
+static struct query_node *parse_unary(struct query_parser *p)
+{
+	struct query_node *node;
+
+	if (p->tok.type == QTOK_NOT) {
+		next_token(p);
+		node = parse_unary(p);
+		if (!node)
+			return NULL;
+
+		return new_node(p, QNODE_NOT, node, NULL);
+	}
+
+	if (p->tok.type == QTOK_LPAREN) {
+		next_token(p);
+		node = parse_or(p);
+		if (!node)
+			return NULL;
+
+		if (p->tok.type != QTOK_RPAREN) {
+			parser_error(p, "Missing \")\"");
+			free_node(node);
+			return NULL;
+		}
+
+		next_token(p);
+		return node;
+	}
+
+	return parse_test(p);
+}
+
+static struct query_node *parse_binary(struct query_parser *p,
+				       enum query_token_type op,
+				       enum query_node_type type,
+				       struct query_node *(*parse_operand)
+						(struct query_parser *))
+{
+	struct query_node *left, *right;
+
+	left = parse_operand(p);
+	while (left && p->tok.type == op) {
+		next_token(p);
+		right = parse_operand(p);
+		if (!right) {
+			free_node(left);
+			return NULL;
+		}
+
+		left = new_node(p, type, left, right);
+	}
+
+	return left;
+}
+
+static struct query_node *parse_and(struct query_parser *p)
+{
+	return parse_binary(p, QTOK_AND, QNODE_AND, parse_unary);
+}
+
+static struct query_node *parse_or(struct query_parser *p)
+{
+	return parse_binary(p, QTOK_OR, QNODE_OR, parse_and);
+}
+
+static bool emit(struct kshark_query *query, const struct query_insn *insn)
+{
+	struct query_insn *code;
+
+	code = realloc(query->code, (query->n_insn + 1) * sizeof(*code));
+	if (!code)
+		return false;
+
+	query->code = code;
+	query->code[query->n_insn++] = *insn;
+
+	return true;
+}
+
+/*
+ * Generate the bytecode of the expression. The evaluation of the logical
+ * operators is short-circuited and the cheaper operand (the one that does not
+ * read data fields) is always evaluated first.
+ */
+static bool generate(struct kshark_query *query, struct query_node *node)
+{
+	struct query_node *first, *second;
+	struct query_insn jump = {0};
+	int jump_pos;
+
+	switch (node->type) {
+	case QNODE_TEST:
+		return emit(query, &node->test);
+
+	case QNODE_NOT:
+		jump.op = QOP_NOT;
+		return generate(query, node->left) && emit(query, &jump);
+
+	default:
+		first = node->left;
+		second = node->right;
+		if (second->cost < first->cost) {
+			first = node->right;
+			second = node->left;
+		}
+
+		jump.op = (node->type == QNODE_AND) ? QOP_JUMP_FALSE :
+						      QOP_JUMP_TRUE;
+
+		if (!generate(query, first))
+			return false;
+
+		jump_pos = query->n_insn;
+		if (!emit(query, &jump) || !generate(query, second))
+			return false;
+
+		query->code[jump_pos].arg = query->n_insn;
+		return true;
+	}
+}
+
+/**
+ * @brief Compile a query expression.
+ *
+ * @param kshark_ctx: Input location for the session context pointer.
+ * @param sd: Data stream identifier. The names of the events and fields used
+ *	      in the expression are resolved using this Data stream.
+ * @param expr: The text of the query expression.
+ * @param error: Optional output location for an error message. In the case
+ *		 of a failure, the user is responsible for freeing the message.
+ *
+ * @returns The compiled query on success, or NULL on failure. The user is
+ *	    responsible for freeing the query, using kshark_query_free().
+ */
+struct kshark_query *kshark_query_compile(struct kshark_context *kshark_ctx,
+					  int sd, const char *expr,
+					  char **error)
+{
+	struct query_insn ret = {.op = QOP_RET};
+	struct query_parser p = {0};
+	struct query_node *root;
+
+	if (error)
+		*error = NULL;
+
+	p.stream = kshark_get_data_stream(kshark_ctx, sd);
+	if (!p.stream || !expr)
+		return NULL;
+
+	p.query = calloc(1, sizeof(*p.query));
+	if (!p.query)
+		goto fail;
+
+	p.query->stream = p.stream;
+	p.query->expr = strdup(expr);
+	if (!p.query->expr)
+		goto fail;
+
+	p.expr = p.pos = expr;
+
+	next_token(&p);
+	root = parse_or(&p);
+	if (root && p.tok.type != QTOK_END)
+		parser_error(&p, "Unexpected token");
+
+	if (p.error || !root) {
+		free_node(root);
+		goto fail;
+	}
+
+	if (!generate(p.query, root) || !emit(p.query, &ret)) {
+		free_node(root);
+		parser_error(&p, "Failed to allocate memory");
+		goto fail;
+	}
+
+	free_node(root);
+
+	return p.query;
+
+ fail:
+	kshark_query_free(p.query);
+
+	if (error)
+		*error = p.error;
+	else
+		free(p.error);
+
+	return NULL;
+}
+
+/**
+ * @brief Free all memory used by a compiled query.
+ *
+ * @param query: Input location for the query object.
+ */
+void kshark_query_free(struct kshark_query *query)
+{
+	int i;
+
+	if (!query)
+		return;
+
+	for (i = 0; i < query->n_fields; ++i)
+		free(query->fields[i]);
+
+	free(query->fields);
+	free(query->code);
+	free(query->expr);
+	free(query);
+}
+
+/**
+ * @brief Get the text of the expression used to compile the query.
+ *
+ * @param query: Input location for the query object.
+ */
+const char *kshark_query_string(const struct kshark_query *query)
+{
+	return query ? query->expr : NULL;
+}
+
+/*
+ * Read the value of a data field, without any locking. Use the value
+ * extracted during the loading, if available, followed by a field handle
+ * and finally by the name of the field.
+ */
+static bool read_field_unlocked(struct kshark_data_stream *stream,
+				const struct kshark_entry *entry,
+				const char *field, int64_t *val)
+{
+	struct kshark_field_handle *handle;
+
+	if (stream->columns &&
+	    kshark_read_field_column(stream, entry, field, val))
+		return true;
+
+	if (stream->interface.get_field_handle &&
+	    stream->interface.read_event_field_handle_int64) {
+		handle = stream->interface.get_field_handle(stream,
+							    entry->event_id,
+							    field);
+
+		return handle &&
+		       stream->interface.read_event_field_handle_int64(stream,
+								       entry,
+								       handle,
+								       val) >= 0;
+	}
+
+	return stream->interface.read_event_field_int64(stream, entry,
+							field, val) >= 0;
+}
+
+/* Quiet warnings over documenting simple structures */
+//! @cond Doxygen_Suppress
+
+/* The number of entries, having their data fields read ahead at once. */
+#define QUERY_BLOCK_SIZE	(1 << 16)
+
+/*
+ * The values of the data fields of a query for a block of entries, read
+ * ahead of the evaluation of the query.
+ */
+struct query_prefetch {
+	/* The row of the first entry of the block. */
+	size_t		first;
+
+	/* The values of all fields, ordered by field and then by row. */
+	int64_t		*values;
+
+	/* Bitset, having a bit set for each successfully read value. */
+	uint64_t	*valid;
+};
+
+//! @endcond
+
+static bool read_field(const struct kshark_query *query, int field,
+		       const struct kshark_entry *entry,
+		       const struct query_prefetch *pf, size_t row,
+		       int64_t *val)
+{
+	struct kshark_data_stream *stream = query->stream;
+	size_t idx;
+	bool ret;
+
+	if (entry->event_id < 0)
+		return false;
+
+	if (pf) {
+		idx = (size_t) field * QUERY_BLOCK_SIZE + row - pf->first;
+		if (!(pf->valid[idx >> 6] & (1ULL << (idx & 63))))
+			return false;
+
+		*val = pf->values[idx];
+		return true;
+	}
+
+	/*
+	 * Currently the data reading operations are not thread-safe.
+	 * Use a mutex to protect the access.
+	 */
+	pthread_mutex_lock(&stream->input_mutex);
+	ret = read_field_unlocked(stream, entry, query->fields[field], val);
+	pthread_mutex_unlock(&stream->input_mutex);
+
+	return ret;
+}
+
+static inline bool test_entry(const struct kshark_query *query,
+			      const struct query_insn *insn,
+			      const struct kshark_entry *entry,
+			      const struct query_prefetch *pf, size_t row)
+{
+	int64_t val;
+
+	switch (insn->column) {
+	case QCOL_STREAM:
+		val = entry->stream_id;
+		break;
+	case QCOL_CPU:
+		val = entry->cpu;
+		break;
+	case QCOL_PID:
+		val = entry->pid;
+		break;
+	case QCOL_EVENT:
+		val = entry->event_id;
+		break;
+	case QCOL_TS:
+		val = entry->ts;
+		break;
+	default:
+		if (!read_field(query, insn->arg, entry, pf, row, &val))
+			return false;
+	}
+
+	switch (insn->cmp) {
+	case QCMP_EQ:
+		return val == insn->a;
+	case QCMP_NE:
+		return val != insn->a;
+	case QCMP_LT:
+		return val < insn->a;
+	case QCMP_LE:
+		return val <= insn->a;
+	case QCMP_GT:
+		return val > insn->a;
+	case QCMP_GE:
+		return val >= insn->a;
+	default:
+		return val >= insn->a && val <= insn->b;
+	}
+}
+
+static bool match_entry(const struct kshark_query *query,
+			const struct kshark_entry *entry,
+			const struct query_prefetch *pf, size_t row)
+{
+	const struct query_insn *insn;
+	bool res = false;
+	int pc = 0;
+
+	if (!query || entry->stream_id != query->stream->stream_id)
+		return false;
+
+	while (1) {
+		insn = &query->code[pc++];
+		switch (insn->op) {
+		case QOP_TEST:
+			res = test_entry(query, insn, entry, pf, row);
+			break;
+		case QOP_NOT:
+			res = !res;
+			break;
+		case QOP_JUMP_FALSE:
+			if (!res)
+				pc = insn->arg;
+			break;
+		case QOP_JUMP_TRUE:
+			if (res)
+				pc = insn->arg;
+			break;
+		default:
+			return res;
+		}
+	}
+}
+
+/**
+ * @brief Check if an entry matches the query. Only entries from the Data
+ *	  stream used to compile the query can match.
+ *
+ * @param query: Input location for the query object.
+ * @param entry: Input location for the entry.
+ */
+bool kshark_query_match(const struct kshark_query *query,
+			const struct kshark_entry *entry)
+{
+	return match_entry(query, entry, NULL, 0);
+}
+
+/*
+ * Read the data fields of the query for a block of entries. The data reading
+ * operations are not thread-safe, hence this is done in a single sequential
+ * pass, holding the mutex of the stream.
+ */
+static void prefetch_fields(const struct kshark_query *query,
+			    struct kshark_entry **data,
+			    size_t first, size_t last,
+			    struct query_prefetch *pf)
+{
+	struct kshark_data_stream *stream = query->stream;
+	const struct kshark_entry *e;
+	size_t i, idx;
+	int f;
+
+	pf->first = first;
+	memset(pf->valid, 0, (size_t) query->n_fields * QUERY_BLOCK_SIZE / 8);
+
+	pthread_mutex_lock(&stream->input_mutex);
+
+	for (i = first; i < last; ++i) {
+		e = data[i];
+		if (e->stream_id != stream->stream_id || e->event_id < 0)
+			continue;
+
+		for (f = 0; f < query->n_fields; ++f) {
+			idx = (size_t) f * QUERY_BLOCK_SIZE + i - first;
+			if (read_field_unlocked(stream, e, query->fields[f],
+						&pf->values[idx]))
+				pf->valid[idx >> 6] |= 1ULL << (idx & 63);
+		}
+	}
+
+	pthread_mutex_unlock(&stream->input_mutex);
+}
+
+/* Quiet warnings over documenting simple structures */
+//! @cond Doxygen_Suppress
+
+struct query_task {
+	const struct kshark_query	*query;
+	struct kshark_entry		**data;
+	const struct query_prefetch	*pf;
+	size_t				first;
+	size_t				last;
+	uint64_t			*bitset;
+	ssize_t				count;
+};
+
+//! @endcond
+
+static void query_worker(void *arg)
+{
+	struct query_task *task = arg;
+	size_t i;
+
+	for (i = task->first; i < task->last; ++i) {
+		if (match_entry(task->query, task->data[i], task->pf, i)) {
+			task->bitset[i >> 6] |= 1ULL << (i & 63);
+			++task->count;
+		}
+	}
+}
+
+/*
+ * Evaluate the query over the entries in the range [first, last). Each task
+ * processes a sub-range, aligned to the words of the bitset. This way no two
+ * tasks write to the same word.
+ */
+static ssize_t query_run(struct query_task *tasks, int n_threads,
+			 size_t first, size_t last)
+{
+	size_t n_words = (last - first + 63) / 64, chunk;
+	ssize_t count = 0;
+	int i;
+
+	chunk = (n_words + n_threads - 1) / n_threads * 64;
+	for (i = 0; i < n_threads; ++i) {
+		tasks[i].count = 0;
+		tasks[i].first = first + i * chunk;
+		tasks[i].last = first + (i + 1) * chunk;
+		if (tasks[i].first > last)
+			tasks[i].first = last;
+
+		if (tasks[i].last > last)
+			tasks[i].last = last;
+	}
+
+	kshark_pool_run(query_worker, tasks, sizeof(*tasks), n_threads,
+			KS_TASK_INTERACTIVE, NULL);
+
+	for (i = 0; i < n_threads; ++i)
+		count += tasks[i].count;
+
+	return count;
+}
+
+/**
+ * @brief Evaluate the query over an array of entries, using the thread pool.
+ *	  The data fields used by the query are read ahead, in a sequential
+ *	  pass over each block of entries. Only the evaluation of the query
+ *	  is done in parallel.
+ *
+ * @param query: Input location for the query object.
+ * @param data: Input location for the trace data.
+ * @param n_entries: The size of the inputted data.
+ * @param n_threads: The number of parallel tasks to split the data into. If
+ *		     zero or negative, the size of the thread pool is used.
+ * @param bitset: Output location for a bitset, having a bit set for each
+ *		  matching entry (see kshark_query_bit()). The user is
+ *		  responsible for freeing the bitset.
+ *
+ * @returns The number of matching entries on success, or a negative error
+ *	    code on failure.
+ */
+ssize_t kshark_query_bitset(const struct kshark_query *query,
+			    struct kshark_entry **data, size_t n_entries,
+			    int n_threads, uint64_t **bitset)
+{
+	size_t n_words = (n_entries + 63) / 64, n_values, first, last;
+	struct query_prefetch pf = {0}, *ppf = NULL;
+	struct query_task *tasks;
+	ssize_t count = 0;
+	int i;
+
+	if (!query)
+		return -EFAULT;
+
+	if (n_threads <= 0)
+		n_threads = kshark_pool_size();
+
+	if (n_threads <= 0)
+		n_threads = 1;
+
+	if (n_threads > n_words)
+		n_threads = n_words ? n_words : 1;
+
+	*bitset = calloc(n_words ? n_words : 1, sizeof(**bitset));
+	tasks = calloc(n_threads, sizeof(*tasks));
+	if (query->n_fields) {
+		n_values = (size_t) query->n_fields * QUERY_BLOCK_SIZE;
+		pf.values = malloc(n_values * sizeof(*pf.values));
+		pf.valid = malloc(n_values / 8);
+		ppf = &pf;
+	}
+
+	if (!*bitset || !tasks || (ppf && (!pf.values || !pf.valid))) {
+		fprintf(stderr, "Failed to allocate memory for query bitset.\n");
+		free(*bitset);
+		free(tasks);
+		free(pf.values);
+		free(pf.valid);
+		*bitset = NULL;
+		return -ENOMEM;
+	}
+
+	for (i = 0; i < n_threads; ++i) {
+		tasks[i].query = query;
+		tasks[i].data = data;
+		tasks[i].pf = ppf;
+		tasks[i].bitset = *bitset;
+	}
+
+	if (!ppf) {
+		count = query_run(tasks, n_threads, 0, n_entries);
+	} else {
+		for (first = 0; first < n_entries; first = last) {
+			last = first + QUERY_BLOCK_SIZE;
+			if (last > n_entries)
+				last = n_entries;
+
+			prefetch_fields(query, data, first, last, &pf);
+			count += query_run(tasks, n_threads, first, last);
+		}
+	}
+
+	free(pf.values);
+	free(pf.valid);
+	free(tasks);
+
+	return count;
+}
+
+/**
+ * @brief Apply a query as a filter. All entries from the Data stream of the
+ *	  query that do not match the query will have unset in their "visible"
+ *	  fields the bits of the filter mask of the session's context. Entries
+ *	  from other Data streams are not affected.
+ *
+ * @param kshark_ctx: Input location for the session context pointer.
+ * @param query: Input location for the query object.
+ * @param data: Input location for the trace data to be filtered.
+ * @param n_entries: The size of the inputted data.
+ */
+void kshark_query_filter_entries(struct kshark_context *kshark_ctx,
+				 const struct kshark_query *query,
+				 struct kshark_entry **data,
+				 size_t n_entries)
+{
+	int sd = query->stream->stream_id;
+	uint64_t *bitset;
+	size_t i;
+
+	if (kshark_query_bitset(query, data, n_entries, 0, &bitset) < 0)
+		return;
+
+	for (i = 0; i < n_entries; ++i)
+		if (data[i]->stream_id == sd && !kshark_query_bit(bitset, i))
+			data[i]->visible &= ~kshark_ctx->filter_mask;
+
+	free(bitset);
+}
+
+/**
+ * @brief Set the query filter of a Data stream. The filter is applied by
+ *	  kshark_filter_stream_entries() and kshark_filter_all_entries(),
+ *	  together with the Id filters, as well as by kshark_load_all_entries()
+ *	  and kshark_append_all_entries().
+ *
+ * @param kshark_ctx: Input location for the session context pointer.
+ * @param sd: Data stream identifier.
+ * @param expr: The text of the query expression. Use NULL or an empty string
+ *		to clear the query filter.
+ * @param error: Optional output location for an error message. In the case
+ *		 of a failure, the user is responsible for freeing the message.
+ *
+ * @returns Zero on success, or a negative error code on failure.
+ */
+int kshark_filter_set_query(struct kshark_context *kshark_ctx, int sd,
+			    const char *expr, char **error)
+{
+	struct kshark_data_stream *stream;
+	struct kshark_query *query = NULL;
+
+	if (error)
+		*error = NULL;
+
+	stream = kshark_get_data_stream(kshark_ctx, sd);
+	if (!stream)
+		return -EFAULT;
+
+	if (expr && *expr) {
+		query = kshark_query_compile(kshark_ctx, sd, expr, error);
+		if (!query)
+			return -EINVAL;
+	}
+
+	kshark_query_free(stream->query_filter);
+	stream->query_filter = query;
+
+	return 0;
+}
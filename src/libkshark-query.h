@@ -0,0 +1,70 @@
+/* SPDX-License-Identifier: LGPL-2.1 */
+
+/*
+ * Copyright (C) 2021 VMware Inc, Yordan Karadzhov (VMware) <y.karadz@gmail.com>
+ */
+
+/**
+ *  @file    libkshark-query.h
+ *  @brief   Compiled query expressions over the entries of a Data stream.
+ */
+
+#ifndef _LIB_KSHARK_QUERY_H
+#define _LIB_KSHARK_QUERY_H
+
+// KernelShark
+#include "libkshark.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif // __cplusplus
+
+/**
+ * A query expression, compiled into bytecode. The expression can use the
+ * columns of the entries ("stream", "cpu", "pid", "event" and "ts") and any
+ * integer data field of the events. Example:
+ *
+ *	cpu in 0..15 && event == sched_switch && prev_state == D && ts > 1.5s
+ *
+ * The supported operators are "==", "!=", "<", "<=", ">", ">=", "in a..b",
+ * "&&", "||" and "!". Event names can be given with or without the name of
+ * the system ("sched/sched_switch" or "sched_switch"). Timestamps can have
+ * a unit suffix ("s", "ms", "us" or "ns"). The letters of the task states
+ * (R, S, D, T, t, X, Z, P, I) can be used as values of the data fields.
+ */
+struct kshark_query;
+
+struct kshark_query *kshark_query_compile(struct kshark_context *kshark_ctx,
+					  int sd, const char *expr,
+					  char **error);
+
+void kshark_query_free(struct kshark_query *query);
+
+const char *kshark_query_string(const struct kshark_query *query);
+
+bool kshark_query_match(const struct kshark_query *query,
+			const struct kshark_entry *entry);
+
+ssize_t kshark_query_bitset(const struct kshark_query *query,
+			    struct kshark_entry **data, size_t n_entries,
+			    int n_threads, uint64_t **bitset);
+
+/** Check if the bit of a given entry is set in a query bitset. */
+static inline bool kshark_query_bit(const uint64_t *bitset, size_t row)
+{
+	return bitset[row >> 6] & (1ULL << (row & 63));
+}
+
+void kshark_query_filter_entries(struct kshark_context *kshark_ctx,
+				 const struct kshark_query *query,
+				 struct kshark_entry **data,
+				 size_t n_entries);
+
+int kshark_filter_set_query(struct kshark_context *kshark_ctx, int sd,
+			    const char *expr, char **error);
+
+#ifdef __cplusplus
+}
+#endif // __cplusplus
+
+#endif // _LIB_KSHARK_QUERY_H
@@ -0,0 +1,457 @@
+// SPDX-License-Identifier: LGPL-2.1
+
+/*
+ * Copyright (C) 2021 VMware Inc, Yordan Karadzhov (VMware) <y.karadz@gmail.com>
+ */
+
+ /**
+  *  @file    libkshark-stats.c
+  *  @brief   Indexes for fast statistics over arbitrary time ranges.
+  */
+
+// C
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+// KernelShark
+#include "libkshark-stats.h"
+#include "libkshark-pool.h"
+
+/* Quiet warnings over documenting simple structures */
+//! @cond Doxygen_Suppress
+
+#define COUNTER_MAP_INIT_BITS	10
+
+#define COUNTER_MAP_EMPTY	(-1)
+
+struct counter_map {
+	uint64_t	*keys;
+	ssize_t		*values;
+	size_t		size;
+	size_t		count;
+};
+
+struct fill_task {
+	struct kshark_event_count_index	*index;
+	struct kshark_entry		**data;
+	const size_t			*row_counter;
+	size_t				first;
+	size_t				last;
+	/* Per counter count, replaced by the write position after counting. */
+	size_t				*pos;
+	bool				scatter;
+};
+
+//! @endcond
+
+static inline uint64_t counter_key(int sd, int cpu, int event_id)
+{
+	return ((uint64_t) (uint16_t) sd << 48) |
+	       ((uint64_t) (uint16_t) cpu << 32) |
+	       (uint32_t) event_id;
+}
+
+static inline size_t counter_hash(uint64_t key, size_t size)
+{
+	/* Fibonacci hashing. The size of the map is always a power of 2. */
+	return (key * 11400714819323198485llu) >> 32 & (size - 1);
+}
+
+static bool counter_map_init(struct counter_map *map, size_t size)
+{
+	size_t i;
+
+	map->keys = malloc(size * sizeof(*map->keys));
+	map->values = malloc(size * sizeof(*map->values));
+	if (!map->keys || !map->values) {
+		free(map->keys);
+		free(map->values);
+		return false;
+	}
+
+	for (i = 0; i < size; ++i)
+		map->values[i] = COUNTER_MAP_EMPTY;
+
+	map->size = size;
+	map->count = 0;
+
+	return true;
+}
+
+static void counter_map_free(struct counter_map *map)
+{
+	free(map->keys);
+	free(map->values);
+}
+
+static ssize_t *counter_map_slot(struct counter_map *map, uint64_t key)
+{
+	size_t i = counter_hash(key, map->size);
+
+	while (map->values[i] != COUNTER_MAP_EMPTY &&
+	       map->keys[i] != key)
+		i = (i + 1) & (map->size - 1);
+
+	map->keys[i] = key;
+
+	return &map->values[i];
+}
+
+static bool counter_map_grow(struct counter_map *map)
+{
+	struct counter_map new_map;
+	size_t i;
+
+	if (!counter_map_init(&new_map, map->size * 2))
+		return false;
+
+	for (i = 0; i < map->size; ++i)
+		if (map->values[i] != COUNTER_MAP_EMPTY)
+			*counter_map_slot(&new_map, map->keys[i]) =
+				map->values[i];
+
+	new_map.count = map->count;
+	counter_map_free(map);
+	*map = new_map;
+
+	return true;
+}
+
+static int compare_counters(const void *a, const void *b)
+{
+	const struct kshark_event_counter *ca = a, *cb = b;
+	uint64_t ka = counter_key(ca->stream_id, ca->cpu, ca->event_id);
+	uint64_t kb = counter_key(cb->stream_id, cb->cpu, cb->event_id);
+
+	if (ka > kb)
+		return 1;
+
+	if (ka < kb)
+		return -1;
+
+	return 0;
+}
+
+static void fill_worker(void *arg)
+{
+	struct fill_task *task = arg;
+	struct kshark_event_counter *counter;
+	size_t i, c;
+
+	for (i = task->first; i < task->last; ++i) {
+		c = task->row_counter[i];
+		if (task->scatter) {
+			counter = &task->index->counters[c];
+			counter->ts[task->pos[c]++] = task->data[i]->ts;
+		} else {
+			++task->pos[c];
+		}
+	}
+}
+
+static void fill_run(struct fill_task *tasks, int n_tasks, bool scatter)
+{
+	int t;
+
+	for (t = 0; t < n_tasks; ++t)
+		tasks[t].scatter = scatter;
+
+	/*
+	 * Nobody waits for the index, hence any interactive work, submitted
+	 * to the thread pool in the meantime, goes first.
+	 */
+	kshark_pool_run(fill_worker, tasks, sizeof(*tasks), n_tasks,
+			KS_TASK_BACKGROUND, NULL);
+}
+
+/*
+ * Copy the timestamps of the entries into the arrays of their counters. The
+ * data is split into chunks, processed in parallel. Each task counts the
+ * entries of each counter in its chunk and, once the counts of all tasks are
+ * known, writes the timestamps directly into their final positions.
+ */
+static bool fill_counters(struct kshark_event_count_index *index,
+			  struct kshark_entry **data,
+			  const size_t *row_counter, size_t n_entries)
+{
+	struct fill_task *tasks;
+	size_t c, chunk, total;
+	size_t *counts;
+	int t, n_tasks;
+
+	n_tasks = kshark_pool_size();
+	if (n_tasks < 1 || n_entries < 65536)
+		n_tasks = 1;
+
+	tasks = calloc(n_tasks, sizeof(*tasks));
+	counts = calloc((size_t) n_tasks * index->n_counters, sizeof(*counts));
+	if (!tasks || (index->n_counters && !counts)) {
+		free(tasks);
+		free(counts);
+		return false;
+	}
+
+	chunk = (n_entries + n_tasks - 1) / n_tasks;
+	for (t = 0; t < n_tasks; ++t) {
+		tasks[t].index = index;
+		tasks[t].data = data;
+		tasks[t].row_counter = row_counter;
+		tasks[t].first = t * chunk < n_entries ? t * chunk : n_entries;
+		tasks[t].last = tasks[t].first + chunk < n_entries ?
+				tasks[t].first + chunk : n_entries;
+		tasks[t].pos = counts + (size_t) t * index->n_counters;
+	}
+
+	if (n_tasks > 1) {
+		fill_run(tasks, n_tasks, false);
+
+		for (c = 0; c < index->n_counters; ++c) {
+			for (total = 0, t = 0; t < n_tasks; ++t) {
+				size_t count = tasks[t].pos[c];
+
+				tasks[t].pos[c] = total;
+				total += count;
+			}
+		}
+	}
+
+	fill_run(tasks, n_tasks, true);
+
+	free(counts);
+	free(tasks);
+
+	return true;
+}
+
+/**
+ * @brief Build the prefix-count index of the loaded trace data. The index
+ *	  holds the timestamps of all entries, grouped by their
+ *	  (Data stream, CPU, Event) key. It has to be rebuilt if the timestamps
+ *	  of the entries change (for example when a clock offset is applied).
+ *	  The timestamps are copied by the thread pool, as background work.
+ *
+ * @param data: Input location for the trace data.
+ * @param n_entries: The size of the inputted data.
+ *
+ * @returns The index on success, or NULL on failure. The user is responsible
+ *	    for freeing the index, using kshark_event_count_index_free().
+ */
+struct kshark_event_count_index *
+kshark_event_count_index_alloc(struct kshark_entry **data, size_t n_entries)
+{
+	struct kshark_event_count_index *index;
+	struct kshark_event_counter *counter;
+	size_t i, *row_counter, capacity = 0;
+	struct counter_map map;
+	ssize_t *slot;
+
+	index = calloc(1, sizeof(*index));
+	row_counter = malloc(n_entries * sizeof(*row_counter));
+	if (!index || (!row_counter && n_entries) ||
+	    !counter_map_init(&map, 1 << COUNTER_MAP_INIT_BITS)) {
+		free(index);
+		free(row_counter);
+		goto fail;
+	}
+
+	/* First pass: identify all keys and count the entries per key. */
+	for (i = 0; i < n_entries; ++i) {
+		slot = counter_map_slot(&map, counter_key(data[i]->stream_id,
+							  data[i]->cpu,
+							  data[i]->event_id));
+
+		if (*slot == COUNTER_MAP_EMPTY) {
+			if (index->n_counters == capacity) {
+				capacity = capacity ? 2 * capacity : 64;
+				counter = realloc(index->counters,
+						  capacity * sizeof(*counter));
+				if (!counter)
+					goto fail_free;
+
+				index->counters = counter;
+			}
+
+			counter = &index->counters[index->n_counters];
+			counter->stream_id = data[i]->stream_id;
+			counter->cpu = data[i]->cpu;
+			counter->event_id = data[i]->event_id;
+			counter->size = 0;
+			counter->ts = NULL;
+
+			*slot = index->n_counters++;
+
+			if (2 * (++map.count) > map.size &&
+			    !counter_map_grow(&map))
+				goto fail_free;
+
+			slot = counter_map_slot(&map, counter_key(counter->stream_id,
+								  counter->cpu,
+								  counter->event_id));
+		}
+
+		row_counter[i] = *slot;
+		index->counters[*slot].size++;
+	}
+
+	for (i = 0; i < index->n_counters; ++i) {
+		counter = &index->counters[i];
+		counter->ts = malloc(counter->size * sizeof(*counter->ts));
+		if (!counter->ts)
+			goto fail_free;
+	}
+
+	/*
+	 * Second pass: fill the timestamps. The data is sorted in time, hence
+	 * the array of timestamps of each counter is sorted as well.
+	 */
+	if (!fill_counters(index, data, row_counter, n_entries))
+		goto fail_free;
+
+	qsort(index->counters, index->n_counters,
+	      sizeof(*index->counters), compare_counters);
+
+	index->n_entries = n_entries;
+
+	counter_map_free(&map);
+	free(row_counter);
+
+	return index;
+
+ fail_free:
+	counter_map_free(&map);
+	free(row_counter);
+	kshark_event_count_index_free(index);
+
+ fail:
+	fprintf(stderr, "Failed to allocate memory for event count index.\n");
+	return NULL;
+}
+
+/**
+ * @brief Free all memory used by a prefix-count index.
+ *
+ * @param index: Input location for the index object.
+ */
+void kshark_event_count_index_free(struct kshark_event_count_index *index)
+{
+	size_t i;
+
+	if (!index)
+		return;
+
+	for (i = 0; i < index->n_counters; ++i)
+		free(index->counters[i].ts);
+
+	free(index->counters);
+	free(index);
+}
+
+/* Get the number of timestamps of the counter, which are smaller than "ts". */
+static size_t count_before(const struct kshark_event_counter *counter,
+			   int64_t ts)
+{
+	ssize_t l = -1, h = counter->size, mid;
+
+	BSEARCH(h, l, counter->ts[mid] < ts);
+
+	return h;
+}
+
+/*
+ * Get the number of timestamps of the counter, which are smaller or equal
+ * to "ts". Using this instead of count_before(ts + 1) avoids overflow when
+ * "ts" is INT64_MAX.
+ */
+static size_t count_up_to(const struct kshark_event_counter *counter,
+			  int64_t ts)
+{
+	ssize_t l = -1, h = counter->size, mid;
+
+	BSEARCH(h, l, counter->ts[mid] <= ts);
+
+	return h;
+}
+
+static inline bool key_match(int key, int value)
+{
+	return key == KS_COUNT_ANY || key == value;
+}
+
+static inline uint64_t counter_key_at(const struct kshark_event_count_index *index,
+				      size_t i)
+{
+	const struct kshark_event_counter *c = &index->counters[i];
+
+	return counter_key(c->stream_id, c->cpu, c->event_id);
+}
+
+/* Get the position of the first counter, having a key not smaller than "key". */
+static size_t first_counter(const struct kshark_event_count_index *index,
+			    uint64_t key)
+{
+	ssize_t l = -1, h = index->n_counters, mid;
+
+	BSEARCH(h, l, counter_key_at(index, mid) < key);
+
+	return h;
+}
+
+/**
+ * @brief Get the number of entries having a given key and timestamps inside
+ *	  a given time range. The filtering of the entries is ignored.
+ *
+ * @param index: Input location for the prefix-count index.
+ * @param sd: Data stream identifier or KS_COUNT_ANY.
+ * @param cpu: CPU Id or KS_COUNT_ANY.
+ * @param event_id: Event Id or KS_COUNT_ANY.
+ * @param min: Lower edge of the time range (inclusive).
+ * @param max: Upper edge of the time range (inclusive).
+ *
+ * @returns The number of matching entries.
+ */
+size_t kshark_event_count(const struct kshark_event_count_index *index,
+			  int sd, int cpu, int event_id,
+			  int64_t min, int64_t max)
+{
+	const struct kshark_event_counter *counter;
+	size_t i, first = 0, last, count = 0;
+	uint64_t key;
+
+	if (!index || max < min)
+		return 0;
+
+	/*
+	 * The counters are sorted by their (Data stream, CPU, Event) keys.
+	 * Use binary search to find the range of counters, matching the
+	 * leading parts of the key, which are not wildcards.
+	 */
+	last = index->n_counters;
+	if (sd != KS_COUNT_ANY) {
+		if (cpu == KS_COUNT_ANY) {
+			key = counter_key(sd, 0, 0);
+			last = first_counter(index, key + (1ULL << 48));
+		} else if (event_id == KS_COUNT_ANY) {
+			key = counter_key(sd, cpu, 0);
+			last = first_counter(index, key + (1ULL << 32));
+		} else {
+			key = counter_key(sd, cpu, event_id);
+			last = first_counter(index, key + 1);
+		}
+
+		first = first_counter(index, key);
+	}
+
+	for (i = first; i < last; ++i) {
+		counter = &index->counters[i];
+		if (!key_match(sd, counter->stream_id) ||
+		    !key_match(cpu, counter->cpu) ||
+		    !key_match(event_id, counter->event_id))
+			continue;
+
+		count += count_up_to(counter, max) -
+			 count_before(counter, min);
+	}
+
+	return count;
+}
@@ -0,0 +1,80 @@
+/* SPDX-License-Identifier: LGPL-2.1 */
+
+/*
+ * Copyright (C) 2021 VMware Inc, Yordan Karadzhov (VMware) <y.karadz@gmail.com>
+ */
+
+/**
+ *  @file    libkshark-stats.h
+ *  @brief   Indexes for fast statistics over arbitrary time ranges.
+ */
+
+#ifndef _LIB_KSHARK_STATS_H
+#define _LIB_KSHARK_STATS_H
+
+// KernelShark
+#include "libkshark.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif // __cplusplus
+
+/**
+ * Wildcard value, matching any Data stream, any CPU or any event in the count
+ * queries.
+ */
+#define KS_COUNT_ANY	INT32_MIN
+
+/**
+ * Cumulative counter of the entries having a given (Data stream, CPU, Event)
+ * key. The timestamps of the entries are stored sorted in time, hence the
+ * position of a timestamp in the array is equal to the number of entries
+ * having this key, recorded before this moment.
+ */
+struct kshark_event_counter {
+	/** Data stream identifier. */
+	int16_t		stream_id;
+
+	/** CPU Id. */
+	int16_t		cpu;
+
+	/** Event Id. */
+	int		event_id;
+
+	/** Sorted array of timestamps. */
+	int64_t		*ts;
+
+	/** The number of timestamps in the array. */
+	size_t		size;
+};
+
+/**
+ * Prefix-count index of all loaded entries. It allows the number of entries
+ * having a given (Data stream, CPU, Event) key and recorded inside arbitrary
+ * time range to be retrieved using two binary searches.
+ */
+struct kshark_event_count_index {
+	/** Array of counters, sorted by their keys. */
+	struct kshark_event_counter	*counters;
+
+	/** The number of counters. */
+	size_t				n_counters;
+
+	/** The total number of indexed entries. */
+	size_t				n_entries;
+};
+
+struct kshark_event_count_index *
+kshark_event_count_index_alloc(struct kshark_entry **data, size_t n_entries);
+
+void kshark_event_count_index_free(struct kshark_event_count_index *index);
+
+size_t kshark_event_count(const struct kshark_event_count_index *index,
+			  int sd, int cpu, int event_id,
+			  int64_t min, int64_t max);
+
+#ifdef __cplusplus
+}
+#endif // __cplusplus
+
+#endif // _LIB_KSHARK_STATS_H
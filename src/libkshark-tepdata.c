@@ -19,6 +19,9 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <inttypes.h>
+#include <unistd.h>
+#include <sys/stat.h>
 
 // trace-cmd
 #include "trace-cmd/trace-cmd.h"
@@ -28,6 +31,7 @@
 #include "libkshark.h"
 #include "libkshark-plugin.h"
 #include "libkshark-tepdata.h"
+#include "libkshark-decompress.h"
 
 static __thread struct trace_seq seq;
 
@@ -39,6 +43,27 @@ static bool init_thread_seq(void)
 	return seq.buffer != NULL;
 }
 
+/** The maximum length of the name of a task (including the terminator). */
+#define TEPDATA_COMM_LEN	16
+
+/*
+ * Protects the names of the tasks. The names get replaced by the loading
+ * thread, while another thread may show the preview of the data.
+ */
+static pthread_mutex_t comms_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+/** The name of a task, valid from a given moment in time. */
+struct tepdata_comm {
+	/** Process Id of the task. */
+	int	pid;
+
+	/** The time since when the name is valid. */
+	int64_t	ts;
+
+	/** The name of the task. */
+	char	comm[TEPDATA_COMM_LEN];
+};
+
 /** Structure for handling all unique attributes of the FTRACE data. */
 struct tepdata_handle {
 	/** Page event used to parse the page. */
@@ -61,6 +86,48 @@ struct tepdata_handle {
 
 	/** Pointer to the sched_switch_comm_field format descriptor. */
 	struct tep_format_field	*sched_switch_comm_field;
+
+	/**
+	 * The names of the tasks over time, sorted by pid and time. Built
+	 * while loading the data.
+	 */
+	struct tepdata_comm	*comms;
+
+	/** The number of names of tasks. */
+	size_t			n_comms;
+
+	/** List of the resolved field descriptors (handles). */
+	struct kshark_field_handle	*field_handles;
+
+	/** The unique Id of the tracing session, or zero if unknown. */
+	unsigned long long	trace_id;
+
+	/**
+	 * Identifier of the host stream, having the guest information for
+	 * this stream. Negative if unknown.
+	 */
+	int			host_sd;
+
+	/** The number of known guests of this (host) stream. */
+	int			n_guests;
+
+	/** The page-level time index of each CPU. Built on demand. */
+	struct kshark_page_index	**page_index;
+
+	/** The number of pages of each CPU. */
+	ssize_t				*n_pages;
+};
+
+/** Descriptor of a data field of a given event. */
+struct kshark_field_handle {
+	/** Pointer to the next descriptor. */
+	struct kshark_field_handle	*next;
+
+	/** The unique Id of the event. */
+	int				event_id;
+
+	/** Pointer to the format descriptor of the field. */
+	struct tep_format_field		*field;
 };
 
 struct tep_handle *kshark_get_tep(struct kshark_data_stream *stream)
@@ -160,21 +227,29 @@ static void missed_events_action(struct kshark_data_stream *stream,
 
 /**
  * rec_list is used to pass the data to the load functions.
- * The rec_list will contain the list of entries from the source,
- * and will be a link list of per CPU entries.
+ * The rec_list will contain the array of entries (or records) of a given
+ * CPU, sorted in time.
  */
 struct rec_list {
 	union {
-		/* Used by kshark_load_data_records */
-		struct {
-			/** next pointer, matches entry->next */
-			struct rec_list		*next;
-			/** pointer to the raw record data */
-			struct tep_record	*rec;
-		};
-		/** entry - Used for kshark_load_data_entries() */
-		struct kshark_entry		entry;
+		/** Used by kshark_load_tep_records() */
+		struct tep_record	**recs;
+
+		/** Used by kshark_load_data_entries() */
+		struct kshark_entry	**entries;
+
+		/** Generic access to the array */
+		void			**items;
 	};
+
+	/** The number of items in the array. */
+	size_t		size;
+
+	/** The number of items allocated. */
+	size_t		capacity;
+
+	/** The position of the next item to be merged. */
+	size_t		pos;
 };
 
 static int get_next_pid(struct kshark_data_stream *stream,
@@ -189,19 +264,225 @@ static int get_next_pid(struct kshark_data_stream *stream,
 	return ret ? : val;
 }
 
-static void register_command(struct kshark_data_stream *stream,
+/**
+ * Local (per loader) table of the names of the tasks. The names are
+ * collected from the sched_switch events without touching the data
+ * structures of libtraceevent and are published once, at the end of
+ * the loading.
+ */
+struct comm_table {
+	/** Array of names of tasks, in the order of their appearance. */
+	struct tepdata_comm	*comms;
+
+	/** The number of names of tasks. */
+	size_t			n_comms;
+
+	/** The size of the array of names. */
+	size_t			size;
+
+	/**
+	 * Open addressing hash table of the indexes (inside "comms") of the
+	 * most recent name of each task. Empty slots are negative.
+	 */
+	ssize_t			*last;
+
+	/** The number of bits of the hash table. */
+	unsigned int		n_bits;
+
+	/** The number of tasks. */
+	size_t			n_pids;
+};
+
+static size_t comm_table_slot(const struct comm_table *table, int pid)
+{
+	size_t mask = (1UL << table->n_bits) - 1;
+	size_t h = ((uint32_t) pid * 2654435761U) & mask;
+
+	while (table->last[h] >= 0 && table->comms[table->last[h]].pid != pid)
+		h = (h + 1) & mask;
+
+	return h;
+}
+
+static bool comm_table_rehash(struct comm_table *table)
+{
+	ssize_t *last;
+	size_t i, n;
+
+	n = 1UL << ++table->n_bits;
+	last = malloc(n * sizeof(*last));
+	if (!last)
+		return false;
+
+	free(table->last);
+	table->last = last;
+	for (i = 0; i < n; ++i)
+		table->last[i] = -1;
+
+	/* The later names overwrite the earlier ones. */
+	for (i = 0; i < table->n_comms; ++i)
+		table->last[comm_table_slot(table, table->comms[i].pid)] = i;
+
+	return true;
+}
+
+static bool comm_table_init(struct comm_table *table)
+{
+	memset(table, 0, sizeof(*table));
+	table->n_bits = 9;
+
+	return comm_table_rehash(table);
+}
+
+static void comm_table_free(struct comm_table *table)
+{
+	free(table->comms);
+	free(table->last);
+}
+
+static bool register_command(struct kshark_data_stream *stream,
+			     struct comm_table *table,
 			     struct tep_record *record,
-			     int pid)
+			     int pid, int64_t ts)
 {
 	struct tep_format_field *comm_field = get_sched_comm(stream);
 	const char *comm = record->data + comm_field->offset;
+	struct tepdata_comm *new_comms;
+	size_t h, len;
 	/*
 	 * TODO: The retrieve of the name of the command above needs to be
 	 * implemented as a wrapper function in libtracevent.
 	 */
 
-	if (!tep_is_pid_registered(kshark_get_tep(stream), pid))
-			tep_register_comm(kshark_get_tep(stream), comm, pid);
+	h = comm_table_slot(table, pid);
+	if (table->last[h] >= 0 &&
+	    strncmp(table->comms[table->last[h]].comm, comm,
+		    TEPDATA_COMM_LEN - 1) == 0) {
+		/* The name of the task did not change. */
+		return true;
+	}
+
+	if (table->n_comms == table->size) {
+		table->size = table->size ? table->size * 2 : 256;
+		new_comms = realloc(table->comms,
+				    table->size * sizeof(*new_comms));
+		if (!new_comms)
+			return false;
+
+		table->comms = new_comms;
+	}
+
+	len = comm_field->size < TEPDATA_COMM_LEN ?
+	      comm_field->size : TEPDATA_COMM_LEN - 1;
+
+	table->comms[table->n_comms].pid = pid;
+	table->comms[table->n_comms].ts = ts;
+	memset(table->comms[table->n_comms].comm, 0, TEPDATA_COMM_LEN);
+	strncpy(table->comms[table->n_comms].comm, comm, len);
+
+	if (table->last[h] < 0)
+		++table->n_pids;
+
+	table->last[h] = table->n_comms++;
+	if (table->n_pids * 2 > (1UL << table->n_bits))
+		return comm_table_rehash(table);
+
+	return true;
+}
+
+static int compare_comms(const void *a, const void *b)
+{
+	const struct tepdata_comm *ca = a, *cb = b;
+
+	if (ca->pid != cb->pid)
+		return (ca->pid > cb->pid) ? 1 : -1;
+
+	if (ca->ts != cb->ts)
+		return (ca->ts > cb->ts) ? 1 : -1;
+
+	return 0;
+}
+
+/*
+ * Sort the names of the tasks collected during the loading and register the
+ * earliest name of each task in libtraceevent. The table gets moved into the
+ * handle of the stream, where it is used for time-aware lookups.
+ */
+static void publish_commands(struct kshark_data_stream *stream,
+			     struct comm_table *table)
+{
+	struct tepdata_handle *tep_handle = stream->interface.handle;
+	struct tepdata_comm *comms = table->comms;
+	size_t i, n = 0;
+
+	qsort(comms, table->n_comms, sizeof(*comms), compare_comms);
+
+	/*
+	 * The names registered in libtraceevent are used when printing the
+	 * events, hence the data reading has to be blocked as well.
+	 */
+	pthread_mutex_lock(&stream->input_mutex);
+	pthread_mutex_lock(&comms_mutex);
+
+	for (i = 0; i < table->n_comms; ++i) {
+		if (n && comms[n - 1].pid == comms[i].pid &&
+		    strcmp(comms[n - 1].comm, comms[i].comm) == 0) {
+			/*
+			 * The records of different CPUs are processed one
+			 * after another. Remove the duplicates.
+			 */
+			continue;
+		}
+
+		if ((!n || comms[n - 1].pid != comms[i].pid) &&
+		    !tep_is_pid_registered(kshark_get_tep(stream),
+					   comms[i].pid)) {
+			tep_register_comm(kshark_get_tep(stream),
+					  comms[i].comm, comms[i].pid);
+		}
+
+		comms[n++] = comms[i];
+	}
+
+	free(tep_handle->comms);
+	tep_handle->comms = comms;
+	tep_handle->n_comms = n;
+
+	pthread_mutex_unlock(&comms_mutex);
+	pthread_mutex_unlock(&stream->input_mutex);
+
+	table->comms = NULL;
+	table->n_comms = table->size = 0;
+}
+
+/*
+ * Get the name of a task at a given moment in time. Returns NULL if the name
+ * is not known. Must be called with "comms_mutex" held.
+ */
+static const char *get_comm(struct kshark_data_stream *stream,
+			    int pid, int64_t ts)
+{
+	struct tepdata_handle *tep_handle = stream->interface.handle;
+	const struct tepdata_comm *comms = tep_handle->comms;
+	ssize_t h, l, mid;
+
+	if (!tep_handle->n_comms)
+		return NULL;
+
+	/* Find the last name of the task, which is valid at this time. */
+	h = tep_handle->n_comms;
+	l = -1;
+	BSEARCH(h, l, comms[mid].pid < pid ||
+		      (comms[mid].pid == pid && comms[mid].ts <= ts));
+
+	if (l >= 0 && comms[l].pid == pid)
+		return comms[l].comm;
+
+	/* The time is before the first name of the task. Use the first name. */
+	if (l + 1 < (ssize_t) tep_handle->n_comms && comms[l + 1].pid == pid)
+		return comms[l + 1].comm;
+
+	return NULL;
 }
 
 /**
@@ -212,60 +493,170 @@ enum rec_type {
 	REC_ENTRY,
 };
 
-static void free_rec_list(struct rec_list **rec_list, int n_cpus,
-			  enum rec_type type)
+static bool rec_list_append(struct rec_list *list, void *item)
+{
+	void **items_tmp;
+	size_t capacity;
+
+	if (list->size == list->capacity) {
+		capacity = list->capacity ? 2 * list->capacity : 1024;
+		items_tmp = realloc(list->items, capacity * sizeof(*items_tmp));
+		if (!items_tmp)
+			return false;
+
+		list->items = items_tmp;
+		list->capacity = capacity;
+	}
+
+	list->items[list->size++] = item;
+
+	return true;
+}
+
+/*
+ * Allocate a new entry and append it to the list. If "spill" is true, the
+ * entry is allocated taking into account the memory budget of the session.
+ */
+static struct kshark_entry *rec_list_new_entry(struct kshark_context *kshark_ctx,
+					       struct rec_list *list, bool spill)
+{
+	struct kshark_entry *entry;
+
+	entry = spill ? kshark_entry_alloc(kshark_ctx) :
+			calloc(1, sizeof(*entry));
+	if (!entry)
+		return NULL;
+
+	if (!rec_list_append(list, entry)) {
+		if (spill)
+			kshark_free_entry(kshark_ctx, entry);
+		else
+			free(entry);
+
+		return NULL;
+	}
+
+	return entry;
+}
+
+/* Free all items which are not merged yet, and the arrays. */
+static void free_rec_list(struct kshark_context *kshark_ctx,
+			  struct rec_list *rec_list, int n_cpus,
+			  enum rec_type type, bool spill)
 {
-	struct rec_list *temp_rec;
+	size_t i;
 	int cpu;
 
 	for (cpu = 0; cpu < n_cpus; ++cpu) {
-		while (rec_list[cpu]) {
-			temp_rec = rec_list[cpu];
-			rec_list[cpu] = temp_rec->next;
+		for (i = rec_list[cpu].pos; i < rec_list[cpu].size; ++i) {
 			if (type == REC_RECORD)
-				free_record(temp_rec->rec);
-			free(temp_rec);
+				free_record(rec_list[cpu].recs[i]);
+			else if (spill)
+				kshark_free_entry(kshark_ctx,
+						  rec_list[cpu].entries[i]);
+			else
+				free(rec_list[cpu].entries[i]);
 		}
+
+		free(rec_list[cpu].items);
 	}
+
 	free(rec_list);
 }
 
+static void free_batch_record(void *rec)
+{
+	free_record(rec);
+}
+
+static bool page_index_cached(struct kshark_data_stream *stream);
+
+static uint64_t page_index_mask(struct kshark_data_stream *stream);
+
+static bool page_index_add(struct kshark_page_index **index_ptr,
+			   ssize_t *n_ptr, uint64_t page_mask,
+			   const struct tep_record *rec);
+
+static void page_index_publish(struct kshark_data_stream *stream,
+			       struct kshark_page_index **page_index,
+			       ssize_t *n_pages);
+
+static void free_index_arrays(struct kshark_page_index **page_index,
+			      ssize_t *n_pages, int n_cpus);
+
 static ssize_t get_records(struct kshark_context *kshark_ctx,
 			   struct kshark_data_stream *stream,
-			   struct rec_list ***rec_list,
-			   enum rec_type type)
+			   struct rec_list **rec_list,
+			   enum rec_type type, bool spill)
 {
+	struct kshark_page_index **page_index = NULL;
+	struct kshark_plugin_batch *batch = NULL;
 	struct tep_event_filter *adv_filter;
-	struct rec_list **temp_next;
-	struct rec_list **cpu_list;
-	struct rec_list *temp_rec;
+	struct rec_list *cpu_list;
+	struct comm_table comms;
 	struct tep_record *rec;
-	ssize_t count, total = 0;
+	ssize_t *n_pages = NULL;
+	uint64_t page_mask = 0;
+	ssize_t total = 0;
 	int pid, next_pid, cpu;
+	bool cached;
+
+	if (!comm_table_init(&comms))
+		return -ENOMEM;
 
 	cpu_list = calloc(stream->n_cpus, sizeof(*cpu_list));
-	if (!cpu_list)
+	if (!cpu_list) {
+		comm_table_free(&comms);
 		return -ENOMEM;
+	}
+
+	/*
+	 * If the page-level time index is not cached, it is built here, while
+	 * reading the records, instead of an extra pass over the file.
+	 */
+	pthread_mutex_lock(&stream->input_mutex);
+	cached = page_index_cached(stream);
+	pthread_mutex_unlock(&stream->input_mutex);
+
+	if (!cached) {
+		page_index = calloc(stream->n_cpus, sizeof(*page_index));
+		n_pages = calloc(stream->n_cpus, sizeof(*n_pages));
+		if (!page_index || !n_pages)
+			goto fail;
+
+		page_mask = page_index_mask(stream);
+	}
 
 	if (type == REC_ENTRY)
 		adv_filter = get_adv_filter(stream);
 
-	for (cpu = 0; cpu < stream->n_cpus; ++cpu) {
-		count = 0;
-		cpu_list[cpu] = NULL;
-		temp_next = &cpu_list[cpu];
+	/*
+	 * The records of the events, having batch handlers, are kept until
+	 * a batch of such records (of the same CPU) is collected.
+	 */
+	if (type == REC_ENTRY && stream->batch_handlers) {
+		batch = kshark_plugin_batch_alloc(stream, free_batch_record);
+		if (!batch)
+			goto fail;
+	}
 
+	for (cpu = 0; cpu < stream->n_cpus; ++cpu) {
 		rec = tracecmd_read_cpu_first(kshark_get_tep_input(stream), cpu);
 		while (rec) {
-			*temp_next = temp_rec = calloc(1, sizeof(*temp_rec));
-			if (!temp_rec)
+			if (page_index &&
+			    !page_index_add(&page_index[cpu], &n_pages[cpu],
+					    page_mask, rec)) {
+				free_record(rec);
 				goto fail;
-
-			temp_rec->next = NULL;
+			}
 
 			switch (type) {
 			case REC_RECORD:
-				temp_rec->rec = rec;
+				if (!rec_list_append(&cpu_list[cpu], rec)) {
+					free_record(rec);
+					goto fail;
+				}
+
 				pid = tep_data_pid(kshark_get_tep(stream), rec);
 				break;
 			case REC_ENTRY: {
@@ -276,29 +667,34 @@ static ssize_t get_records(struct kshark_context *kshark_ctx,
 					 * Insert a custom "missed_events" entry just
 					 * befor this record.
 					 */
-					entry = &temp_rec->entry;
+					entry = rec_list_new_entry(kshark_ctx,
+								   &cpu_list[cpu],
+								   spill);
+					if (!entry) {
+						free_record(rec);
+						goto fail;
+					}
+
 					missed_events_action(stream, rec, entry);
 
 					/* Apply time calibration. */
 					kshark_postprocess_entry(stream, rec, entry);
 
 					entry->stream_id = stream->stream_id;
+				}
 
-					temp_next = &temp_rec->next;
-					++count;
-
-					/* Now allocate a new rec_list node and comtinue. */
-					*temp_next = temp_rec = calloc(1, sizeof(*temp_rec));
+				entry = rec_list_new_entry(kshark_ctx, &cpu_list[cpu],
+							   spill);
+				if (!entry) {
+					free_record(rec);
+					goto fail;
 				}
 
-				entry = &temp_rec->entry;
 				set_entry_values(stream, rec, entry);
 
-				if(entry->event_id == get_sched_switch_id(stream)) {
+				next_pid = -1;
+				if(entry->event_id == get_sched_switch_id(stream))
 					next_pid = get_next_pid(stream, rec);
-					if (next_pid >= 0)
-						register_command(stream, rec, next_pid);
-				}
 
 				entry->stream_id = stream->stream_id;
 
@@ -308,6 +704,17 @@ static ssize_t get_records(struct kshark_context *kshark_ctx,
 				 */
 				kshark_postprocess_entry(stream, rec, entry);
 
+				/*
+				 * Collect the name of the task. Use the calibrated
+				 * time of the entry.
+				 */
+				if (next_pid >= 0 &&
+				    !register_command(stream, &comms, rec,
+						      next_pid, entry->ts)) {
+					free_record(rec);
+					goto fail;
+				}
+
 				pid = entry->pid;
 
 				/* Apply Id filtering. */
@@ -318,31 +725,51 @@ static ssize_t get_records(struct kshark_context *kshark_ctx,
 				    tep_filter_match(adv_filter, rec) != FILTER_MATCH)
 					unset_event_filter_flag(kshark_ctx, entry);
 
-				free_record(rec);
+				if (!batch ||
+				    !kshark_plugin_batch_add(batch, cpu, rec, entry))
+					free_record(rec);
 				break;
 			} /* REC_ENTRY */
 			}
 
 			kshark_hash_id_add(stream->tasks, pid);
 
-			temp_next = &temp_rec->next;
-
-			++count;
 			rec = tracecmd_read_data(kshark_get_tep_input(stream), cpu);
 		}
 
-		total += count;
+		total += cpu_list[cpu].size;
+	}
+
+	/* All names of tasks are known now. Make them available. */
+	if (type == REC_ENTRY)
+		publish_commands(stream, &comms);
+
+	if (batch) {
+		kshark_plugin_batch_end(batch);
+		free(batch);
 	}
 
+	comm_table_free(&comms);
+
+	if (page_index)
+		page_index_publish(stream, page_index, n_pages);
+
 	*rec_list = cpu_list;
 	return total;
 
  fail:
-	free_rec_list(cpu_list, stream->n_cpus, type);
+	if (batch) {
+		kshark_plugin_batch_flush(batch);
+		free(batch);
+	}
+
+	comm_table_free(&comms);
+	free_index_arrays(page_index, n_pages, stream->n_cpus);
+	free_rec_list(kshark_ctx, cpu_list, stream->n_cpus, type, spill);
 	return -ENOMEM;
 }
 
-static int pick_next_cpu(struct rec_list **rec_list, int n_cpus,
+static int pick_next_cpu(struct rec_list *rec_list, int n_cpus,
 			 enum rec_type type)
 {
 	uint64_t ts = 0;
@@ -351,15 +778,15 @@ static int pick_next_cpu(struct rec_list **rec_list, int n_cpus,
 	int cpu;
 
 	for (cpu = 0; cpu < n_cpus; ++cpu) {
-		if (!rec_list[cpu])
+		if (rec_list[cpu].pos == rec_list[cpu].size)
 			continue;
 
 		switch (type) {
 		case REC_RECORD:
-			rec_ts = rec_list[cpu]->rec->ts;
+			rec_ts = rec_list[cpu].recs[rec_list[cpu].pos]->ts;
 			break;
 		case REC_ENTRY:
-			rec_ts = rec_list[cpu]->entry.ts;
+			rec_ts = rec_list[cpu].entries[rec_list[cpu].pos]->ts;
 			break;
 		}
 		if (!ts || rec_ts < ts) {
@@ -387,7 +814,7 @@ static int pick_next_cpu(struct rec_list **rec_list, int n_cpus,
  * @param kshark_ctx: Input location for context pointer.
  * @param data_rows: Output location for the trace data. The user is
  *		     responsible for freeing the elements of the outputted
- *		     array.
+ *		     array. If a memory budget is set, use kshark_free_entries().
  *
  * @returns The size of the outputted data in the case of success, or a
  *	    negative error code on failure.
@@ -398,14 +825,14 @@ ssize_t tepdata_load_entries(struct kshark_data_stream *stream,
 {
 	enum rec_type type = REC_ENTRY;
 	struct kshark_entry **rows;
-	struct rec_list **rec_list;
+	struct rec_list *rec_list;
 	ssize_t count, total = 0;
 
-	total = get_records(kshark_ctx, stream, &rec_list, type);
+	total = get_records(kshark_ctx, stream, &rec_list, type, true);
 	if (total < 0)
 		goto fail;
 
-	rows = calloc(total, sizeof(struct kshark_entry *));
+	rows = kshark_bulk_alloc(total, sizeof(struct kshark_entry *));
 	if (!rows)
 		goto fail_free;
 
@@ -414,20 +841,19 @@ ssize_t tepdata_load_entries(struct kshark_data_stream *stream,
 
 		next_cpu = pick_next_cpu(rec_list, stream->n_cpus, type);
 
-		if (next_cpu >= 0) {
-			rows[count] = &rec_list[next_cpu]->entry;
-			rec_list[next_cpu] = rec_list[next_cpu]->next;
-		}
+		if (next_cpu >= 0)
+			rows[count] =
+				rec_list[next_cpu].entries[rec_list[next_cpu].pos++];
 	}
 
 	/* There should be no entries left in rec_list. */
-	free_rec_list(rec_list, stream->n_cpus, type);
+	free_rec_list(kshark_ctx, rec_list, stream->n_cpus, type, true);
 	*data_rows = rows;
 
 	return total;
 
  fail_free:
-	free_rec_list(rec_list, stream->n_cpus, type);
+	free_rec_list(kshark_ctx, rec_list, stream->n_cpus, type, true);
 
  fail:
 	fprintf(stderr, "Failed to allocate memory during data loading.\n");
@@ -443,11 +869,11 @@ static ssize_t tepdata_load_matrix(struct kshark_data_stream *stream,
 				   uint64_t **ts_array)
 {
 	enum rec_type type = REC_ENTRY;
-	struct rec_list **rec_list;
+	struct rec_list *rec_list;
 	ssize_t count, total = 0;
 	bool status;
 
-	total = get_records(kshark_ctx, stream, &rec_list, type);
+	total = get_records(kshark_ctx, stream, &rec_list, type, false);
 	if (total < 0)
 		goto fail;
 
@@ -464,8 +890,8 @@ static ssize_t tepdata_load_matrix(struct kshark_data_stream *stream,
 
 		next_cpu = pick_next_cpu(rec_list, stream->n_cpus, type);
 		if (next_cpu >= 0) {
-			struct rec_list *rec = rec_list[next_cpu];
-			struct kshark_entry *e = &rec->entry;
+			struct kshark_entry *e =
+				rec_list[next_cpu].entries[rec_list[next_cpu].pos++];
 
 			if (offset_array)
 				(*offset_array)[count] = e->offset;
@@ -484,17 +910,16 @@ static ssize_t tepdata_load_matrix(struct kshark_data_stream *stream,
 			if (event_array)
 				(*event_array)[count] = e->event_id;
 
-			rec_list[next_cpu] = rec_list[next_cpu]->next;
-			free(rec);
+			free(e);
 		}
 	}
 
 	/* There should be no entries left in rec_list. */
-	free_rec_list(rec_list, stream->n_cpus, type);
+	free_rec_list(kshark_ctx, rec_list, stream->n_cpus, type, false);
 	return total;
 
  fail_free:
-	free_rec_list(rec_list, stream->n_cpus, type);
+	free_rec_list(kshark_ctx, rec_list, stream->n_cpus, type, false);
 
  fail:
 	fprintf(stderr, "Failed to allocate memory during data loading.\n");
@@ -519,10 +944,8 @@ ssize_t kshark_load_tep_records(struct kshark_context *kshark_ctx, int sd,
 {
 	struct kshark_data_stream *stream;
 	enum rec_type type = REC_RECORD;
-	struct rec_list **rec_list;
-	struct rec_list *temp_rec;
+	struct rec_list *rec_list;
 	struct tep_record **rows;
-	struct tep_record *rec;
 	ssize_t count, total = 0;
 
 	if (*data_rows)
@@ -532,11 +955,11 @@ ssize_t kshark_load_tep_records(struct kshark_context *kshark_ctx, int sd,
 	if (!stream)
 		return -EBADF;
 
-	total = get_records(kshark_ctx, stream, &rec_list, type);
+	total = get_records(kshark_ctx, stream, &rec_list, type, false);
 	if (total < 0)
 		goto fail;
 
-	rows = calloc(total, sizeof(struct tep_record *));
+	rows = kshark_bulk_alloc(total, sizeof(struct tep_record *));
 	if (!rows)
 		goto fail_free;
 
@@ -545,24 +968,19 @@ ssize_t kshark_load_tep_records(struct kshark_context *kshark_ctx, int sd,
 
 		next_cpu = pick_next_cpu(rec_list, stream->n_cpus, type);
 
-		if (next_cpu >= 0) {
-			rec = rec_list[next_cpu]->rec;
-			rows[count] = rec;
-
-			temp_rec = rec_list[next_cpu];
-			rec_list[next_cpu] = rec_list[next_cpu]->next;
-			free(temp_rec);
-			/* The record is still referenced in rows */
-		}
+		/* The record is referenced in rows. */
+		if (next_cpu >= 0)
+			rows[count] =
+				rec_list[next_cpu].recs[rec_list[next_cpu].pos++];
 	}
 
 	/* There should be no records left in rec_list */
-	free_rec_list(rec_list, stream->n_cpus, type);
+	free_rec_list(kshark_ctx, rec_list, stream->n_cpus, type, false);
 	*data_rows = rows;
 	return total;
 
  fail_free:
-	free_rec_list(rec_list, stream->n_cpus, type);
+	free_rec_list(kshark_ctx, rec_list, stream->n_cpus, type, false);
 
  fail:
 	fprintf(stderr, "Failed to allocate memory during data loading.\n");
@@ -689,18 +1107,32 @@ static const int tepdata_get_pid(struct kshark_data_stream *stream,
 	return pid;
 }
 
-static char *tepdata_get_task(struct kshark_data_stream *stream,
-			      const struct kshark_entry *entry)
+/* Get a copy of the name of a task at a given moment in time. */
+static char *copy_comm(struct kshark_data_stream *stream, int pid, int64_t ts)
 {
-	int pid = stream->interface.get_pid(stream, entry);
 	const char *task;
 	char *buffer;
+	int ret;
 
-	task = tep_data_comm_from_pid(kshark_get_tep(stream), pid);
-	if (asprintf(&buffer, "%s", task)  <= 0)
-		return NULL;
+	pthread_mutex_lock(&comms_mutex);
 
-	return buffer;
+	task = get_comm(stream, pid, ts);
+	if (!task)
+		task = tep_data_comm_from_pid(kshark_get_tep(stream), pid);
+
+	ret = asprintf(&buffer, "%s", task);
+
+	pthread_mutex_unlock(&comms_mutex);
+
+	return ret > 0 ? buffer : NULL;
+}
+
+static char *tepdata_get_task(struct kshark_data_stream *stream,
+			      const struct kshark_entry *entry)
+{
+	int pid = stream->interface.get_pid(stream, entry);
+
+	return copy_comm(stream, pid, entry->ts);
 }
 
 static char *tepdata_get_latency(struct kshark_data_stream *stream,
@@ -873,18 +1305,20 @@ static char* kshark_dump_custom_entry(struct kshark_data_stream *stream,
 				      const struct kshark_entry *entry,
 				      kshark_custom_info_func info_func)
 {
-	char *entry_str;
+	char *entry_str, *task;
 	int size = 0;
 
+	task = copy_comm(stream, entry->pid, entry->ts);
 	size = asprintf(&entry_str, "%" PRIu64 "; %s-%i; CPU %i; ; %s; %s; 0x%x",
 			entry->ts,
-			tep_data_comm_from_pid(kshark_get_tep(stream), entry->pid),
+			task,
 			entry->pid,
 			entry->cpu,
 			info_func(stream, entry, false),
 			info_func(stream, entry, true),
 			entry->visible);
 
+	free(task);
 	if (size > 0)
 		return entry_str;
 
@@ -1061,81 +1495,950 @@ int tepdata_read_event_field(struct kshark_data_stream *stream,
 	return ret;
 }
 
-/** Initialize all methods used by a stream of FTRACE data. */
-static void kshark_tep_init_methods(struct kshark_data_stream *stream)
-{
-	stream->interface.get_pid = tepdata_get_pid;
-	stream->interface.get_task = tepdata_get_task;
-	stream->interface.get_event_id = tepdata_get_event_id;
-	stream->interface.get_event_name = tepdata_get_event_name;
-	stream->interface.get_latency = tepdata_get_latency;
-	stream->interface.get_info = tepdata_get_info;
-	stream->interface.find_event_id = tepdata_find_event_id;
-	stream->interface.get_all_event_ids = tepdata_get_event_ids;
-	stream->interface.dump_entry = tepdata_dump_entry;
-	stream->interface.get_all_field_names = tepdata_get_field_names;
-	stream->interface.get_event_field_type = tepdata_get_field_type;
-	stream->interface.read_record_field_int64 = tepdata_read_record_field;
-	stream->interface.read_event_field_int64 = tepdata_read_event_field;
-	stream->interface.load_entries = tepdata_load_entries;
-	stream->interface.load_matrix = tepdata_load_matrix;
-}
-
-/** Find a host stream from the same tracing session, that has guest information */
-static struct tracecmd_input *
-kshark_tep_find_merge_peer(struct kshark_context *kshark_ctx,
-			   struct tracecmd_input *handle)
+static struct kshark_field_handle *
+tepdata_get_field_handle(struct kshark_data_stream *stream,
+			 int event_id, const char *field)
 {
-	struct tracecmd_input *peer_handle = NULL;
-	struct kshark_data_stream *peer_stream;
-	unsigned long long trace_id;
-	int *stream_ids = NULL;
-	int ret;
-	int i;
-
-	trace_id = tracecmd_get_traceid(handle);
-	if (!trace_id)
-		goto out;
+	struct tepdata_handle *tep_handle = stream->interface.handle;
+	struct kshark_field_handle *handle;
+	struct tep_format_field *evt_field;
 
-	stream_ids = kshark_all_streams(kshark_ctx);
-	if (!stream_ids)
-		goto out;
+	if (!field)
+		return NULL;
 
-	for (i = 0; i < kshark_ctx->n_streams - 1; i++) {
-		peer_stream = kshark_get_data_stream(kshark_ctx, stream_ids[i]);
-		if (!peer_stream || peer_stream->format != KS_TEP_DATA)
-			continue;
+	for (handle = tep_handle->field_handles; handle; handle = handle->next)
+		if (handle->event_id == event_id &&
+		    strcmp(handle->field->name, field) == 0)
+			return handle;
 
-		peer_handle = kshark_get_tep_input(peer_stream);
-		if (!peer_handle)
-			continue;
+	evt_field = get_evt_field(stream, event_id, field);
+	if (!evt_field)
+		return NULL;
 
-		ret = tracecmd_get_guest_cpumap(peer_handle, trace_id,
-						NULL, NULL, NULL);
-		if (!ret)
-			break;
+	handle = malloc(sizeof(*handle));
+	if (!handle) {
+		fprintf(stderr, "Failed to allocate memory for field handle.\n");
+		return NULL;
 	}
 
-	if (i == kshark_ctx->n_streams)
-		peer_handle = NULL;
+	handle->event_id = event_id;
+	handle->field = evt_field;
+	handle->next = tep_handle->field_handles;
+	tep_handle->field_handles = handle;
 
-out:
-	free(stream_ids);
-	return peer_handle;
+	return handle;
 }
 
-const char *tep_plugin_names[] = {
-	"sched_events",
-	"missed_events",
-	"kvm_combo",
-};
-
-#define LINUX_IDLE_TASK_PID	0
+static bool check_record(struct kshark_data_stream *stream,
+			 struct tep_record *record,
+			 const struct kshark_field_handle *handle)
+{
+	return record && handle &&
+	       tep_data_type(kshark_get_tep(stream), record) == handle->event_id;
+}
 
-int kshark_tep_handle_plugins(struct kshark_context *kshark_ctx, int sd)
+static int tepdata_read_record_field_handle(struct kshark_data_stream *stream,
+					    void *rec,
+					    const struct kshark_field_handle *handle,
+					    int64_t *val)
+{
+	struct tep_record *record = rec;
+
+	if (!check_record(stream, record, handle))
+		return -EINVAL;
+
+	return tep_read_number_field(handle->field, record->data,
+				     (unsigned long long *) val);
+}
+
+static int tepdata_read_event_field_handle(struct kshark_data_stream *stream,
+					   const struct kshark_entry *entry,
+					   const struct kshark_field_handle *handle,
+					   int64_t *val)
+{
+	struct tep_record *record;
+	int ret;
+
+	if (!handle || entry->event_id != handle->event_id)
+		return -EINVAL;
+
+	record = tracecmd_read_at(kshark_get_tep_input(stream),
+				  entry->offset, NULL);
+	if (!record)
+		return -EFAULT;
+
+	ret = tep_read_number_field(handle->field, record->data,
+				    (unsigned long long *) val);
+	free_record(record);
+
+	return ret;
+}
+
+static char *read_field_str(struct tep_format_field *field,
+			    struct tep_record *record)
+{
+	unsigned int offset = field->offset, size = field->size;
+	unsigned long long val;
+
+	if (field->flags & TEP_FIELD_IS_DYNAMIC) {
+		/*
+		 * The field holds the offset (low 16 bits) and the size
+		 * (high 16 bits) of the data.
+		 */
+		if (tep_read_number_field(field, record->data, &val) < 0)
+			return NULL;
+
+		offset = val & 0xffff;
+		size = val >> 16;
+	} else if (!(field->flags & TEP_FIELD_IS_ARRAY)) {
+		return NULL;
+	}
+
+	if (offset + size > record->size)
+		return NULL;
+
+	return strndup((char *) record->data + offset, size);
+}
+
+static char *tepdata_read_record_field_str(struct kshark_data_stream *stream,
+					   void *rec,
+					   const struct kshark_field_handle *handle)
+{
+	struct tep_record *record = rec;
+
+	if (!check_record(stream, record, handle))
+		return NULL;
+
+	return read_field_str(handle->field, record);
+}
+
+static char *tepdata_read_event_field_str(struct kshark_data_stream *stream,
+					  const struct kshark_entry *entry,
+					  const struct kshark_field_handle *handle)
+{
+	struct tep_record *record;
+	char *str;
+
+	if (!handle || entry->event_id != handle->event_id)
+		return NULL;
+
+	record = tracecmd_read_at(kshark_get_tep_input(stream),
+				  entry->offset, NULL);
+	if (!record)
+		return NULL;
+
+	str = read_field_str(handle->field, record);
+	free_record(record);
+
+	return str;
+}
+
+/** Magic string, identifying the files of page-level time indexes. */
+#define KS_PAGE_INDEX_MAGIC	"KSPIDX01"
+
+/* Quiet warnings over documenting simple structures */
+//! @cond Doxygen_Suppress
+
+struct page_index_header {
+	char		magic[8];
+	uint64_t	file_size;
+	int64_t		mtime_sec;
+	int64_t		mtime_nsec;
+	int32_t		n_cpus;
+	int32_t		page_size;
+};
+
+//! @endcond
+
+/*
+ * The name of the cache file is derived from the path of the trace data file
+ * and the name of the buffer (FNV-1a hash).
+ */
+static char *page_index_file(struct kshark_data_stream *stream)
+{
+	uint64_t hash = 0xcbf29ce484222325ULL;
+	char *path, *dir, *file = NULL;
+	const char *c;
+
+	path = realpath(stream->file, NULL);
+	if (!path)
+		return NULL;
+
+	for (c = path; *c; ++c)
+		hash = (hash ^ (unsigned char) *c) * 0x100000001b3ULL;
+
+	for (c = stream->name ? stream->name : ""; *c; ++c)
+		hash = (hash ^ (unsigned char) *c) * 0x100000001b3ULL;
+
+	free(path);
+
+	dir = kshark_cache_dir();
+	if (!dir)
+		return NULL;
+
+	if (asprintf(&file, "%s/%016" PRIx64 ".ksidx", dir, hash) <= 0)
+		file = NULL;
+
+	free(dir);
+
+	return file;
+}
+
+static bool page_index_header_init(struct kshark_data_stream *stream,
+				   struct page_index_header *header)
+{
+	struct stat st;
+
+	if (stat(stream->file, &st) < 0)
+		return false;
+
+	memset(header, 0, sizeof(*header));
+	memcpy(header->magic, KS_PAGE_INDEX_MAGIC, sizeof(header->magic));
+	header->file_size = st.st_size;
+	header->mtime_sec = st.st_mtim.tv_sec;
+	header->mtime_nsec = st.st_mtim.tv_nsec;
+	header->n_cpus = stream->n_cpus;
+	header->page_size = tracecmd_page_size(kshark_get_tep_input(stream));
+
+	return true;
+}
+
+static void free_index_arrays(struct kshark_page_index **page_index,
+			      ssize_t *n_pages, int n_cpus)
+{
+	int cpu;
+
+	if (page_index) {
+		for (cpu = 0; cpu < n_cpus; ++cpu)
+			free(page_index[cpu]);
+	}
+
+	free(page_index);
+	free(n_pages);
+}
+
+static void free_page_index(struct tepdata_handle *tep_handle, int n_cpus)
+{
+	free_index_arrays(tep_handle->page_index, tep_handle->n_pages, n_cpus);
+	tep_handle->page_index = NULL;
+	tep_handle->n_pages = NULL;
+}
+
+static bool alloc_page_index(struct tepdata_handle *tep_handle, int n_cpus)
+{
+	tep_handle->page_index = calloc(n_cpus, sizeof(*tep_handle->page_index));
+	tep_handle->n_pages = calloc(n_cpus, sizeof(*tep_handle->n_pages));
+
+	if (!tep_handle->page_index || !tep_handle->n_pages) {
+		free_page_index(tep_handle, 0);
+		return false;
+	}
+
+	return true;
+}
+
+/* Load the index from the cache. Fails if the trace data file has changed. */
+static bool load_page_index(struct kshark_data_stream *stream,
+			    const char *file)
+{
+	struct tepdata_handle *tep_handle = stream->interface.handle;
+	struct page_index_header header, expected;
+	int64_t n_pages;
+	bool ok = false;
+	FILE *f;
+	int cpu;
+
+	if (!page_index_header_init(stream, &expected))
+		return false;
+
+	f = fopen(file, "r");
+	if (!f)
+		return false;
+
+	if (fread(&header, sizeof(header), 1, f) != 1 ||
+	    memcmp(&header, &expected, sizeof(header)) != 0 ||
+	    !alloc_page_index(tep_handle, stream->n_cpus))
+		goto out;
+
+	for (cpu = 0; cpu < stream->n_cpus; ++cpu) {
+		if (fread(&n_pages, sizeof(n_pages), 1, f) != 1 || n_pages < 0)
+			goto out;
+
+		tep_handle->n_pages[cpu] = n_pages;
+		if (!n_pages)
+			continue;
+
+		tep_handle->page_index[cpu] =
+			malloc(n_pages * sizeof(**tep_handle->page_index));
+		if (!tep_handle->page_index[cpu] ||
+		    fread(tep_handle->page_index[cpu],
+			  sizeof(**tep_handle->page_index),
+			  n_pages, f) != n_pages)
+			goto out;
+	}
+
+	ok = true;
+
+ out:
+	fclose(f);
+	if (!ok)
+		free_page_index(tep_handle, stream->n_cpus);
+
+	return ok;
+}
+
+/*
+ * Store the index in the cache. The index is written into a temporary file,
+ * which is renamed at the end, hence a concurrent reader never sees a
+ * partially written index.
+ */
+static void save_page_index(struct kshark_data_stream *stream,
+			    const char *file)
+{
+	struct tepdata_handle *tep_handle = stream->interface.handle;
+	struct page_index_header header;
+	char *tmp_file;
+	int64_t n_pages;
+	bool ok = true;
+	int fd, cpu;
+	FILE *f;
+
+	if (!page_index_header_init(stream, &header) ||
+	    asprintf(&tmp_file, "%s.XXXXXX", file) <= 0)
+		return;
+
+	fd = mkstemp(tmp_file);
+	if (fd < 0) {
+		free(tmp_file);
+		return;
+	}
+
+	f = fdopen(fd, "w");
+	if (!f) {
+		close(fd);
+		unlink(tmp_file);
+		free(tmp_file);
+		return;
+	}
+
+	ok = fwrite(&header, sizeof(header), 1, f) == 1;
+	for (cpu = 0; ok && cpu < stream->n_cpus; ++cpu) {
+		n_pages = tep_handle->n_pages[cpu];
+		ok = fwrite(&n_pages, sizeof(n_pages), 1, f) == 1 &&
+		     fwrite(tep_handle->page_index[cpu],
+			    sizeof(**tep_handle->page_index),
+			    n_pages, f) == n_pages;
+	}
+
+	if (fclose(f) != 0 || !ok || rename(tmp_file, file) < 0)
+		unlink(tmp_file);
+
+	free(tmp_file);
+}
+
+/*
+ * Add a record to the index of its CPU. The records must be added in the
+ * order they are stored in the file.
+ */
+static bool page_index_add(struct kshark_page_index **index_ptr,
+			   ssize_t *n_ptr, uint64_t page_mask,
+			   const struct tep_record *rec)
+{
+	struct kshark_page_index *index = *index_ptr, *tmp;
+	ssize_t n = *n_ptr;
+
+	if (!n || (index[n - 1].offset & page_mask) !=
+		  (rec->offset & page_mask)) {
+		/* Grow the array in powers of two. */
+		if ((n & (n - 1)) == 0) {
+			tmp = realloc(index, (n ? 2 * n : 1) * sizeof(*index));
+			if (!tmp)
+				return false;
+
+			*index_ptr = index = tmp;
+		}
+
+		index[n].offset = rec->offset;
+		index[n].first_ts = rec->ts;
+		index[n].count = 0;
+		++n;
+	}
+
+	index[n - 1].last_ts = rec->ts;
+	index[n - 1].count++;
+	*n_ptr = n;
+
+	return true;
+}
+
+static uint64_t page_index_mask(struct kshark_data_stream *stream)
+{
+	return ~((uint64_t) tracecmd_page_size(kshark_get_tep_input(stream)) - 1);
+}
+
+/*
+ * Walk the records of the CPU, without decoding their content. Only the
+ * offsets and the timestamps of the records are used.
+ */
+static ssize_t index_cpu(struct kshark_data_stream *stream, int cpu,
+			 struct kshark_page_index **index_ptr)
+{
+	struct tracecmd_input *input = kshark_get_tep_input(stream);
+	uint64_t page_mask = page_index_mask(stream);
+	struct kshark_page_index *index = NULL;
+	struct tep_record *rec;
+	ssize_t n = 0;
+
+	for (rec = tracecmd_read_cpu_first(input, cpu); rec;
+	     rec = tracecmd_read_data(input, cpu)) {
+		if (!page_index_add(&index, &n, page_mask, rec)) {
+			free_record(rec);
+			free(index);
+			return -ENOMEM;
+		}
+
+		free_record(rec);
+	}
+
+	*index_ptr = index;
+
+	return n;
+}
+
+/*
+ * Load the index from the cache, if it is not loaded yet. Must be called
+ * with the input mutex of the stream being locked.
+ */
+static bool page_index_cached(struct kshark_data_stream *stream)
+{
+	struct tepdata_handle *tep_handle = stream->interface.handle;
+	char *file;
+	bool ret;
+
+	if (tep_handle->page_index)
+		return true;
+
+	file = page_index_file(stream);
+	ret = file && load_page_index(stream, file);
+	free(file);
+
+	return ret;
+}
+
+/*
+ * Make an index, built while loading the data, available and store it in the
+ * cache. The index gets freed, if in the meantime the stream got an index.
+ */
+static void page_index_publish(struct kshark_data_stream *stream,
+			       struct kshark_page_index **page_index,
+			       ssize_t *n_pages)
+{
+	struct tepdata_handle *tep_handle = stream->interface.handle;
+	char *file;
+
+	pthread_mutex_lock(&stream->input_mutex);
+
+	if (tep_handle->page_index) {
+		pthread_mutex_unlock(&stream->input_mutex);
+		free_index_arrays(page_index, n_pages, stream->n_cpus);
+		return;
+	}
+
+	tep_handle->page_index = page_index;
+	tep_handle->n_pages = n_pages;
+
+	file = page_index_file(stream);
+	if (file)
+		save_page_index(stream, file);
+
+	pthread_mutex_unlock(&stream->input_mutex);
+	free(file);
+}
+
+static int build_page_index(struct kshark_data_stream *stream)
+{
+	struct tepdata_handle *tep_handle = stream->interface.handle;
+	char *file;
+	ssize_t n_pages;
+	int cpu;
+
+	if (page_index_cached(stream))
+		return 0;
+
+	file = page_index_file(stream);
+	if (!alloc_page_index(tep_handle, stream->n_cpus)) {
+		free(file);
+		return -ENOMEM;
+	}
+
+	for (cpu = 0; cpu < stream->n_cpus; ++cpu) {
+		n_pages = index_cpu(stream, cpu, &tep_handle->page_index[cpu]);
+		if (n_pages < 0) {
+			free_page_index(tep_handle, stream->n_cpus);
+			free(file);
+			return n_pages;
+		}
+
+		tep_handle->n_pages[cpu] = n_pages;
+	}
+
+	if (file)
+		save_page_index(stream, file);
+
+	free(file);
+
+	return 0;
+}
+
+/**
+ * @brief Get the page-level time index of a given CPU. The index is built
+ *	  while loading the entries, or on the first call (if the entries
+ *	  are not loaded yet), by walking the records without decoding them.
+ *	  The index is stored in the cache directory. Later the index is
+ *	  loaded from the cache, unless the trace data file has changed.
+ */
+static ssize_t tepdata_get_page_index(struct kshark_data_stream *stream,
+				      int cpu,
+				      const struct kshark_page_index **index)
+{
+	struct tepdata_handle *tep_handle = stream->interface.handle;
+	ssize_t ret = 0;
+
+	if (cpu < 0 || cpu >= stream->n_cpus || !tep_handle->input)
+		return -EINVAL;
+
+	/*
+	 * Currently the data reading operations are not thread-safe.
+	 * Use a mutex to protect the access.
+	 */
+	pthread_mutex_lock(&stream->input_mutex);
+	if (!tep_handle->page_index)
+		ret = build_page_index(stream);
+	pthread_mutex_unlock(&stream->input_mutex);
+
+	if (ret < 0)
+		return ret;
+
+	*index = tep_handle->page_index[cpu];
+
+	return tep_handle->n_pages[cpu];
+}
+
+static int compare_entry_time(const void *a, const void *b)
+{
+	const struct kshark_entry *ea = *(const struct kshark_entry **) a;
+	const struct kshark_entry *eb = *(const struct kshark_entry **) b;
+
+	if (ea->ts > eb->ts)
+		return 1;
+
+	if (ea->ts < eb->ts)
+		return -1;
+
+	return 0;
+}
+
+/* Make a preview entry out of a sampled record. The record gets freed. */
+static struct kshark_entry *preview_entry(struct kshark_context *kshark_ctx,
+					  struct kshark_data_stream *stream,
+					  struct tep_record *rec)
+{
+	struct kshark_entry *entry;
+
+	entry = calloc(1, sizeof(*entry));
+	if (entry) {
+		set_entry_values(stream, rec, entry);
+		entry->stream_id = stream->stream_id;
+		kshark_calib_entry(stream, entry);
+
+		kshark_hash_id_add(stream->tasks, entry->pid);
+		kshark_apply_filters(kshark_ctx, stream, entry);
+	}
+
+	free_record(rec);
+
+	return entry;
+}
+
+/*
+ * Sample the first record of every "stride"-th page of each CPU, using the
+ * cached page index. Must be called with "input_mutex" held.
+ */
+static ssize_t preview_from_index(struct kshark_context *kshark_ctx,
+				  struct kshark_data_stream *stream,
+				  size_t max_pages,
+				  struct kshark_entry ***data_rows)
+{
+	struct tepdata_handle *tep_handle = stream->interface.handle;
+	struct kshark_entry **rows;
+	size_t total = 0, stride, p;
+	struct tep_record *rec;
+	ssize_t n = 0;
+	int cpu;
+
+	for (cpu = 0; cpu < stream->n_cpus; ++cpu)
+		total += tep_handle->n_pages[cpu];
+
+	stride = (total + max_pages - 1) / max_pages;
+	if (!stride)
+		stride = 1;
+
+	rows = calloc(total / stride + stream->n_cpus, sizeof(*rows));
+	if (!rows)
+		return -ENOMEM;
+
+	for (cpu = 0; cpu < stream->n_cpus; ++cpu) {
+		for (p = 0; p < tep_handle->n_pages[cpu]; p += stride) {
+			rec = tracecmd_read_at(kshark_get_tep_input(stream),
+					       tep_handle->page_index[cpu][p].offset,
+					       NULL);
+			if (!rec)
+				continue;
+
+			rows[n] = preview_entry(kshark_ctx, stream, rec);
+			if (!rows[n]) {
+				kshark_free_preview(rows, n);
+				return -ENOMEM;
+			}
+
+			++n;
+		}
+	}
+
+	*data_rows = rows;
+
+	return n;
+}
+
+/*
+ * Sample the first record of every "stride"-th page of the file, without an
+ * index. The data pages of all CPUs follow each other until the end of the
+ * file and reading at the beginning of a page returns its first record.
+ * Must be called with "input_mutex" held.
+ */
+static ssize_t preview_from_file(struct kshark_context *kshark_ctx,
+				 struct kshark_data_stream *stream,
+				 size_t max_pages,
+				 struct kshark_entry ***data_rows)
+{
+	struct tracecmd_input *input = kshark_get_tep_input(stream);
+	uint64_t page_size, start = UINT64_MAX, offset, step;
+	struct kshark_entry **rows;
+	size_t total, stride;
+	struct tep_record *rec;
+	struct stat st;
+	ssize_t n = 0;
+	int cpu;
+
+	/*
+	 * The offsets are in the decompressed data, while only the size of
+	 * the compressed file is known. Such files are not sampled.
+	 */
+	if (kshark_is_compressed(stream->file) ||
+	    stat(stream->file, &st) != 0)
+		return 0;
+
+	page_size = tracecmd_page_size(input);
+	if (!page_size)
+		return 0;
+
+	for (cpu = 0; cpu < stream->n_cpus; ++cpu) {
+		rec = tracecmd_read_cpu_first(input, cpu);
+		if (!rec)
+			continue;
+
+		if (rec->offset < start)
+			start = rec->offset;
+
+		free_record(rec);
+	}
+
+	start -= start % page_size;
+	if (start >= (uint64_t) st.st_size)
+		return 0;
+
+	total = (st.st_size - start + page_size - 1) / page_size;
+	stride = (total + max_pages - 1) / max_pages;
+	if (!stride)
+		stride = 1;
+
+	rows = calloc(total / stride + 1, sizeof(*rows));
+	if (!rows)
+		return -ENOMEM;
+
+	step = stride * page_size;
+	for (offset = start; offset < (uint64_t) st.st_size; offset += step) {
+		rec = tracecmd_read_at(input, offset, NULL);
+		if (!rec)
+			continue;
+
+		rows[n] = preview_entry(kshark_ctx, stream, rec);
+		if (!rows[n]) {
+			kshark_free_preview(rows, n);
+			return -ENOMEM;
+		}
+
+		++n;
+	}
+
+	*data_rows = rows;
+
+	return n;
+}
+
+/**
+ * @brief Load an approximate (preview) version of the trace data. Only the
+ *	  first record of every N-th page of the file is loaded, where N is
+ *	  chosen such that no more than "max_pages" pages get sampled. If the
+ *	  page-level time index of the Data stream is cached, the pages of
+ *	  each CPU are located by using the index. Otherwise the pages are
+ *	  sampled directly at evenly spaced offsets in the file. In both
+ *	  cases the time for getting the preview does not depend on the size
+ *	  of the file. The sampled tasks are added to the list of tasks of the
+ *	  Data stream. No plugin actions are applied to the sampled entries.
+ *
+ * @param kshark_ctx: Input location for the session context pointer.
+ * @param sd: Data stream identifier.
+ * @param max_pages: The maximum number of pages to be sampled.
+ * @param data_rows: Output location for the sampled entries. The entries are
+ *		     not allocated by using kshark_entry_alloc(). Use free() to
+ *		     free each entry and the array.
+ *
+ * @returns The number of sampled entries on success, or a negative error
+ *	    code on failure.
+ */
+ssize_t kshark_tep_load_preview(struct kshark_context *kshark_ctx, int sd,
+				size_t max_pages,
+				struct kshark_entry ***data_rows)
 {
-	int i, n_tep_plugins = sizeof(tep_plugin_names) / sizeof (const char *);
-	struct kshark_plugin_list *plugin;
+	struct kshark_data_stream *stream;
+	struct kshark_entry **rows = NULL;
+	ssize_t n;
+
+	stream = kshark_get_data_stream(kshark_ctx, sd);
+	if (!stream || !max_pages)
+		return -EBADF;
+
+	/*
+	 * Currently the data reading operations are not thread-safe.
+	 * Use a mutex to protect the access.
+	 */
+	pthread_mutex_lock(&stream->input_mutex);
+
+	if (page_index_cached(stream))
+		n = preview_from_index(kshark_ctx, stream, max_pages, &rows);
+	else
+		n = preview_from_file(kshark_ctx, stream, max_pages, &rows);
+
+	pthread_mutex_unlock(&stream->input_mutex);
+
+	if (n == -ENOMEM) {
+		fprintf(stderr,
+			"Failed to allocate memory for trace data preview.\n");
+		return n;
+	}
+
+	if (n > 0) {
+		qsort(rows, n, sizeof(*rows), compare_entry_time);
+		*data_rows = rows;
+	} else {
+		free(rows);
+	}
+
+	return n;
+}
+
+/**
+ * @brief Free the entries loaded by using kshark_tep_load_preview().
+ *
+ * @param data: Input location for the sampled entries.
+ * @param n: The number of sampled entries.
+ */
+void kshark_free_preview(struct kshark_entry **data, size_t n)
+{
+	size_t r;
+
+	for (r = 0; r < n; ++r)
+		free(data[r]);
+
+	free(data);
+}
+
+/** Initialize all methods used by a stream of FTRACE data. */
+static void kshark_tep_init_methods(struct kshark_data_stream *stream)
+{
+	stream->interface.get_pid = tepdata_get_pid;
+	stream->interface.get_task = tepdata_get_task;
+	stream->interface.get_event_id = tepdata_get_event_id;
+	stream->interface.get_event_name = tepdata_get_event_name;
+	stream->interface.get_latency = tepdata_get_latency;
+	stream->interface.get_info = tepdata_get_info;
+	stream->interface.find_event_id = tepdata_find_event_id;
+	stream->interface.get_all_event_ids = tepdata_get_event_ids;
+	stream->interface.dump_entry = tepdata_dump_entry;
+	stream->interface.get_all_field_names = tepdata_get_field_names;
+	stream->interface.get_event_field_type = tepdata_get_field_type;
+	stream->interface.read_record_field_int64 = tepdata_read_record_field;
+	stream->interface.read_event_field_int64 = tepdata_read_event_field;
+	stream->interface.get_field_handle = tepdata_get_field_handle;
+	stream->interface.read_event_field_handle_int64 =
+		tepdata_read_event_field_handle;
+	stream->interface.read_record_field_handle_int64 =
+		tepdata_read_record_field_handle;
+	stream->interface.read_event_field_handle_str =
+		tepdata_read_event_field_str;
+	stream->interface.read_record_field_handle_str =
+		tepdata_read_record_field_str;
+	stream->interface.get_page_index = tepdata_get_page_index;
+	stream->interface.load_entries = tepdata_load_entries;
+	stream->interface.load_matrix = tepdata_load_matrix;
+}
+
+static struct tepdata_handle *get_tep_handle(struct kshark_data_stream *stream)
+{
+	if (!stream || stream->format != KS_TEP_DATA)
+		return NULL;
+
+	/* The handle is NULL, while the stream is being initialized. */
+	return stream->interface.handle;
+}
+
+static bool probe_host(struct kshark_data_stream *stream,
+		       unsigned long long trace_id,
+		       const char **name, int *vcpu_count,
+		       const int **cpu_pid)
+{
+	struct tepdata_handle *tep_handle = get_tep_handle(stream);
+
+	if (!tep_handle || !tep_handle->input)
+		return false;
+
+	return tracecmd_get_guest_cpumap(tep_handle->input, trace_id,
+					 name, vcpu_count, cpu_pid) == 0;
+}
+
+/*
+ * Find a host stream from the same tracing session, that has the guest
+ * information for a given trace Id. The stream "hint" is checked first,
+ * followed by the streams known to be hosts of other guests. The stream "sd"
+ * (the guest itself) is skipped.
+ */
+static int find_host_stream(struct kshark_context *kshark_ctx,
+			    int sd, int hint,
+			    unsigned long long trace_id,
+			    const char **name, int *vcpu_count,
+			    const int **cpu_pid)
+{
+	struct kshark_data_stream *stream;
+	struct tepdata_handle *tep_handle;
+	int i, pass, *stream_ids;
+	int host_sd = -ENODATA;
+
+	if (!trace_id)
+		return -ENODATA;
+
+	if (hint >= 0 && hint != sd &&
+	    probe_host(kshark_get_data_stream(kshark_ctx, hint), trace_id,
+		       name, vcpu_count, cpu_pid))
+		return hint;
+
+	stream_ids = kshark_all_streams(kshark_ctx);
+	if (!stream_ids)
+		return -ENODATA;
+
+	for (pass = 0; pass < 2 && host_sd < 0; ++pass) {
+		for (i = 0; i < kshark_ctx->n_streams; ++i) {
+			if (stream_ids[i] == sd || stream_ids[i] == hint)
+				continue;
+
+			stream = kshark_get_data_stream(kshark_ctx,
+							stream_ids[i]);
+			tep_handle = get_tep_handle(stream);
+			if (!tep_handle ||
+			    (tep_handle->n_guests > 0) != (pass == 0))
+				continue;
+
+			if (probe_host(stream, trace_id,
+				       name, vcpu_count, cpu_pid)) {
+				host_sd = stream_ids[i];
+				break;
+			}
+		}
+	}
+
+	free(stream_ids);
+
+	return host_sd;
+}
+
+/* Remember the host of a guest stream. */
+static void set_host_stream(struct kshark_context *kshark_ctx,
+			    struct kshark_data_stream *guest, int host_sd)
+{
+	struct tepdata_handle *guest_handle = get_tep_handle(guest);
+	struct tepdata_handle *host_handle;
+
+	if (!guest_handle || guest_handle->host_sd == host_sd)
+		return;
+
+	host_handle = get_tep_handle(kshark_get_data_stream(kshark_ctx,
+							    guest_handle->host_sd));
+	if (host_handle)
+		host_handle->n_guests--;
+
+	guest_handle->host_sd = host_sd;
+	host_handle = get_tep_handle(kshark_get_data_stream(kshark_ctx,
+							    host_sd));
+	if (host_handle)
+		host_handle->n_guests++;
+}
+
+/*
+ * Forget the host-guest links of a stream, which is being closed. The closed
+ * stream is no longer a guest of its host and its own guests have no host.
+ */
+static void unlink_host_stream(struct kshark_data_stream *stream)
+{
+	struct tepdata_handle *tep_handle = get_tep_handle(stream);
+	struct kshark_context *kshark_ctx = NULL;
+	struct tepdata_handle *other;
+	int i, *stream_ids;
+
+	if (!tep_handle || !kshark_instance(&kshark_ctx))
+		return;
+
+	set_host_stream(kshark_ctx, stream, -ENODATA);
+
+	if (tep_handle->n_guests <= 0)
+		return;
+
+	stream_ids = kshark_all_streams(kshark_ctx);
+	if (!stream_ids)
+		return;
+
+	for (i = 0; i < kshark_ctx->n_streams; ++i) {
+		other = get_tep_handle(kshark_get_data_stream(kshark_ctx,
+							      stream_ids[i]));
+		if (other && other->host_sd == stream->stream_id)
+			other->host_sd = -ENODATA;
+	}
+
+	free(stream_ids);
+	tep_handle->n_guests = 0;
+}
+
+const char *tep_plugin_names[] = {
+	"sched_events",
+	"missed_events",
+	"kvm_combo",
+};
+
+#define LINUX_IDLE_TASK_PID	0
+
+int kshark_tep_handle_plugins(struct kshark_context *kshark_ctx, int sd)
+{
+	int i, n_tep_plugins = sizeof(tep_plugin_names) / sizeof (const char *);
+	struct kshark_plugin_list *plugin;
 	struct kshark_data_stream *stream;
 
 	stream = kshark_get_data_stream(kshark_ctx, sd);
@@ -1174,6 +2477,9 @@ static int kshark_tep_stream_init(struct kshark_data_stream *stream,
 	if (!tep_handle->tep)
 		goto fail;
 
+	tep_handle->trace_id = tracecmd_get_traceid(input);
+	tep_handle->host_sd = -ENODATA;
+
 	tep_handle->sched_switch_event_id = -EINVAL;
 	event = tep_find_event_by_name(tep_handle->tep,
 				       "sched", "sched_switch");
@@ -1340,8 +2646,9 @@ int kshark_tep_init_input(struct kshark_data_stream *stream,
 			  const char *file)
 {
 	struct kshark_context *kshark_ctx = NULL;
-	struct tracecmd_input *merge_peer;
 	struct tracecmd_input *input;
+	char path[64];
+	int fd, host_sd;
 
 	if (!kshark_instance(&kshark_ctx) || !init_thread_seq())
 		return -EEXIST;
@@ -1353,14 +2660,33 @@ int kshark_tep_init_input(struct kshark_data_stream *stream,
 	tep_plugin_add_option("ftrace:parent", "1");
 	tep_plugin_add_option("ftrace:indent", "0");
 
-	input = tracecmd_open_head(file);
+	if (kshark_is_compressed(file)) {
+		/*
+		 * trace-cmd reads the decompressed data from the (unlinked)
+		 * temporary file. The file gets deleted once trace-cmd closes
+		 * its own descriptor.
+		 */
+		fd = kshark_decompress_file(file);
+		if (fd < 0)
+			return fd;
+
+		snprintf(path, sizeof(path), "/proc/self/fd/%i", fd);
+		input = tracecmd_open_head(path);
+		close(fd);
+	} else {
+		input = tracecmd_open_head(file);
+	}
+
 	if (!input)
 		return -EEXIST;
 
 	/* Find a merge peer from the same tracing session. */
-	merge_peer = kshark_tep_find_merge_peer(kshark_ctx, input);
-	if (merge_peer)
-		tracecmd_pair_peer(input, merge_peer);
+	host_sd = find_host_stream(kshark_ctx, stream->stream_id, -1,
+				   tracecmd_get_traceid(input),
+				   NULL, NULL, NULL);
+	if (host_sd >= 0)
+		tracecmd_pair_peer(input,
+				   kshark_get_tep_input(kshark_ctx->stream[host_sd]));
 
 	/* Read the tracing data from the file. */
 	if (tracecmd_init_data(input) < 0)
@@ -1370,6 +2696,9 @@ int kshark_tep_init_input(struct kshark_data_stream *stream,
 	if (kshark_tep_stream_init(stream, input) < 0)
 		goto fail;
 
+	if (host_sd >= 0)
+		set_host_stream(kshark_ctx, stream, host_sd);
+
 	stream->name = strdup("top");
 
 	return 0;
@@ -1413,6 +2742,9 @@ int kshark_tep_init_local(struct kshark_data_stream *stream)
 void kshark_tep_close_interface(struct kshark_data_stream *stream)
 {
 	struct tepdata_handle *tep_handle = stream->interface.handle;
+	struct kshark_field_handle *field_handle;
+
+	unlink_host_stream(stream);
 
 	if (seq.buffer)
 		trace_seq_destroy(&seq);
@@ -1426,10 +2758,53 @@ void kshark_tep_close_interface(struct kshark_data_stream *stream)
 	if (tep_handle->input)
 		tracecmd_close(tep_handle->input);
 
+	free_page_index(tep_handle, stream->n_cpus);
+
+	while (tep_handle->field_handles) {
+		field_handle = tep_handle->field_handles;
+		tep_handle->field_handles = field_handle->next;
+		free(field_handle);
+	}
+
+	free(tep_handle->comms);
 	free(tep_handle);
 	stream->interface.handle = NULL;
 }
 
+/**
+ * @brief Get the size (in bytes) of the memory used by the readout interface
+ *	  of a stream of FTRACE data. The memory used internally by
+ *	  libtraceevent and libtracecmd is not included.
+ */
+size_t kshark_tep_memory(struct kshark_data_stream *stream)
+{
+	struct tepdata_handle *tep_handle = stream->interface.handle;
+	struct kshark_field_handle *field_handle;
+	size_t size;
+	int cpu;
+
+	if (!tep_handle)
+		return 0;
+
+	size = sizeof(*tep_handle) +
+	       tep_handle->n_comms * sizeof(*tep_handle->comms);
+
+	for (field_handle = tep_handle->field_handles; field_handle;
+	     field_handle = field_handle->next)
+		size += sizeof(*field_handle);
+
+	if (tep_handle->page_index) {
+		size += stream->n_cpus * (sizeof(*tep_handle->page_index) +
+					  sizeof(*tep_handle->n_pages));
+
+		for (cpu = 0; cpu < stream->n_cpus; ++cpu)
+			size += tep_handle->n_pages[cpu] *
+				sizeof(**tep_handle->page_index);
+	}
+
+	return size;
+}
+
 /** Check if the filter any filter is set. */
 bool kshark_tep_filter_is_set(struct kshark_data_stream *stream)
 {
@@ -1551,81 +2926,79 @@ void kshark_tracecmd_free_hostguest_map(struct kshark_host_guest_map *map, int c
  */
 int kshark_tracecmd_get_hostguest_mapping(struct kshark_host_guest_map **map)
 {
-	struct kshark_host_guest_map *gmap = NULL;
-	struct tracecmd_input *peer_handle = NULL;
-	struct kshark_data_stream *peer_stream;
-	struct tracecmd_input *guest_handle = NULL;
-	struct kshark_data_stream *guest_stream;
 	struct kshark_context *kshark_ctx = NULL;
-	unsigned long long trace_id;
+	struct kshark_host_guest_map *gmap;
+	struct kshark_data_stream *guest_stream;
+	struct tepdata_handle *guest_handle;
 	const char *name;
 	int vcpu_count;
 	const int *cpu_pid;
 	int *stream_ids;
-	int i, j, k;
+	int i, host_sd;
 	int count = 0;
-	int ret;
 
 	if (!map || !kshark_instance(&kshark_ctx))
 		return -EFAULT;
 	if (*map)
 		return -EEXIST;
 
+	if (!kshark_ctx->n_streams)
+		return 0;
+
 	stream_ids = kshark_all_streams(kshark_ctx);
+	if (!stream_ids)
+		return -ENOMEM;
+
+	/* Each stream can be the guest in no more than one mapping. */
+	gmap = calloc(kshark_ctx->n_streams, sizeof(*gmap));
+	if (!gmap)
+		goto mem_error;
+
 	for (i = 0; i < kshark_ctx->n_streams; i++) {
 		guest_stream = kshark_get_data_stream(kshark_ctx, stream_ids[i]);
-		if (!guest_stream || guest_stream->format != KS_TEP_DATA)
+		guest_handle = get_tep_handle(guest_stream);
+		if (!guest_handle || !guest_handle->trace_id)
 			continue;
-		guest_handle = kshark_get_tep_input(guest_stream);
-		if (!guest_handle)
-			continue;
-		trace_id = tracecmd_get_traceid(guest_handle);
-		if (!trace_id)
+
+		/*
+		 * The host is usually already known, because it has been
+		 * found when opening the guest.
+		 */
+		host_sd = find_host_stream(kshark_ctx, stream_ids[i],
+					   guest_handle->host_sd,
+					   guest_handle->trace_id,
+					   &name, &vcpu_count, &cpu_pid);
+		if (host_sd < 0 || !vcpu_count)
 			continue;
-		for (j = 0; j < kshark_ctx->n_streams; j++) {
-			if (stream_ids[i] == stream_ids[j])
-				continue;
-			peer_stream = kshark_get_data_stream(kshark_ctx, stream_ids[j]);
-			if (!peer_stream || peer_stream->format != KS_TEP_DATA)
-				continue;
-			peer_handle = kshark_get_tep_input(peer_stream);
-			if (!peer_handle)
-				continue;
-			ret = tracecmd_get_guest_cpumap(peer_handle, trace_id,
-							&name, &vcpu_count, &cpu_pid);
-			if (!ret && vcpu_count) {
-				gmap = realloc(*map,
-					       (count + 1) * sizeof(struct kshark_host_guest_map));
-				if (!gmap)
-					goto mem_error;
-				*map = gmap;
-				memset(&gmap[count], 0, sizeof(struct kshark_host_guest_map));
-				count++;
-				gmap[count - 1].guest_id = stream_ids[i];
-				gmap[count - 1].host_id = stream_ids[j];
-				gmap[count - 1].guest_name = strdup(name);
-				if (!gmap[count - 1].guest_name)
-					goto mem_error;
-				gmap[count - 1].vcpu_count = vcpu_count;
-				gmap[count - 1].cpu_pid = malloc(sizeof(int) * vcpu_count);
-				if (!gmap[count - 1].cpu_pid)
-					goto mem_error;
-				for (k = 0; k < vcpu_count; k++)
-					gmap[count - 1].cpu_pid[k] = cpu_pid[k];
-				break;
-			}
-		}
+
+		set_host_stream(kshark_ctx, guest_stream, host_sd);
+
+		gmap[count].guest_id = stream_ids[i];
+		gmap[count].host_id = host_sd;
+		gmap[count].vcpu_count = vcpu_count;
+		gmap[count].guest_name = strdup(name);
+		gmap[count].cpu_pid = malloc(sizeof(int) * vcpu_count);
+		++count;
+
+		if (!gmap[count - 1].guest_name || !gmap[count - 1].cpu_pid)
+			goto mem_error;
+
+		memcpy(gmap[count - 1].cpu_pid, cpu_pid,
+		       sizeof(int) * vcpu_count);
 	}
 
 	free(stream_ids);
+
+	if (count)
+		*map = gmap;
+	else
+		free(gmap);
+
 	return count;
 
 mem_error:
 	free(stream_ids);
-	if (*map) {
-		kshark_tracecmd_free_hostguest_map(*map, count);
-		*map = NULL;
-	}
+	kshark_tracecmd_free_hostguest_map(gmap, count);
 
 	return -ENOMEM;
 }
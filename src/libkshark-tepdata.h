@@ -26,6 +26,8 @@ int kshark_tep_init_local(struct kshark_data_stream *stream);
 
 void kshark_tep_close_interface(struct kshark_data_stream *stream);
 
+size_t kshark_tep_memory(struct kshark_data_stream *stream);
+
 bool kshark_tep_filter_is_set(struct kshark_data_stream *stream);
 
 int kshark_tep_add_filter_str(struct kshark_data_stream *stream,
@@ -55,6 +57,12 @@ struct tep_record;
 ssize_t kshark_load_tep_records(struct kshark_context *kshark_ctx, int sd,
 				struct tep_record ***data_rows);
 
+ssize_t kshark_tep_load_preview(struct kshark_context *kshark_ctx, int sd,
+				size_t max_pages,
+				struct kshark_entry ***data_rows);
+
+void kshark_free_preview(struct kshark_entry **data, size_t n);
+
 struct kshark_host_guest_map {
 	/** ID of guest stream */
 	int guest_id;
@@ -19,11 +19,22 @@
 #include <stdio.h>
 #include <assert.h>
 #include <string.h>
+#include <stdarg.h>
+#include <limits.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <linux/mempolicy.h>
 
 // KernelShark
 #include "libkshark.h"
 #include "libkshark-plugin.h"
 #include "libkshark-tepdata.h"
+#include "libkshark-query.h"
+#include "libkshark-decompress.h"
+#include "libkshark-pool.h"
 
 static struct kshark_context *kshark_context_handler = NULL;
 
@@ -43,6 +54,8 @@ static bool kshark_default_context(struct kshark_context **context)
 
 	kshark_ctx->filter_mask = 0x0;
 
+	kshark_ctx->spill_fd = -1;
+
 	/* Will free kshark_context_handler. */
 	kshark_free(NULL);
 
@@ -54,6 +67,431 @@ static bool kshark_default_context(struct kshark_context **context)
 	return true;
 }
 
+/** The size of the memory region, reserved for the spill file (1 TB). */
+#define KS_SPILL_MAX_SIZE	(1UL << 40)
+
+/** The spill file grows by segments of this size (64 MB). */
+#define KS_SPILL_SEGMENT_SIZE	(1UL << 26)
+
+/** The size of the (transparent) huge pages (2 MB). */
+#define KS_HUGE_PAGE_SIZE	(1UL << 21)
+
+/** Bulk arrays smaller than this (8 MB) are allocated as usual. */
+#define KS_BULK_MIN_SIZE	(1UL << 23)
+
+static void spill_close(struct kshark_context *kshark_ctx)
+{
+	if (kshark_ctx->spill_base)
+		munmap(kshark_ctx->spill_base, KS_SPILL_MAX_SIZE);
+
+	if (kshark_ctx->spill_fd >= 0)
+		close(kshark_ctx->spill_fd);
+
+	kshark_ctx->spill_fd = -1;
+	kshark_ctx->spill_base = NULL;
+	kshark_ctx->spill_mapped = kshark_ctx->spill_used = 0;
+	kshark_ctx->spill_entries = 0;
+}
+
+/*
+ * All spilled entries are freed. Unmap the segments of the spill file
+ * (keeping the region of the address space reserved) and truncate the
+ * file, so that the next spilled entries reuse the space from the start.
+ */
+static void spill_reset(struct kshark_context *kshark_ctx)
+{
+	void *mem;
+
+	if (kshark_ctx->spill_mapped) {
+		mem = mmap(kshark_ctx->spill_base, kshark_ctx->spill_mapped,
+			   PROT_NONE,
+			   MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE |
+			   MAP_FIXED,
+			   -1, 0);
+
+		if (mem == MAP_FAILED ||
+		    ftruncate(kshark_ctx->spill_fd, 0)) {
+			/* Give up the spill file. A new one gets opened. */
+			spill_close(kshark_ctx);
+			return;
+		}
+	}
+
+	kshark_ctx->spill_mapped = kshark_ctx->spill_used = 0;
+}
+
+static bool spill_open(struct kshark_context *kshark_ctx)
+{
+	const char *dir = getenv("TMPDIR");
+	char *file;
+
+	if (asprintf(&file, "%s/kshark-spill-XXXXXX", dir ? dir : "/tmp") <= 0)
+		return false;
+
+	kshark_ctx->spill_fd = mkstemp(file);
+	if (kshark_ctx->spill_fd >= 0) {
+		/* The file will be deleted as soon as it gets closed. */
+		unlink(file);
+	}
+
+	free(file);
+	if (kshark_ctx->spill_fd < 0)
+		return false;
+
+	/*
+	 * Reserve (without committing any memory) one big region of the
+	 * address space. The segments of the file are mapped one after
+	 * another inside this region, hence all spilled entries are easy
+	 * to recognize by their address.
+	 */
+	kshark_ctx->spill_base = mmap(NULL, KS_SPILL_MAX_SIZE, PROT_NONE,
+				      MAP_PRIVATE | MAP_ANONYMOUS |
+				      MAP_NORESERVE,
+				      -1, 0);
+
+	if (kshark_ctx->spill_base == MAP_FAILED) {
+		kshark_ctx->spill_base = NULL;
+		spill_close(kshark_ctx);
+		return false;
+	}
+
+	return true;
+}
+
+static bool spill_grow(struct kshark_context *kshark_ctx)
+{
+	size_t offset = kshark_ctx->spill_mapped;
+	void *mem;
+
+	if (offset + KS_SPILL_SEGMENT_SIZE > KS_SPILL_MAX_SIZE ||
+	    ftruncate(kshark_ctx->spill_fd, offset + KS_SPILL_SEGMENT_SIZE))
+		return false;
+
+	/*
+	 * This is a shared file mapping. The kernel can write the pages back
+	 * to the file and drop them from memory when the memory is needed,
+	 * and page them in again on demand.
+	 */
+	mem = mmap((char *) kshark_ctx->spill_base + offset,
+		   KS_SPILL_SEGMENT_SIZE,
+		   PROT_READ | PROT_WRITE,
+		   MAP_SHARED | MAP_FIXED,
+		   kshark_ctx->spill_fd, offset);
+
+	if (mem == MAP_FAILED)
+		return false;
+
+	kshark_ctx->spill_mapped += KS_SPILL_SEGMENT_SIZE;
+
+	return true;
+}
+
+static struct kshark_entry *spill_alloc(struct kshark_context *kshark_ctx)
+{
+	struct kshark_entry *entry;
+
+	if (!kshark_ctx->spill_base && !spill_open(kshark_ctx))
+		return NULL;
+
+	if (kshark_ctx->spill_used + sizeof(*entry) > kshark_ctx->spill_mapped &&
+	    !spill_grow(kshark_ctx))
+		return NULL;
+
+	/* The new pages of the file are zero-filled. */
+	entry = (struct kshark_entry *)
+		((char *) kshark_ctx->spill_base + kshark_ctx->spill_used);
+
+	kshark_ctx->spill_used += sizeof(*entry);
+	++kshark_ctx->spill_entries;
+
+	return entry;
+}
+
+/** The maximum length of a self-tracing message. */
+#define KS_SELF_TRACE_MAX_LEN	256
+
+static int self_trace_fd = -1;
+
+static pthread_once_t self_trace_once = PTHREAD_ONCE_INIT;
+
+static void self_trace_init(void)
+{
+	const char *dirs[] = {"/sys/kernel/tracing",
+			      "/sys/kernel/debug/tracing"};
+	const char *env = getenv(KS_SELF_TRACE_ENV);
+	char file[PATH_MAX];
+	size_t i;
+
+	if (!env)
+		return;
+
+	/* The user can provide the path to the tracefs mount point. */
+	if (env[0] == '/') {
+		dirs[0] = env;
+		dirs[1] = NULL;
+	}
+
+	for (i = 0; i < 2 && dirs[i] && self_trace_fd < 0; ++i) {
+		snprintf(file, sizeof(file), "%s/trace_marker", dirs[i]);
+		self_trace_fd = open(file, O_WRONLY | O_CLOEXEC);
+	}
+
+	if (self_trace_fd < 0)
+		fprintf(stderr,
+			"Failed to open trace_marker. Self-tracing is disabled.\n");
+}
+
+/**
+ * @brief Check if the self-tracing of KernelShark is enabled. The
+ *	  self-tracing is enabled by setting the KS_SELF_TRACE_ENV
+ *	  environment variable.
+ */
+bool kshark_self_trace_enabled(void)
+{
+	pthread_once(&self_trace_once, self_trace_init);
+
+	return self_trace_fd >= 0;
+}
+
+static void self_trace_write(char *buffer, int n)
+{
+	if (n >= KS_SELF_TRACE_MAX_LEN)
+		n = KS_SELF_TRACE_MAX_LEN - 1;
+
+	if (write(self_trace_fd, buffer, n) < 0) {
+		/* Nothing to do. The tracing may be stopped. */
+	}
+}
+
+/**
+ * @brief Mark the beginning of an internal phase of KernelShark in the ftrace
+ *	  buffer. The message uses the format of the "atrace" markers
+ *	  ("B|pid|name"), hence it can be visualized as a slice by the trace
+ *	  viewers supporting it. Does nothing if the self-tracing is disabled.
+ *
+ * @param fmt: The printf-like format of the name of the phase.
+ */
+void kshark_self_trace_begin(const char *fmt, ...)
+{
+	char buffer[KS_SELF_TRACE_MAX_LEN];
+	va_list args;
+	int n;
+
+	if (!kshark_self_trace_enabled())
+		return;
+
+	n = snprintf(buffer, sizeof(buffer), "B|%i|", getpid());
+
+	va_start(args, fmt);
+	n += vsnprintf(buffer + n, sizeof(buffer) - n, fmt, args);
+	va_end(args);
+
+	self_trace_write(buffer, n);
+}
+
+/**
+ * @brief Mark the end of the last internal phase of KernelShark, started by
+ *	  the same thread. Does nothing if the self-tracing is disabled.
+ */
+void kshark_self_trace_end(void)
+{
+	char buffer[KS_SELF_TRACE_MAX_LEN];
+
+	if (!kshark_self_trace_enabled())
+		return;
+
+	self_trace_write(buffer,
+			 snprintf(buffer, sizeof(buffer), "E|%i", getpid()));
+}
+
+/**
+ * @brief Set the memory budget for the entries of the session. When loading
+ *	  data, the entries above the budget are kept in a memory mapped
+ *	  temporary file, instead of the heap. The pages of the file are
+ *	  loaded into memory on demand and can be dropped by the kernel if
+ *	  the memory is needed. This allows to open trace files which are
+ *	  bigger than the available RAM.
+ *
+ * @param kshark_ctx: Input location for context pointer.
+ * @param budget: The budget in bytes. Zero means no limit.
+ */
+void kshark_set_memory_budget(struct kshark_context *kshark_ctx,
+			      size_t budget)
+{
+	kshark_ctx->mem_budget = budget;
+}
+
+/**
+ * @brief Allocate a new (zero-initialized) entry, taking into account the
+ *	  memory budget of the session.
+ *
+ * @param kshark_ctx: Input location for context pointer.
+ *
+ * @returns Pointer to the new entry, or NULL on failure. Use
+ *	    kshark_free_entry() to free the entry.
+ */
+struct kshark_entry *kshark_entry_alloc(struct kshark_context *kshark_ctx)
+{
+	struct kshark_entry *entry;
+
+	if (!kshark_ctx->mem_budget ||
+	    kshark_ctx->mem_used + sizeof(*entry) <= kshark_ctx->mem_budget) {
+		entry = calloc(1, sizeof(*entry));
+		if (entry)
+			kshark_ctx->mem_used += sizeof(*entry);
+
+		return entry;
+	}
+
+	return spill_alloc(kshark_ctx);
+}
+
+/**
+ * @brief Check if an entry has been spilled into the temporary file.
+ *
+ * @param kshark_ctx: Input location for context pointer.
+ * @param entry: Input location for the entry.
+ */
+bool kshark_entry_is_spilled(struct kshark_context *kshark_ctx,
+			     const struct kshark_entry *entry)
+{
+	const char *base = kshark_ctx->spill_base;
+	const char *ptr = (const char *) entry;
+
+	return base && ptr >= base && ptr < base + kshark_ctx->spill_used;
+}
+
+/**
+ * @brief Free an entry allocated by using kshark_entry_alloc(). The space of
+ *	  the spilled entries is reclaimed once all of them are freed.
+ *
+ * @param kshark_ctx: Input location for context pointer.
+ * @param entry: Input location for the entry.
+ */
+void kshark_free_entry(struct kshark_context *kshark_ctx,
+		       struct kshark_entry *entry)
+{
+	if (!entry)
+		return;
+
+	if (kshark_entry_is_spilled(kshark_ctx, entry)) {
+		if (--kshark_ctx->spill_entries == 0)
+			spill_reset(kshark_ctx);
+
+		return;
+	}
+
+	free(entry);
+	if (kshark_ctx->mem_used >= sizeof(*entry))
+		kshark_ctx->mem_used -= sizeof(*entry);
+}
+
+/**
+ * @brief Free an array of entries, loaded by using kshark_load_entries() or
+ *	  kshark_load_all_entries(), and all its elements. The temporary file
+ *	  holding the spilled entries (if any) is shared by all arrays of the
+ *	  session. Its space is reclaimed once all spilled entries are freed.
+ *
+ * @param kshark_ctx: Input location for context pointer.
+ * @param data: Input location for the array of entries.
+ * @param n: The size of the array.
+ */
+void kshark_free_entries(struct kshark_context *kshark_ctx,
+			 struct kshark_entry **data, size_t n)
+{
+	size_t r;
+
+	for (r = 0; r < n; ++r)
+		kshark_free_entry(kshark_ctx, data[r]);
+
+	/* The per-CPU index of the data is no longer valid. */
+	if (kshark_ctx->cpu_index && kshark_ctx->cpu_index->data == data)
+		kshark_unregister_cpu_index(kshark_ctx);
+
+	free(data);
+}
+
+static pthread_once_t numa_once = PTHREAD_ONCE_INIT;
+static unsigned long numa_mask;
+static int numa_nodes;
+
+static void numa_init(void)
+{
+	char path[64];
+	int n;
+
+	/* Only the first nodes, fitting in the mask, are used. */
+	for (n = 0; n < (int) (8 * sizeof(numa_mask)); ++n) {
+		snprintf(path, sizeof(path),
+			 "/sys/devices/system/node/node%i", n);
+		if (access(path, F_OK) != 0)
+			continue;
+
+		numa_mask |= 1UL << n;
+		++numa_nodes;
+	}
+}
+
+/*
+ * Interleave the (still untouched) pages of the array over all NUMA nodes.
+ * The parallel workers are not pinned to nodes, hence no worker has a
+ * preferred node, but together they use the memory bandwidth of all nodes.
+ * Failure only means that the default policy is used.
+ */
+static void bulk_interleave(char *mem, size_t size)
+{
+	uintptr_t page = sysconf(_SC_PAGESIZE), begin, end;
+
+	begin = ((uintptr_t) mem + page - 1) & ~(page - 1);
+	end = (uintptr_t) mem + size;
+	if (end <= begin)
+		return;
+
+	syscall(SYS_mbind, (void *) begin, end - begin, MPOL_INTERLEAVE,
+		&numa_mask, 8 * sizeof(numa_mask) + 1, 0);
+}
+
+/**
+ * @brief Allocate a (zero-initialized) array for bulk trace data, like the
+ *	  array of rows of the entries. Big arrays are backed by transparent
+ *	  huge pages, if the system supports them. On machines having
+ *	  multiple NUMA nodes, the pages of big arrays are also interleaved
+ *	  over the nodes. Otherwise this is equivalent to calloc().
+ *
+ * @param n: The number of elements of the array.
+ * @param size: The size of one element.
+ *
+ * @returns Pointer to the array, or NULL on failure. The user is responsible
+ *	    for freeing the array by using free().
+ */
+void *kshark_bulk_alloc(size_t n, size_t size)
+{
+	uintptr_t begin, end;
+	char *mem;
+
+	mem = calloc(n, size);
+	if (!mem || n * size < KS_BULK_MIN_SIZE)
+		return mem;
+
+	/*
+	 * The big arrays are mapped directly by the C library and their pages
+	 * are still untouched. Only the part of the array, aligned to the
+	 * huge pages, can be backed by huge pages. Failure only means that
+	 * transparent huge pages are not available.
+	 */
+	begin = ((uintptr_t) mem + KS_HUGE_PAGE_SIZE - 1) &
+		~(KS_HUGE_PAGE_SIZE - 1);
+	end = ((uintptr_t) mem + n * size) & ~(KS_HUGE_PAGE_SIZE - 1);
+	if (end > begin)
+		madvise((void *) begin, end - begin, MADV_HUGEPAGE);
+
+	pthread_once(&numa_once, numa_init);
+	if (numa_nodes > 1)
+		bulk_interleave(mem, n * size);
+
+	return mem;
+}
+
 /**
  * @brief Initialize a kshark session. This function must be called before
  *	  calling any other kshark function. If the session has been
@@ -110,7 +548,9 @@ int kshark_open(struct kshark_context *kshark_ctx, const char *file)
 	if (sd < 0)
 		return sd;
 
+	kshark_self_trace_begin("kshark: open %s", file);
 	rt = kshark_stream_open(kshark_ctx->stream[sd], file);
+	kshark_self_trace_end();
 	if (rt < 0)
 		return rt;
 
@@ -133,6 +573,10 @@ static void kshark_stream_free(struct kshark_data_stream *stream)
 
 	kshark_hash_id_free(stream->tasks);
 
+	kshark_query_free(stream->query_filter);
+
+	kshark_free_field_columns(stream);
+
 	free(stream->calib_array);
 	free(stream->file);
 	free(stream->name);
@@ -148,6 +592,7 @@ static struct kshark_data_stream *kshark_stream_alloc()
 		goto fail;
 
 	stream->event_handlers = NULL;
+	stream->batch_handlers = NULL;
 	stream->plugins = NULL;
 
 	stream->show_task_filter = kshark_hash_id_alloc(KS_FILTER_HASH_NBITS);
@@ -210,8 +655,16 @@ int kshark_add_stream(struct kshark_context *kshark_ctx)
 
 static bool is_tep(const char *filename)
 {
-	char *ext = strrchr(filename, '.');
-	return ext && strcmp(ext, ".dat") == 0;
+	size_t len = strlen(filename);
+	const char *ext;
+
+	/* Compressed trace-cmd files are named "<file>.dat.zst". */
+	if (kshark_is_compressed(filename))
+		len -= strlen(KS_ZSTD_EXT);
+
+	ext = memrchr(filename, '.', len);
+	return ext && len - (ext - filename) == 4 &&
+	       strncmp(ext, ".dat", 4) == 0;
 }
 
 static void set_format(struct kshark_context *kshark_ctx,
@@ -355,6 +808,7 @@ void kshark_close(struct kshark_context *kshark_ctx, int sd)
 	if (stream->plugins) {
 		kshark_handle_all_dpis(stream, KSHARK_PLUGIN_CLOSE);
 		kshark_free_event_handler_list(stream->event_handlers);
+		kshark_free_batch_handler_list(stream->batch_handlers);
 		kshark_free_dpi_list(stream->plugins);
 	}
 
@@ -388,7 +842,9 @@ void kshark_close_all(struct kshark_context *kshark_ctx)
 
 /**
  * @brief Deinitialize kshark session. Should be called after closing all
- *	  open trace data files and before your application terminates.
+ *	  open trace data files and before your application terminates. If
+ *	  this is the session of the global handler, the threads of the thread
+ *	  pool are stopped as well.
  *
  * @param kshark_ctx: Optional input location for session context pointer.
  *		      If it points to a context of a session, that session
@@ -397,6 +853,8 @@ void kshark_close_all(struct kshark_context *kshark_ctx)
  */
 void kshark_free(struct kshark_context *kshark_ctx)
 {
+	bool global;
+
 	if (kshark_ctx == NULL) {
 		if (kshark_context_handler == NULL)
 			return;
@@ -414,10 +872,21 @@ void kshark_free(struct kshark_context *kshark_ctx)
 
 	kshark_free_dri_list(kshark_ctx->inputs);
 
-	if (kshark_ctx == kshark_context_handler)
+	kshark_clear_column_decls(kshark_ctx);
+
+	kshark_unregister_cpu_index(kshark_ctx);
+
+	spill_close(kshark_ctx);
+
+	global = (kshark_ctx == kshark_context_handler);
+	if (global)
 		kshark_context_handler = NULL;
 
 	free(kshark_ctx);
+
+	/* The thread pool is shared by all sessions of the process. */
+	if (global)
+		kshark_pool_destroy();
 }
 
 /**
@@ -707,6 +1176,24 @@ static void set_all_visible(uint8_t *v) {
 	*v |= 0xFF & ~KS_PLUGIN_UNTOUCHED_MASK;
 }
 
+static void apply_query_filters(struct kshark_context *kshark_ctx, int sd,
+				struct kshark_entry **data, size_t n_entries)
+{
+	struct kshark_data_stream *stream;
+	int i;
+
+	for (i = 0; i < KS_MAX_NUM_STREAMS; ++i) {
+		if (sd >= 0 && i != sd)
+			continue;
+
+		stream = kshark_ctx->stream[i];
+		if (stream && stream->query_filter)
+			kshark_query_filter_entries(kshark_ctx,
+						    stream->query_filter,
+						    data, n_entries);
+	}
+}
+
 static void filter_entries(struct kshark_context *kshark_ctx, int sd,
 			   struct kshark_entry **data, size_t n_entries)
 {
@@ -730,11 +1217,14 @@ static void filter_entries(struct kshark_context *kshark_ctx, int sd,
 			return;
 		}
 
-		if (!kshark_filter_is_set(kshark_ctx, sd))
+		if (!kshark_filter_is_set(kshark_ctx, sd) &&
+		    !stream->query_filter)
 			return;
 	}
 
-	/* Apply only the Id filters. */
+	kshark_self_trace_begin("kshark: filter stream %i", sd);
+
+	/* Apply the Id filters. */
 	for (i = 0; i < n_entries; ++i) {
 		if (sd >= 0) {
 			/*
@@ -754,6 +1244,11 @@ static void filter_entries(struct kshark_context *kshark_ctx, int sd,
 		/* Apply Id filtering. */
 		kshark_apply_filters(kshark_ctx, stream, data[i]);
 	}
+
+	/* Apply the query filters. */
+	apply_query_filters(kshark_ctx, sd, data, n_entries);
+
+	kshark_self_trace_end();
 }
 
 /**
@@ -860,8 +1355,9 @@ void kshark_plugin_actions(struct kshark_data_stream *stream,
 }
 
 /**
- * @brief Post-process the content of the entry. This includes time calibration
- *	  and all registered event-specific plugin actions.
+ * @brief Post-process the content of the entry. This includes time calibration,
+ *	  all registered event-specific plugin actions and the extraction of
+ *	  the declared data fields into columns.
  *
  * @param stream: Input location for a Trace data stream pointer.
  * @param record: Input location for the trace record.
@@ -873,6 +1369,8 @@ void kshark_postprocess_entry(struct kshark_data_stream *stream,
 	kshark_calib_entry(stream, entry);
 
 	kshark_plugin_actions(stream, record, entry);
+
+	kshark_fill_field_columns(stream, record, entry);
 }
 
 /**
@@ -911,6 +1409,98 @@ ssize_t kshark_find_entry_by_time(int64_t time,
 	return h;
 }
 
+/**
+ * @brief Find the page of a given CPU, containing a given time, by using the
+ *	  page-level time index of the Data stream. No records are read.
+ *
+ * @param stream: Input location for a Trace data stream pointer.
+ * @param cpu: The CPU.
+ * @param time: The value of time to search for (as recorded in the file).
+ * @param page: Output location for the page.
+ *
+ * @returns On success, the index of the last page having first timestamp
+ *	    equal or smaller than "time". If all pages have timestamps greater
+ *	    than "time" the function returns BSEARCH_ALL_GREATER (negative
+ *	    value). Other negative values are error codes.
+ */
+ssize_t kshark_find_page_by_time(struct kshark_data_stream *stream, int cpu,
+				 int64_t time,
+				 const struct kshark_page_index **page)
+{
+	const struct kshark_page_index *index;
+	ssize_t n_pages;
+	size_t l, h, mid;
+
+	if (!stream->interface.get_page_index)
+		return -ENOTSUP;
+
+	n_pages = stream->interface.get_page_index(stream, cpu, &index);
+	if (n_pages <= 0)
+		return n_pages ? n_pages : -ENODATA;
+
+	if (index[0].first_ts > time)
+		return BSEARCH_ALL_GREATER;
+
+	l = 0;
+	h = n_pages;
+
+	/*
+	 * After executing the BSEARCH macro, "l" will be the index of the last
+	 * page having first timestamp <= time.
+	 */
+	BSEARCH(h, l, index[mid].first_ts <= time);
+
+	*page = &index[l];
+
+	return l;
+}
+
+/**
+ * @brief Get the directory used to cache data (like the page-level time
+ *	  indexes of the trace files). This is "$KS_USER_CACHE_DIR" if set,
+ *	  otherwise "$XDG_CACHE_HOME/kernelshark" or
+ *	  "$HOME/.cache/kernelshark". The directory is created if it does not
+ *	  exist.
+ *
+ * @returns The path to the directory, or NULL on failure. The user is
+ *	    responsible for freeing the returned string.
+ */
+char *kshark_cache_dir(void)
+{
+	const char *env;
+	char *dir, *c;
+	int ret;
+
+	if ((env = getenv("KS_USER_CACHE_DIR")))
+		ret = asprintf(&dir, "%s", env);
+	else if ((env = getenv("XDG_CACHE_HOME")))
+		ret = asprintf(&dir, "%s/kernelshark", env);
+	else if ((env = getenv("HOME")))
+		ret = asprintf(&dir, "%s/.cache/kernelshark", env);
+	else
+		return NULL;
+
+	if (ret <= 0)
+		return NULL;
+
+	/* Create all missing components of the path. */
+	for (c = dir + 1; *c; ++c) {
+		if (*c != '/')
+			continue;
+
+		*c = '\0';
+		mkdir(dir, 0700);
+		*c = '/';
+	}
+
+	if (mkdir(dir, 0700) < 0 && errno != EEXIST) {
+		free(dir);
+		return NULL;
+	}
+
+	return dir;
+}
+
 /**
  * @brief Simple Pid matching function to be user for data requests.
  *
@@ -1071,7 +1661,6 @@ void kshark_free_entry_request(struct kshark_entry_request *req)
 
 /** Dummy entry, used to indicate the existence of filtered entries. */
 const struct kshark_entry dummy_entry = {
-	.next		= NULL,
 	.visible	= 0x00,
 	.cpu		= KS_FILTERED_BIN,
 	.pid		= KS_FILTERED_BIN,
@@ -1240,7 +1829,7 @@ kshark_merge_data_entries(struct kshark_entry_data_set *buffers, int n_buffers)
 			tot += buffers[i].n_rows;
 	}
 
-	merged_data = calloc(tot, sizeof(*merged_data));
+	merged_data = kshark_bulk_alloc(tot, sizeof(*merged_data));
 	if (!merged_data) {
 		fputs("Failed to allocate memory for mergeing data entries.\n",
 		      stderr);
@@ -1314,6 +1903,10 @@ void kshark_set_clock_offset(struct kshark_context *kshark_ctx,
 			entries[i]->ts += correction;
 
 	kshark_data_qsort(entries, size);
+
+	/* The order of the entries has changed. Rebuild the per-CPU index. */
+	if (kshark_get_cpu_index(kshark_ctx, entries, size))
+		kshark_register_cpu_index(kshark_ctx, entries, size);
 }
 
 static ssize_t load_all_entries(struct kshark_context *kshark_ctx,
@@ -1344,8 +1937,11 @@ static ssize_t load_all_entries(struct kshark_context *kshark_ctx,
 	/* Add the data of the new streams. */
 	for (i = first_stream; i < n_streams; ++i) {
 		buffers[j].data = NULL;
+
+		kshark_self_trace_begin("kshark: load stream %i", i);
 		buffers[j].n_rows = kshark_load_entries(kshark_ctx, i,
 							&buffers[j].data);
+		kshark_self_trace_end();
 
 		if (buffers[j].n_rows < 0) {
 			data_size = buffers[j].n_rows;
@@ -1359,7 +1955,33 @@ static ssize_t load_all_entries(struct kshark_context *kshark_ctx,
 		*data_rows = buffers[0].data;
 	} else {
 		/* Merge all streams. */
+		kshark_self_trace_begin("kshark: merge %i data sets",
+					n_data_sets);
 		*data_rows = kshark_merge_data_entries(buffers, n_data_sets);
+		kshark_self_trace_end();
+	}
+
+	/*
+	 * The Id filters are applied while loading. The query filters are
+	 * applied to the merged data, because they are evaluated in parallel.
+	 */
+	kshark_self_trace_begin("kshark: query filters");
+	for (i = first_stream; i < n_streams; ++i)
+		apply_query_filters(kshark_ctx, i, *data_rows, data_size);
+	kshark_self_trace_end();
+
+	/*
+	 * The prior data gets freed below, hence its per-CPU index (if any)
+	 * is no longer valid. Index the merged data, if the index is used.
+	 */
+	if (loaded_rows && kshark_ctx->cpu_index &&
+	    kshark_ctx->cpu_index->data == loaded_rows)
+		kshark_unregister_cpu_index(kshark_ctx);
+
+	if (kshark_ctx->cpu_index_users > 0 && *data_rows && data_size > 0) {
+		kshark_self_trace_begin("kshark: per-CPU index");
+		kshark_register_cpu_index(kshark_ctx, *data_rows, data_size);
+		kshark_self_trace_end();
 	}
 
  error:
@@ -1370,23 +1992,102 @@ static ssize_t load_all_entries(struct kshark_context *kshark_ctx,
 }
 
 /**
- * @brief Load the content of the all opened data file into an array of
- *	  kshark_entries.
+ * @brief Load the content of the trace data file asociated with a given
+ *	  Data stream identifie into an array of kshark_entries.
  *	  If one or more filters are set, the "visible" fields of each entry
  *	  is updated according to the criteria provided by the filters. The
  *	  field "filter_mask" of the session's context is used to control the
  *	  level of visibility/invisibility of the filtered entries.
  *
  * @param kshark_ctx: Input location for context pointer.
+ * @param sd: Data stream identifier.
  * @param data_rows: Output location for the trace data. The user is
  *		     responsible for freeing the elements of the outputted
- *		     array.
+ *		     array. If a memory budget is set, use kshark_free_entries().
  *
  * @returns The size of the outputted data in the case of success, or a
  *	    negative error code on failure.
  */
-ssize_t kshark_load_all_entries(struct kshark_context *kshark_ctx,
-				struct kshark_entry ***data_rows)
+ssize_t kshark_load_entries(struct kshark_context *kshark_ctx, int sd,
+			    struct kshark_entry ***data_rows)
+{
+	struct kshark_data_stream *stream;
+	ssize_t n_rows;
+	int ret;
+
+	stream = kshark_get_data_stream(kshark_ctx, sd);
+	if (!stream)
+		return -EBADF;
+
+	/* The declared data fields are extracted during the loading. */
+	ret = kshark_init_field_columns(kshark_ctx, stream);
+	if (ret < 0)
+		return ret;
+
+	n_rows = stream->interface.load_entries(stream, kshark_ctx, data_rows);
+	if (n_rows >= 0)
+		kshark_sort_field_columns(stream);
+
+	return n_rows;
+}
+
+/**
+ * @brief Load the content of the trace data file asociated with a given
+ *	  Data stream identifie into a data matrix.
+ *
+ * @param kshark_ctx: Input location for context pointer.
+ * @param sd: Data stream identifier.
+ * @param data_rows: Output location for the trace data. The user is
+ *		     responsible for freeing the elements of the outputted
+ *		     array.
+ *
+ * @returns The size of the outputted data in the case of success, or a
+ *	    negative error code on failure.
+ */
+ssize_t kshark_load_matrix(struct kshark_context *kshark_ctx, int sd,
+			   int16_t **cpu_array,
+			   int32_t **pid_array,
+			   int32_t **event_array,
+			   int64_t **offset_array,
+			   uint64_t **ts_array)
+{
+	struct kshark_data_stream *stream;
+
+	stream = kshark_get_data_stream(kshark_ctx, sd);
+	if (!stream)
+		return -EBADF;
+
+	/*
+	 * The entries used while loading the matrix are temporary, hence no
+	 * data fields can be extracted into columns.
+	 */
+	kshark_free_field_columns(stream);
+
+	return stream->interface.load_matrix(stream, kshark_ctx, cpu_array,
+							     pid_array,
+							     event_array,
+							     offset_array,
+							     ts_array);
+}
+
+/**
+ * @brief Load the content of the all opened data file into an array of
+ *	  kshark_entries.
+ *	  If one or more filters are set, the "visible" fields of each entry
+ *	  is updated according to the criteria provided by the filters. The
+ *	  field "filter_mask" of the session's context is used to control the
+ *	  level of visibility/invisibility of the filtered entries.
+ *
+ * @param kshark_ctx: Input location for context pointer.
+ * @param data_rows: Output location for the trace data. The user is
+ *		     responsible for freeing the elements of the outputted
+ *		     array.
+ *
+ * @returns The size of the outputted data in the case of success, or a
+ *	    negative error code on failure.
+ */
+ssize_t kshark_load_all_entries(struct kshark_context *kshark_ctx,
+				struct kshark_entry ***data_rows)
 {
 	return load_all_entries(kshark_ctx,
 				NULL, 0,
@@ -1408,6 +2109,324 @@ ssize_t kshark_append_all_entries(struct kshark_context *kshark_ctx,
 				kshark_ctx->n_streams,
 				merged_data);
 }
+
+/* Quiet warnings over documenting simple structures */
+//! @cond Doxygen_Suppress
+
+struct cpu_index_task {
+	struct kshark_cpu_index		*index;
+	size_t				first;
+	size_t				last;
+	/* Per group count, replaced by the write position after counting. */
+	size_t				*pos;
+	bool				scatter;
+};
+
+//! @endcond
+
+static inline ssize_t cpu_index_group(const struct kshark_cpu_index *index,
+				      const struct kshark_entry *e)
+{
+	if (e->stream_id >= KS_MAX_NUM_STREAMS ||
+	    e->cpu < 0 || e->cpu >= index->n_cpus[e->stream_id])
+		return -1;
+
+	return index->first_group[e->stream_id] + e->cpu;
+}
+
+static void cpu_index_worker(void *arg)
+{
+	struct cpu_index_task *task = arg;
+	struct kshark_cpu_index *index = task->index;
+	ssize_t g;
+	size_t i;
+
+	for (i = task->first; i < task->last; ++i) {
+		g = cpu_index_group(index, index->data[i]);
+		if (g < 0)
+			continue;
+
+		if (task->scatter)
+			index->rows[task->pos[g]++] = i;
+		else
+			++task->pos[g];
+	}
+}
+
+static void cpu_index_run(struct cpu_index_task *tasks, int n_tasks,
+			  bool scatter)
+{
+	int t;
+
+	for (t = 0; t < n_tasks; ++t)
+		tasks[t].scatter = scatter;
+
+	kshark_pool_run(cpu_index_worker, tasks, sizeof(*tasks), n_tasks,
+			KS_TASK_INTERACTIVE, NULL);
+}
+
+/**
+ * @brief Build a per-CPU index of the trace data. The data is split into
+ *	  chunks, processed in parallel. Each task counts the entries of
+ *	  each CPU in its chunk and, once the counts of all tasks are
+ *	  known, writes the rows of its entries directly into their final
+ *	  positions.
+ *
+ * @param kshark_ctx: Input location for the session context pointer.
+ * @param data: Input location for the trace data, sorted in time.
+ * @param n_rows: The size of the trace data.
+ *
+ * @returns The index on success, or NULL on failure. The user is
+ *	    responsible for freeing the index by using kshark_cpu_index_free().
+ */
+struct kshark_cpu_index *
+kshark_cpu_index_alloc(struct kshark_context *kshark_ctx,
+		       struct kshark_entry **data, size_t n_rows)
+{
+	struct kshark_data_stream *stream;
+	struct kshark_cpu_index *index;
+	struct cpu_index_task *tasks = NULL;
+	size_t *counts = NULL;
+	size_t g, chunk, total;
+	int sd, t, n_tasks;
+
+	if (n_rows > UINT32_MAX) {
+		fputs("Too many entries for a per-CPU index.\n", stderr);
+		return NULL;
+	}
+
+	index = calloc(1, sizeof(*index));
+	if (!index)
+		goto fail;
+
+	index->data = data;
+	index->n_rows = n_rows;
+	for (sd = 0; sd < KS_MAX_NUM_STREAMS; ++sd) {
+		stream = kshark_get_data_stream(kshark_ctx, sd);
+		if (!stream || stream->n_cpus <= 0)
+			continue;
+
+		index->first_group[sd] = index->n_groups;
+		index->n_cpus[sd] = stream->n_cpus;
+		index->n_groups += stream->n_cpus;
+	}
+
+	index->group_start = calloc(index->n_groups + 1,
+				    sizeof(*index->group_start));
+	if (!index->group_start)
+		goto fail;
+
+	n_tasks = kshark_pool_size();
+	if (n_tasks < 1 || n_rows < 65536)
+		n_tasks = 1;
+
+	tasks = calloc(n_tasks, sizeof(*tasks));
+	counts = calloc((size_t) n_tasks * index->n_groups, sizeof(*counts));
+	if (!tasks || (index->n_groups && !counts))
+		goto fail;
+
+	chunk = (n_rows + n_tasks - 1) / n_tasks;
+	for (t = 0; t < n_tasks; ++t) {
+		tasks[t].index = index;
+		tasks[t].first = t * chunk < n_rows ? t * chunk : n_rows;
+		tasks[t].last = tasks[t].first + chunk < n_rows ?
+				tasks[t].first + chunk : n_rows;
+		tasks[t].pos = counts + (size_t) t * index->n_groups;
+	}
+
+	cpu_index_run(tasks, n_tasks, false);
+
+	/*
+	 * Turn the counts into write positions. The chunks are ordered in
+	 * time, hence the rows of each group stay sorted.
+	 */
+	for (total = 0, g = 0; g < index->n_groups; ++g) {
+		index->group_start[g] = total;
+		for (t = 0; t < n_tasks; ++t) {
+			size_t count = tasks[t].pos[g];
+
+			tasks[t].pos[g] = total;
+			total += count;
+		}
+	}
+
+	index->group_start[index->n_groups] = total;
+
+	index->rows = kshark_bulk_alloc(total ? total : 1, sizeof(*index->rows));
+	if (!index->rows)
+		goto fail;
+
+	cpu_index_run(tasks, n_tasks, true);
+
+	free(counts);
+	free(tasks);
+
+	return index;
+
+ fail:
+	fprintf(stderr, "Failed to allocate memory for per-CPU index.\n");
+	free(counts);
+	free(tasks);
+	kshark_cpu_index_free(index);
+	return NULL;
+}
+
+/** Free a per-CPU index of the trace data. */
+void kshark_cpu_index_free(struct kshark_cpu_index *index)
+{
+	if (!index)
+		return;
+
+	free(index->rows);
+	free(index->group_start);
+	free(index);
+}
+
+/**
+ * @brief Get the rows of all entries recorded on a given CPU.
+ *
+ * @param index: Input location for the per-CPU index.
+ * @param sd: Data stream identifier.
+ * @param cpu: The CPU.
+ * @param rows: Output location for the rows of the entries, sorted in time.
+ *		The array is owned by the index.
+ *
+ * @returns The number of entries recorded on the CPU.
+ */
+size_t kshark_cpu_index_get(const struct kshark_cpu_index *index,
+			    int sd, int cpu, const uint32_t **rows)
+{
+	size_t g;
+
+	*rows = NULL;
+	if (sd < 0 || sd >= KS_MAX_NUM_STREAMS ||
+	    cpu < 0 || cpu >= index->n_cpus[sd])
+		return 0;
+
+	g = index->first_group[sd] + cpu;
+	*rows = index->rows + index->group_start[g];
+
+	return index->group_start[g + 1] - index->group_start[g];
+}
+
+/**
+ * @brief Get the next (in time) entry recorded on the same CPU.
+ *
+ * @param index: Input location for the per-CPU index.
+ * @param row: The row of the entry in the indexed trace data.
+ *
+ * @returns The row of the next entry on the same CPU, or -1 if this is the
+ *	    last entry of the CPU.
+ */
+ssize_t kshark_next_on_cpu(const struct kshark_cpu_index *index, size_t row)
+{
+	size_t l, h, m;
+	ssize_t g;
+
+	if (row >= index->n_rows)
+		return -1;
+
+	g = cpu_index_group(index, index->data[row]);
+	if (g < 0)
+		return -1;
+
+	/* The rows of the group are sorted. Use binary search. */
+	l = index->group_start[g];
+	h = index->group_start[g + 1];
+	while (l < h) {
+		m = l + (h - l) / 2;
+		if (index->rows[m] < row)
+			l = m + 1;
+		else
+			h = m;
+	}
+
+	if (l + 1 >= index->group_start[g + 1] || index->rows[l] != row)
+		return -1;
+
+	return index->rows[l + 1];
+}
+
+/**
+ * @brief Build a per-CPU index of the loaded trace data and keep it in the
+ *	  session, so that it can be reused (by the plugins for example).
+ *	  The previous index of the session (if any) gets freed.
+ *
+ * @param kshark_ctx: Input location for the session context pointer.
+ * @param data: Input location for the trace data, sorted in time.
+ * @param n_rows: The size of the trace data.
+ *
+ * @returns Zero on success, or a negative error code on failure.
+ */
+int kshark_register_cpu_index(struct kshark_context *kshark_ctx,
+			      struct kshark_entry **data, size_t n_rows)
+{
+	kshark_unregister_cpu_index(kshark_ctx);
+
+	kshark_ctx->cpu_index = kshark_cpu_index_alloc(kshark_ctx, data,
+						       n_rows);
+
+	return kshark_ctx->cpu_index ? 0 : -ENOMEM;
+}
+
+/**
+ * @brief Free the per-CPU index, kept in the session.
+ *
+ * @param kshark_ctx: Input location for the session context pointer.
+ */
+void kshark_unregister_cpu_index(struct kshark_context *kshark_ctx)
+{
+	kshark_cpu_index_free(kshark_ctx->cpu_index);
+	kshark_ctx->cpu_index = NULL;
+}
+
+/**
+ * @brief Ask for a per-CPU index of the trace data. From now on, the index
+ *	  gets built (and kept in the session) every time the data is
+ *	  loaded. Each call has to be paired with kshark_release_cpu_index().
+ *
+ * @param kshark_ctx: Input location for the session context pointer.
+ */
+void kshark_request_cpu_index(struct kshark_context *kshark_ctx)
+{
+	++kshark_ctx->cpu_index_users;
+}
+
+/**
+ * @brief Release a per-CPU index, requested by kshark_request_cpu_index().
+ *	  The index gets freed if it has no more users.
+ *
+ * @param kshark_ctx: Input location for the session context pointer.
+ */
+void kshark_release_cpu_index(struct kshark_context *kshark_ctx)
+{
+	if (kshark_ctx->cpu_index_users > 0 &&
+	    --kshark_ctx->cpu_index_users == 0)
+		kshark_unregister_cpu_index(kshark_ctx);
+}
+
+/**
+ * @brief Get the per-CPU index of a given array of trace data, kept in the
+ *	  session.
+ *
+ * @param kshark_ctx: Input location for the session context pointer.
+ * @param data: Input location for the trace data.
+ * @param n_rows: The size of the trace data.
+ *
+ * @returns The index, or NULL if no index of this data is registered.
+ */
+const struct kshark_cpu_index *
+kshark_get_cpu_index(struct kshark_context *kshark_ctx,
+		     struct kshark_entry **data, size_t n_rows)
+{
+	struct kshark_cpu_index *index = kshark_ctx->cpu_index;
+
+	if (!index || index->data != data || index->n_rows != n_rows)
+		return NULL;
+
+	return index;
+}
+
 static inline void free_ptr(void *ptr)
 {
 	if (ptr)
@@ -1421,31 +2440,31 @@ bool kshark_data_matrix_alloc(size_t n_rows, int16_t **cpu_array,
 				      uint64_t **ts_array)
 {
 	if (offset_array) {
-		*offset_array = calloc(n_rows, sizeof(**offset_array));
+		*offset_array = kshark_bulk_alloc(n_rows, sizeof(**offset_array));
 		if (!*offset_array)
 			return false;
 	}
 
 	if (cpu_array) {
-		*cpu_array = calloc(n_rows, sizeof(**cpu_array));
+		*cpu_array = kshark_bulk_alloc(n_rows, sizeof(**cpu_array));
 		if (!*cpu_array)
 			goto free_offset;
 	}
 
 	if (ts_array) {
-		*ts_array = calloc(n_rows, sizeof(**ts_array));
+		*ts_array = kshark_bulk_alloc(n_rows, sizeof(**ts_array));
 		if (!*ts_array)
 			goto free_cpu;
 	}
 
 	if (pid_array) {
-		*pid_array = calloc(n_rows, sizeof(**pid_array));
+		*pid_array = kshark_bulk_alloc(n_rows, sizeof(**pid_array));
 		if (!*pid_array)
 			goto free_ts;
 	}
 
 	if (event_array) {
-		*event_array = calloc(n_rows, sizeof(**event_array));
+		*event_array = kshark_bulk_alloc(n_rows, sizeof(**event_array));
 		if (!*event_array)
 			goto free_pid;
 	}
@@ -1546,6 +2565,12 @@ kshark_merge_data_matrices(struct kshark_matrix_data_set *buffers, int n_buffers
 
 #define KS_CONTAINER_DEFAULT_SIZE	1024
 
+/*
+ * The maximum number of time-sorted runs tracked by a data container. Data
+ * having more runs is sorted by using qsort().
+ */
+#define KS_CONTAINER_MAX_RUNS		4096
+
 struct kshark_data_container *kshark_init_data_container()
 {
 	struct kshark_data_container *container;
@@ -1561,7 +2586,10 @@ struct kshark_data_container *kshark_init_data_container()
 		goto fail;
 
 	container->capacity = KS_CONTAINER_DEFAULT_SIZE;
-	container->sorted = false;
+
+	/* Empty container is sorted. */
+	container->sorted = true;
+	container->n_runs = 1;
 
 	return container;
 
@@ -1577,12 +2605,79 @@ void kshark_free_data_container(struct kshark_data_container *container)
 		free(container->data[i]);
 
 	free(container->data);
+	free(container->runs);
 	free(container);
 }
 
+/** Get the size (in bytes) of the memory used by a data container. */
+size_t kshark_data_container_memory(const struct kshark_data_container *container)
+{
+	if (!container)
+		return 0;
+
+	return sizeof(*container) +
+	       container->capacity * sizeof(*container->data) +
+	       container->size * sizeof(**container->data) +
+	       container->runs_capacity * sizeof(*container->runs);
+}
+
+/* A new time-sorted run of data starts at index "pos". */
+static void data_container_add_run(struct kshark_data_container *container,
+				   ssize_t pos)
+{
+	ssize_t *runs_tmp, capacity;
+
+	container->sorted = false;
+	if (container->n_runs < 0)
+		return;
+
+	if (container->n_runs == KS_CONTAINER_MAX_RUNS)
+		goto untracked;
+
+	/* The start of the first run (index 0) is not stored. */
+	if (container->n_runs > container->runs_capacity) {
+		capacity = container->runs_capacity ?
+			   2 * container->runs_capacity : 16;
+
+		runs_tmp = realloc(container->runs,
+				   capacity * sizeof(*container->runs));
+		if (!runs_tmp)
+			goto untracked;
+
+		container->runs = runs_tmp;
+		container->runs_capacity = capacity;
+	}
+
+	container->runs[container->n_runs++ - 1] = pos;
+
+	return;
+
+ untracked:
+	free(container->runs);
+	container->runs = NULL;
+	container->runs_capacity = 0;
+	container->n_runs = -1;
+}
+
+/**
+ * @brief Append a new value to the data container. The data plugins append
+ *	  the values in the order of loading, which is CPU by CPU. Hence the
+ *	  container keeps track of the time-sorted runs of data, in order to
+ *	  make the sorting fast. If the values are appended in time order,
+ *	  the container stays sorted and sorting is not needed.
+ *
+ * @param container: Input location for the data container.
+ * @param entry: The entry, the value is associated with.
+ * @param field: The value.
+ *
+ * @returns The new size of the container on success, or a negative error code
+ *	    on failure.
+ */
 ssize_t kshark_data_container_append(struct kshark_data_container *container,
 				     struct kshark_entry *entry, int64_t field)
 {
+	struct kshark_data_field_int64 *data_field;
+
 	if (container->capacity == container->size) {
 		struct kshark_data_field_int64	**data_tmp;
 
@@ -1595,9 +2690,18 @@ ssize_t kshark_data_container_append(struct kshark_data_container *container,
 		container->capacity *= 2;
 	}
 
-	container->data[container->size] = malloc(sizeof(container->data));
-	container->data[container->size]->entry = entry;
-	container->data[container->size++]->field = field;
+	data_field = malloc(sizeof(*data_field));
+	if (!data_field)
+		return -ENOMEM;
+
+	/* A new run starts, only if the element is really appended. */
+	if (container->size &&
+	    entry->ts < container->data[container->size - 1]->entry->ts)
+		data_container_add_run(container, container->size);
+
+	data_field->entry = entry;
+	data_field->field = field;
+	container->data[container->size++] = data_field;
 
 	return container->size;
 }
@@ -1618,15 +2722,113 @@ static int compare_time_dc(const void* a, const void* b)
 	return 0;
 }
 
+//! @cond Doxygen_Suppress
+
+struct dc_run {
+	ssize_t	pos;
+	ssize_t	end;
+};
+
+//! @endcond
+
+static inline bool dc_run_less(struct kshark_data_field_int64 **data,
+			       const struct dc_run *a, const struct dc_run *b)
+{
+	int64_t ts_a = data[a->pos]->entry->ts;
+	int64_t ts_b = data[b->pos]->entry->ts;
+
+	/* For equal timestamps, keep the order of the runs. */
+	return ts_a < ts_b || (ts_a == ts_b && a->pos < b->pos);
+}
+
+static void dc_heap_down(struct kshark_data_field_int64 **data,
+			 struct dc_run *heap, ssize_t n, ssize_t i)
+{
+	struct dc_run tmp;
+	ssize_t min, c;
+
+	while (true) {
+		min = i;
+		for (c = 2 * i + 1; c <= 2 * i + 2 && c < n; ++c)
+			if (dc_run_less(data, &heap[c], &heap[min]))
+				min = c;
+
+		if (min == i)
+			return;
+
+		tmp = heap[i];
+		heap[i] = heap[min];
+		heap[min] = tmp;
+		i = min;
+	}
+}
+
+/*
+ * K-way merge of the time-sorted runs of the data, using a binary heap of
+ * the runs.
+ */
+static bool data_container_merge_runs(struct kshark_data_container *container)
+{
+	struct kshark_data_field_int64 **data = container->data, **merged;
+	ssize_t r, i, n = container->n_runs;
+	struct dc_run *heap;
+
+	heap = malloc(n * sizeof(*heap));
+	merged = malloc(container->size * sizeof(*merged));
+	if (!heap || !merged) {
+		free(heap);
+		free(merged);
+		return false;
+	}
+
+	for (r = 0; r < n; ++r) {
+		heap[r].pos = r ? container->runs[r - 1] : 0;
+		heap[r].end = r < n - 1 ? container->runs[r] : container->size;
+	}
+
+	for (r = n / 2 - 1; r >= 0; --r)
+		dc_heap_down(data, heap, n, r);
+
+	for (i = 0; i < container->size; ++i) {
+		merged[i] = data[heap[0].pos++];
+		if (heap[0].pos == heap[0].end)
+			heap[0] = heap[--n];
+
+		dc_heap_down(data, heap, n, 0);
+	}
+
+	free(heap);
+	free(data);
+
+	container->data = merged;
+	container->capacity = container->size;
+
+	return true;
+}
+
+/**
+ * @brief Sort in time the data of the container. The time-sorted runs of
+ *	  data are merged. If the runs are unknown (too many), qsort() is
+ *	  used.
+ *
+ * @param container: Input location for the data container.
+ */
 void kshark_data_container_sort(struct kshark_data_container *container)
 {
 	struct kshark_data_field_int64	**data_tmp;
 
-	qsort(container->data, container->size,
-	      sizeof(struct kshark_data_field_int64 *),
-	      compare_time_dc);
+	/* Nothing to do, if the data is sorted by construction. */
+	if (!container->sorted &&
+	    (container->n_runs < 0 || !data_container_merge_runs(container)))
+		qsort(container->data, container->size,
+		      sizeof(struct kshark_data_field_int64 *),
+		      compare_time_dc);
 
 	container->sorted = true;
+	container->n_runs = 1;
+	free(container->runs);
+	container->runs = NULL;
+	container->runs_capacity = 0;
 
 	data_tmp = realloc(container->data,
 			   container->size * sizeof(*container->data));
@@ -1673,3 +2875,321 @@ ssize_t kshark_find_entry_field_by_time(int64_t time,
 	BSEARCH(h, l, data[mid]->entry->ts < time);
 	return h;
 }
+
+/**
+ * @brief Declare a data field of a given event to be extracted into a column
+ *	  during the loading of the entries. The declaration applies to all
+ *	  Data streams, having this event.
+ *
+ * @param kshark_ctx: Input location for the session context pointer.
+ * @param event: The name of the event, in the form "system/name".
+ * @param field: The name of the data field.
+ *
+ * @returns Zero on success, or a negative error code on failure.
+ */
+int kshark_declare_field_column(struct kshark_context *kshark_ctx,
+				const char *event, const char *field)
+{
+	struct kshark_column_decl *decl;
+
+	for (decl = kshark_ctx->column_decls; decl; decl = decl->next)
+		if (strcmp(decl->event, event) == 0 &&
+		    strcmp(decl->field, field) == 0)
+			return 0;
+
+	decl = calloc(1, sizeof(*decl));
+	if (!decl)
+		goto fail;
+
+	decl->event = strdup(event);
+	decl->field = strdup(field);
+	if (!decl->event || !decl->field)
+		goto fail;
+
+	decl->next = kshark_ctx->column_decls;
+	kshark_ctx->column_decls = decl;
+
+	return 0;
+
+ fail:
+	fprintf(stderr, "Failed to allocate memory for column declaration.\n");
+	if (decl) {
+		free(decl->event);
+		free(decl->field);
+		free(decl);
+	}
+
+	return -ENOMEM;
+}
+
+/**
+ * @brief Declare data fields to be extracted into columns during the loading
+ *	  of the entries.
+ *
+ * @param kshark_ctx: Input location for the session context pointer.
+ * @param spec: The declaration, in the form
+ *		"system/event:field,field;system/event:field".
+ *
+ * @returns Zero on success, or a negative error code on failure.
+ */
+int kshark_declare_field_columns(struct kshark_context *kshark_ctx,
+				 const char *spec)
+{
+	char *buffer, *decl, *event, *fields, *field, *save_decl, *save_field;
+	int ret = 0;
+
+	buffer = strdup(spec);
+	if (!buffer)
+		return -ENOMEM;
+
+	for (decl = strtok_r(buffer, ";", &save_decl); decl;
+	     decl = strtok_r(NULL, ";", &save_decl)) {
+		event = strtok_r(decl, ":", &save_field);
+		fields = strtok_r(NULL, "", &save_field);
+		if (!event || !fields) {
+			fprintf(stderr, "Invalid column declaration %s\n", spec);
+			ret = -EINVAL;
+			break;
+		}
+
+		for (field = strtok_r(fields, ",", &save_field); field;
+		     field = strtok_r(NULL, ",", &save_field)) {
+			ret = kshark_declare_field_column(kshark_ctx,
+							  event, field);
+			if (ret < 0)
+				goto end;
+		}
+	}
+
+ end:
+	free(buffer);
+
+	return ret;
+}
+
+/**
+ * @brief Clear all declarations of data fields to be extracted into columns.
+ *
+ * @param kshark_ctx: Input location for the session context pointer.
+ */
+void kshark_clear_column_decls(struct kshark_context *kshark_ctx)
+{
+	struct kshark_column_decl *decl;
+
+	while (kshark_ctx->column_decls) {
+		decl = kshark_ctx->column_decls;
+		kshark_ctx->column_decls = decl->next;
+
+		free(decl->event);
+		free(decl->field);
+		free(decl);
+	}
+}
+
+/**
+ * @brief Create the (empty) columns of a Data stream, according to the
+ *	  declarations of the session. The values from previous loading
+ *	  (if any) are dropped. Declared fields, which do not exist in the
+ *	  Data stream are ignored.
+ *
+ * @param kshark_ctx: Input location for the session context pointer.
+ * @param stream: Input location for a Trace data stream pointer.
+ *
+ * @returns Zero on success, or a negative error code on failure.
+ */
+int kshark_init_field_columns(struct kshark_context *kshark_ctx,
+			      struct kshark_data_stream *stream)
+{
+	struct kshark_column_decl *decl;
+	struct kshark_field_column *col;
+	struct kshark_field_handle *handle;
+	int event_id;
+
+	kshark_free_field_columns(stream);
+
+	if (!kshark_ctx->column_decls ||
+	    !stream->interface.get_field_handle ||
+	    !stream->interface.read_record_field_handle_int64)
+		return 0;
+
+	for (decl = kshark_ctx->column_decls; decl; decl = decl->next) {
+		event_id = stream->interface.find_event_id(stream, decl->event);
+		if (event_id < 0)
+			continue;
+
+		handle = stream->interface.get_field_handle(stream, event_id,
+							    decl->field);
+		if (!handle)
+			continue;
+
+		col = calloc(1, sizeof(*col));
+		if (!col)
+			goto fail;
+
+		col->event_id = event_id;
+		col->handle = handle;
+		col->field = strdup(decl->field);
+		col->data = kshark_init_data_container();
+		col->next = stream->columns;
+		stream->columns = col;
+
+		if (!col->field || !col->data)
+			goto fail;
+	}
+
+	return 0;
+
+ fail:
+	fprintf(stderr, "Failed to allocate memory for field column.\n");
+	kshark_free_field_columns(stream);
+
+	return -ENOMEM;
+}
+
+/**
+ * @brief Free all columns of a Data stream.
+ *
+ * @param stream: Input location for a Trace data stream pointer.
+ */
+void kshark_free_field_columns(struct kshark_data_stream *stream)
+{
+	struct kshark_field_column *col;
+
+	while (stream->columns) {
+		col = stream->columns;
+		stream->columns = col->next;
+
+		if (col->data)
+			kshark_free_data_container(col->data);
+
+		free(col->field);
+		free(col);
+	}
+}
+
+/**
+ * @brief Extract the values of the data fields of an entry into the columns
+ *	  of the Data stream.
+ *
+ * @param stream: Input location for a Trace data stream pointer.
+ * @param record: Input location for the trace record.
+ * @param entry: Input location for entry.
+ */
+void kshark_fill_field_columns(struct kshark_data_stream *stream,
+			       void *record, struct kshark_entry *entry)
+{
+	struct kshark_field_column *col;
+	int64_t val;
+
+	for (col = stream->columns; col; col = col->next) {
+		if (col->event_id != entry->event_id)
+			continue;
+
+		if (stream->interface.read_record_field_handle_int64(stream,
+								     record,
+								     col->handle,
+								     &val) < 0)
+			continue;
+
+		kshark_data_container_append(col->data, entry, val);
+	}
+}
+
+/**
+ * @brief Sort in time the columns of a Data stream. Must be called after the
+ *	  loading of the entries.
+ *
+ * @param stream: Input location for a Trace data stream pointer.
+ */
+void kshark_sort_field_columns(struct kshark_data_stream *stream)
+{
+	struct kshark_field_column *col;
+
+	for (col = stream->columns; col; col = col->next)
+		if (col->data->size)
+			kshark_data_container_sort(col->data);
+}
+
+/**
+ * @brief Get the size (in bytes) of the memory used by the columns of a Data
+ *	  stream.
+ *
+ * @param stream: Input location for a Trace data stream pointer.
+ */
+size_t kshark_field_columns_memory(struct kshark_data_stream *stream)
+{
+	struct kshark_field_column *col;
+	size_t size = 0;
+
+	for (col = stream->columns; col; col = col->next)
+		size += sizeof(*col) + strlen(col->field) + 1 +
+			kshark_data_container_memory(col->data);
+
+	return size;
+}
+
+/**
+ * @brief Get the column of a data field of a given event.
+ *
+ * @param stream: Input location for a Trace data stream pointer.
+ * @param event_id: Event Id.
+ * @param field: The name of the data field.
+ *
+ * @returns The values of the field, sorted in time, or NULL if the field is
+ *	    not extracted.
+ */
+struct kshark_data_container *
+kshark_get_field_column(struct kshark_data_stream *stream,
+			int event_id, const char *field)
+{
+	struct kshark_field_column *col;
+
+	for (col = stream->columns; col; col = col->next)
+		if (col->event_id == event_id && strcmp(col->field, field) == 0)
+			return col->data;
+
+	return NULL;
+}
+
+/**
+ * @brief Read the value of a data field of an entry from the columns of the
+ *	  Data stream. No trace record is read.
+ *
+ * @param stream: Input location for a Trace data stream pointer.
+ * @param entry: Input location for entry.
+ * @param field: The name of the data field.
+ * @param val: Output location for the value of the field.
+ *
+ * @returns True if the field is extracted and the value is found. Otherwise
+ *	    false.
+ */
+bool kshark_read_field_column(struct kshark_data_stream *stream,
+			      const struct kshark_entry *entry,
+			      const char *field, int64_t *val)
+{
+	struct kshark_data_container *col;
+	ssize_t i;
+
+	col = kshark_get_field_column(stream, entry->event_id, field);
+	if (!col || !col->size)
+		return false;
+
+	/* The binary search never returns the lower edge of the range. */
+	if (col->data[0]->entry->ts >= entry->ts)
+		i = 0;
+	else
+		i = kshark_find_entry_field_by_time(entry->ts, col->data,
+						    0, col->size - 1);
+	if (i < 0)
+		return false;
+
+	/* Several entries can have the same timestamp. */
+	for (; i < col->size && col->data[i]->entry->ts == entry->ts; ++i) {
+		if (col->data[i]->entry == entry) {
+			*val = col->data[i]->field;
+			return true;
+		}
+	}
+
+	return false;
+}
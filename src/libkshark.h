@@ -33,9 +33,6 @@ extern "C" {
  * info etc.) is available on-demand via the offset into the trace file.
  */
 struct kshark_entry {
-	/** Pointer to the next (in time) kshark_entry on the same CPU core. */
-	struct kshark_entry *next; /* MUST BE FIRST ENTRY */
-
 	/**
 	 * A bit mask controlling the visibility of the entry. A value of OxFF
 	 * would mean that the entry is visible everywhere. Use
@@ -134,6 +131,59 @@ typedef const int (*stream_read_record_field) (struct kshark_data_stream *,
 					       const char *,
 					       int64_t *);
 
+/**
+ * Opaque descriptor of a data field of a given event. The descriptor is
+ * resolved once and can be used to read the value of the field without
+ * any further lookups. It is owned by the Data stream.
+ */
+struct kshark_field_handle;
+
+typedef struct kshark_field_handle *
+(*stream_get_field_handle) (struct kshark_data_stream *,
+			    int,
+			    const char *);
+
+typedef int (*stream_read_event_field_handle) (struct kshark_data_stream *,
+					       const struct kshark_entry *,
+					       const struct kshark_field_handle *,
+					       int64_t *);
+
+typedef int (*stream_read_record_field_handle) (struct kshark_data_stream *,
+						void *,
+						const struct kshark_field_handle *,
+						int64_t *);
+
+typedef char *(*stream_read_event_field_str) (struct kshark_data_stream *,
+					      const struct kshark_entry *,
+					      const struct kshark_field_handle *);
+
+typedef char *(*stream_read_record_field_str) (struct kshark_data_stream *,
+					       void *,
+					       const struct kshark_field_handle *);
+
+/**
+ * An element of the page-level time index of a Data stream. The timestamps
+ * are as recorded in the file (no time calibration is applied).
+ */
+struct kshark_page_index {
+	/** File offset of the first record of the page. */
+	int64_t		offset;
+
+	/** The timestamp of the first record of the page. */
+	int64_t		first_ts;
+
+	/** The timestamp of the last record of the page. */
+	int64_t		last_ts;
+
+	/** The number of records in the page. */
+	int32_t		count;
+};
+
+/** A function type to be used by the method interface of the data stream. */
+typedef ssize_t (*stream_get_page_index_func) (struct kshark_data_stream *,
+					       int,
+					       const struct kshark_page_index **);
+
 struct kshark_context;
 
 /** A function type to be used by the method interface of the data stream. */
@@ -209,6 +259,29 @@ struct kshark_data_stream_interface {
 	/** Method used to access the value of an event's data field. */
 	stream_read_record_field	read_record_field_int64;
 
+	/**
+	 * Method used to resolve a data field of a given event into a
+	 * descriptor (handle).
+	 */
+	stream_get_field_handle		get_field_handle;
+
+	/** Method used to access the value of a data field via handle. */
+	stream_read_event_field_handle	read_event_field_handle_int64;
+
+	/** Method used to access the value of a data field via handle. */
+	stream_read_record_field_handle	read_record_field_handle_int64;
+
+	/** Method used to access the string of a data field via handle. */
+	stream_read_event_field_str	read_event_field_handle_str;
+
+	/** Method used to access the string of a data field via handle. */
+	stream_read_record_field_str	read_record_field_handle_str;
+
+	/**
+	 * Method used to retrieve the page-level time index of a given CPU.
+	 */
+	stream_get_page_index_func	get_page_index;
+
 	/** Method used to load the data in the form of entries. */
 	load_entries_func	load_entries;
 
@@ -274,6 +347,9 @@ struct kshark_data_stream {
 	/** Hash of CPUs to not display. */
 	struct kshark_hash_id	*hide_cpu_filter;
 
+	/** Compiled query expression used to filter the entries. */
+	struct kshark_query	*query_filter;
+
 	/** List of Plugin interfaces. */
 	struct kshark_dpi_list	*plugins;
 
@@ -286,9 +362,15 @@ struct kshark_data_stream {
 	/** List of Plugin's Event handlers. */
 	struct kshark_event_proc_handler	*event_handlers;
 
+	/** List of Plugin's batch Event handlers. */
+	struct kshark_batch_proc_handler	*batch_handlers;
+
 	/** List of Plugin's Draw handlers. */
 	struct kshark_draw_handler		*draw_handlers;
 
+	/** List of columns of data field values, extracted during loading. */
+	struct kshark_field_column		*columns;
+
 	/**
 	 * The interface of methods used to operate over the data from a given
 	 * stream.
@@ -328,6 +410,43 @@ struct kshark_context {
 
 	/** The number of plugins. */
 	int				n_plugins;
+
+	/**
+	 * Memory budget (in bytes) for the entries allocated on the heap.
+	 * The entries above the budget are spilled into a memory mapped
+	 * temporary file. Zero means no limit.
+	 */
+	size_t				mem_budget;
+
+	/** Memory (in bytes) used by the entries allocated on the heap. */
+	size_t				mem_used;
+
+	/** File descriptor of the temporary file used to spill entries. */
+	int				spill_fd;
+
+	/** Address of the memory region, reserved for the spill file. */
+	void				*spill_base;
+
+	/** The size (in bytes) of the part of the spill file being mapped. */
+	size_t				spill_mapped;
+
+	/** The size (in bytes) of the part of the spill file being used. */
+	size_t				spill_used;
+
+	/** The number of entries in the spill file, which are not freed. */
+	size_t				spill_entries;
+
+	/** List of data fields to be extracted during loading. */
+	struct kshark_column_decl	*column_decls;
+
+	/** Per-CPU index of the loaded trace data. */
+	struct kshark_cpu_index		*cpu_index;
+
+	/**
+	 * The number of users (plugins) of the per-CPU index. The index is
+	 * built when the data is loaded, only if there are users.
+	 */
+	int				cpu_index_users;
 };
 
 bool kshark_instance(struct kshark_context **kshark_ctx);
@@ -375,6 +494,36 @@ void kshark_close_all(struct kshark_context *kshark_ctx);
 
 void kshark_free(struct kshark_context *kshark_ctx);
 
+void kshark_set_memory_budget(struct kshark_context *kshark_ctx,
+			      size_t budget);
+
+struct kshark_entry *kshark_entry_alloc(struct kshark_context *kshark_ctx);
+
+bool kshark_entry_is_spilled(struct kshark_context *kshark_ctx,
+			     const struct kshark_entry *entry);
+
+void kshark_free_entry(struct kshark_context *kshark_ctx,
+		       struct kshark_entry *entry);
+
+void kshark_free_entries(struct kshark_context *kshark_ctx,
+			 struct kshark_entry **data, size_t n);
+
+void *kshark_bulk_alloc(size_t n, size_t size);
+
+/**
+ * Environment variable enabling the self-tracing of KernelShark. If set, the
+ * internal phases of KernelShark are written into the trace_marker of ftrace.
+ * The value can be the path to the tracefs mount point.
+ */
+#define KS_SELF_TRACE_ENV	"KSHARK_SELF_TRACE"
+
+bool kshark_self_trace_enabled(void);
+
+void kshark_self_trace_begin(const char *fmt, ...)
+	__attribute__ ((format (printf, 1, 2)));
+
+void kshark_self_trace_end(void);
+
 static inline int kshark_get_pid(const struct kshark_entry *entry)
 {
 	struct kshark_data_stream *stream =
@@ -470,69 +619,77 @@ static inline char *kshark_dump_entry(const struct kshark_entry *entry)
 	return stream->interface.dump_entry(stream, entry);
 }
 
-/**
- * @brief Load the content of the trace data file asociated with a given
- *	  Data stream identifie into an array of kshark_entries.
- *	  If one or more filters are set, the "visible" fields of each entry
- *	  is updated according to the criteria provided by the filters. The
- *	  field "filter_mask" of the session's context is used to control the
- *	  level of visibility/invisibility of the filtered entries.
- *
- * @param kshark_ctx: Input location for context pointer.
- * @param sd: Data stream identifier.
- * @param data_rows: Output location for the trace data. The user is
- *		     responsible for freeing the elements of the outputted
- *		     array.
- *
- * @returns The size of the outputted data in the case of success, or a
- *	    negative error code on failure.
- */
-static inline ssize_t kshark_load_entries(struct kshark_context *kshark_ctx,
-					  int sd,
-					  struct kshark_entry ***data_rows)
-{
-	struct kshark_data_stream *stream;
+/** Declaration of a data field to be extracted during loading. */
+struct kshark_column_decl {
+	/** Pointer to the next declaration. */
+	struct kshark_column_decl	*next;
 
-	stream = kshark_get_data_stream(kshark_ctx, sd);
-	if (!stream)
-		return -EBADF;
+	/** The name of the event, in the form "system/name". */
+	char				*event;
 
-	return stream->interface.load_entries(stream, kshark_ctx, data_rows);
-}
+	/** The name of the data field. */
+	char				*field;
+};
 
 /**
- * @brief Load the content of the trace data file asociated with a given
- *	  Data stream identifie into a data matrix.
- *
- * @param kshark_ctx: Input location for context pointer.
- * @param sd: Data stream identifier.
- * @param data_rows: Output location for the trace data. The user is
- *		     responsible for freeing the elements of the outputted
- *		     array.
- *
- * @returns The size of the outputted data in the case of success, or a
- *	    negative error code on failure.
+ * Column of the values of a data field of a given event, extracted during
+ * the loading of the entries. The column is sparse, it contains only the
+ * entries of the event.
  */
-static inline ssize_t kshark_load_matrix(struct kshark_context *kshark_ctx,
-					 int sd,
-					 int16_t **cpu_array,
-					 int32_t **pid_array,
-					 int32_t **event_array,
-					 int64_t **offset_array,
-					 uint64_t **ts_array)
-{
-	struct kshark_data_stream *stream;
+struct kshark_field_column {
+	/** Pointer to the next column. */
+	struct kshark_field_column	*next;
 
-	stream = kshark_get_data_stream(kshark_ctx, sd);
-	if (!stream)
-		return -EBADF;
+	/** Event Id. */
+	int				event_id;
 
-	return stream->interface.load_matrix(stream, kshark_ctx, cpu_array,
-								 pid_array,
-								 event_array,
-								 offset_array,
-								 ts_array);
-}
+	/** The name of the data field. */
+	char				*field;
+
+	/** Descriptor of the data field. */
+	struct kshark_field_handle	*handle;
+
+	/** The values of the field, sorted in time. */
+	struct kshark_data_container	*data;
+};
+
+int kshark_declare_field_column(struct kshark_context *kshark_ctx,
+				const char *event, const char *field);
+
+int kshark_declare_field_columns(struct kshark_context *kshark_ctx,
+				 const char *spec);
+
+void kshark_clear_column_decls(struct kshark_context *kshark_ctx);
+
+int kshark_init_field_columns(struct kshark_context *kshark_ctx,
+			      struct kshark_data_stream *stream);
+
+void kshark_free_field_columns(struct kshark_data_stream *stream);
+
+void kshark_fill_field_columns(struct kshark_data_stream *stream,
+			       void *record, struct kshark_entry *entry);
+
+void kshark_sort_field_columns(struct kshark_data_stream *stream);
+
+size_t kshark_field_columns_memory(struct kshark_data_stream *stream);
+
+struct kshark_data_container *
+kshark_get_field_column(struct kshark_data_stream *stream,
+			int event_id, const char *field);
+
+bool kshark_read_field_column(struct kshark_data_stream *stream,
+			      const struct kshark_entry *entry,
+			      const char *field, int64_t *val);
+
+ssize_t kshark_load_entries(struct kshark_context *kshark_ctx, int sd,
+			    struct kshark_entry ***data_rows);
+
+ssize_t kshark_load_matrix(struct kshark_context *kshark_ctx, int sd,
+			   int16_t **cpu_array,
+			   int32_t **pid_array,
+			   int32_t **event_array,
+			   int64_t **offset_array,
+			   uint64_t **ts_array);
 
 /** Bit masks used to control the visibility of the entry after filtering. */
 enum kshark_filter_masks {
@@ -681,6 +838,12 @@ ssize_t kshark_find_entry_by_time(int64_t time,
 				  struct kshark_entry **data_rows,
 				  size_t l, size_t h);
 
+ssize_t kshark_find_page_by_time(struct kshark_data_stream *stream, int cpu,
+				 int64_t time,
+				 const struct kshark_page_index **page);
+
+char *kshark_cache_dir(void);
+
 bool kshark_match_pid(struct kshark_context *kshark_ctx,
 		      struct kshark_entry *e, int sd, int *pid);
 
@@ -813,6 +976,68 @@ ssize_t kshark_append_all_entries(struct kshark_context *kshark_ctx,
 				  ssize_t n_prior_rows,
 				  int first_streams,
 				  struct kshark_entry ***merged_data);
+
+/**
+ * Per-CPU index of the trace data. For each CPU of each Data stream, the
+ * index contains the rows (in the array of trace data) of all entries
+ * recorded on this CPU, sorted in time. This allows for contiguous
+ * traversal of the data of a given CPU. The index can be built only for
+ * trace data having less than 2^32 entries.
+ */
+struct kshark_cpu_index {
+	/**
+	 * The rows of all entries, grouped by Data stream and CPU. Inside
+	 * each group the rows are sorted in time.
+	 */
+	uint32_t		*rows;
+
+	/**
+	 * The position (in "rows") of the first row of each group. The size
+	 * of this array is "n_groups + 1", the last element being equal to
+	 * the total number of rows in the index.
+	 */
+	size_t			*group_start;
+
+	/** The number of groups (all CPUs of all Data streams). */
+	size_t			n_groups;
+
+	/** The group of CPU 0 for each Data stream. */
+	size_t			first_group[KS_MAX_NUM_STREAMS];
+
+	/** The number of CPUs for each Data stream. */
+	int			n_cpus[KS_MAX_NUM_STREAMS];
+
+	/** The indexed trace data. */
+	struct kshark_entry	**data;
+
+	/** The size of the indexed trace data. */
+	size_t			n_rows;
+};
+
+struct kshark_cpu_index *
+kshark_cpu_index_alloc(struct kshark_context *kshark_ctx,
+		       struct kshark_entry **data, size_t n_rows);
+
+void kshark_cpu_index_free(struct kshark_cpu_index *index);
+
+size_t kshark_cpu_index_get(const struct kshark_cpu_index *index,
+			    int sd, int cpu, const uint32_t **rows);
+
+ssize_t kshark_next_on_cpu(const struct kshark_cpu_index *index, size_t row);
+
+int kshark_register_cpu_index(struct kshark_context *kshark_ctx,
+			      struct kshark_entry **data, size_t n_rows);
+
+void kshark_unregister_cpu_index(struct kshark_context *kshark_ctx);
+
+void kshark_request_cpu_index(struct kshark_context *kshark_ctx);
+
+void kshark_release_cpu_index(struct kshark_context *kshark_ctx);
+
+const struct kshark_cpu_index *
+kshark_get_cpu_index(struct kshark_context *kshark_ctx,
+		     struct kshark_entry **data, size_t n_rows);
+
 /**
  * Data collections are used to optimize the search for an entry having an
  * abstract property, defined by a Matching condition function and an array of
@@ -858,6 +1083,22 @@ struct kshark_entry_collection {
 
 	/** Number of data intervals in this collection. */
 	size_t size;
+
+	/**
+	 * Array of indexes of the entries, at which the state of the
+	 * collection changes. The state is defined by the Process Id and
+	 * the CPU Id of the entries satisfying the Matching condition.
+	 */
+	size_t *state_points;
+
+	/**
+	 * Array of indexes of the last entries, satisfying the Matching
+	 * condition, before each state change.
+	 */
+	size_t *state_ends;
+
+	/** Number of states in this collection. */
+	size_t n_states;
 };
 
 struct kshark_entry_collection *
@@ -904,6 +1145,9 @@ kshark_get_collection_entry_back(struct kshark_entry_request **req,
 				 const struct kshark_entry_collection *col,
 				 ssize_t *index);
 
+ssize_t kshark_get_collection_state(const struct kshark_entry_collection *col,
+				    size_t row);
+
 /** Size of the task'c hash table in terms of bits being used by the key. */
 #define KS_TASK_HASH_NBITS	16
 
@@ -946,6 +1190,8 @@ void kshark_hash_id_free(struct kshark_hash_id *hash);
 
 int *kshark_hash_ids(struct kshark_hash_id *hash);
 
+size_t kshark_hash_id_memory(const struct kshark_hash_id *hash);
+
 static inline int kshark_filter_task_count(struct kshark_hash_id *hash)
 {
 	return hash->count;
@@ -1200,12 +1446,25 @@ struct kshark_data_container {
 	ssize_t		capacity;
 
 	bool		sorted;
+
+	/*
+	 * Indexes of the data, where the time goes backwards. Between two
+	 * such indexes the data is sorted in time.
+	 */
+	ssize_t		*runs;
+
+	/* The number of time-sorted runs, or -1 if too many to be tracked. */
+	ssize_t		n_runs;
+
+	ssize_t		runs_capacity;
 };
 
 struct kshark_data_container *kshark_init_data_container();
 
 void kshark_free_data_container(struct kshark_data_container *container);
 
+size_t kshark_data_container_memory(const struct kshark_data_container *container);
+
 ssize_t kshark_data_container_append(struct kshark_data_container *container,
 				     struct kshark_entry *entry, int64_t field);
 
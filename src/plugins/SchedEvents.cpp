@@ -8,14 +8,23 @@
  *  @file    SchedEvents.cpp
  *  @brief   Defines a callback function for Sched events used to plot in green
  *	     the wake up latency of the task and in red the time the task was
- *	     preempted by another task.
+ *	     preempted by another task. The plugin also highlights the
+ *	     critical path (the wakeup chain) of a task.
  */
 
+// C++
+#include <algorithm>
+#include <iostream>
+
+// Qt
+#include <QMessageBox>
+
 // KernelShark
 #include "libkshark.h"
 #include "plugins/sched_events.h"
 #include "KsPlotTools.hpp"
 #include "KsPlugins.hpp"
+#include "KsMainWindow.hpp"
 
 using namespace KsPlot;
 
@@ -42,6 +51,29 @@ static PlotObject *makeShape(std::vector<const Graph *> graph,
 	return rec;
 };
 
+static PlotObject *makePathShape(std::vector<const Graph *> graph,
+				 std::vector<int> bin,
+				 std::vector<int64_t>,
+				 Color col, float size)
+{
+	Rectangle *rec = new KsPlot::Rectangle;
+	Point p0 = graph[0]->getBin(bin[0])._base;
+	Point p1 = graph[0]->getBin(bin[1])._base;
+	int height = graph[0]->height();
+
+	rec->setFill(true);
+	rec->setPoint(0, p0.x(), p0.y() - height);
+	rec->setPoint(1, p0.x(), p0.y() - height * .8);
+
+	rec->setPoint(3, p1.x(), p1.y() - height);
+	rec->setPoint(2, p1.x(), p1.y() - height * .8);
+
+	rec->_size = size;
+	rec->_color = col;
+
+	return rec;
+};
+
 /*
  * Ideally, the sched_switch has to be the last trace event recorded before the
  * task is preempted. Because of this, when the data is loaded (the first pass),
@@ -50,40 +82,117 @@ static PlotObject *makeShape(std::vector<const Graph *> graph,
  * sched_switch event may be followed by some trailing events from the same task
  * (printk events for example). This has the effect of extending the graph of
  * the task outside of the actual duration of the task. The "second pass" over
- * the data is used to fix this problem. It takes advantage of the "next" field
- * of the entry (this field is set during the first pass) to search for trailing
- * events after the "sched_switch".
+ * the data is used to fix this problem. It uses the per-CPU index of the data,
+ * built when the data is loaded, to search for trailing events after the
+ * "sched_switch".
  */
-static void secondPass(plugin_sched_context *plugin_ctx)
+static bool secondPass(plugin_sched_context *plugin_ctx,
+		       kshark_entry **data, size_t n_rows)
 {
+	kshark_context *kshark_ctx(nullptr);
+	const kshark_cpu_index *index;
 	kshark_data_container *cSS;
 	kshark_entry *e;
+	ssize_t row, next;
 	int pid_rec;
 
+	if (!n_rows || !kshark_instance(&kshark_ctx))
+		return false;
+
+	index = kshark_get_cpu_index(kshark_ctx, data, n_rows);
+	if (!index)
+		return false;
+
+	auto lamFindRow = [&] (const kshark_entry *entry) -> ssize_t {
+		ssize_t r = kshark_find_entry_by_time(entry->ts, data,
+						      0, n_rows - 1);
+		if (r < 0)
+			return -1;
+
+		/* Go to the first entry having this timestamp. */
+		while (r > 0 && data[r - 1]->ts >= entry->ts)
+			--r;
+
+		for (; r < (ssize_t) n_rows && data[r]->ts == entry->ts; ++r)
+			if (data[r] == entry)
+				return r;
+
+		return -1;
+	};
+
 	cSS = plugin_ctx->ss_data;
 	for (ssize_t i = 0; i < cSS->size; ++i) {
 		pid_rec = plugin_sched_get_pid(cSS->data[i]->field);
 		e = cSS->data[i]->entry;
-		if (!e->next || e->pid == 0 ||
-		    e->event_id == e->next->event_id ||
-		    pid_rec != e->next->pid)
+		if (e->pid == 0)
+			continue;
+
+		row = lamFindRow(e);
+		if (row < 0)
+			continue;
+
+		next = kshark_next_on_cpu(index, row);
+		if (next < 0 ||
+		    e->event_id == data[next]->event_id ||
+		    pid_rec != data[next]->pid)
 			continue;
 
 		/* Find the very last trailing event. */
-		for (; e->next; e = e->next) {
-			if (e->next->pid != plugin_sched_get_pid(cSS->data[i]->field)) {
+		for (; next >= 0; next = kshark_next_on_cpu(index, row)) {
+			if (data[next]->pid != pid_rec) {
 				/*
 				 * This is the last trailing event. Change the
 				 * "pid" to be equal to the "next pid" of the
 				 * sched_switch event and leave a sign that you
 				 * edited this entry.
 				 */
-				e->pid = cSS->data[i]->entry->pid;
-				e->visible &= ~KS_PLUGIN_UNTOUCHED_MASK;
+				data[row]->pid = e->pid;
+				data[row]->visible &= ~KS_PLUGIN_UNTOUCHED_MASK;
 				break;
 			}
+
+			row = next;
 		}
 	}
+
+	return true;
+}
+
+static void criticalPathPlot(KsCppArgV *argvCpp,
+			     const sched_critical_path *path, int pid)
+{
+	kshark_trace_histo *histo = argvCpp->_histo;
+	int binStart, binEnd;
+	Color col;
+
+	auto lamGetBin = [histo] (int64_t ts) {
+		if (ts <= histo->min)
+			return 0;
+
+		if (ts >= histo->max)
+			return histo->n_bins - 1;
+
+		return (int) ((ts - histo->min) / histo->bin_size);
+	};
+
+	for (size_t i = 0; i < path->n_segments; ++i) {
+		const sched_path_segment &seg = path->segments[i];
+		if (seg.pid != pid ||
+		    seg.end < histo->min || seg.start > histo->max)
+			continue;
+
+		binStart = lamGetBin(seg.start);
+		binEnd = lamGetBin(seg.end);
+
+		if (seg.type == SCHED_PATH_RUNNING)
+			col = {0, 0, 255}; // Blue
+		else
+			col = {255, 165, 0}; // Orange
+
+		argvCpp->_shapes->push_front(makePathShape({argvCpp->_graph},
+							   {binStart, binEnd},
+							   {}, col, -1));
+	}
 }
 
 /**
@@ -109,8 +218,9 @@ void plugin_draw(kshark_cpp_argv *argv_c, int sd, int pid, int draw_action)
 
 	if (!plugin_ctx->second_pass_done) {
 		/* The second pass is not done yet. */
-		secondPass(plugin_ctx);
-		plugin_ctx->second_pass_done = true;
+		plugin_ctx->second_pass_done =
+			secondPass(plugin_ctx, argvCpp->_histo->data,
+				   argvCpp->_histo->data_size);
 	}
 
 	IsApplicableFunc checkFieldSW = [=] (kshark_data_container *d,
@@ -142,4 +252,92 @@ void plugin_draw(kshark_cpp_argv *argv_c, int sd, int pid, int draw_action)
 			       makeShape,
 			       {255, 0, 0}, // Red
 			       -1);         // Default size
+
+	if (plugin_ctx->critical_path) {
+		try {
+			criticalPathPlot(argvCpp, plugin_ctx->critical_path,
+					 pid);
+		} catch (const std::exception &exc) {
+			std::cerr << "Exception in criticalPathPlot\n"
+				  << exc.what() << std::endl;
+		}
+	}
+}
+
+static void showCriticalPath(KsMainWindow *ks)
+{
+	KsGraphMark &markA = ks->markersPtr()->getMarker(DualMarkerState::A);
+	KsGraphMark &markB = ks->markersPtr()->getMarker(DualMarkerState::B);
+	plugin_sched_context *plugin_ctx;
+	sched_critical_path *path;
+	QVector<int> taskList;
+	kshark_entry *e;
+	int sd;
+
+	if (!markA._isSet || !markB._isSet) {
+		QString err("Select an entry of the task with Marker A and ");
+		err += "the other end of the time interval with Marker B.";
+		QMessageBox msgBox;
+		msgBox.critical(nullptr, "Error", err);
+
+		return;
+	}
+
+	e = ks->dataPtr()->rows()[markA._pos];
+	sd = e->stream_id;
+	plugin_ctx = get_sched_context(sd);
+	if (!plugin_ctx || e->pid <= 0) {
+		QString err("No scheduling data for this task.");
+		QMessageBox msgBox;
+		msgBox.critical(nullptr, "Error", err);
+
+		return;
+	}
+
+	path = plugin_sched_critical_path(sd, e->pid,
+					  std::min(markA._ts, markB._ts),
+					  std::max(markA._ts, markB._ts));
+	if (!path)
+		return;
+
+	plugin_sched_free_critical_path(plugin_ctx->critical_path);
+	plugin_ctx->critical_path = path;
+
+	/* Show the Task graphs of all tasks on the critical path. */
+	taskList = ks->graphPtr()->glPtr()->_streamPlots[sd]._taskList;
+	for (size_t i = 0; i < path->n_segments; ++i)
+		if (path->segments[i].pid > 0 &&
+		    !taskList.contains(path->segments[i].pid))
+			taskList.append(path->segments[i].pid);
+
+	std::sort(taskList.begin(), taskList.end());
+	ks->graphPtr()->taskReDraw(sd, taskList);
+}
+
+static void clearCriticalPath(KsMainWindow *ks)
+{
+	plugin_sched_context *plugin_ctx;
+
+	for (auto const &sd: KsUtils::getStreamIdList()) {
+		plugin_ctx = get_sched_context(sd);
+		if (!plugin_ctx || !plugin_ctx->critical_path)
+			continue;
+
+		plugin_sched_free_critical_path(plugin_ctx->critical_path);
+		plugin_ctx->critical_path = nullptr;
+
+		ks->graphPtr()->taskReDraw(sd,
+			ks->graphPtr()->glPtr()->_streamPlots[sd]._taskList);
+	}
+}
+
+/** Add the menus of the plugin to the GUI. */
+void *plugin_sched_add_menu(void *ks_ptr)
+{
+	KsMainWindow *ks = static_cast<KsMainWindow *>(ks_ptr);
+
+	ks->addPluginMenu("Tools/Critical Path", showCriticalPath);
+	ks->addPluginMenu("Tools/Clear Critical Path", clearCriticalPath);
+
+	return nullptr;
 }
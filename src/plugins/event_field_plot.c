@@ -76,6 +76,18 @@ plugin_efp_init_context(struct kshark_data_stream *stream)
 		goto fail;
 	}
 
+	plugin_ctx->field_handle =
+		stream->interface.get_field_handle(stream,
+						   plugin_ctx->event_id,
+						   plugin_ctx->field_name);
+
+	if (!plugin_ctx->field_handle) {
+		fprintf(stderr, "Field %s of event %s not found in stream %s:%s\n",
+			plugin_ctx->field_name, plugin_ctx->event_name,
+			stream->file, stream->name);
+		goto fail;
+	}
+
 	plugin_ctx->data = kshark_init_data_container();
 	if (!plugin_ctx->data)
 		goto fail;
@@ -87,27 +99,33 @@ plugin_efp_init_context(struct kshark_data_stream *stream)
 	return NULL;
 }
 
-static void plugin_get_field(struct kshark_data_stream *stream, void *rec,
-			     struct kshark_entry *entry)
+static void plugin_get_field(struct kshark_data_stream *stream, int cpu,
+			     struct kshark_plugin_batch_item *items, size_t n)
 {
 	struct plugin_efp_context *plugin_ctx;
 	int64_t val;
+	size_t i;
 
 	plugin_ctx = get_efp_context(stream->stream_id);
 	if (!plugin_ctx)
 		return;
 
-	stream->interface.read_record_field_int64(stream, rec,
-						  plugin_ctx->field_name,
-						  &val);
+	for (i = 0; i < n; ++i) {
+		if (stream->interface.read_record_field_handle_int64(stream,
+								     items[i].rec,
+								     plugin_ctx->field_handle,
+								     &val) < 0)
+			continue;
 
-	kshark_data_container_append(plugin_ctx->data, entry, val);
+		kshark_data_container_append(plugin_ctx->data,
+					     items[i].entry, val);
 
-	if (val > plugin_ctx->field_max)
-		plugin_ctx->field_max = val;
+		if (val > plugin_ctx->field_max)
+			plugin_ctx->field_max = val;
 
-	if (val < plugin_ctx->field_min)
-		plugin_ctx->field_min = val;
+		if (val < plugin_ctx->field_min)
+			plugin_ctx->field_min = val;
+	}
 }
 
 /** Load this plugin. */
@@ -118,7 +136,7 @@ int KSHARK_PLOT_PLUGIN_INITIALIZER(struct kshark_data_stream *stream)
 	if (!plugin_ctx)
 		return 0;
 
-	kshark_register_event_handler(stream,
+	kshark_register_batch_handler(stream,
 				      plugin_ctx->event_id,
 				      plugin_get_field);
 
@@ -138,7 +156,7 @@ int KSHARK_PLOT_PLUGIN_DEINITIALIZER(struct kshark_data_stream *stream)
 	if (!plugin_ctx)
 		return 0;
 
-	kshark_unregister_event_handler(stream,
+	kshark_unregister_batch_handler(stream,
 					plugin_ctx->event_id,
 					plugin_get_field);
 
@@ -149,6 +167,19 @@ int KSHARK_PLOT_PLUGIN_DEINITIALIZER(struct kshark_data_stream *stream)
 	return 1;
 }
 
+/** Report the memory used by this plugin. */
+size_t KSHARK_PLOT_PLUGIN_MEMORY(struct kshark_data_stream *stream)
+{
+	struct plugin_efp_context *plugin_ctx;
+
+	plugin_ctx = get_efp_context(stream->stream_id);
+	if (!plugin_ctx)
+		return 0;
+
+	return sizeof(*plugin_ctx) +
+	       kshark_data_container_memory(plugin_ctx->data);
+}
+
 void *KSHARK_MENU_PLUGIN_INITIALIZER(void *gui_ptr)
 {
 	printf("--> event_field init menu\n");
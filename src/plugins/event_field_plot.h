@@ -31,6 +31,9 @@ struct plugin_efp_context {
 	/** Event field name. */
 	char 		*field_name;
 
+	/** Event field descriptor. */
+	struct kshark_field_handle	*field_handle;
+
 	/** The max value of the field in the data. */
 	int64_t		field_max;
 
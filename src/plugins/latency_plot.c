@@ -56,7 +56,7 @@ static struct plugin_latency_context *
 plugin_latency_init_context(struct kshark_data_stream *stream)
 {
 	struct plugin_latency_context *plugin_ctx;
-	int sd = stream->stream_id;
+	int i, sd = stream->stream_id;
 
 	/* No context should exist when we initialize the plugin. */
 	assert(plugin_latency_context_handler[sd] == NULL);
@@ -87,6 +87,20 @@ plugin_latency_init_context(struct kshark_data_stream *stream)
 		goto fail;
 	}
 
+	for (i = 0; i < 2; ++i) {
+		plugin_ctx->field_handle[i] =
+			stream->interface.get_field_handle(stream,
+							   plugin_ctx->event_id[i],
+							   plugin_ctx->field_name[i]);
+		if (!plugin_ctx->field_handle[i]) {
+			fprintf(stderr, "Field %s of event %s not found in stream %s:%s\n",
+				plugin_ctx->field_name[i],
+				plugin_ctx->event_name[i],
+				stream->file, stream->name);
+			goto fail;
+		}
+	}
+
 	plugin_ctx->second_pass_done = false;
 	plugin_ctx->max_latency = INT64_MIN;
 
@@ -104,14 +118,15 @@ plugin_latency_init_context(struct kshark_data_stream *stream)
 
 static void plugin_get_field(struct kshark_data_stream *stream, void *rec,
 			     struct kshark_entry *entry,
-			     char *field_name,
+			     struct kshark_field_handle *field_handle,
 			     struct kshark_data_container *data)
 {
 	int64_t val;
 
-	stream->interface.read_record_field_int64(stream, rec,
-						  field_name,
-						  &val);
+	if (stream->interface.read_record_field_handle_int64(stream, rec,
+							     field_handle,
+							     &val) < 0)
+		return;
 
 	kshark_data_container_append(data, entry, val);
 }
@@ -126,7 +141,7 @@ static void plugin_get_field_a(struct kshark_data_stream *stream, void *rec,
 		return;
 
 	plugin_get_field(stream, rec, entry,
-			 plugin_ctx->field_name[0],
+			 plugin_ctx->field_handle[0],
 			 plugin_ctx->data[0]);
 }
 
@@ -140,7 +155,7 @@ static void plugin_get_field_b(struct kshark_data_stream *stream, void *rec,
 		return;
 
 	plugin_get_field(stream, rec, entry,
-			 plugin_ctx->field_name[1],
+			 plugin_ctx->field_handle[1],
 			 plugin_ctx->data[1]);
 }
 
@@ -195,6 +210,20 @@ int KSHARK_PLOT_PLUGIN_DEINITIALIZER(struct kshark_data_stream *stream)
 	return 1;
 }
 
+/** Report the memory used by this plugin. */
+size_t KSHARK_PLOT_PLUGIN_MEMORY(struct kshark_data_stream *stream)
+{
+	struct plugin_latency_context *plugin_ctx;
+
+	plugin_ctx = get_latency_context(stream->stream_id);
+	if (!plugin_ctx)
+		return 0;
+
+	return sizeof(*plugin_ctx) +
+	       kshark_data_container_memory(plugin_ctx->data[0]) +
+	       kshark_data_container_memory(plugin_ctx->data[1]);
+}
+
 void *KSHARK_MENU_PLUGIN_INITIALIZER(void *gui_ptr)
 {
 	printf("--> latency_plot init menu\n");
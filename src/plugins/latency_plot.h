@@ -31,6 +31,9 @@ struct plugin_latency_context {
 	/** Event field names. */
 	char		*field_name[2];
 
+	/** Event field descriptors. */
+	struct kshark_field_handle	*field_handle[2];
+
 	/** True if the second pass is already done. */
 	bool		second_pass_done;
 
@@ -12,6 +12,7 @@
 // C
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
 #include <assert.h>
 
 // trace-cmd
@@ -82,6 +83,345 @@ define_wakeup_event(struct tep_handle *tep, const char *wakeup_name,
 	return true;
 }
 
+/* Quiet warnings over documenting simple structures */
+//! @cond Doxygen_Suppress
+
+/*
+ * A scheduling edge of a task. For switch-out edges "arg" is the previous
+ * state of the task. For wakeup edges "arg" is the Process Id of the waker.
+ */
+struct sched_edge {
+	struct kshark_entry	*entry;
+	int			pid;
+	int			arg;
+};
+
+struct sched_edge_array {
+	struct sched_edge	*edges;
+	size_t			size;
+};
+
+struct sched_wakeup_graph {
+	struct sched_edge_array	switch_in;
+	struct sched_edge_array	switch_out;
+	struct sched_edge_array	wakeup;
+};
+
+#define SCHED_PATH_MAX_SEGMENTS	(1 << 16)
+
+//! @endcond
+
+static void plugin_sched_free_wakeup_graph(struct sched_wakeup_graph *graph)
+{
+	if (!graph)
+		return;
+
+	free(graph->switch_in.edges);
+	free(graph->switch_out.edges);
+	free(graph->wakeup.edges);
+	free(graph);
+}
+
+static int compare_edges(const void *a, const void *b)
+{
+	const struct sched_edge *ea = a, *eb = b;
+
+	if (ea->pid != eb->pid)
+		return (ea->pid > eb->pid) ? 1 : -1;
+
+	if (ea->entry->ts != eb->entry->ts)
+		return (ea->entry->ts > eb->entry->ts) ? 1 : -1;
+
+	return 0;
+}
+
+static bool edges_alloc(struct sched_edge_array *array, size_t size)
+{
+	array->size = 0;
+	array->edges = malloc((size ? size : 1) * sizeof(*array->edges));
+
+	return array->edges;
+}
+
+static void edges_push(struct sched_edge_array *array,
+		       struct kshark_entry *entry, int pid, int arg)
+{
+	struct sched_edge *edge = &array->edges[array->size++];
+
+	edge->entry = entry;
+	edge->pid = pid;
+	edge->arg = arg;
+}
+
+/*
+ * Build the index of the scheduling edges of all tasks. The edges are sorted
+ * by Process Id and time.
+ */
+static struct sched_wakeup_graph *
+sched_build_wakeup_graph(struct plugin_sched_context *plugin_ctx)
+{
+	struct kshark_data_container *cSS = plugin_ctx->ss_data;
+	struct kshark_data_container *cSW = plugin_ctx->sw_data;
+	struct sched_wakeup_graph *graph;
+	ks_num_field_t field;
+	ssize_t i;
+
+	graph = calloc(1, sizeof(*graph));
+	if (!graph ||
+	    !edges_alloc(&graph->switch_in, cSS->size) ||
+	    !edges_alloc(&graph->switch_out, cSS->size) ||
+	    !edges_alloc(&graph->wakeup, cSW->size)) {
+		fprintf(stderr,
+			"Failed to allocate memory for sched_wakeup_graph.\n");
+		plugin_sched_free_wakeup_graph(graph);
+		return NULL;
+	}
+
+	for (i = 0; i < cSS->size; ++i) {
+		field = cSS->data[i]->field;
+
+		/* The "pid" of the sched_switch entry is the "next pid". */
+		edges_push(&graph->switch_in, cSS->data[i]->entry,
+			   cSS->data[i]->entry->pid, 0);
+
+		edges_push(&graph->switch_out, cSS->data[i]->entry,
+			   plugin_sched_get_pid(field),
+			   plugin_sched_get_prev_state(field));
+	}
+
+	/* The "pid" of the wakeup entry is the task doing the wakeup. */
+	for (i = 0; i < cSW->size; ++i)
+		edges_push(&graph->wakeup, cSW->data[i]->entry,
+			   cSW->data[i]->field, cSW->data[i]->entry->pid);
+
+	qsort(graph->switch_in.edges, graph->switch_in.size,
+	      sizeof(struct sched_edge), compare_edges);
+
+	qsort(graph->switch_out.edges, graph->switch_out.size,
+	      sizeof(struct sched_edge), compare_edges);
+
+	qsort(graph->wakeup.edges, graph->wakeup.size,
+	      sizeof(struct sched_edge), compare_edges);
+
+	return graph;
+}
+
+/* Find the last edge of a task, recorded not later than "ts". */
+static const struct sched_edge *
+find_last_edge(const struct sched_edge_array *array, int pid, int64_t ts)
+{
+	ssize_t l = -1, h = array->size, mid;
+	const struct sched_edge *edge;
+
+	BSEARCH(h, l, array->edges[mid].pid < pid ||
+		      (array->edges[mid].pid == pid &&
+		       array->edges[mid].entry->ts <= ts));
+
+	if (l < 0)
+		return NULL;
+
+	edge = &array->edges[l];
+
+	return (edge->pid == pid) ? edge : NULL;
+}
+
+static bool path_add(struct sched_critical_path *path, size_t *capacity,
+		     int pid, int64_t start, int64_t end,
+		     enum sched_path_segment_type type)
+{
+	struct sched_path_segment *segments;
+
+	if (start < path->start)
+		start = path->start;
+
+	if (end <= start)
+		return true;
+
+	if (path->n_segments == *capacity) {
+		*capacity = *capacity ? *capacity * 2 : 64;
+		segments = realloc(path->segments,
+				   *capacity * sizeof(*segments));
+		if (!segments)
+			return false;
+
+		path->segments = segments;
+	}
+
+	segments = &path->segments[path->n_segments++];
+	segments->start = start;
+	segments->end = end;
+	segments->pid = pid;
+	segments->type = type;
+
+	return true;
+}
+
+static bool sched_walk_path(const struct sched_wakeup_graph *graph,
+			    struct sched_critical_path *path)
+{
+	const struct sched_edge *in, *out, *wakeup;
+	int64_t t = path->end, t_prev, t_in;
+	size_t capacity = 0;
+	int pid = path->pid;
+
+	/*
+	 * Walk backwards in time. The time when the task was not running is
+	 * attributed to the task that woke it up.
+	 */
+	while (t > path->start && path->n_segments < SCHED_PATH_MAX_SEGMENTS) {
+		t_prev = t;
+
+		in = find_last_edge(&graph->switch_in, pid, t);
+		out = find_last_edge(&graph->switch_out, pid, t);
+		if (pid == 0 || (!in && (!out || out->entry->ts == t))) {
+			/* Running since the beginning of the interval. */
+			return path_add(path, &capacity, pid, path->start, t,
+					pid ? SCHED_PATH_RUNNING :
+					      SCHED_PATH_BLOCKED);
+		}
+
+		if (out && out->entry->ts < t &&
+		    (!in || out->entry->ts > in->entry->ts)) {
+			/*
+			 * The task has been switched out after its last
+			 * switch in. It is not running at "t".
+			 */
+			t_in = t;
+		} else {
+			t_in = in->entry->ts;
+			if (!path_add(path, &capacity, pid, t_in, t,
+				      SCHED_PATH_RUNNING))
+				return false;
+
+			out = find_last_edge(&graph->switch_out, pid, t_in);
+			if (!out) {
+				return path_add(path, &capacity, pid,
+						path->start, t_in,
+						SCHED_PATH_PREEMPTED);
+			}
+		}
+
+		if (!(out->arg & 0x7f)) {
+			/* The task has been preempted. */
+			if (!path_add(path, &capacity, pid,
+				      out->entry->ts, t_in,
+				      SCHED_PATH_PREEMPTED))
+				return false;
+
+			t = out->entry->ts;
+		} else {
+			wakeup = find_last_edge(&graph->wakeup, pid, t_in);
+
+			if (!wakeup || wakeup->entry->ts < out->entry->ts) {
+				/* The wakeup is not recorded (yet). */
+				if (!path_add(path, &capacity, pid,
+					      out->entry->ts, t_in,
+					      SCHED_PATH_BLOCKED))
+					return false;
+
+				t = out->entry->ts;
+			} else {
+				if (!path_add(path, &capacity, pid,
+					      wakeup->entry->ts, t_in,
+					      SCHED_PATH_WAKEUP_LATENCY))
+					return false;
+
+				if (wakeup->arg == 0 || wakeup->arg == pid) {
+					/* Woken up by an interrupt. */
+					if (!path_add(path, &capacity, pid,
+						      out->entry->ts,
+						      wakeup->entry->ts,
+						      SCHED_PATH_BLOCKED))
+						return false;
+
+					t = out->entry->ts;
+				} else {
+					/* Follow the waker. */
+					pid = wakeup->arg;
+					t = wakeup->entry->ts;
+				}
+			}
+		}
+
+		/* Make sure that the walk always goes back in time. */
+		if (t >= t_prev)
+			break;
+	}
+
+	return true;
+}
+
+/**
+ * @brief Extract the critical path of a task inside a given time interval.
+ *	  The index of the wakeup edges is built on the first call.
+ *
+ * @param sd: Data stream identifier.
+ * @param pid: The Process Id of the task.
+ * @param start: The start of the time interval.
+ * @param end: The end of the time interval.
+ *
+ * @returns The critical path on success, or NULL on failure. The user is
+ *	    responsible for freeing the path, using
+ *	    plugin_sched_free_critical_path().
+ */
+struct sched_critical_path *
+plugin_sched_critical_path(int sd, int pid, int64_t start, int64_t end)
+{
+	struct plugin_sched_context *plugin_ctx = get_sched_context(sd);
+	struct sched_path_segment tmp;
+	struct sched_critical_path *path;
+	size_t i, n;
+
+	if (!plugin_ctx || end <= start)
+		return NULL;
+
+	if (!plugin_ctx->wakeup_graph) {
+		plugin_ctx->wakeup_graph = sched_build_wakeup_graph(plugin_ctx);
+		if (!plugin_ctx->wakeup_graph)
+			return NULL;
+	}
+
+	path = calloc(1, sizeof(*path));
+	if (!path)
+		goto fail;
+
+	path->sd = sd;
+	path->pid = pid;
+	path->start = start;
+	path->end = end;
+
+	if (!sched_walk_path(plugin_ctx->wakeup_graph, path))
+		goto fail;
+
+	/* The segments are found in reverse order. */
+	for (i = 0, n = path->n_segments; i < n / 2; ++i) {
+		tmp = path->segments[i];
+		path->segments[i] = path->segments[n - i - 1];
+		path->segments[n - i - 1] = tmp;
+	}
+
+	return path;
+
+ fail:
+	fprintf(stderr, "Failed to allocate memory for sched_critical_path.\n");
+	plugin_sched_free_critical_path(path);
+	return NULL;
+}
+
+/**
+ * @brief Free all memory used by a critical path.
+ *
+ * @param path: Input location for the critical path.
+ */
+void plugin_sched_free_critical_path(struct sched_critical_path *path)
+{
+	if (!path)
+		return;
+
+	free(path->segments);
+	free(path);
+}
+
 static void plugin_sched_free_context(int sd)
 {
 	struct plugin_sched_context *plugin_ctx = get_sched_context(sd);
@@ -94,6 +434,9 @@ static void plugin_sched_free_context(int sd)
 	if (plugin_ctx->sw_data)
 		kshark_free_data_container(plugin_ctx->sw_data);
 
+	plugin_sched_free_wakeup_graph(plugin_ctx->wakeup_graph);
+	plugin_sched_free_critical_path(plugin_ctx->critical_path);
+
 	free(plugin_ctx);
 	plugin_sched_context_handler[sd] = NULL;
 }
@@ -217,6 +560,7 @@ int KSHARK_PLOT_PLUGIN_INITIALIZER(struct kshark_data_stream *stream)
 {
 	printf("--> sched init %i\n", stream->stream_id);
 	struct plugin_sched_context *plugin_ctx;
+	struct kshark_context *kshark_ctx = NULL;
 
 	plugin_ctx = plugin_sched_init_context(stream);
 	if (!plugin_ctx)
@@ -232,6 +576,10 @@ int KSHARK_PLOT_PLUGIN_INITIALIZER(struct kshark_data_stream *stream)
 
 	kshark_register_draw_handler(stream, plugin_draw);
 
+	/* The second pass over the data uses the per-CPU index. */
+	if (kshark_instance(&kshark_ctx))
+		kshark_request_cpu_index(kshark_ctx);
+
 	return 1;
 }
 
@@ -240,6 +588,7 @@ int KSHARK_PLOT_PLUGIN_DEINITIALIZER(struct kshark_data_stream *stream)
 {
 	printf("<-- sched close %i\n", stream->stream_id);
 	struct plugin_sched_context *plugin_ctx;
+	struct kshark_context *kshark_ctx = NULL;
 	int sd = stream->stream_id;
 
 	plugin_ctx = get_sched_context(sd);
@@ -256,7 +605,45 @@ int KSHARK_PLOT_PLUGIN_DEINITIALIZER(struct kshark_data_stream *stream)
 
 	kshark_unregister_draw_handler(stream, plugin_draw);
 
+	if (kshark_instance(&kshark_ctx))
+		kshark_release_cpu_index(kshark_ctx);
+
 	plugin_sched_free_context(sd);
 
 	return 1;
 }
+
+/** Report the memory used by this plugin. */
+size_t KSHARK_PLOT_PLUGIN_MEMORY(struct kshark_data_stream *stream)
+{
+	struct plugin_sched_context *plugin_ctx;
+	struct sched_wakeup_graph *graph;
+	size_t size;
+
+	plugin_ctx = get_sched_context(stream->stream_id);
+	if (!plugin_ctx)
+		return 0;
+
+	size = sizeof(*plugin_ctx) +
+	       kshark_data_container_memory(plugin_ctx->ss_data) +
+	       kshark_data_container_memory(plugin_ctx->sw_data);
+
+	graph = plugin_ctx->wakeup_graph;
+	if (graph)
+		size += sizeof(*graph) +
+			(graph->switch_in.size +
+			 graph->switch_out.size +
+			 graph->wakeup.size) * sizeof(struct sched_edge);
+
+	if (plugin_ctx->critical_path)
+		size += sizeof(*plugin_ctx->critical_path) +
+			plugin_ctx->critical_path->n_segments *
+			sizeof(*plugin_ctx->critical_path->segments);
+
+	return size;
+}
+
+void *KSHARK_MENU_PLUGIN_INITIALIZER(void *gui_ptr)
+{
+	return plugin_sched_add_menu(gui_ptr);
+}
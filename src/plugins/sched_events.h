@@ -20,6 +20,63 @@
 extern "C" {
 #endif
 
+struct sched_wakeup_graph;
+
+/** The type of a segment of the critical path. */
+enum sched_path_segment_type {
+	/** The task is running. */
+	SCHED_PATH_RUNNING,
+
+	/** The task is preempted (runnable, but not running). */
+	SCHED_PATH_PREEMPTED,
+
+	/** The task is woken up, but still waits for a CPU. */
+	SCHED_PATH_WAKEUP_LATENCY,
+
+	/** The task is blocked and the waker is unknown (or is an interrupt). */
+	SCHED_PATH_BLOCKED,
+};
+
+/** A segment of the critical path. */
+struct sched_path_segment {
+	/** The start of the segment. */
+	int64_t		start;
+
+	/** The end of the segment. */
+	int64_t		end;
+
+	/** The Process Id of the task the time is attributed to. */
+	int		pid;
+
+	/** The type of the segment. */
+	enum sched_path_segment_type	type;
+};
+
+/**
+ * The critical path of a task inside a given time interval. The path
+ * follows the "who woke whom" chain backwards in time, starting from the end
+ * of the interval.
+ */
+struct sched_critical_path {
+	/** Data stream identifier. */
+	int				sd;
+
+	/** The Process Id of the task. */
+	int				pid;
+
+	/** The start of the time interval. */
+	int64_t				start;
+
+	/** The end of the time interval. */
+	int64_t				end;
+
+	/** Array of segments, sorted in time. */
+	struct sched_path_segment	*segments;
+
+	/** The number of segments. */
+	size_t				n_segments;
+};
+
 /** Structure representing a plugin-specific context. */
 struct plugin_sched_context {
 	/** Page event used to parse the page. */
@@ -51,6 +108,12 @@ struct plugin_sched_context {
 
 	/** . */
 	struct kshark_data_container	*sw_data;
+
+	/** Index of the wakeup edges, built on first use. */
+	struct sched_wakeup_graph	*wakeup_graph;
+
+	/** The critical path to be highlighted. */
+	struct sched_critical_path	*critical_path;
 };
 
 struct plugin_sched_context *get_sched_context(int sd);
@@ -64,6 +127,13 @@ int plugin_sched_get_prev_state(ks_num_field_t field);
 void plugin_draw(struct kshark_cpp_argv *argv, int sd, int pid,
 		 int draw_action);
 
+struct sched_critical_path *
+plugin_sched_critical_path(int sd, int pid, int64_t start, int64_t end);
+
+void plugin_sched_free_critical_path(struct sched_critical_path *path);
+
+void *plugin_sched_add_menu(void *gui_ptr);
+
 #ifdef __cplusplus
 }
 #endif
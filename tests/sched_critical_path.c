@@ -0,0 +1,129 @@
+// SPDX-License-Identifier: LGPL-2.1
+
+/*
+ * Copyright (C) 2021 VMware Inc, Yordan Karadzhov (VMware) <y.karadz@gmail.com>
+ */
+
+/**
+ *  @file    sched_critical_path.c
+ *  @brief   Test of the critical path, extracted by the sched_events plugin.
+ */
+
+// The static helpers of the plugin are tested directly.
+#include "plugins/sched_events.c"
+
+/* The GUI part of the plugin is not needed here. */
+void plugin_draw(struct kshark_cpp_argv *argv, int sd, int pid,
+		 int draw_action)
+{}
+
+void *plugin_sched_add_menu(void *gui_ptr)
+{
+	return NULL;
+}
+
+#define TASK_A	100
+#define TASK_B	200
+
+#define N_ENTRIES	8
+
+static struct kshark_entry entries[N_ENTRIES];
+
+static int n_entries;
+
+static struct kshark_entry *new_entry(int64_t ts, int pid)
+{
+	struct kshark_entry *entry = &entries[n_entries++];
+
+	entry->ts = ts;
+	entry->pid = pid;
+
+	return entry;
+}
+
+static void sched_switch(struct plugin_sched_context *plugin_ctx, int64_t ts,
+			 int prev_pid, int prev_state, int next_pid)
+{
+	ks_num_field_t field = 0;
+
+	plugin_sched_set_pid(&field, prev_pid);
+	plugin_sched_set_prev_state(&field, prev_state);
+	kshark_data_container_append(plugin_ctx->ss_data,
+				     new_entry(ts, next_pid), field);
+}
+
+static void sched_wakeup(struct plugin_sched_context *plugin_ctx, int64_t ts,
+			 int waker, int pid)
+{
+	kshark_data_container_append(plugin_ctx->sw_data,
+				     new_entry(ts, waker), pid);
+}
+
+static const struct sched_path_segment expected[] = {
+	{  0,  5, TASK_B, SCHED_PATH_RUNNING},
+	{  5, 50, TASK_B, SCHED_PATH_PREEMPTED},
+	{ 50, 60, TASK_B, SCHED_PATH_RUNNING},
+	{ 60, 80, TASK_A, SCHED_PATH_WAKEUP_LATENCY},
+};
+
+int main(int argc, char **argv)
+{
+	struct plugin_sched_context *plugin_ctx;
+	struct sched_critical_path *path;
+	int ret = 1;
+	size_t i;
+
+	plugin_ctx = calloc(1, sizeof(*plugin_ctx));
+	if (!plugin_ctx)
+		return 1;
+
+	plugin_sched_context_handler[0] = plugin_ctx;
+	plugin_ctx->ss_data = kshark_init_data_container();
+	plugin_ctx->sw_data = kshark_init_data_container();
+	if (!plugin_ctx->ss_data || !plugin_ctx->sw_data)
+		goto out;
+
+	/*
+	 * Task B gets preempted and task A starts running. A blocks (state
+	 * "S") in the middle of the interval and B gets the CPU. B wakes up
+	 * A, but A is still waiting for a CPU at the end of the interval.
+	 */
+	sched_switch(plugin_ctx,  5, TASK_B, 0, 0);
+	sched_switch(plugin_ctx, 10, 0, 0, TASK_A);
+	sched_switch(plugin_ctx, 50, TASK_A, 1, TASK_B);
+	sched_wakeup(plugin_ctx, 60, TASK_B, TASK_A);
+
+	path = plugin_sched_critical_path(0, TASK_A, 0, 80);
+	if (!path)
+		goto out;
+
+	for (i = 0; i < path->n_segments; ++i)
+		printf("[%li, %li] pid: %i  type: %i\n",
+		       path->segments[i].start, path->segments[i].end,
+		       path->segments[i].pid, path->segments[i].type);
+
+	if (path->n_segments != sizeof(expected) / sizeof(expected[0])) {
+		fprintf(stderr, "Unexpected number of segments.\n");
+		goto free_path;
+	}
+
+	for (i = 0; i < path->n_segments; ++i) {
+		if (path->segments[i].start != expected[i].start ||
+		    path->segments[i].end != expected[i].end ||
+		    path->segments[i].pid != expected[i].pid ||
+		    path->segments[i].type != expected[i].type) {
+			fprintf(stderr, "Unexpected segment %zu.\n", i);
+			goto free_path;
+		}
+	}
+
+	ret = 0;
+
+ free_path:
+	plugin_sched_free_critical_path(path);
+
+ out:
+	plugin_sched_free_context(0);
+
+	return ret;
+}